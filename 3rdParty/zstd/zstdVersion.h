@@ -0,0 +1,5 @@
+// URL: https://github.com/facebook/zstd
+// Release: v1.5.7, lib/ only (without dictBuilder, legacy and deprecated)
+//
+// Note: decompress/huf_decompress_amd64.S is only needed on x86-64 with GCC
+//       or Clang, define ZSTD_DISABLE_ASM if the build does not assemble it.
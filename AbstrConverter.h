@@ -76,6 +76,8 @@ public:
                             uint32_t iBrickCompression,
                             uint32_t iBrickCompressionLevel,
                             uint32_t iBrickLayout,
+                            uint32_t iBrickPreFilter,
+                            bool bAdaptiveCompression,
                             const bool bQuantizeTo8Bit) = 0;
 
   virtual bool ConvertToUVF(const std::list<std::string>& files,
@@ -89,6 +91,8 @@ public:
                             uint32_t iBrickCompression,
                             uint32_t iBrickCompressionLevel,
                             uint32_t iBrickLayout,
+                            uint32_t iBrickPreFilter,
+                            bool bAdaptiveCompression,
                             const bool bQuantizeTo8Bit) = 0;
 
   virtual bool ConvertToRAW(const std::string& strSourceFilename,
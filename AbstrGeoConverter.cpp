@@ -50,6 +50,12 @@ bool AbstrGeoConverter::ConvertToNative(const Mesh&,
   return false;
 }
 
+std::shared_ptr<TriangleStream>
+AbstrGeoConverter::CreateTriangleStream(const std::string&,
+                                        const std::string&) const {
+  return std::shared_ptr<TriangleStream>();
+}
+
 bool AbstrGeoConverter::CanRead(const std::string& fn) const
 {
   return SupportedExtension(SysTools::ToUpperCase(SysTools::GetExt(fn)));
@@ -49,6 +49,24 @@ typedef std::vector<FLOATVECTOR3> VertVec;
 typedef std::vector<uint32_t> IndexVec;
 class Mesh;
 
+/// Receives a triangle mesh piece by piece so meshes that do not fit into
+/// memory can still be written, see AbstrGeoConverter::CreateTriangleStream
+class TriangleStream {
+public:
+  virtual ~TriangleStream() {}
+
+  /// @param vertices new vertices, appended to the ones already written
+  /// @param normals one normal per new vertex
+  /// @param indices three indices per triangle, the indices count all
+  ///                vertices appended so far starting at zero
+  /// @return false if the data could not be written
+  virtual bool Append(const VertVec& vertices, const VertVec& normals,
+                      const IndexVec& indices) = 0;
+
+  /// completes and closes the file, no more data may be appended afterwards
+  virtual bool Close() = 0;
+};
+
 class AbstrGeoConverter {
 public:
   virtual ~AbstrGeoConverter() {}
@@ -60,6 +78,17 @@ public:
   virtual bool ConvertToNative(const Mesh& m,
                                const std::string& strTargetFilename);
 
+  /// opens a file to which a triangle mesh can be written incrementally
+  /// @param strTargetFilename the file to create
+  /// @param strDesc a description of the mesh e.g. its name
+  /// @return an empty pointer if the format does not support streaming or
+  ///         the file could not be created, ConvertToNative has to be used
+  ///         in the former case
+  virtual std::shared_ptr<TriangleStream> CreateTriangleStream(
+    const std::string& strTargetFilename, const std::string& strDesc
+  ) const;
+  virtual bool CanStreamTriangles() const { return false; }
+
   /// @param filename the file in question
   /// @return SupportedExtension() for the file's extension
   virtual bool CanRead(const std::string& fn) const;
@@ -20,6 +20,7 @@ struct TypeErase {
   struct GenericType {
     virtual ~GenericType() {}
     virtual size_t elems() const { return 0; }
+    virtual void release() {}
   };
   template<typename T> struct TypeEraser : GenericType {
     TypeEraser(const T& t) : thing(t) {}
@@ -27,6 +28,7 @@ struct TypeErase {
     virtual ~TypeEraser() {}
     T& get() { return thing; }
     size_t elems() const { return thing.size(); }
+    void release() { T().swap(thing); }
     private: T thing;
   };
 
@@ -91,7 +93,7 @@ struct CacheLRU {
 };
 
 struct BrickCache::bcinfo {
-    bcinfo(): bytes(0) {}
+    bcinfo(): bytes(0) { this->spare.reserve(max_spare); }
     // this is wordy but they all just forward to a real implementation below.
     const void* lookup(const BrickKey& k, uint8_t) {
       return this->typed_lookup<uint8_t>(k);
@@ -123,6 +125,62 @@ struct BrickCache::bcinfo {
       return this->typed_lookup<float>(k);
     }
 
+    std::shared_ptr<const void> pin(const BrickKey& k, uint8_t) {
+      return this->typed_pin<uint8_t>(k);
+    }
+    std::shared_ptr<const void> pin(const BrickKey& k, uint16_t) {
+      return this->typed_pin<uint16_t>(k);
+    }
+    std::shared_ptr<const void> pin(const BrickKey& k, uint32_t) {
+      return this->typed_pin<uint32_t>(k);
+    }
+    std::shared_ptr<const void> pin(const BrickKey& k, uint64_t) {
+      return this->typed_pin<uint64_t>(k);
+    }
+    std::shared_ptr<const void> pin(const BrickKey& k, int8_t) {
+      return this->typed_pin<int8_t>(k);
+    }
+    std::shared_ptr<const void> pin(const BrickKey& k, int16_t) {
+      return this->typed_pin<int16_t>(k);
+    }
+    std::shared_ptr<const void> pin(const BrickKey& k, int32_t) {
+      return this->typed_pin<int32_t>(k);
+    }
+    std::shared_ptr<const void> pin(const BrickKey& k, int64_t) {
+      return this->typed_pin<int64_t>(k);
+    }
+    std::shared_ptr<const void> pin(const BrickKey& k, float) {
+      return this->typed_pin<float>(k);
+    }
+
+    void recycle(std::vector<uint8_t>& data) {
+      this->typed_recycle<uint8_t>(data);
+    }
+    void recycle(std::vector<uint16_t>& data) {
+      this->typed_recycle<uint16_t>(data);
+    }
+    void recycle(std::vector<uint32_t>& data) {
+      this->typed_recycle<uint32_t>(data);
+    }
+    void recycle(std::vector<uint64_t>& data) {
+      this->typed_recycle<uint64_t>(data);
+    }
+    void recycle(std::vector<int8_t>& data) {
+      this->typed_recycle<int8_t>(data);
+    }
+    void recycle(std::vector<int16_t>& data) {
+      this->typed_recycle<int16_t>(data);
+    }
+    void recycle(std::vector<int32_t>& data) {
+      this->typed_recycle<int32_t>(data);
+    }
+    void recycle(std::vector<int64_t>& data) {
+      this->typed_recycle<int64_t>(data);
+    }
+    void recycle(std::vector<float>& data) {
+      this->typed_recycle<float>(data);
+    }
+
     // the erasure means we can just do the insert with the thing we already
     // have: it'll make a shared_ptr out of it and insert it into the
     // container.
@@ -157,15 +215,7 @@ struct BrickCache::bcinfo {
     ///@}
     void remove() {
       if(!cache.empty()) {
-        // libstdc++ complains it's not a heap otherwise.. somehow.  bug?
-        std::make_heap(this->cache.begin(), this->cache.end(), CacheLRU());
-        const CacheElem& entry = this->cache.front();
-        TypeErase::GenericType& gt = *(entry.second.gt);
-        assert((entry.second.width * gt.elems()) <= this->bytes);
-        this->bytes -= entry.second.width * gt.elems();
-
-        std::pop_heap(this->cache.begin(), this->cache.end(), CacheLRU());
-        this->cache.pop_back();
+        this->keep_holder(this->evict());
       }
       assert(this->size() == this->bytes);
     }
@@ -175,11 +225,23 @@ struct BrickCache::bcinfo {
     template<typename T> const void* typed_lookup(const BrickKey& k);
     template<typename T> const void* typed_add(const BrickKey&,
                                                std::vector<T>&);
+    template<typename T> std::shared_ptr<const void> typed_pin(
+      const BrickKey& k
+    );
+    template<typename T> void typed_recycle(std::vector<T>&);
+    template<typename T> std::vector<TypeErase>::iterator spare_holder();
+    TypeErase evict();
+    void keep_holder(TypeErase&&);
 
   private:
     typedef std::pair<BrickInfo, TypeErase> CacheElem;
     std::vector<CacheElem> cache;
     size_t bytes; ///< how much memory we're currently using for data.
+    /// holders of removed bricks, recycled for new ones.  Their data is
+    /// released (or handed out by 'recycle') when the brick is removed, so
+    /// they hold no memory which 'bytes' would miss.
+    std::vector<TypeErase> spare;
+    static const size_t max_spare = 4;
 };
 
 struct KeyMatches {
@@ -208,6 +270,76 @@ const void* BrickCache::bcinfo::typed_lookup(const BrickKey& k) {
   return dynamic_cast<TypeErase::TypeEraser<std::vector<T>>&>(gt).get().data();
 }
 
+// the returned pointer shares ownership of the erased vector, so it stays
+// valid after 'remove' drops the cache's reference.
+template<typename T> std::shared_ptr<const void>
+BrickCache::bcinfo::typed_pin(const BrickKey& k) {
+  using namespace std::placeholders;
+  KeyMatches km;
+  auto func = std::bind(&KeyMatches::operator(), km, k, _1);
+
+  typedef std::vector<CacheElem> maptype;
+  maptype::iterator i = std::find_if(this->cache.begin(), this->cache.end(),
+                                     func);
+  if(i == this->cache.end()) { return std::shared_ptr<const void>(); }
+
+  i->first.access_time = time(NULL);
+  TypeErase::GenericType& gt = *(i->second.gt);
+  const T* data =
+    dynamic_cast<TypeErase::TypeEraser<std::vector<T>>&>(gt).get().data();
+  return std::shared_ptr<const void>(i->second.gt, data);
+}
+
+// takes the least recently used brick out of the cache.
+TypeErase BrickCache::bcinfo::evict() {
+  assert(!this->cache.empty());
+  // libstdc++ complains it's not a heap otherwise.. somehow.  bug?
+  std::make_heap(this->cache.begin(), this->cache.end(), CacheLRU());
+  const CacheElem& entry = this->cache.front();
+  TypeErase::GenericType& gt = *(entry.second.gt);
+  assert((entry.second.width * gt.elems()) <= this->bytes);
+  this->bytes -= entry.second.width * gt.elems();
+
+  std::pop_heap(this->cache.begin(), this->cache.end(), CacheLRU());
+  TypeErase evicted = std::move(this->cache.back().second);
+  this->cache.pop_back();
+  return evicted;
+}
+
+// keeps the holder of an evicted brick for the next 'add', unless it is
+// pinned.  Whatever data it still holds is freed.
+void BrickCache::bcinfo::keep_holder(TypeErase&& evicted) {
+  if(evicted.gt.use_count() == 1 && this->spare.size() < max_spare) {
+    evicted.gt->release();
+    this->spare.push_back(std::move(evicted));
+  }
+}
+
+// finds a spare holder for vectors of T.
+template<typename T> std::vector<TypeErase>::iterator
+BrickCache::bcinfo::spare_holder() {
+  typedef TypeErase::TypeEraser<std::vector<T>> holder;
+  for(auto i=this->spare.begin(); i != this->spare.end(); ++i) {
+    if(dynamic_cast<holder*>(i->gt.get()) != NULL) { return i; }
+  }
+  return this->spare.end();
+}
+
+// the buffer moves straight from the evicted brick to 'data', so it is never
+// held by the cache without being counted.
+template<typename T>
+void BrickCache::bcinfo::typed_recycle(std::vector<T>& data) {
+  if(this->cache.empty()) { return; }
+  typedef TypeErase::TypeEraser<std::vector<T>> holder;
+  TypeErase evicted = this->evict();
+  holder* h = dynamic_cast<holder*>(evicted.gt.get());
+  if(h != NULL && evicted.gt.use_count() == 1) {
+    h->get().swap(data);
+  }
+  this->keep_holder(std::move(evicted));
+  assert(this->size() == this->bytes);
+}
+
 template<typename T>
 const void* BrickCache::bcinfo::typed_add(const BrickKey& k,
                                           std::vector<T>& data) {
@@ -221,8 +353,20 @@ const void* BrickCache::bcinfo::typed_add(const BrickKey& k,
          this->cache.end());
 #endif
   this->bytes += sizeof(T) * data.size();
-  this->cache.push_back(std::make_pair(BrickInfo(k, time(NULL)),
-                        std::move(data)));
+  std::vector<TypeErase>::iterator h = this->spare_holder<T>();
+  if(h == this->spare.end()) {
+    this->cache.push_back(std::make_pair(BrickInfo(k, time(NULL)),
+                          std::move(data)));
+  } else {
+    // move the data into the old (empty) holder, instead of allocating a
+    // new one.
+    typedef TypeErase::TypeEraser<std::vector<T>> holder;
+    static_cast<holder&>(*h->gt).get().swap(data);
+    this->cache.push_back(std::make_pair(BrickInfo(k, time(NULL)),
+                                         std::move(*h)));
+    std::swap(*h, this->spare.back());
+    this->spare.pop_back();
+  }
 
   assert(this->size() == this->bytes);
   TypeErase::GenericType& gt = *this->cache.back().second.gt;
@@ -300,6 +444,71 @@ const void* BrickCache::add(const BrickKey& k,
   return this->ci->add(k, data);
 }
 
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, uint8_t value) {
+  return this->ci->pin(k, value);
+}
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, uint16_t value) {
+  return this->ci->pin(k, value);
+}
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, uint32_t value) {
+  return this->ci->pin(k, value);
+}
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, uint64_t value) {
+  return this->ci->pin(k, value);
+}
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, int8_t value) {
+  return this->ci->pin(k, value);
+}
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, int16_t value) {
+  return this->ci->pin(k, value);
+}
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, int32_t value) {
+  return this->ci->pin(k, value);
+}
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, int64_t value) {
+  return this->ci->pin(k, value);
+}
+std::shared_ptr<const void>
+BrickCache::pin(const BrickKey& k, float value) {
+  return this->ci->pin(k, value);
+}
+
+void BrickCache::recycle(std::vector<uint8_t>& data) {
+  this->ci->recycle(data);
+}
+void BrickCache::recycle(std::vector<uint16_t>& data) {
+  this->ci->recycle(data);
+}
+void BrickCache::recycle(std::vector<uint32_t>& data) {
+  this->ci->recycle(data);
+}
+void BrickCache::recycle(std::vector<uint64_t>& data) {
+  this->ci->recycle(data);
+}
+void BrickCache::recycle(std::vector<int8_t>& data) {
+  this->ci->recycle(data);
+}
+void BrickCache::recycle(std::vector<int16_t>& data) {
+  this->ci->recycle(data);
+}
+void BrickCache::recycle(std::vector<int32_t>& data) {
+  this->ci->recycle(data);
+}
+void BrickCache::recycle(std::vector<int64_t>& data) {
+  this->ci->recycle(data);
+}
+void BrickCache::recycle(std::vector<float>& data) {
+  this->ci->recycle(data);
+}
+
 void BrickCache::remove() { this->ci->remove(); }
 size_t BrickCache::size() const { return this->ci->size(); }
 
@@ -31,6 +31,21 @@ class BrickCache {
     const void* lookup(const BrickKey&, float);
     ///@}
 
+    /// like lookup, but the returned pointer keeps the data alive, even if
+    /// the brick is removed from the cache in the meantime.  Note that such
+    /// pinned bricks are no longer accounted for in 'size'.
+    ///@{
+    std::shared_ptr<const void> pin(const BrickKey&, uint8_t);
+    std::shared_ptr<const void> pin(const BrickKey&, uint16_t);
+    std::shared_ptr<const void> pin(const BrickKey&, uint32_t);
+    std::shared_ptr<const void> pin(const BrickKey&, uint64_t);
+    std::shared_ptr<const void> pin(const BrickKey&, int8_t);
+    std::shared_ptr<const void> pin(const BrickKey&, int16_t);
+    std::shared_ptr<const void> pin(const BrickKey&, int32_t);
+    std::shared_ptr<const void> pin(const BrickKey&, int64_t);
+    std::shared_ptr<const void> pin(const BrickKey&, float);
+    ///@}
+
     /// These return their argument for ease of use.
     ///@{
     const void* add(const BrickKey&, std::vector<uint8_t>&);
@@ -44,6 +59,22 @@ class BrickCache {
     const void* add(const BrickKey&, std::vector<float>&);
     ///@}
 
+    /// Removes the least recently used brick, like 'remove', and swaps its
+    /// buffer into the (empty) argument if it is of that type and not
+    /// pinned.  Read new bricks into that, and 'add' them: a cache which is
+    /// full anyway then streams bricks without allocating.
+    ///@{
+    void recycle(std::vector<uint8_t>&);
+    void recycle(std::vector<uint16_t>&);
+    void recycle(std::vector<uint32_t>&);
+    void recycle(std::vector<uint64_t>&);
+    void recycle(std::vector<int8_t>&);
+    void recycle(std::vector<int16_t>&);
+    void recycle(std::vector<int32_t>&);
+    void recycle(std::vector<int64_t>&);
+    void recycle(std::vector<float>&);
+    ///@}
+
     /// removes the most appropriate element.
     void remove();
 
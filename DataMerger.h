@@ -0,0 +1,218 @@
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Scientific Computing and Imaging Institute,
+   University of Utah.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#ifndef TUVOK_DATA_MERGER_H
+#define TUVOK_DATA_MERGER_H
+
+#include "StdTuvokDefines.h"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Basics/LargeRAWFile.h"
+#include "Controller/Controller.h"
+#include "DebugOut/AbstrDebugOut.h"
+
+/// one input of a merge, a raw file whose values are mapped through
+/// fScale*(v+fBias) before they are combined
+class MergeDataset {
+public:
+  MergeDataset(std::string _strFilename="", uint64_t _iHeaderSkip=0, bool _bDelete=false,
+               double _fScale=1.0, double _fBias=0.0) :
+    strFilename(_strFilename),
+    iHeaderSkip(_iHeaderSkip),
+    bDelete(_bDelete),
+    fScale(_fScale),
+    fBias(_fBias)
+  {}
+
+  std::string strFilename;
+  uint64_t iHeaderSkip;
+  bool bDelete;
+  double fScale;
+  double fBias;
+};
+
+/// maps a source value through the scale/bias of its dataset, the result is
+/// clamped to the range of T instead of wrapping around
+template <class T> static T MergeTransform(T v, double fScale, double fBias) {
+  const double fMax = static_cast<double>(std::numeric_limits<T>::max());
+  const double fLowest = std::numeric_limits<T>::is_integer ?
+                         static_cast<double>(std::numeric_limits<T>::min()) :
+                         -fMax;
+  const double f = fScale*(v + fBias);
+  if (f >= fMax) return std::numeric_limits<T>::max();
+  if (f <= fLowest) return T(fLowest);
+  return T(f);
+}
+
+/// a+b, integer results that do not fit into T stick to its limits
+template <class T> static T MergeAdd(T a, T b) {
+  if (!std::numeric_limits<T>::is_integer) return T(a + b);
+  if (b > T(0) && a > T(std::numeric_limits<T>::max() - b))
+    return std::numeric_limits<T>::max();
+  if (b < T(0) && a < T(std::numeric_limits<T>::min() - b))
+    return std::numeric_limits<T>::min();
+  return T(a + b);
+}
+
+/// combines iCount values of all sources into 'pTarget', the data is split
+/// into chunks that are processed in parallel, within a chunk the sources
+/// are applied one after the other in tight, vectorizable loops
+template <class T> static void MergeCombine(
+  const std::vector<MergeDataset>& strFiles,
+  const std::vector<const T*>& vSource, T* pTarget, size_t iCount,
+  bool bUseMaxMode)
+{
+  const size_t iChunkSize = 1<<16;
+  const int iChunks = int((iCount+iChunkSize-1)/iChunkSize);
+
+#pragma omp parallel for schedule(static)
+  for (int c = 0; c < iChunks; ++c) {
+    const size_t iFirst = size_t(c)*iChunkSize;
+    const size_t iEnd = std::min(iCount, iFirst+iChunkSize);
+    T* out = pTarget;
+
+    for (size_t i = 0;i<vSource.size();i++) {
+      const T* in = vSource[i];
+      const double fScale = strFiles[i].fScale;
+      const double fBias = strFiles[i].fBias;
+      // the common case of unscaled inputs skips the round trip through
+      // double altogether
+      const bool bIdentity = (fScale == 1.0 && fBias == 0.0);
+
+      if (i == 0) {
+        if (bIdentity)
+          std::copy(in+iFirst, in+iEnd, out+iFirst);
+        else
+          for (size_t j = iFirst;j<iEnd;j++)
+            out[j] = MergeTransform(in[j], fScale, fBias);
+      } else if (bUseMaxMode) {
+        if (bIdentity)
+          for (size_t j = iFirst;j<iEnd;j++)
+            out[j] = std::max(out[j], in[j]);
+        else
+          for (size_t j = iFirst;j<iEnd;j++)
+            out[j] = std::max(out[j], MergeTransform(in[j], fScale, fBias));
+      } else {
+        if (bIdentity)
+          for (size_t j = iFirst;j<iEnd;j++)
+            out[j] = MergeAdd(out[j], in[j]);
+        else
+          for (size_t j = iFirst;j<iEnd;j++)
+            out[j] = MergeAdd(out[j], MergeTransform(in[j], fScale, fBias));
+      }
+    }
+  }
+}
+
+/// Combines all input files in a single pass: every input is read block by
+/// block in lockstep, the block is combined in memory and the result is
+/// written to the target exactly once.
+template <class T> class DataMerger {
+public:
+  DataMerger(const std::vector<MergeDataset>& strFiles,
+             const std::string& strTarget, uint64_t iElemCount,
+             tuvok::MasterController* pMasterController,
+             bool bUseMaxMode) :
+    bIsOK(false)
+  {
+    AbstrDebugOut& dbg = *(pMasterController->DebugOut());
+    dbg.Message(_func_,"Merging %u files ...", unsigned(strFiles.size()));
+
+    std::vector<std::shared_ptr<LargeRAWFile>> sources;
+    for (size_t i = 0;i<strFiles.size();i++) {
+      std::shared_ptr<LargeRAWFile> source(
+        new LargeRAWFile(strFiles[i].strFilename, strFiles[i].iHeaderSkip)
+      );
+      source->Open(false);
+      if (!source->IsOpen()) {
+        dbg.Error(_func_, "Could not open '%s'!",
+                  strFiles[i].strFilename.c_str());
+        return;
+      }
+      sources.push_back(source);
+    }
+
+    LargeRAWFile target(strTarget);
+    if (!target.Create()) {
+      dbg.Error(_func_, "Could not create '%s'", strTarget.c_str());
+      return;
+    }
+
+    // all inputs plus the output share the copy budget
+    const uint64_t iBlockElems = std::max<uint64_t>(1, std::min<uint64_t>(
+      iElemCount, BLOCK_COPY_SIZE/((strFiles.size()+1)*sizeof(T))
+    ));
+    std::vector<std::vector<T>> vSource(strFiles.size(),
+                                        std::vector<T>(static_cast<size_t>(iBlockElems)));
+    std::vector<T> vTarget(static_cast<size_t>(iBlockElems));
+    std::vector<const T*> vSourcePtr(strFiles.size());
+    for (size_t i = 0;i<vSource.size();i++) vSourcePtr[i] = &vSource[i][0];
+
+    for (uint64_t iPos = 0;iPos<iElemCount;iPos+=iBlockElems) {
+      const size_t iCount = size_t(std::min(iBlockElems, iElemCount-iPos));
+      dbg.Message(_func_,"Merging ... %u%%",
+                  unsigned(100*iPos/iElemCount));
+
+      for (size_t i = 0;i<sources.size();i++) {
+        if (sources[i]->ReadRAW((unsigned char*)&vSource[i][0],
+                                iCount*sizeof(T)) != iCount*sizeof(T)) {
+          dbg.Error(_func_, "Could not read '%s'!",
+                    strFiles[i].strFilename.c_str());
+          target.Close();
+          std::remove(strTarget.c_str());
+          return;
+        }
+      }
+
+      MergeCombine(strFiles, vSourcePtr, &vTarget[0], iCount, bUseMaxMode);
+
+      if (target.WriteRAW((unsigned char*)&vTarget[0],
+                          iCount*sizeof(T)) != iCount*sizeof(T)) {
+        dbg.Error(_func_, "Could not write '%s'!", strTarget.c_str());
+        target.Close();
+        std::remove(strTarget.c_str());
+        return;
+      }
+    }
+
+    target.Close();
+    bIsOK = true;
+  }
+
+  bool IsOK() const {return bIsOK;}
+
+private:
+  bool bIsOK;
+};
+
+#endif // TUVOK_DATA_MERGER_H
@@ -31,9 +31,11 @@
            SCI Institute
            University of Utah
 */
+#include <algorithm>
 #include "Dataset.h"
 #include "Basics/MathTools.h"
 #include "Basics/Mesh.h"
+#include "Controller/Controller.h"
 
 namespace tuvok {
 
@@ -110,4 +112,77 @@ Dataset::GetTextCoords(BrickTable::const_iterator brick,
   return std::make_pair(vTexcoordsMin, vTexcoordsMax);
 }
 
+/// forwards the C style brick callback to a Dataset::BrickFunction
+static bool CallBrickFunction(void* pData, const UINT64VECTOR3& vBrickSize,
+                              const UINT64VECTOR3& vBrickOffset,
+                              void* pUserContext) {
+  const Dataset::BrickFunction* f =
+    static_cast<const Dataset::BrickFunction*>(pUserContext);
+  return (*f)(pData, vBrickSize, vBrickOffset);
+}
+
+bool Dataset::ApplyFunction(uint64_t iLODLevel,
+                            const BrickFunction& brickFunc,
+                            uint64_t iOverlap,
+                            unsigned int /*iThreadCount*/,
+                            bool /*bOrdered*/) const {
+  return ApplyFunction(iLODLevel, CallBrickFunction,
+                       const_cast<BrickFunction*>(&brickFunc), iOverlap);
+}
+
+namespace {
+  template<typename T> bool BrickToMemory(const Dataset& ds, const BrickKey& k,
+                                          void* pData, size_t iBytes) {
+    std::vector<T> vData;
+    if(!ds.GetBrick(k, vData)) { return false; }
+    if(vData.size() * sizeof(T) > iBytes) {
+      T_ERROR("brick needs %llu bytes, only %llu given",
+              static_cast<unsigned long long>(vData.size() * sizeof(T)),
+              static_cast<unsigned long long>(iBytes));
+      return false;
+    }
+    std::copy(vData.begin(), vData.end(), static_cast<T*>(pData));
+    return true;
+  }
+}
+
+bool Dataset::GetBrick(const BrickKey& k, void* pData, size_t iBytes) const {
+  const unsigned size = GetBitWidth() / 8;
+  const bool sign = GetIsSigned();
+  const bool fp = GetIsFloat();
+  if(!sign && !fp && size == 1) {
+    return BrickToMemory<uint8_t>(*this, k, pData, iBytes);
+  } else if(!sign && !fp && size == 2) {
+    return BrickToMemory<uint16_t>(*this, k, pData, iBytes);
+  } else if(!sign && !fp && size == 4) {
+    return BrickToMemory<uint32_t>(*this, k, pData, iBytes);
+  } else if(sign && !fp && size == 1) {
+    return BrickToMemory<int8_t>(*this, k, pData, iBytes);
+  } else if(sign && !fp && size == 2) {
+    return BrickToMemory<int16_t>(*this, k, pData, iBytes);
+  } else if(sign && !fp && size == 4) {
+    return BrickToMemory<int32_t>(*this, k, pData, iBytes);
+  } else if(sign && fp && size == 4) {
+    return BrickToMemory<float>(*this, k, pData, iBytes);
+  } else if(sign && fp && size == 8) {
+    return BrickToMemory<double>(*this, k, pData, iBytes);
+  }
+  T_ERROR("unsupported type.");
+  return false;
+}
+
+bool Dataset::GetBricks(const std::vector<BrickKey>& vKeys,
+                        const std::vector<void*>& vData,
+                        size_t iBytes) const {
+  if(vKeys.size() != vData.size()) {
+    T_ERROR("%u bricks, but %u buffers", unsigned(vKeys.size()),
+            unsigned(vData.size()));
+    return false;
+  }
+  for(size_t i=0; i < vKeys.size(); ++i) {
+    if(!GetBrick(vKeys[i], vData[i], iBytes)) { return false; }
+  }
+  return true;
+}
+
 } // tuvok namespace.
@@ -42,6 +42,7 @@
 #include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 #include <boost/noncopyable.hpp>
 #include "Basics/Grids.h"
 #include "Basics/Vectors.h"
@@ -98,6 +99,18 @@ public:
   virtual bool GetBrick(const BrickKey&, std::vector<int32_t>&) const=0;
   virtual bool GetBrick(const BrickKey&, std::vector<float>&) const=0;
   virtual bool GetBrick(const BrickKey&, std::vector<double>&) const=0;
+  /// reads the brick into the given memory, in the data set's own type;
+  /// 'iBytes' must be at least voxels * components * GetBitWidth()/8.
+  /// Unlike the vector versions this never (re)allocates, if the data set
+  /// overrides it.  The default just goes through a temporary vector.
+  virtual bool GetBrick(const BrickKey&, void* pData, size_t iBytes) const;
+  /// reads a batch of bricks like the GetBrick above, brick i into
+  /// vData[i], each of which holds 'iBytes'.  Data sets which can fetch
+  /// neighboring bricks with a single read override this; the default reads
+  /// one brick after the other.
+  virtual bool GetBricks(const std::vector<BrickKey>& vKeys,
+                         const std::vector<void*>& vData,
+                         size_t iBytes) const;
   ///@}
   virtual BrickTable::const_iterator BricksBegin() const = 0;
   virtual BrickTable::const_iterator BricksEnd() const = 0;
@@ -163,6 +176,23 @@ public:
                         void *pUserContext,
                         uint64_t iOverlap) const = 0;
 
+  /// per brick function of the callable ApplyFunction: brick data, brick
+  /// size and position of the first non-overlap voxel within the LoD
+  typedef std::function<bool(void* pData,
+                             const UINT64VECTOR3& vBrickSize,
+                             const UINT64VECTOR3& vBrickOffset)> BrickFunction;
+
+  /// Applies brickFunc to every brick of a LoD using up to iThreadCount
+  /// workers (0: one per core). With bOrdered the calls happen in brick
+  /// order and one at a time, otherwise brickFunc is called concurrently
+  /// and must be thread safe. The default implementation visits the bricks
+  /// serially through the function pointer variant above.
+  virtual bool ApplyFunction(uint64_t iLODLevel,
+                             const BrickFunction& brickFunc,
+                             uint64_t iOverlap,
+                             unsigned int iThreadCount = 0,
+                             bool bOrdered = true) const;
+
   /// Virtual constructor.
   virtual Dataset* Create(const std::string&, uint64_t, bool) const=0;  
 
@@ -4,12 +4,22 @@
 // * ContainsData: deal with new metadata appropriately
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <fstream>
+#include <limits>
+#include <random>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+#include "Basics/LargeFileMMap.h"
 #include "Basics/SysTools.h"
 #include "Controller/Controller.h"
 #include "Controller/StackTimer.h"
@@ -17,6 +27,8 @@
 #include "DynamicBrickingDS.h"
 #include "FileBackedDataset.h"
 #include "IOManager.h"
+#include "IOTrace.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
 #include "const-brick-iterator.h"
 #include "uvfDataset.h"
 
@@ -44,17 +56,60 @@ struct GBPrelim {
   VoxelIndex src_offset;
 };
 
+/// identifies the source file a min/max sidecar was computed from.
+struct SourceStamp {
+  uint64_t size;
+  uint64_t mtime;
+  uint64_t hash; ///< FNV-1a of the first and last 64k of the file
+};
+
+/// Layout of the min/max sidecar: an MMHeader followed by 'n_elems'
+/// MMRecords, sorted by brick key.  Everything is fixed width and in native
+/// byte order, so the file can be mapped and used in place.
+///@{
+struct MMHeader {
+  char magic[8];
+  uint64_t version;
+  SourceStamp source;
+  uint64_t brickSize[3];
+  uint64_t n_elems;
+};
+struct MMRecord {
+  uint64_t timestep, lod, brick;
+  double minScalar, maxScalar;
+};
+///@}
+static_assert(sizeof(MMHeader) == 72 && sizeof(MMRecord) == 40,
+              "sidecar layout must not depend on the compiler's padding");
+/// the order of the records in the sidecar.
+static bool mm_less(const MMRecord& a, const MMRecord& b) {
+  return a.timestep != b.timestep ? a.timestep < b.timestep :
+         a.lod != b.lod ? a.lod < b.lod : a.brick < b.brick;
+}
+static const char mm_magic[8] = {'T','V','K','M','M','A','X','\0'};
+/// bump whenever the layout or meaning of the sidecar changes.
+static const uint64_t mm_version = 1;
+
 struct DynamicBrickingDS::dbinfo {
   std::shared_ptr<LinearIndexDataset> ds;
   const BrickSize brickSize;
   BrickCache cache;
   size_t cacheBytes;
-  std::unordered_map<BrickKey, MinMaxBlock, BKeyHash> minmax;
   enum MinMaxMode mmMode;
+  /// MM_PRECOMPUTE results, sorted by key.  'mm_records' points into the
+  /// mapped sidecar, or into 'mm_computed' if we had to compute them.
+  ///@{
+  std::vector<MMRecord> mm_computed;
+  std::shared_ptr<LargeFileMMap> mm_file;
+  std::shared_ptr<const void> mm_mem;
+  const MMRecord* mm_records;
+  size_t mm_n;
+  ///@}
 
   dbinfo(std::shared_ptr<LinearIndexDataset> d,
          BrickSize bs, size_t bytes, enum MinMaxMode mm) :
-    ds(d), brickSize(bs), cacheBytes(bytes), mmMode(mm) {}
+    ds(d), brickSize(bs), cacheBytes(bytes), mmMode(mm), mm_records(NULL),
+    mm_n(0) {}
 
   // early, non-type-specific parts of GetBrick.
   GBPrelim BrickSetup(const BrickKey&, const DynamicBrickingDS& tgt) const;
@@ -63,6 +118,17 @@ struct DynamicBrickingDS::dbinfo {
   template<typename T> bool Brick(const DynamicBrickingDS& ds,
                                   const BrickKey& key,
                                   std::vector<T>& data);
+  // same, but into the caller's memory, which holds 'elems' T's.
+  template<typename T> bool Brick(const DynamicBrickingDS& ds,
+                                  const BrickKey& key,
+                                  T* data, size_t elems);
+  // like Brick, but points into the source brick instead of copying
+  template<typename T> bool View(const DynamicBrickingDS& ds,
+                                 const BrickKey& key,
+                                 DynamicBrickingDS::BrickView<T>& view);
+  // the (pinned) source brick, from the cache or freshly read.
+  template<typename T>
+  std::shared_ptr<const void> SourceBrick(const BrickKey& skey);
 
   // given the brick key in the dynamic DS, return the corresponding BrickKey
   // in the source data.
@@ -70,15 +136,17 @@ struct DynamicBrickingDS::dbinfo {
 
   BrickLayout TargetBrickLayout(size_t lod, size_t ts) const;
 
-  /// since ComputeMinMaxes is soooo absurdly slow, we try to cache the
-  /// results.  These load/save all our min/maxes to a stream.
+  /// we cache the results of ComputeMinMaxes in a sidecar file.  Loading
+  /// fails if the sidecar was made for a different source or brick size.
   ///@{
-  void LoadMinMax(std::istream&);
-  void SaveMinMax(std::ostream&) const;
+  bool LoadMinMax(const std::string& fname, const SourceStamp&);
+  bool SaveMinMax(const std::string& fname, const SourceStamp&) const;
   ///@}
 
   /// run through all of the bricks and compute min/max info.
-  void ComputeMinMaxes(BrickedDataset&);
+  void ComputeMinMaxes(const DynamicBrickingDS&);
+  /// looks up a brick's min/max in the ComputeMinMaxes results.
+  MinMaxBlock PrecomputedMinMax(const BrickKey&) const;
 
   // sets the cache size (bytes)
   void SetCacheSize(size_t bytes);
@@ -97,6 +165,10 @@ struct DynamicBrickingDS::dbinfo {
   bool CopyBrick(std::vector<T>& dest, Iter src, size_t components,
                  const BrickSize tgt_bs, const BrickSize src_bs,
                  VoxelIndex src_offset);
+  template<typename T, typename Iter>
+  bool CopyBrick(T* dest, Iter src, size_t components,
+                 const BrickSize tgt_bs, const BrickSize src_bs,
+                 VoxelIndex src_offset);
 };
 
 BrickSize SourceMaxBrickSize(const BrickedDataset&);
@@ -478,13 +550,6 @@ BrickKey DynamicBrickingDS::dbinfo::SourceBrickKey(const BrickKey& k) const {
   assert(std::get<0>(skey) < bds->GetNumberOfTimesteps());
   assert(std::get<2>(skey) < bds->GetTotalBrickCount());
 #endif
-  MESSAGE("keymap query: <%u,%u,%u> -> <%u,%u,%u>",
-          static_cast<unsigned>(std::get<0>(k)),
-          static_cast<unsigned>(std::get<1>(k)),
-          static_cast<unsigned>(std::get<2>(k)),
-          static_cast<unsigned>(std::get<0>(skey)),
-          static_cast<unsigned>(std::get<1>(skey)),
-          static_cast<unsigned>(std::get<2>(skey)));
   return skey;
 }
 
@@ -506,15 +571,24 @@ bool DynamicBrickingDS::dbinfo::CopyBrick(
   std::vector<T>& dest, const Iter srcdata, size_t components,
   const BrickSize tgt_bs, const BrickSize src_bs,
   VoxelIndex src_offset
+) {
+  // make sure the vector is big enough.
+  dest.resize(tgt_bs[0]*tgt_bs[1]*tgt_bs[2]*components);
+  return this->CopyBrick<T>(dest.data(), srcdata, components, tgt_bs, src_bs,
+                            src_offset);
+}
+
+// 'dest' must hold tgt_bs.volume() * components elements.
+template<typename T, typename Iter>
+bool DynamicBrickingDS::dbinfo::CopyBrick(
+  T* dest, const Iter srcdata, size_t components,
+  const BrickSize tgt_bs, const BrickSize src_bs,
+  VoxelIndex src_offset
 ) {
   assert(tgt_bs[0] <= src_bs[0] && "target can't be larger than source");
   assert(tgt_bs[1] <= src_bs[1] && "target can't be larger than source");
   assert(tgt_bs[2] <= src_bs[2] && "target can't be larger than source");
 
-  // make sure the vector is big enough.
-  //assert(dest.size() >= (tgt_bs[0]*tgt_bs[1]*tgt_bs[2])); // be sure!
-  dest.resize(tgt_bs[0]*tgt_bs[1]*tgt_bs[2]*components);
-
   const VoxelIndex orig_offset = src_offset;
 
   // our copy size/scanline size is the width of our target brick.
@@ -529,15 +603,7 @@ bool DynamicBrickingDS::dbinfo::CopyBrick(
       const uint64_t src_o = (src_offset[2]*src_bs[0]*src_bs[1] +
                               src_offset[1]*src_bs[0] + src_offset[0]) *
                               components;
-#if 0
-      // memcpy-based: works fast even in debug.
-      std::copy(srcdata.data()+src_o, srcdata.data()+src_o+scanline,
-                dest.data()+tgt_offset);
-#else
-      // iterators: gives nice error messages in debug.
-      std::copy(srcdata+src_o, srcdata+src_o+scanline,
-                dest.begin()+tgt_offset);
-#endif
+      std::copy(srcdata+src_o, srcdata+src_o+scanline, dest+tgt_offset);
       src_offset[1]++; // should follow 'y' increment.
     }
     src_offset[1] = orig_offset[1];
@@ -572,62 +638,129 @@ DynamicBrickingDS::dbinfo::BrickSetup(const BrickKey& k,
   return rv;
 }
 
-// Looks for the brick in the cache; if so, uses it.  Otherwise, grab the brick
-template<typename T>
-bool DynamicBrickingDS::dbinfo::Brick(const DynamicBrickingDS& ds,
-                                      const BrickKey& key,
-                                      std::vector<T>& data) {
-  StackTimer gbrick(PERF_DY_GET_BRICK);
-  GBPrelim pre = this->BrickSetup(key, ds);
-
-  const void* lookup;
+// Looks for the source brick in the cache; if so, uses it.  Otherwise, grab
+// the brick from the source and add it to the cache.  The returned pointer
+// keeps the data alive even if the cache evicts it.
+template<typename T> std::shared_ptr<const void>
+DynamicBrickingDS::dbinfo::SourceBrick(const BrickKey& skey) {
+  std::shared_ptr<const void> lookup;
   {
     tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_CACHE_LOOKUPS, 1.0);
     StackTimer cc(PERF_DY_CACHE_LOOKUP);
-    lookup = this->cache.lookup(pre.skey, T(42));
+    lookup = this->cache.pin(skey, T(42));
   }
   // first: check the cache and see if we can get the data easy.
-  if(NULL != lookup) {
-    MESSAGE("found <%u,%u,%u> in the cache!",
-            static_cast<unsigned>(std::get<0>(pre.skey)),
-            static_cast<unsigned>(std::get<1>(pre.skey)),
-            static_cast<unsigned>(std::get<2>(pre.skey)));
-    tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_BRICK_COPIED, 1.0);
-    StackTimer copies(PERF_DY_BRICK_COPY);
-    const T* srcdata = static_cast<const T*>(lookup);
-    const size_t components = this->ds->GetComponentCount();
-    return this->CopyBrick<T>(data, srcdata, components, pre.tgt_bs, pre.src_bs,
-                              pre.src_offset);
+  if(lookup) {
+    IO_TRACE_INSTANT(TR_CACHE_HIT, std::get<2>(skey));
+    return lookup;
   }
-  // nope?  oh well.  read it.
+  IO_TRACE_INSTANT(TR_CACHE_MISS, std::get<2>(skey));
+  // nope?  oh well.  read it.  When the cache is full, we make room first and
+  // read into the memory of the brick we dropped, so streaming through the
+  // data does not allocate.
+  const size_t elems = this->ds->GetMaxBrickSize().volume() *
+                       this->ds->GetComponentCount();
   std::vector<T> srcdata;
   {
     StackTimer loadBrick(PERF_DY_RESERVE_BRICK);
-    srcdata.resize(this->ds->GetMaxBrickSize().volume());
+    if(this->cacheBytes > 0) {
+      // the first brick we drop hands us its buffer; later ones are freed.
+      while(this->cache.size() > 0 && !this->FitsInCache(elems * sizeof(T))) {
+        if(srcdata.capacity() == 0) { this->cache.recycle(srcdata); }
+        else { this->cache.remove(); }
+      }
+    }
+    srcdata.resize(elems);
   }
   {
     StackTimer loadBrick(PERF_DY_LOAD_BRICK);
-    if(!this->ds->GetBrick(pre.skey, srcdata)) { return false; }
+    IO_TRACE_SCOPE(TR_SOURCE_READ, std::get<2>(skey));
+    if(!this->ds->GetBrick(skey, srcdata.data(), elems * sizeof(T))) {
+      return std::shared_ptr<const void>();
+    }
   }
 
   // add it to the cache.
-  const T* sdata = static_cast<const T*>(srcdata.data());
   if(this->cacheBytes > 0) {
     tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_CACHE_ADDS, 1.0);
     StackTimer cc(PERF_DY_CACHE_ADD);
-    // is the cache full?  find room.
-    while(!this->FitsInCache(srcdata.size() * sizeof(T))) {
-      this->cache.remove();
-    }
-    sdata = static_cast<const T*>(this->cache.add(pre.skey, srcdata));
+    this->cache.add(skey, srcdata);
+    return this->cache.pin(skey, T(42));
   }
+  std::shared_ptr<std::vector<T>> owned =
+    std::make_shared<std::vector<T>>(std::move(srcdata));
+  return std::shared_ptr<const void>(owned, owned->data());
+}
+
+template<typename T>
+bool DynamicBrickingDS::dbinfo::Brick(const DynamicBrickingDS& ds,
+                                      const BrickKey& key,
+                                      std::vector<T>& data) {
+  StackTimer gbrick(PERF_DY_GET_BRICK);
+  GBPrelim pre = this->BrickSetup(key, ds);
+
+  const std::shared_ptr<const void> src = this->SourceBrick<T>(pre.skey);
+  if(!src) { return false; }
+
+  const T* sdata = static_cast<const T*>(src.get());
   const size_t components = this->ds->GetComponentCount();
   tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_BRICK_COPIED, 1.0);
   StackTimer copies(PERF_DY_BRICK_COPY);
+  IO_TRACE_SCOPE(TR_COPY, std::get<2>(key));
   return this->CopyBrick<T>(data, sdata, components, pre.tgt_bs, pre.src_bs,
                             pre.src_offset);
 }
 
+template<typename T>
+bool DynamicBrickingDS::dbinfo::Brick(const DynamicBrickingDS& ds,
+                                      const BrickKey& key,
+                                      T* data, size_t elems) {
+  StackTimer gbrick(PERF_DY_GET_BRICK);
+  GBPrelim pre = this->BrickSetup(key, ds);
+  const size_t components = this->ds->GetComponentCount();
+  if(pre.tgt_bs[0]*pre.tgt_bs[1]*pre.tgt_bs[2]*components > elems) {
+    T_ERROR("brick does not fit into the given memory.");
+    return false;
+  }
+
+  const std::shared_ptr<const void> src = this->SourceBrick<T>(pre.skey);
+  if(!src) { return false; }
+
+  const T* sdata = static_cast<const T*>(src.get());
+  tuvok::Controller::Instance().IncrementPerfCounter(PERF_DY_BRICK_COPIED, 1.0);
+  StackTimer copies(PERF_DY_BRICK_COPY);
+  IO_TRACE_SCOPE(TR_COPY, std::get<2>(key));
+  return this->CopyBrick<T>(data, sdata, components, pre.tgt_bs, pre.src_bs,
+                            pre.src_offset);
+}
+
+// same as Brick, minus the copy: we just describe where the target brick sits
+// inside its source brick.
+template<typename T>
+bool DynamicBrickingDS::dbinfo::View(const DynamicBrickingDS& ds,
+                                     const BrickKey& key,
+                                     DynamicBrickingDS::BrickView<T>& view) {
+  StackTimer gbrick(PERF_DY_GET_BRICK);
+  const GBPrelim pre = this->BrickSetup(key, ds);
+
+  std::shared_ptr<const void> src = this->SourceBrick<T>(pre.skey);
+  if(!src) { return false; }
+
+  const size_t components = this->ds->GetComponentCount();
+  view.components = components;
+  view.origin = pre.src_offset;
+  view.extents = pre.tgt_bs;
+  view.pitch[0] = components;
+  view.pitch[1] = components * pre.src_bs[0];
+  view.pitch[2] = components * pre.src_bs[0] * pre.src_bs[1];
+  view.data = static_cast<const T*>(src.get()) +
+              pre.src_offset[2] * view.pitch[2] +
+              pre.src_offset[1] * view.pitch[1] +
+              pre.src_offset[0] * view.pitch[0];
+  view.pin = std::move(src);
+  return true;
+}
+
 
 namespace {
   template<typename T> MinMaxBlock mm(const BrickKey& bk,
@@ -669,107 +802,341 @@ MinMaxBlock minmax_brick(const BrickKey& bk, const BrickedDataset& ds) {
   return MinMaxBlock();
 }
 
-/// we can cache the precomputed brick min/maxes in a file, and then
-/// just read those. this can be a big win, since the calculation is
-/// veeeery slow.
-/// @return the file we would save for this case.
-static std::string precomputed_filename(const BrickedDataset& ds,
-                                        const BrickSize bsize)
+/// directory for the min/max sidecars; empty means "next to the source".
+static std::string mm_cache_dir;
+
+void DynamicBrickingDS::SetMinMaxCacheDir(const std::string& dir) {
+  mm_cache_dir = dir;
+}
+
+static uint64_t fnv1a(uint64_t hash, const char* data, size_t len) {
+  for(size_t i=0; i < len; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+static const uint64_t fnv_basis = 14695981039346656037ULL;
+
+/// size and modification time of the file, plus a hash of its head and
+/// tail.  Hashing the whole file would cost as much as the precompute.
+static bool source_stamp(const std::string& fn, SourceStamp& stamp) {
+  LARGE_STAT_BUFFER st;
+  if(!SysTools::GetFileStats(fn, st)) { return false; }
+  stamp.size = static_cast<uint64_t>(st.st_size);
+  stamp.mtime = static_cast<uint64_t>(st.st_mtime);
+
+  std::ifstream ifs(fn.c_str(), std::ios::binary);
+  if(!ifs) { return false; }
+  const uint64_t window = 65536;
+  std::vector<char> buf(static_cast<size_t>(std::min(window, stamp.size)));
+  stamp.hash = fnv_basis;
+  ifs.read(buf.data(), buf.size());
+  stamp.hash = fnv1a(stamp.hash, buf.data(), static_cast<size_t>(ifs.gcount()));
+  if(stamp.size > window) {
+    ifs.clear();
+    ifs.seekg(static_cast<std::streamoff>(stamp.size - window));
+    ifs.read(buf.data(), buf.size());
+    stamp.hash = fnv1a(stamp.hash, buf.data(),
+                       static_cast<size_t>(ifs.gcount()));
+  }
+  return static_cast<bool>(ifs) || ifs.eof();
+}
+
+/// we can cache the precomputed brick min/maxes in a sidecar file, and then
+/// just map that.  The sidecar lives next to the source, or in the directory
+/// given to SetMinMaxCacheDir; in the latter case the name includes a hash
+/// of the source's path, so equally named sources do not collide.
+/// @param[out] source the file the data set comes from
+/// @return the sidecar we would use for this case, empty if there is none.
+static std::string minmax_sidecar(const DynamicBrickingDS& ds,
+                                  const BrickSize bsize, std::string& source)
 {
   try {
-    std::ostringstream fname;
-    const FileBackedDataset& fbds = dynamic_cast<const FileBackedDataset&>(ds);
-    fname << "." << bsize[0] << "x" << bsize[1] << "x" << bsize[2] << "-"
-          << SysTools::GetFilename(fbds.Filename()) << ".cached";
-    return fname.str();
+    source = ds.Filename();
   } catch(const std::bad_cast&) {
     WARNING("Data doesn't come from a file.  We can't save minmaxes.");
+    return "";
+  }
+  std::ostringstream fname;
+  if(mm_cache_dir.empty()) {
+    fname << SysTools::GetPath(source);
+  } else {
+    fname << mm_cache_dir << "/" << std::hex
+          << fnv1a(fnv_basis, source.c_str(), source.size()) << std::dec;
+  }
+  fname << "." << SysTools::GetFilename(source) << "." << bsize[0] << "x"
+        << bsize[1] << "x" << bsize[2] << ".minmax";
+  return fname.str();
+}
+
+bool DynamicBrickingDS::dbinfo::LoadMinMax(const std::string& fname,
+                                           const SourceStamp& stamp) {
+  LARGE_STAT_BUFFER st;
+  if(!SysTools::GetFileStats(fname, st)) { return false; }
+  const uint64_t fsize = static_cast<uint64_t>(st.st_size);
+  if(fsize < sizeof(MMHeader)) {
+    WARNING("min/max sidecar %s is truncated; ignoring it.", fname.c_str());
+    return false;
   }
-  return "";
-}
 
-void DynamicBrickingDS::dbinfo::LoadMinMax(std::istream& is) {
-  if(!is) { T_ERROR("could not open min/max cache!"); return; }
+  std::shared_ptr<LargeFileMMap> mm(new LargeFileMMap(fname, std::ios::in));
+  if(!mm->is_open()) {
+    WARNING("could not map min/max sidecar %s", fname.c_str());
+    return false;
+  }
+  std::shared_ptr<const void> mem = mm->rd(0, fsize);
+  const MMHeader* hdr = static_cast<const MMHeader*>(mem.get());
+  if(memcmp(hdr->magic, mm_magic, sizeof(mm_magic)) != 0 ||
+     hdr->version != mm_version) {
+    WARNING("%s is not a (current) min/max sidecar; ignoring it.",
+            fname.c_str());
+    return false;
+  }
+  if(hdr->source.size != stamp.size || hdr->source.mtime != stamp.mtime ||
+     hdr->source.hash != stamp.hash ||
+     hdr->brickSize[0] != this->brickSize[0] ||
+     hdr->brickSize[1] != this->brickSize[1] ||
+     hdr->brickSize[2] != this->brickSize[2]) {
+    MESSAGE("min/max sidecar %s is stale.", fname.c_str());
+    return false;
+  }
+  if(fsize != sizeof(MMHeader) + hdr->n_elems * sizeof(MMRecord)) {
+    WARNING("min/max sidecar %s is broken; ignoring it.", fname.c_str());
+    return false;
+  }
 
-  uint64_t n_elems;
-  is.read(reinterpret_cast<char*>(&n_elems), sizeof(uint64_t));
-
-  for(uint64_t i=0; i < n_elems; ++i) {
-    uint64_t timestep, lod, brick;
-    is.read(reinterpret_cast<char*>(&timestep), sizeof(uint64_t));
-    is.read(reinterpret_cast<char*>(&lod), sizeof(uint64_t));
-    is.read(reinterpret_cast<char*>(&brick), sizeof(uint64_t));
-    const BrickKey key(timestep, lod, brick);
-    MinMaxBlock mm;
-    is.read(reinterpret_cast<char*>(&mm.minScalar), sizeof(double));
-    is.read(reinterpret_cast<char*>(&mm.maxScalar), sizeof(double));
-    if(!is) {
-      T_ERROR("read failed?  cache is broken.  ignoring it.");
-      this->minmax.clear();
-      return;
+  // we look records up with a binary search, so they must be in order.
+  const MMRecord* rec = reinterpret_cast<const MMRecord*>(hdr + 1);
+  const size_t n = static_cast<size_t>(hdr->n_elems);
+  if(!std::is_sorted(rec, rec+n, mm_less)) {
+    WARNING("min/max sidecar %s is not sorted; ignoring it.", fname.c_str());
+    return false;
+  }
+  this->mm_computed.clear();
+  this->mm_file = mm;
+  this->mm_mem = mem;
+  this->mm_records = rec;
+  this->mm_n = n;
+  return true;
+}
+
+/// a temporary name next to 'fname' which no other writer uses, be it in
+/// another process or another thread of this one.
+static std::string mm_tmpname(const std::string& fname) {
+  static std::atomic<unsigned> serial(0);
+  std::random_device rd;
+  std::ostringstream tmp;
+  tmp << fname << "." << std::hex << rd() << rd() << "." << serial++
+      << ".tmp";
+  return tmp.str();
+}
+
+/// writes to a temporary and renames it, so that a reader (possibly in
+/// another process on shared storage) never sees a partial sidecar.
+bool DynamicBrickingDS::dbinfo::SaveMinMax(const std::string& fname,
+                                           const SourceStamp& stamp) const {
+  MMHeader hdr;
+  memcpy(hdr.magic, mm_magic, sizeof(mm_magic));
+  hdr.version = mm_version;
+  hdr.source = stamp;
+  for(size_t i=0; i < 3; ++i) { hdr.brickSize[i] = this->brickSize[i]; }
+  hdr.n_elems = this->mm_n;
+  MESSAGE("Saving %llu brick min/maxes to %s", hdr.n_elems, fname.c_str());
+
+  const std::string tmp = mm_tmpname(fname);
+  {
+    std::ofstream os(tmp.c_str(), std::ios::binary);
+    if(!os) {
+      WARNING("could not create min/max sidecar (%s); ignoring cache.",
+              tmp.c_str());
+      return false;
+    }
+    os.write(reinterpret_cast<const char*>(&hdr), sizeof(MMHeader));
+    if(this->mm_n > 0) {
+      os.write(reinterpret_cast<const char*>(this->mm_records),
+               this->mm_n * sizeof(MMRecord));
+    }
+    if(!os) {
+      WARNING("writing min/max sidecar %s failed.", tmp.c_str());
+      os.close();
+      remove(tmp.c_str());
+      return false;
     }
-    this->minmax.insert(std::make_pair(key, mm));
   }
+#ifdef _WIN32
+  remove(fname.c_str()); // rename does not replace existing files here
+#endif
+  if(rename(tmp.c_str(), fname.c_str()) != 0) {
+    WARNING("could not move min/max sidecar into place (%s)", fname.c_str());
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
 }
 
-void DynamicBrickingDS::dbinfo::SaveMinMax(std::ostream& os) const {
-  if(!os) { T_ERROR("could not create min/max cache."); return; }
-
-  const uint64_t n_elems = this->minmax.size();
-  MESSAGE("Saving %llu brick min/maxes", n_elems);
-  os.write(reinterpret_cast<const char*>(&n_elems), sizeof(uint64_t));
-
-  for(auto b=this->minmax.cbegin(); b != this->minmax.cend(); ++b) {
-    uint64_t timestep, lod, brick;
-    timestep = std::get<0>(b->first);
-    lod = std::get<1>(b->first);
-    brick = std::get<2>(b->first);
-    os.write(reinterpret_cast<const char*>(&timestep), sizeof(uint64_t));
-    os.write(reinterpret_cast<const char*>(&lod), sizeof(uint64_t));
-    os.write(reinterpret_cast<const char*>(&brick), sizeof(uint64_t));
-    MinMaxBlock mm = b->second;
-    os.write(reinterpret_cast<const char*>(&mm.minScalar), sizeof(double));
-    os.write(reinterpret_cast<const char*>(&mm.maxScalar), sizeof(double));
+namespace {
+  /// min/max of one target brick, which sits at 'offset' inside its (already
+  /// loaded) source brick.  Same traversal as CopyBrick, without the copy.
+  template<typename T> MinMaxBlock mm_region(const T* src, size_t components,
+                                             const BrickSize tgt_bs,
+                                             const BrickSize src_bs,
+                                             const VoxelIndex offset) {
+    T lo = std::numeric_limits<T>::max();
+    T hi = std::numeric_limits<T>::lowest();
+    const size_t scanline = tgt_bs[0] * components;
+    for(uint64_t z=0; z < tgt_bs[2]; ++z) {
+      for(uint64_t y=0; y < tgt_bs[1]; ++y) {
+        const T* line = src + ((offset[2]+z)*src_bs[0]*src_bs[1] +
+                               (offset[1]+y)*src_bs[0] + offset[0]) *
+                              components;
+        for(size_t x=0; x < scanline; ++x) {
+          lo = std::min(lo, line[x]);
+          hi = std::max(hi, line[x]);
+        }
+      }
+    }
+    return MinMaxBlock(lo, hi, DBL_MAX, -FLT_MAX);
+  }
+
+  /// reads every source brick once and computes the min/max of all the
+  /// target bricks it holds.  'targets[i]' lists the target bricks within
+  /// 'sources[i]', the results are stored in the same layout.
+  template<typename T> void mm_sources(
+    const LinearIndexDataset& ds, const std::vector<BrickKey>& sources,
+    const std::vector<std::vector<GBPrelim>>& targets,
+    std::vector<std::vector<MinMaxBlock>>& result, bool parallel
+  ) {
+    const size_t components = static_cast<size_t>(ds.GetComponentCount());
+    const int64_t n = static_cast<int64_t>(sources.size());
+#pragma omp parallel if(parallel)
+    {
+      std::vector<T> data;
+#pragma omp for schedule(dynamic)
+      for(int64_t i=0; i < n; ++i) {
+        ds.GetBrick(sources[size_t(i)], data);
+        const std::vector<GBPrelim>& tgts = targets[size_t(i)];
+        result[size_t(i)].resize(tgts.size());
+        for(size_t t=0; t < tgts.size(); ++t) {
+          result[size_t(i)][t] = mm_region(data.data(), components,
+                                           tgts[t].tgt_bs, tgts[t].src_bs,
+                                           tgts[t].src_offset);
+        }
+      }
+    }
   }
 }
 
 /// run through all of the bricks and compute min/max info.
-void DynamicBrickingDS::dbinfo::ComputeMinMaxes(BrickedDataset& ds) {
+/// The target bricks are grouped by the source brick they come from, so
+/// every source brick is read (and decompressed) just once.  Octree backed
+/// UVFs can be read concurrently, the source bricks are then spread over
+/// all threads.
+void DynamicBrickingDS::dbinfo::ComputeMinMaxes(const DynamicBrickingDS& ds) {
   // first, check if we have this cached.
-  const std::string fname = precomputed_filename(ds, this->brickSize);
-  if(SysTools::FileExists(fname)) {
-    MESSAGE("Brick min/maxes are precomputed.  Reloading from file...");
-    std::ifstream mmfile(fname, std::ios::binary);
-    this->LoadMinMax(mmfile);
-    mmfile.close();
-    return;
+  std::string source;
+  SourceStamp stamp;
+  const std::string fname = minmax_sidecar(ds, this->brickSize, source);
+  const bool cacheable = !fname.empty() && source_stamp(source, stamp);
+  if(cacheable && SysTools::FileExists(fname)) {
+    if(this->LoadMinMax(fname, stamp)) {
+      MESSAGE("Brick min/maxes are precomputed; loaded them from %s",
+              fname.c_str());
+      return;
+    }
+    this->mm_file.reset();
+    this->mm_mem.reset();
+    this->mm_records = NULL;
+    this->mm_n = 0;
   }
 
   {
     StackTimer precompute(PERF_MM_PRECOMPUTE);
-    unsigned i=0;
-    const unsigned len = static_cast<unsigned>(
-      std::distance(ds.BricksBegin(), ds.BricksEnd())
-    );
-    for(auto b=ds.BricksBegin(); b != ds.BricksEnd(); ++b, ++i) {
-      MESSAGE("precomputing brick %u of %u", i, len);
-      MinMaxBlock mm = minmax_brick(b->first, ds);
-      this->minmax.insert(std::make_pair(b->first, mm));
-      while(this->cache.size() > this->cacheBytes) { this->cache.remove(); }
+    std::vector<BrickKey> sources;
+    std::vector<std::vector<BrickKey>> keys;
+    std::vector<std::vector<GBPrelim>> targets;
+    std::unordered_map<BrickKey, size_t, BKeyHash> source_idx;
+    for(auto b=ds.BricksBegin(); b != ds.BricksEnd(); ++b) {
+      const GBPrelim pre = this->BrickSetup(b->first, ds);
+      auto s = source_idx.find(pre.skey);
+      if(s == source_idx.end()) {
+        s = source_idx.insert(std::make_pair(pre.skey, sources.size())).first;
+        sources.push_back(pre.skey);
+        keys.push_back(std::vector<BrickKey>());
+        targets.push_back(std::vector<GBPrelim>());
+      }
+      keys[s->second].push_back(b->first);
+      targets[s->second].push_back(pre);
     }
+    MESSAGE("precomputing min/max of %u bricks from %u source bricks",
+            static_cast<unsigned>(ds.GetTotalBrickCount()),
+            static_cast<unsigned>(sources.size()));
+
+    std::shared_ptr<const UVFDataset> uvf =
+      std::dynamic_pointer_cast<const UVFDataset>(this->ds);
+    const bool parallel = uvf && uvf->IsTOCBlock();
+
+    std::vector<std::vector<MinMaxBlock>> result(sources.size());
+    const unsigned size = this->ds->GetBitWidth() / 8;
+    const bool sign = this->ds->GetIsSigned();
+    const bool fp = this->ds->GetIsFloat();
+    const LinearIndexDataset& src = *this->ds;
+    if(!sign && !fp && size == 1) {
+      mm_sources<uint8_t>(src, sources, targets, result, parallel);
+    } else if(!sign && !fp && size == 2) {
+      mm_sources<uint16_t>(src, sources, targets, result, parallel);
+    } else if(!sign && !fp && size == 4) {
+      mm_sources<uint32_t>(src, sources, targets, result, parallel);
+    } else if(sign && !fp && size == 1) {
+      mm_sources<int8_t>(src, sources, targets, result, parallel);
+    } else if(sign && !fp && size == 2) {
+      mm_sources<int16_t>(src, sources, targets, result, parallel);
+    } else if(sign && !fp && size == 4) {
+      mm_sources<int32_t>(src, sources, targets, result, parallel);
+    } else if(sign && fp && size == 4) {
+      mm_sources<float>(src, sources, targets, result, parallel);
+    } else {
+      T_ERROR("unsupported type.");
+      assert(false);
+      return;
+    }
+
+    this->mm_computed.clear();
+    this->mm_computed.reserve(static_cast<size_t>(ds.GetTotalBrickCount()));
+    for(size_t i=0; i < sources.size(); ++i) {
+      for(size_t t=0; t < keys[i].size(); ++t) {
+        const MMRecord r = {
+          std::get<0>(keys[i][t]), std::get<1>(keys[i][t]),
+          std::get<2>(keys[i][t]),
+          result[i][t].minScalar, result[i][t].maxScalar
+        };
+        this->mm_computed.push_back(r);
+      }
+    }
+    std::sort(this->mm_computed.begin(), this->mm_computed.end(), mm_less);
+    this->mm_records = this->mm_computed.data();
+    this->mm_n = this->mm_computed.size();
   }
   // remove all cached bricks
   while(this->cache.size() > 0) { this->cache.remove(); }
 
   // try to cache that data to a file, now.
-  std::ofstream mmcache(fname, std::ios::binary);
-  if(!mmcache) {
-    WARNING("could not open min/max cache file (%s); ignoring cache.",
-            fname.c_str());
-    return;
+  if(cacheable) { this->SaveMinMax(fname, stamp); }
+}
+
+/// binary search through the sorted records, wherever they live.
+MinMaxBlock
+DynamicBrickingDS::dbinfo::PrecomputedMinMax(const BrickKey& bk) const {
+  const MMRecord key = {
+    std::get<0>(bk), std::get<1>(bk), std::get<2>(bk), 0.0, 0.0
+  };
+  const MMRecord* end = this->mm_records + this->mm_n;
+  const MMRecord* r = std::lower_bound(this->mm_records, end, key, mm_less);
+  if(r == end || mm_less(key, *r)) {
+    assert(false && "brick has no precomputed min/max");
+    return MinMaxBlock();
   }
-  this->SaveMinMax(mmcache);
-  mmcache.close();
+  return MinMaxBlock(r->minScalar, r->maxScalar, DBL_MAX, -FLT_MAX);
 }
 
 void DynamicBrickingDS::dbinfo::SetCacheSize(size_t bytes) {
@@ -784,7 +1151,7 @@ size_t DynamicBrickingDS::dbinfo::GetCacheSize() const {
 
 /// @returns true if 'bytes' bytes will fit into the current cache
 bool DynamicBrickingDS::dbinfo::FitsInCache(size_t bytes) const {
-  return bytes < this->cacheBytes;
+  return this->cache.size() + bytes <= this->cacheBytes;
 }
 
 bool DynamicBrickingDS::GetBrick(const BrickKey& k, std::vector<uint8_t>& data) const
@@ -829,6 +1196,68 @@ bool DynamicBrickingDS::GetBrick(const BrickKey&,
   return false;
 }
 
+// reads the brick as the source's type, straight into the given memory.
+bool DynamicBrickingDS::GetBrick(const BrickKey& k, void* data,
+                                 size_t bytes) const
+{
+  const unsigned size = this->GetBitWidth() / 8;
+  const bool sign = this->GetIsSigned();
+  const bool fp = this->GetIsFloat();
+  if(!sign && !fp && size == 1) {
+    return this->di->Brick(*this, k, static_cast<uint8_t*>(data), bytes/1);
+  } else if(!sign && !fp && size == 2) {
+    return this->di->Brick(*this, k, static_cast<uint16_t*>(data), bytes/2);
+  } else if(!sign && !fp && size == 4) {
+    return this->di->Brick(*this, k, static_cast<uint32_t*>(data), bytes/4);
+  } else if(sign && !fp && size == 1) {
+    return this->di->Brick(*this, k, static_cast<int8_t*>(data), bytes/1);
+  } else if(sign && !fp && size == 2) {
+    return this->di->Brick(*this, k, static_cast<int16_t*>(data), bytes/2);
+  } else if(sign && !fp && size == 4) {
+    return this->di->Brick(*this, k, static_cast<int32_t*>(data), bytes/4);
+  } else if(sign && fp && size == 4) {
+    return this->di->Brick(*this, k, static_cast<float*>(data), bytes/4);
+  }
+  T_ERROR("unsupported type.");
+  return false;
+}
+
+bool DynamicBrickingDS::GetBrickView(const BrickKey& k,
+                                     BrickView<uint8_t>& view) const
+{
+  return this->di->View<uint8_t>(*this, k, view);
+}
+bool DynamicBrickingDS::GetBrickView(const BrickKey& k,
+                                     BrickView<int8_t>& view) const
+{
+  return this->di->View<int8_t>(*this, k, view);
+}
+bool DynamicBrickingDS::GetBrickView(const BrickKey& k,
+                                     BrickView<uint16_t>& view) const
+{
+  return this->di->View<uint16_t>(*this, k, view);
+}
+bool DynamicBrickingDS::GetBrickView(const BrickKey& k,
+                                     BrickView<int16_t>& view) const
+{
+  return this->di->View<int16_t>(*this, k, view);
+}
+bool DynamicBrickingDS::GetBrickView(const BrickKey& k,
+                                     BrickView<uint32_t>& view) const
+{
+  return this->di->View<uint32_t>(*this, k, view);
+}
+bool DynamicBrickingDS::GetBrickView(const BrickKey& k,
+                                     BrickView<int32_t>& view) const
+{
+  return this->di->View<int32_t>(*this, k, view);
+}
+bool DynamicBrickingDS::GetBrickView(const BrickKey& k,
+                                     BrickView<float>& view) const
+{
+  return this->di->View<float>(*this, k, view);
+}
+
 void DynamicBrickingDS::SetRescaleFactors(const DOUBLEVECTOR3& scale) {
   this->di->ds->SetRescaleFactors(scale);
 }
@@ -906,8 +1335,7 @@ MinMaxBlock DynamicBrickingDS::MaxMinForKey(const BrickKey& bk) const {
     } break;
     case MM_DYNAMIC: return minmax_brick(bk, *this); break;
     case MM_PRECOMPUTE: {
-      assert(this->di->minmax.find(bk) != this->di->minmax.end());
-      return this->di->minmax.find(bk)->second;
+      return this->di->PrecomputedMinMax(bk);
     } break;
   }
   return MinMaxBlock();
@@ -926,8 +1354,128 @@ bool DynamicBrickingDS::ApplyFunction(uint64_t lod,
                                           void* pUserContext),
                         void *pUserContext,
                         uint64_t iOverlap) const {
-  T_ERROR("This probably doesn't work.");
-  return di->ds->ApplyFunction(lod, brickFunc, pUserContext, iOverlap);
+  return ApplyFunction(lod,
+                       [=](void* pData, const UINT64VECTOR3& vBrickSize,
+                           const UINT64VECTOR3& vBrickOffset) {
+                         return brickFunc(pData, vBrickSize, vBrickOffset,
+                                          pUserContext);
+                       },
+                       iOverlap, 1, true);
+}
+
+/*
+ ApplyFunction (parallel):
+
+ Walks the rebricked bricks of the LoD in index order. Each brick is
+ assembled through GetBrick, which shares the brick cache and is
+ therefore serialized; removing surplus overlap and the calls to the
+ user function run on up to iThreadCount workers. Sizes and offsets
+ refer to the rebricked layout, not to the source bricks.
+*/
+bool DynamicBrickingDS::ApplyFunction(uint64_t lod,
+                                      const BrickFunction& brickFunc,
+                                      uint64_t iOverlap,
+                                      unsigned int iThreadCount,
+                                      bool bOrdered) const {
+  const uint64_t iStoredOverlap = this->GetBrickOverlapSize()[0];
+  if(lod >= this->GetLODLevelCount() || iOverlap > iStoredOverlap) {
+    return false;
+  }
+  const uint32_t skipOverlap = static_cast<uint32_t>(iStoredOverlap-iOverlap);
+  const size_t iVoxelSize = size_t(this->GetBitWidth()/8) *
+                            size_t(this->GetComponentCount());
+  const size_t iMaxBrickBytes = this->di->brickSize[0] *
+                                this->di->brickSize[1] *
+                                this->di->brickSize[2] * iVoxelSize;
+
+  const size_t timestep = 0; /// @todo properly implement
+  const UINTVECTOR3 layout = this->GetBrickLayout(lod, timestep);
+  const int iBrickCount = int(layout.volume());
+
+  if(iThreadCount == 0) {
+    iThreadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  iThreadCount = std::min(iThreadCount, unsigned(std::max(1, iBrickCount)));
+
+  std::atomic<bool> bOK(true);
+  std::exception_ptr pError;
+
+  // assembles brick i into pBrickData, returns its size and position
+  auto loadBrick = [&](int i, uint8_t* pBrickData, UINT64VECTOR3& vSize,
+                       UINT64VECTOR3& vOffset) {
+    const BrickKey k(timestep, lod, size_t(i));
+    const UINT64VECTOR3 brickSize(this->GetBrickVoxelCounts(k));
+    bool bRead;
+#pragma omp critical(DynamicBrickingApplyFunction)
+    bRead = this->GetBrick(k, pBrickData, iMaxBrickBytes);
+    if(!bRead) { return false; }
+
+    if(skipOverlap != 0) {
+      VolumeTools::RemoveBoundary(pBrickData, brickSize, iVoxelSize,
+                                  skipOverlap);
+    }
+    vSize = brickSize - uint64_t(2*skipOverlap);
+    const VoxelIndex idx = TargetIndex(k, *this, this->di->brickSize);
+    vOffset = UINT64VECTOR3(idx[0], idx[1], idx[2]);
+    return true;
+  };
+
+#pragma omp parallel num_threads(iThreadCount)
+  {
+    std::vector<uint8_t> vBrickData(iMaxBrickBytes);
+    UINT64VECTOR3 vSize, vOffset;
+
+    if(bOrdered) {
+#pragma omp for ordered schedule(static,1)
+      for(int i = 0; i < iBrickCount; ++i) {
+        bool bLoaded = false;
+        std::exception_ptr pLoadError;
+        if(bOK) {
+          try {
+            bLoaded = loadBrick(i, &vBrickData[0], vSize, vOffset);
+          } catch(...) {
+            pLoadError = std::current_exception();
+          }
+        }
+#pragma omp ordered
+        {
+          if(bOK && pLoadError) {
+            pError = pLoadError;
+            bOK = false;
+          } else if(bOK && !bLoaded) {
+            bOK = false;
+          } else if(bOK) {
+            try {
+              if(!brickFunc(&vBrickData[0], vSize, vOffset)) { bOK = false; }
+            } catch(...) {
+              pError = std::current_exception();
+              bOK = false;
+            }
+          }
+        }
+      }
+    } else {
+#pragma omp for schedule(dynamic)
+      for(int i = 0; i < iBrickCount; ++i) {
+        if(!bOK) { continue; }
+        try {
+          if(!loadBrick(i, &vBrickData[0], vSize, vOffset) ||
+             !brickFunc(&vBrickData[0], vSize, vOffset)) {
+            bOK = false;
+          }
+        } catch(...) {
+#pragma omp critical(DynamicBrickingApplyFunctionError)
+          {
+            if(!pError) { pError = std::current_exception(); }
+          }
+          bOK = false;
+        }
+      }
+    }
+  }
+
+  if(pError) { std::rethrow_exception(pError); }
+  return bOK;
 }
 
 const char* DynamicBrickingDS::Name() const {
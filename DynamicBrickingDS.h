@@ -3,6 +3,7 @@
 
 #include <array>
 #include <memory>
+#include <string>
 #include <vector>
 #include "LinearIndexDataset.h"
 #include "FileBackedDataset.h"
@@ -18,7 +19,8 @@ public:
   /// MM_SOURCE: use the min/max from the source dataset.  this is likely to
   /// have a greater range the actual data, but might still be okay.
   /// MM_PRECOMPUTE: precompute all the new bricks' min/max info when this
-  /// object is created.  Induces huge delays.
+  /// object is created.  Every source brick is read once; expect about the
+  /// time of one pass over the source data.
   /// MM_DYNAMIC: compute the exact min/max dynamically when the brick is
   /// requested.
   enum MinMaxMode { MM_SOURCE=0, MM_PRECOMPUTE, MM_DYNAMIC };
@@ -35,6 +37,10 @@ public:
   virtual std::shared_ptr<const Histogram1D> Get1DHistogram() const;
   virtual std::shared_ptr<const Histogram2D> Get2DHistogram() const;
 
+  /// Directory for the sidecar files which cache MM_PRECOMPUTE results.  By
+  /// default (empty string) they are stored next to the source data.
+  static void SetMinMaxCacheDir(const std::string& dir);
+
   /// modifies the cache size used for holding large bricks.
   void SetCacheSize(size_t megabytes);
   /// get the cache size used for holding large bricks in MB
@@ -54,6 +60,35 @@ public:
   virtual bool GetBrick(const BrickKey&, std::vector<int32_t>&) const;
   virtual bool GetBrick(const BrickKey&, std::vector<float>&) const;
   virtual bool GetBrick(const BrickKey&, std::vector<double>&) const;
+  virtual bool GetBrick(const BrickKey&, void* data, size_t bytes) const;
+  ///@}
+
+  /// A read-only view of a brick, pointing into the (cached) source brick
+  /// which holds it instead of copying it out.  Component c of voxel
+  /// (x,y,z) is at data[z*pitch[2] + y*pitch[1] + x*pitch[0] + c].
+  template<typename T> struct BrickView {
+    std::shared_ptr<const void> pin; ///< keeps the source brick alive
+    const T* data;                   ///< first voxel of the brick
+    std::array<uint64_t,3> origin;   ///< offset of the brick in the source
+    std::array<size_t,3> extents;    ///< brick size, in voxels
+    std::array<size_t,3> pitch;      ///< strides, in elements of T
+    size_t components;
+
+    const T& operator()(size_t x, size_t y, size_t z, size_t c=0) const {
+      return data[z*pitch[2] + y*pitch[1] + x*pitch[0] + c];
+    }
+  };
+
+  /// Zero-copy data access.  The view stays valid as long as it is held,
+  /// even if the source brick is evicted from the cache meanwhile.
+  ///@{
+  bool GetBrickView(const BrickKey&, BrickView<uint8_t>&) const;
+  bool GetBrickView(const BrickKey&, BrickView<int8_t>&) const;
+  bool GetBrickView(const BrickKey&, BrickView<uint16_t>&) const;
+  bool GetBrickView(const BrickKey&, BrickView<int16_t>&) const;
+  bool GetBrickView(const BrickKey&, BrickView<uint32_t>&) const;
+  bool GetBrickView(const BrickKey&, BrickView<int32_t>&) const;
+  bool GetBrickView(const BrickKey&, BrickView<float>&) const;
   ///@}
 
   /// User rescaling factors.
@@ -105,6 +140,11 @@ public:
                                           void* pUserContext),
                         void *pUserContext,
                         uint64_t iOverlap) const;
+  virtual bool ApplyFunction(uint64_t iLODLevel,
+                             const BrickFunction& brickFunc,
+                             uint64_t iOverlap,
+                             unsigned int iThreadCount = 0,
+                             bool bOrdered = true) const;
 
   /// Virtual constructor.
   virtual DynamicBrickingDS* Create(const std::string&, uint64_t, bool) const;
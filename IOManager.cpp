@@ -36,14 +36,17 @@
 
 #include "StdTuvokDefines.h"
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <fstream>
 #include <float.h>
 #include <iterator>
+#include <limits>
 #include <set>
 #include <sstream>
 #include <map>
 #include <memory>
+#include <unordered_map>
 #include "3rdParty/jpeglib/jconfig.h"
 
 #include "IOManager.h"
@@ -52,6 +55,7 @@
 #include "Basics/SysTools.h"
 #include "Basics/SystemInfo.h"
 #include "Controller/Controller.h"
+#include "DataMerger.h"
 #include "DSFactory.h"
 #include "DynamicBrickingDS.h"
 #include "exception/UnmergeableDatasets.h"
@@ -61,6 +65,7 @@
 #include "IO/DICOM/DICOMParser.h"
 #include "IO/Images/ImageParser.h"
 #include "IO/Images/StackExporter.h"
+#include "PageCache.h"
 #include "Quantize.h"
 #include "TuvokJPEG.h"
 #include "TransferFunction1D.h"
@@ -70,6 +75,10 @@
 #include "UVF/GeometryDataBlock.h"
 #include "UVF/Histogram1DDataBlock.h"
 #include "UVF/Histogram2DDataBlock.h"
+#include "UVF/KeyValuePairDataBlock.h"
+#include "UVF/MaxMinDataBlock.h"
+#include "UVF/TOCBlock.h"
+#include "UVF/ExtendedOctree/VolumeTools.h"
 
 #include "AmiraConverter.h"
 #include "AnalyzeConverter.h"
@@ -152,6 +161,8 @@ IOManager::IOManager() :
   m_iCompression(1), // default zlib compression
   m_iCompressionLevel(1), // default compression level best speed
   m_iLayout(0), // default scanline layout
+  m_iPreFilter(0), // default no pre-filter
+  m_bAdaptiveCompression(false),
   m_LoadDS(NULL)
 {
   m_vpGeoConverters.push_back(new GeomViewConverter());
@@ -207,6 +218,25 @@ IOManager::~IOManager()
   m_pFinalConverter.reset();
 }
 
+// the queue depth is a property of each octree, IOManager only sets the value
+// octrees start with, so it applies to every dataset opened afterwards. The
+// batches come in through UVFDataset::GetBricks, e.g. from ReadRegion.
+void IOManager::SetAsyncQueueDepth(uint32_t iQueueDepth) {
+  ExtendedOctree::SetDefaultAsyncQueueDepth(iQueueDepth);
+}
+
+uint32_t IOManager::GetAsyncQueueDepth() const {
+  return ExtendedOctree::GetDefaultAsyncQueueDepth();
+}
+
+void IOManager::SetStreaming(bool bStreaming) {
+  tuvok::pagecache::SetStreaming(bStreaming);
+}
+
+bool IOManager::GetStreaming() const {
+  return tuvok::pagecache::Streaming();
+}
+
 vector<std::shared_ptr<FileStackInfo>>
 IOManager::ScanDirectory(string strDirectory) const {
   MESSAGE("Scanning directory %s", strDirectory.c_str());
@@ -504,6 +534,8 @@ bool IOManager::ConvertDataset(FileStackInfo* pStack,
                                       m_iCompression,
                                       m_iCompressionLevel,
                                       m_iLayout,
+                                      m_iPreFilter,
+                                      m_bAdaptiveCompression,
                                       0, bQuantizeTo8Bit
                                      );
 
@@ -574,7 +606,9 @@ bool IOManager::ConvertDataset(FileStackInfo* pStack,
                                       m_bClampToEdge,
                                       m_iCompression,
                                       m_iCompressionLevel,
-                                      m_iLayout);
+                                      m_iLayout,
+                                      m_iPreFilter,
+                                      m_bAdaptiveCompression);
 
     if(remove(strTempMergeFilename.c_str()) != 0) {
       WARNING("Unable to remove temp file %s", strTempMergeFilename.c_str());
@@ -591,156 +625,216 @@ bool IOManager::ConvertDataset(FileStackInfo* pStack,
   #pragma warning(default:4996)
 #endif
 
-class MergeDataset {
-public:
-  MergeDataset(std::string _strFilename="", uint64_t _iHeaderSkip=0, bool _bDelete=false,
-               double _fScale=1.0, double _fBias=0.0) :
-    strFilename(_strFilename),
-    iHeaderSkip(_iHeaderSkip),
-    bDelete(_bDelete),
-    fScale(_fScale),
-    fBias(_fBias)
-  {}
+struct MergeableDatasets : public std::binary_function<Dataset, Dataset, bool> {
+  bool operator()(const Dataset& a, const Dataset& b) const {
+    if(a.GetComponentCount() != b.GetComponentCount() ||
+       a.GetBrickOverlapSize() != b.GetBrickOverlapSize()) {
+      return false;
+    }
 
-  std::string strFilename;
-  uint64_t iHeaderSkip;
-  bool bDelete;
-  double fScale;
-  double fBias;
-};
+    const uint64_t timesteps = a.GetNumberOfTimesteps();
+    if(timesteps != b.GetNumberOfTimesteps()) { return false; }
 
-template <class T> class DataMerger {
-public:
-  DataMerger(const std::vector<MergeDataset>& strFiles,
-             const std::string& strTarget, uint64_t iElemCount,
-             tuvok::MasterController* pMasterController,
-             bool bUseMaxMode) :
-    bIsOK(false)
-  {
-    AbstrDebugOut& dbg = *(pMasterController->DebugOut());
-    dbg.Message(_func_,"Copying first file %s ...",
-                SysTools::GetFilename(strFiles[0].strFilename).c_str());
-    if (!LargeRAWFile::Copy(strFiles[0].strFilename, strTarget,
-                            strFiles[0].iHeaderSkip)) {
-      dbg.Error("Could not copy '%s' to '%s'", strFiles[0].strFilename.c_str(),
-                strTarget.c_str());
-      bIsOK = false;
-      return;
-    }
-
-    dbg.Message(_func_,"Merging ...");
-    LargeRAWFile target(strTarget);
-    target.Open(true);
-
-    if (!target.IsOpen()) {
-      dbg.Error("Could not open '%s'", strTarget.c_str());
-      remove(strTarget.c_str());
-      bIsOK = false;
-      return;
-    }
-
-    uint64_t iCopySize = std::min(iElemCount,BLOCK_COPY_SIZE/2)/sizeof(T);
-    T* pTargetBuffer = new T[size_t(iCopySize)];
-    T* pSourceBuffer = new T[size_t(iCopySize)];
-    for (size_t i = 1;i<strFiles.size();i++) {
-      dbg.Message(_func_,"Merging with file %s ...",
-                  SysTools::GetFilename(strFiles[i].strFilename).c_str());
-      LargeRAWFile source(strFiles[i].strFilename, strFiles[i].iHeaderSkip);
-      source.Open(false);
-      if (!source.IsOpen()) {
-        dbg.Error(_func_, "Could not open '%s'!",
-                  strFiles[i].strFilename.c_str());
-        delete [] pTargetBuffer;
-        delete [] pSourceBuffer;
-        target.Close();
-        remove(strTarget.c_str());
-        bIsOK = false;
-        return;
+    const unsigned LoDs = a.GetLODLevelCount();
+    if(LoDs != b.GetLODLevelCount()) { return false; }
+
+    for(uint64_t ts=0; ts < timesteps; ++ts) {
+      for(uint64_t level=0; level < LoDs; ++level) {
+        const size_t st_ts = static_cast<size_t>(ts);
+        const size_t st_level = static_cast<size_t>(level);
+        if(a.GetDomainSize() != b.GetDomainSize() ||
+           a.GetBrickCount(st_level, st_ts) != b.GetBrickCount(st_level, st_ts)) {
+          return false;
+        }
       }
+    }
 
-      uint64_t iReadSize=0;
-      do {
-         source.ReadRAW((unsigned char*)pSourceBuffer, iCopySize*sizeof(T));
-         iCopySize = target.ReadRAW((unsigned char*)pTargetBuffer,
-                                    iCopySize*sizeof(T))/sizeof(T);
-
-         if (bUseMaxMode) {
-           if (i == 1) {
-             for (uint64_t j = 0;j<iCopySize;j++) {
-               pTargetBuffer[j] = std::max<T>(
-                 T(std::min<double>(
-                   strFiles[0].fScale*(pTargetBuffer[j] + strFiles[0].fBias),
-                   static_cast<double>(std::numeric_limits<T>::max())
-                 )),
-                 T(std::min<double>(
-                   strFiles[i].fScale*(pSourceBuffer[j] + strFiles[i].fBias),
-                   static_cast<double>(std::numeric_limits<T>::max()))
-                 )
-               );
-             }
-           } else {
-             for (uint64_t j = 0;j<iCopySize;j++) {
-               pTargetBuffer[j] = std::max<T>(
-                 pTargetBuffer[j],
-                 T(std::min<double>(strFiles[i].fScale*(pSourceBuffer[j] +
-                                                        strFiles[i].fBias),
-                                    static_cast<double>(std::numeric_limits<T>::max())))
-               );
-             }
-           }
-         } else {
-           if (i == 1) {
-             for (uint64_t j = 0;j<iCopySize;j++) {
-               T a = T(std::min<double>(
-                 strFiles[0].fScale*(pTargetBuffer[j] + strFiles[0].fBias),
-                 static_cast<double>(std::numeric_limits<T>::max())
-               ));
-               T b = T(std::min<double>(
-                 strFiles[i].fScale*(pSourceBuffer[j] + strFiles[i].fBias),
-                 static_cast<double>(std::numeric_limits<T>::max())
-               ));
-               T val = a + b;
-
-               if (val < a || val < b) // overflow
-                 pTargetBuffer[j] = std::numeric_limits<T>::max();
-               else
-                 pTargetBuffer[j] = val;
-             }
-           } else {
-             for (uint64_t j = 0;j<iCopySize;j++) {
-               T b = T(std::min<double>(
-                 strFiles[i].fScale*(pSourceBuffer[j] + strFiles[i].fBias),
-                 static_cast<double>(std::numeric_limits<T>::max())
-               ));
-               T val = pTargetBuffer[j] + b;
-
-               if (val < pTargetBuffer[j] || val < b) // overflow
-                 pTargetBuffer[j] = std::numeric_limits<T>::max();
-               else
-                 pTargetBuffer[j] = val;
-             }
-           }
-         }
-         target.SeekPos(iReadSize*sizeof(T));
-         target.WriteRAW((unsigned char*)pTargetBuffer, iCopySize*sizeof(T));
-         iReadSize += iCopySize;
-      } while (iReadSize < iElemCount);
-      source.Close();
-    }
-
-    delete [] pTargetBuffer;
-    delete [] pSourceBuffer;
-    target.Close();
-
-    bIsOK = true;
-  }
-
-  bool IsOK() const {return bIsOK;}
-
-private:
-  bool bIsOK;
+    return true;
+  }
 };
 
+/// state handed to MergeBricks by the octree merge
+struct BrickMergeContext {
+  const std::vector<MergeDataset>* pFiles;
+  bool bUseMaxMode;
+};
+
+/// combine callback for ExtendedOctreeConverter::Merge, applies the same
+/// scale/bias and sum/max semantics as the flat DataMerger
+template <class T> static bool MergeBricks(
+  const std::vector<const uint8_t*>& vInput, uint8_t* pOutput,
+  uint64_t iValueCount, void* pUserContext)
+{
+  const BrickMergeContext* ctx =
+    static_cast<const BrickMergeContext*>(pUserContext);
+  std::vector<const T*> vSource(vInput.size());
+  for (size_t i = 0;i<vInput.size();i++)
+    vSource[i] = reinterpret_cast<const T*>(vInput[i]);
+  MergeCombine(*ctx->pFiles, vSource, reinterpret_cast<T*>(pOutput),
+               size_t(iValueCount), ctx->bUseMaxMode);
+  return true;
+}
+
+/// Opens the inputs of a merge if all of them are octree UVFs that can be
+/// combined brick by brick, i.e. they pass MergeableDatasets and share
+/// brick layout and component type. Only unsigned 8 and 16 bit data is
+/// accepted as that is what the converters produce and what the histogram
+/// computation supports. Returns an empty vector otherwise.
+static std::vector<std::shared_ptr<UVFDataset>>
+OpenBrickMergeableDatasets(const std::vector<std::string>& strFilenames,
+                           uint64_t iMaxBrickSize)
+{
+  std::vector<std::shared_ptr<UVFDataset>> vDatasets;
+  for (size_t i = 0;i<strFilenames.size();i++) {
+    if (SysTools::ToUpperCase(SysTools::GetExt(strFilenames[i])) != "UVF")
+      return std::vector<std::shared_ptr<UVFDataset>>();
+  }
+
+  MergeableDatasets mergeable;
+  for (size_t i = 0;i<strFilenames.size();i++) {
+    std::shared_ptr<UVFDataset> ds(
+      new UVFDataset(strFilenames[i], iMaxBrickSize, false)
+    );
+    if (!ds->IsTOCBlock() || ds->GetNumberOfTimesteps() == 0)
+      return std::vector<std::shared_ptr<UVFDataset>>();
+
+    const TOCBlock* toc = ds->GetTOCBlock(0);
+    if (toc->GetComponentType() != ExtendedOctree::CT_UINT8 &&
+        toc->GetComponentType() != ExtendedOctree::CT_UINT16)
+      return std::vector<std::shared_ptr<UVFDataset>>();
+
+    if (!vDatasets.empty()) {
+      const TOCBlock* first = vDatasets[0]->GetTOCBlock(0);
+      if (!mergeable(*vDatasets[0], *ds) ||
+          toc->GetComponentType() != first->GetComponentType() ||
+          toc->GetMaxBrickSize() != first->GetMaxBrickSize() ||
+          toc->GetLODDomainSize(0) != first->GetLODDomainSize(0))
+        return std::vector<std::shared_ptr<UVFDataset>>();
+    }
+    vDatasets.push_back(ds);
+  }
+  return vDatasets;
+}
+
+/// Merges octree UVFs that passed OpenBrickMergeableDatasets straight into
+/// a new octree UVF, see TOCBlock::MergeBricked.
+static bool MergeTOCDatasets(
+  const std::vector<std::shared_ptr<UVFDataset>>& vDatasets,
+  const std::vector<MergeDataset>& vParams,
+  const std::string& strTargetFilename, const std::string& strTempDir,
+  const std::string& strDesc, const std::string& strSource,
+  bool bUseMaxMode, bool bUseMedian, bool bClampToEdge,
+  uint32_t iCompression, uint32_t iCompressionLevel, uint32_t iLayout)
+{
+  const UVFDataset& first = *vDatasets[0];
+  const size_t iTimesteps = size_t(first.GetNumberOfTimesteps());
+  const size_t iComponentCount = size_t(first.GetComponentCount());
+
+  BrickMergeContext ctx;
+  ctx.pFiles = &vParams;
+  ctx.bUseMaxMode = bUseMaxMode;
+  bool (*combineFunc)(const std::vector<const uint8_t*>&, uint8_t*, uint64_t,
+                      void*) =
+    (first.GetTOCBlock(0)->GetComponentType() == ExtendedOctree::CT_UINT8)
+    ? MergeBricks<uint8_t> : MergeBricks<uint16_t>;
+
+  wstring wstrUVFName(strTargetFilename.begin(), strTargetFilename.end());
+  UVF uvfFile(wstrUVFName);
+
+  GlobalHeader uvfGlobalHeader;
+  uvfGlobalHeader.bIsBigEndian = EndianConvert::IsBigEndian();
+  uvfGlobalHeader.ulChecksumSemanticsEntry = UVFTables::CS_MD5;
+  uvfFile.SetGlobalHeader(uvfGlobalHeader);
+
+  // the blocks have to stay alive until the file is written, each ToC block
+  // removes its temp file once it is released
+  std::vector<std::shared_ptr<DataBlock>> vBlocks;
+  bool bOK = true;
+
+  for (size_t ts = 0;ts<iTimesteps && bOK;ts++) {
+    std::vector<const TOCBlock*> vSources;
+    for (size_t i = 0;i<vDatasets.size();i++)
+      vSources.push_back(vDatasets[i]->GetTOCBlock(ts));
+
+    std::shared_ptr<MaxMinDataBlock> maxmin(
+      new MaxMinDataBlock(iComponentCount)
+    );
+    std::shared_ptr<TOCBlock> dataVolume(new TOCBlock(UVF::ms_ulReaderVersion));
+    dataVolume->strBlockID = strDesc + " volume converted from " +
+                             strSource + " by ImageVis3D";
+
+    std::string tmpfile;
+    {
+      ostringstream tmpfn;
+      tmpfn << strTempDir << ts << "mergedFile.tmp";
+      tmpfile = tmpfn.str();
+    }
+
+    MESSAGE("Merging bricks of timestep %u ...", unsigned(ts));
+    if (!dataVolume->MergeBricked(vSources, tmpfile, combineFunc, &ctx,
+                                  maxmin, &Controller::Debug::Out(),
+                                  bUseMedian, bClampToEdge,
+                                  COMPRESSION_TYPE(iCompression),
+                                  iCompressionLevel, LAYOUT_TYPE(iLayout))) {
+      T_ERROR("Merging the bricks failed, aborting.");
+      bOK = false;
+      break;
+    }
+    uvfFile.AddDataBlock(dataVolume);
+    vBlocks.push_back(dataVolume);
+
+    // do not compute histograms when we are dealing with color data
+    if (iComponentCount != 4 && iComponentCount != 3) {
+      MESSAGE("Computing 1D Histogram...");
+      std::shared_ptr<Histogram1DDataBlock> hist1d(new Histogram1DDataBlock());
+      std::shared_ptr<Histogram2DDataBlock> hist2d(new Histogram2DDataBlock());
+      if (!hist1d->Compute(dataVolume.get(), 0)) {
+        T_ERROR("Computation of 1D Histogram failed!");
+        bOK = false;
+        break;
+      }
+      MESSAGE("Computing 2D Histogram...");
+      if (!hist2d->Compute(dataVolume.get(), 0, hist1d->GetHistogram().size(),
+                           maxmin->GetGlobalValue().maxScalar)) {
+        T_ERROR("Computation of 2D Histogram failed!");
+        bOK = false;
+        break;
+      }
+      uvfFile.AddDataBlock(hist1d);
+      uvfFile.AddDataBlock(hist2d);
+      vBlocks.push_back(hist1d);
+      vBlocks.push_back(hist2d);
+    } else {
+      WARNING("Multicomponent data; skipping histogram computations.");
+    }
+    uvfFile.AddDataBlock(maxmin);
+    vBlocks.push_back(maxmin);
+  }
+
+  if (bOK) {
+    std::shared_ptr<KeyValuePairDataBlock> metaPairs(
+      new KeyValuePairDataBlock()
+    );
+    metaPairs->AddPair("Data Source", strSource);
+    metaPairs->AddPair("Description", strDesc);
+    metaPairs->AddPair("Source Endianness",
+                       EndianConvert::IsBigEndian() ? "big" : "little");
+    metaPairs->AddPair("Source Type", "integer");
+    metaPairs->AddPair("Source Bitwidth",
+                       SysTools::ToString(first.GetBitWidth()));
+    uvfFile.AddDataBlock(metaPairs);
+
+    MESSAGE("Writing UVF file...");
+    bOK = uvfFile.Create();
+  }
+  uvfFile.Close();
+  vBlocks.clear();
+
+  if (!bOK && SysTools::FileExists(strTargetFilename))
+    remove(strTargetFilename.c_str());
+  return bOK;
+}
+
 bool IOManager::MergeDatasets(const vector <string>& strFilenames,
                               const vector <double>& vScales,
                               const vector<double>& vBiases,
@@ -766,6 +860,25 @@ bool IOManager::MergeDatasets(const vector <string>& strFilenames,
   }
   string        strSourceG = ss.str();
 
+  // octree inputs that share their layout are combined brick by brick,
+  // this avoids the flat export of every input and the rebuild of the
+  // hierarchy from the merged data
+  if (SysTools::ToUpperCase(SysTools::GetExt(strTargetFilename)) == "UVF") {
+    std::vector<std::shared_ptr<UVFDataset>> vDatasets =
+      OpenBrickMergeableDatasets(strFilenames, m_iMaxBrickSize);
+    if (!vDatasets.empty()) {
+      MESSAGE("Inputs share their brick layout, merging bricks directly.");
+      vector<MergeDataset> vParams;
+      for (size_t i = 0;i<strFilenames.size();i++)
+        vParams.push_back(MergeDataset(strFilenames[i], 0, false,
+                                       vScales[i], vBiases[i]));
+      return MergeTOCDatasets(vDatasets, vParams, strTargetFilename,
+                              strTempDir, strTitleG, strSourceG, bUseMaxMode,
+                              m_bUseMedianFilter, m_bClampToEdge,
+                              m_iCompression, m_iCompressionLevel, m_iLayout);
+    }
+  }
+
   bool bRAWCreated = false;
   vector<MergeDataset> vIntermediateFiles;
   for (size_t iInputData = 0;iInputData<strFilenames.size();iInputData++) {
@@ -1029,7 +1142,8 @@ bool IOManager::MergeDatasets(const vector <string>& strFilenames,
         bSignedG, bIsFloatG, vVolumeSizeG, vVolumeAspectG, strTitleG,
         SysTools::GetFilename(strMergedFile), m_iMaxBrickSize,
         m_iBrickOverlap, m_bUseMedianFilter, m_bClampToEdge, m_iCompression,
-        m_iCompressionLevel, m_iLayout);
+        m_iCompressionLevel, m_iLayout, m_iPreFilter,
+        m_bAdaptiveCompression);
   } else {
     for (size_t k = 0;k<m_vpConverters.size();k++) {
       const vector<string>& vStrSupportedExtTarget =
@@ -1121,6 +1235,7 @@ bool IOManager::ConvertDataset(const list<string>& files,
                                bNoUserInteraction, iMaxBrickSize, iBrickOverlap,
                                m_bUseMedianFilter, m_bClampToEdge, 
                                m_iCompression, m_iCompressionLevel, m_iLayout,
+                               m_iPreFilter, m_bAdaptiveCompression,
                                bQuantizeTo8Bit)) {
         return true;
       } else {
@@ -1140,6 +1255,8 @@ bool IOManager::ConvertDataset(const list<string>& files,
                                              m_iCompression,
                                              m_iCompressionLevel,
                                              m_iLayout,
+                                             m_iPreFilter,
+                                             m_bAdaptiveCompression,
                                              bQuantizeTo8Bit);
     } else {
       return false;
@@ -1337,29 +1454,25 @@ public:
   {}
 
   virtual ~MCData() {}
-  virtual bool PerformMC(void* pData, const UINTVECTOR3& vBrickSize, const UINT64VECTOR3& vBrickOffset) = 0;
+
+  /// extracts the isosurface from all bricks of the given LoD that may
+  /// contain it, bricks are processed in parallel
+  virtual bool PerformMC(const tuvok::UVFDataset* pSourceData,
+                         uint64_t iLODlevel) = 0;
 
 protected:
   std::string m_strTargetFile;
 };
 
-bool MCBrick(void* pData, const UINT64VECTOR3& vBrickSize, 
-             const UINT64VECTOR3& vBrickOffset, void* pUserContext) {
-    MCData* pMCData = (MCData*)pUserContext;
-    return pMCData->PerformMC(pData, UINTVECTOR3(vBrickSize), vBrickOffset);
-}
-
 
 bool IOManager::ExtractImageStack(const tuvok::UVFDataset* pSourceData,
                                   const TransferFunction1D* pTrans,
                                   uint64_t iLODlevel, 
                                   const std::string& strTargetFilename,
-                                  const std::string& strTempDir,
+                                  const std::string& /* strTempDir */,
                                   bool bAllDirs) const {
 
 
-  string strTempFilename = SysTools::FindNextSequenceName(strTempDir + SysTools::GetFilename(strTargetFilename)+".tmp_raw");
-  
   if (pSourceData->GetIsFloat() || pSourceData->GetIsSigned()) {
     T_ERROR("Stack export currently only supported for unsigned integer values.");
     return false;
@@ -1370,29 +1483,17 @@ bool IOManager::ExtractImageStack(const tuvok::UVFDataset* pSourceData,
     return false;
   }
 
-
-  MESSAGE("Extracting Data");
-
-  bool bRAWCreated = pSourceData->Export(iLODlevel, strTempFilename, false);
-
-  if (!bRAWCreated) {
-    T_ERROR("Unable to write temp file %s", strTempFilename.c_str());
-    return false;
-  }
-
   MESSAGE("Writing stacks");
 
   double fMaxActValue = (pSourceData->GetRange().first > pSourceData->GetRange().second) ? pTrans->GetSize() : pSourceData->GetRange().second;
 
-  bool bTargetCreated = StackExporter::WriteStacks(strTempFilename, 
+  // slices are assembled straight from the bricks, no temp file needed
+  bool bTargetCreated = StackExporter::WriteStacks(*pSourceData,
+                                                   iLODlevel,
                                                    strTargetFilename,
                                                    pTrans,
-                                                   pSourceData->GetBitWidth(),
-                                                   pSourceData->GetComponentCount(),
                                                    float(pTrans->GetSize() / fMaxActValue),
-                                                   pSourceData->GetDomainSize(static_cast<size_t>(iLODlevel)),
                                                    bAllDirs);
-  remove(strTempFilename.c_str());
 
   if (!bTargetCreated) {
     T_ERROR("Unable to write target file %s", strTargetFilename.c_str());
@@ -1409,36 +1510,264 @@ public:
   MCDataTemplate(const std::string& strTargetFile, T TIsoValue, 
                  const FLOATVECTOR3& vScale, 
                  UINT64VECTOR3 vDataSize, tuvok::AbstrGeoConverter* conv,
-                 const FLOATVECTOR4& vColor) :
+                 const FLOATVECTOR4& vColor, bool bStreamOutput) :
     MCData(strTargetFile),
     m_TIsoValue(TIsoValue),
     m_iIndexoffset(0),
-    m_pMarchingCubes(new MarchingCubes<T>()),
     m_vDataSize(vDataSize),
     m_conv(conv),
     m_vColor(vColor),
-    m_vScale(vScale)
+    m_vScale(vScale),
+    m_bStreamOutput(bStreamOutput)
   {
   }
 
-  virtual ~MCDataTemplate() {
-    tuvok::Mesh m = tuvok::Mesh(m_vertices, m_normals, tuvok::TexCoordVec(),
-                                tuvok::ColorVec(), m_indices, m_indices, 
-                                tuvok::IndexVec(),tuvok::IndexVec(), 
-                                false,false,"Marching Cubes mesh by ImageVis3D",
-                                tuvok::Mesh::MT_TRIANGLES);
-    m.SetDefaultColor(m_vColor);
-    m_conv->ConvertToNative(m, m_strTargetFile);
+  virtual ~MCDataTemplate() {}
+
+  virtual bool PerformMC(const tuvok::UVFDataset* pSourceData,
+                         uint64_t iLODlevel) {
+    const std::string strDesc = "Marching Cubes mesh by ImageVis3D";
+    if (m_bStreamOutput && m_conv->CanStreamTriangles()) {
+      m_stream = m_conv->CreateTriangleStream(m_strTargetFile, strDesc);
+      if (!m_stream) {
+        T_ERROR("Unable to create %s", m_strTargetFile.c_str());
+        return false;
+      }
+    }
+
+    bool bResult = ExtractSurface(pSourceData, size_t(iLODlevel));
+
+    if (m_stream) {
+      bResult = m_stream->Close() && bResult;
+      m_stream.reset();
+    } else if (bResult) {
+      tuvok::Mesh m = tuvok::Mesh(m_vertices, m_normals, tuvok::TexCoordVec(),
+                                  tuvok::ColorVec(), m_indices, m_indices, 
+                                  tuvok::IndexVec(),tuvok::IndexVec(), 
+                                  false,false,strDesc,
+                                  tuvok::Mesh::MT_TRIANGLES);
+      m.SetDefaultColor(m_vColor);
+      bResult = m_conv->ConvertToNative(m, m_strTargetFile);
+    }
+    return bResult;
   }
 
-  virtual bool PerformMC(void* pData, const UINTVECTOR3& vBrickSize, const UINT64VECTOR3& vBrickOffset) {
-   
-    T* ptData = (T*)pData;
+protected:
+  /// the isosurface of a single brick, indices are local to the brick,
+  /// every vertex also carries the global grid edge it was created on
+  struct BrickSurface {
+    tuvok::VertVec        vertices;
+    tuvok::NormVec        normals;
+    tuvok::IndexVec       indices;
+    std::vector<uint64_t> edges;
+  };
+
+  bool ExtractSurface(const tuvok::UVFDataset* pSourceData, size_t lod) {
+    const uint32_t iOverlap = pSourceData->GetBrickOverlapSize().x;
+    // octree (ToC) reads lock the file themselves and decompress in
+    // parallel, the raster block reader shares its file position
+    const bool bSerialReads = !pSourceData->IsTOCBlock();
+    // number of bricks that are extracted before their surfaces get merged,
+    // this bounds the memory held by surfaces that have not been written
+    const size_t iMergeBatch = 64;
+
+    for (size_t ts = 0; ts < size_t(pSourceData->GetNumberOfTimesteps()); ++ts) {
+      const UINTVECTOR3 vLayout = pSourceData->GetBrickLayout(lod, ts);
+      const UINT64VECTOR3 vBrickStride =
+        pSourceData->GetEffectiveBrickSize(BrickKey(ts, lod, 0));
+
+      // skip all bricks whose value range does not contain the isovalue
+      std::vector<BrickKey> vBricks;
+      const size_t iBrickCount = size_t(vLayout.volume());
+      for (size_t i = 0; i < iBrickCount; ++i) {
+        const BrickKey k(ts, lod, i);
+        if (pSourceData->ContainsData(k, double(m_TIsoValue),
+                                      double(m_TIsoValue)))
+          vBricks.push_back(k);
+      }
+      MESSAGE("Extracting isosurface from %u of %u bricks",
+              unsigned(vBricks.size()), unsigned(iBrickCount));
+
+      if (vBricks.size() > size_t(std::numeric_limits<int>::max())) {
+        T_ERROR("Too many bricks for isosurface extraction");
+        return false;
+      }
+
+      for (size_t iFirst = 0; iFirst < vBricks.size(); iFirst += iMergeBatch) {
+        const size_t iCount = std::min(iMergeBatch, vBricks.size()-iFirst);
+
+        // every brick gets its own output slot so the threads never share
+        // a buffer and the final mesh does not depend on the scheduling
+        std::vector<BrickSurface> vSurfaces(iCount);
+        bool bReadError = false;
+
+#pragma omp parallel
+        {
+          MarchingCubes<T> mc;
+          std::vector<uint8_t> vData;
+
+#pragma omp for schedule(dynamic)
+          for (int i = 0; i < int(iCount); ++i) {
+            const BrickKey& k = vBricks[iFirst+size_t(i)];
+            bool bRead;
+            if (bSerialReads) {
+#pragma omp critical(MCReadBrick)
+              bRead = pSourceData->GetBrick(k, vData);
+            } else {
+              bRead = pSourceData->GetBrick(k, vData);
+            }
+            if (!bRead) {
+#pragma omp critical(MCReadError)
+              bReadError = true;
+              continue;
+            }
+
+            UINT64VECTOR3 vBrickSize(pSourceData->GetBrickVoxelCounts(k));
+            const UINT64VECTOR3 vBrickCoords = BrickCoords(k, vLayout);
+
+            // every cell is processed by exactly one brick: a brick covers
+            // the cells between its first voxel and the first voxel of the
+            // next brick, which is the first voxel of its overlap
+            if (iOverlap != 0) {
+              const UINT64VECTOR3 vInner = vBrickSize -
+                UINT64VECTOR3(2*iOverlap, 2*iOverlap, 2*iOverlap);
+              const UINT64VECTOR3 vCropSize(
+                vInner.x + (vBrickCoords.x+1 < vLayout.x ? 1 : 0),
+                vInner.y + (vBrickCoords.y+1 < vLayout.y ? 1 : 0),
+                vInner.z + (vBrickCoords.z+1 < vLayout.z ? 1 : 0));
+              VolumeTools::CropBrick(&vData[0], vBrickSize, sizeof(T),
+                                     UINT64VECTOR3(iOverlap, iOverlap,
+                                                   iOverlap),
+                                     vCropSize);
+              vBrickSize = vCropSize;
+            }
+
+            ProcessBrick(mc, (T*)&vData[0], UINTVECTOR3(vBrickSize),
+                         vBrickCoords * vBrickStride, vSurfaces[size_t(i)]);
+          }
+        }
+
+        if (bReadError) {
+          T_ERROR("Unable to read brick data");
+          return false;
+        }
+
+        // weld the brick surfaces in brick order
+        for (size_t i = 0; i < vSurfaces.size(); ++i) {
+          if (!MergeSurface(vSurfaces[i])) return false;
+          vSurfaces[i] = BrickSurface();
+        }
 
+        // bricks are visited in z-major order, once all bricks below a
+        // given z slice are merged, no later brick can share their vertices
+        if (iFirst+iCount < vBricks.size()) {
+          const uint64_t iZ =
+            BrickCoords(vBricks[iFirst+iCount], vLayout).z * vBrickStride.z;
+          EvictEdges(EdgeKey(0, 0, iZ, 0));
+        } else {
+          m_weldMap.clear();
+        }
+
+        if (m_stream) {
+          if (!m_stream->Append(m_vertices, m_normals, m_indices)) {
+            T_ERROR("Unable to write to %s", m_strTargetFile.c_str());
+            return false;
+          }
+          m_vertices.clear();
+          m_normals.clear();
+          m_indices.clear();
+        }
+      }
+    }
+
+    return true;
+  }
+
+  static UINT64VECTOR3 BrickCoords(const BrickKey& k,
+                                   const UINTVECTOR3& vLayout) {
+    const size_t iIndex = std::get<2>(k);
+    return UINT64VECTOR3(iIndex % vLayout.x,
+                         (iIndex / vLayout.x) % vLayout.y,
+                         iIndex / (uint64_t(vLayout.x) * vLayout.y));
+  }
+
+  /// unique id of a grid edge (identified by its lower voxel and its
+  /// axis 0-2) or of a voxel (axis 3), ordered by z first
+  uint64_t EdgeKey(uint64_t x, uint64_t y, uint64_t z, uint64_t axis) const {
+    return ((z * (m_vDataSize.y+1) + y) * (m_vDataSize.x+1) + x) * 4 + axis;
+  }
+
+  /// MC places vertices on grid edges so two of the three coordinates are
+  /// integers, vertices that hit a voxel exactly are keyed by that voxel
+  uint64_t VertexEdge(const FLOATVECTOR3& vPos,
+                      const UINT64VECTOR3& vBrickOffset) const {
+    const float p[3] = {vPos.x, vPos.y, vPos.z};
+    uint64_t c[3];
+    uint64_t axis = 3;
+    for (size_t d = 0; d < 3; ++d) {
+      const float fRounded = std::floor(p[d] + 0.5f);
+      if (std::fabs(p[d] - fRounded) < 1e-4f) {
+        c[d] = uint64_t(std::max(fRounded, 0.0f));
+      } else {
+        c[d] = uint64_t(std::max(std::floor(p[d]), 0.0f));
+        axis = d;
+      }
+    }
+    return EdgeKey(c[0] + vBrickOffset.x, c[1] + vBrickOffset.y,
+                   c[2] + vBrickOffset.z, axis);
+  }
+
+  /// appends a brick surface, vertices on edges that were already seen are
+  /// replaced by the existing ones and triangles that collapse are dropped
+  bool MergeSurface(const BrickSurface& surface) {
+    std::vector<uint32_t> vRemap(surface.vertices.size());
+    for (size_t i = 0; i < surface.vertices.size(); ++i) {
+      std::pair<WeldMap::iterator, bool> entry = m_weldMap.insert(
+        std::make_pair(surface.edges[i], m_iIndexoffset)
+      );
+      if (entry.second) {
+        if (m_iIndexoffset == std::numeric_limits<uint32_t>::max()) {
+          T_ERROR("Isosurface has too many vertices");
+          return false;
+        }
+        m_vertices.push_back(surface.vertices[i]);
+        m_normals.push_back(surface.normals[i]);
+        ++m_iIndexoffset;
+      }
+      vRemap[i] = entry.first->second;
+    }
+
+    for (size_t i = 0; i+2 < surface.indices.size(); i += 3) {
+      const uint32_t a = vRemap[surface.indices[i]];
+      const uint32_t b = vRemap[surface.indices[i+1]];
+      const uint32_t c = vRemap[surface.indices[i+2]];
+      if (a == b || b == c || a == c) continue;
+      m_indices.push_back(a);
+      m_indices.push_back(b);
+      m_indices.push_back(c);
+    }
+    return true;
+  }
+
+  /// forgets all welding candidates with a key below iKey
+  void EvictEdges(uint64_t iKey) {
+    for (WeldMap::iterator it = m_weldMap.begin(); it != m_weldMap.end();) {
+      if (it->first < iKey)
+        it = m_weldMap.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  /// runs marching cubes on a single brick, this is safe to call
+  /// concurrently as long as every thread uses its own 'mc' and 'surface'
+  void ProcessBrick(MarchingCubes<T>& mc, T* ptData,
+                    const UINTVECTOR3& vBrickSize,
+                    const UINT64VECTOR3& vBrickOffset,
+                    BrickSurface& surface) const {
     // extract isosurface
-    m_pMarchingCubes->SetVolume(vBrickSize.x, vBrickSize.y, vBrickSize.z,
-                                ptData);
-    m_pMarchingCubes->Process(m_TIsoValue);
+    mc.SetVolume(vBrickSize.x, vBrickSize.y, vBrickSize.z, ptData);
+    mc.Process(m_TIsoValue);
 
     // brick scale
     float fMaxSize = (FLOATVECTOR3(m_vDataSize) * m_vScale).maxVal();
@@ -1446,33 +1775,43 @@ public:
     FLOATVECTOR3 vecBrickOffset(vBrickOffset);
     vecBrickOffset = vecBrickOffset * m_vScale;
 
-    for (int i = 0;i<m_pMarchingCubes->m_Isosurface->iVertices;i++) {
-      m_vertices.push_back((m_pMarchingCubes->m_Isosurface->vfVertices[i]+vecBrickOffset-FLOATVECTOR3(m_vDataSize)/2.0f)/fMaxSize);
+    const int iVertices = mc.m_Isosurface->iVertices;
+    const int iTriangles = mc.m_Isosurface->iTriangles;
+    surface.vertices.reserve(size_t(iVertices));
+    surface.normals.reserve(size_t(iVertices));
+    surface.edges.reserve(size_t(iVertices));
+    surface.indices.reserve(size_t(iTriangles)*3);
+
+    for (int i = 0;i<iVertices;i++) {
+      surface.vertices.push_back((mc.m_Isosurface->vfVertices[i]+vecBrickOffset-FLOATVECTOR3(m_vDataSize)/2.0f)/fMaxSize);
+      surface.edges.push_back(VertexEdge(mc.m_Isosurface->vfVertices[i],
+                                         vBrickOffset));
     }
 
-    for (int i = 0;i<m_pMarchingCubes->m_Isosurface->iVertices;i++) {
-      m_normals.push_back(m_pMarchingCubes->m_Isosurface->vfNormals[i]);
-    }    
-
-    for (int i = 0;i<m_pMarchingCubes->m_Isosurface->iTriangles;i++) {
-      m_indices.push_back(m_pMarchingCubes->m_Isosurface->viTriangles[i].x+m_iIndexoffset);
-      m_indices.push_back(m_pMarchingCubes->m_Isosurface->viTriangles[i].y+m_iIndexoffset);
-      m_indices.push_back(m_pMarchingCubes->m_Isosurface->viTriangles[i].z+m_iIndexoffset);
+    for (int i = 0;i<iVertices;i++) {
+      surface.normals.push_back(mc.m_Isosurface->vfNormals[i]);
     }
 
-    m_iIndexoffset += m_pMarchingCubes->m_Isosurface->iVertices;
-
-    return true;
+    for (int i = 0;i<iTriangles;i++) {
+      surface.indices.push_back(mc.m_Isosurface->viTriangles[i].x);
+      surface.indices.push_back(mc.m_Isosurface->viTriangles[i].y);
+      surface.indices.push_back(mc.m_Isosurface->viTriangles[i].z);
+    }
   }
 
-protected:
+  typedef std::unordered_map<uint64_t, uint32_t> WeldMap;
+
   T                  m_TIsoValue;
   uint32_t           m_iIndexoffset;
-  std::shared_ptr<MarchingCubes<T>> m_pMarchingCubes;
   UINT64VECTOR3      m_vDataSize;
   tuvok::AbstrGeoConverter* m_conv;
   FLOATVECTOR4       m_vColor;
   FLOATVECTOR3       m_vScale;
+  bool               m_bStreamOutput;
+  std::shared_ptr<tuvok::TriangleStream> m_stream;
+  /// edge key -> mesh index of the vertices that later bricks may share
+  WeldMap            m_weldMap;
+  /// the mesh, or in streaming mode the part not yet written
   tuvok::VertVec     m_vertices;
   tuvok::NormVec     m_normals;
   tuvok::IndexVec    m_indices;
@@ -1482,13 +1821,13 @@ bool IOManager::ExtractIsosurface(const tuvok::UVFDataset* pSourceData,
                                   uint64_t iLODlevel, double fIsovalue,
                                   const FLOATVECTOR4& vfColor,
                                   const string& strTargetFilename,
-                                  const string& strTempDir) const {
+                                  const string& /* strTempDir */,
+                                  bool bStreamOutput) const {
   if (pSourceData->GetComponentCount() != 1) {
     T_ERROR("Isosurface extraction only supported for scalar volumes.");
     return false;
   }
 
-  string strTempFilename = strTempDir + SysTools::GetFilename(strTargetFilename)+".tmp_raw";
   std::shared_ptr<MCData> pMCData;
 
   bool   bFloatingPoint  = pSourceData->GetIsFloat();
@@ -1510,11 +1849,11 @@ bool IOManager::ExtractIsosurface(const tuvok::UVFDataset* pSourceData,
       switch (iComponentSize) {
         case 32:
           pMCData.reset(new MCDataTemplate<float>(strTargetFilename,
-            float(fIsovalue), vScale, vDomainSize, conv, vfColor
+            float(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
         case 64:
           pMCData.reset(new MCDataTemplate<double>(strTargetFilename,
-            double(fIsovalue), vScale, vDomainSize, conv, vfColor
+            double(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
       }
     }
@@ -1523,38 +1862,38 @@ bool IOManager::ExtractIsosurface(const tuvok::UVFDataset* pSourceData,
       switch (iComponentSize) {
         case  8:
           pMCData.reset(new MCDataTemplate<char>(strTargetFilename,
-            char(fIsovalue), vScale, vDomainSize, conv, vfColor
+            char(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
         case 16:
           pMCData.reset(new MCDataTemplate<short>(strTargetFilename,
-            short(fIsovalue), vScale, vDomainSize, conv, vfColor
+            short(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
         case 32:
           pMCData.reset(new MCDataTemplate<int>(strTargetFilename,
-            int(fIsovalue), vScale, vDomainSize, conv, vfColor
+            int(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
         case 64:
           pMCData.reset(new MCDataTemplate<int64_t>(strTargetFilename,
-            int64_t(fIsovalue), vScale, vDomainSize, conv, vfColor
+            int64_t(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
       }
     } else {
       switch (iComponentSize) {
         case  8:
           pMCData.reset(new MCDataTemplate<unsigned char>(strTargetFilename,
-            (unsigned char)(fIsovalue), vScale, vDomainSize, conv, vfColor
+            (unsigned char)(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
         case 16:
           pMCData.reset(new MCDataTemplate<unsigned short>(strTargetFilename,
-            (unsigned short)(fIsovalue), vScale, vDomainSize, conv, vfColor
+            (unsigned short)(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
         case 32:
           pMCData.reset(new MCDataTemplate<uint32_t>(strTargetFilename,
-            uint32_t(fIsovalue), vScale, vDomainSize, conv, vfColor
+            uint32_t(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
         case 64:
           pMCData.reset(new MCDataTemplate<uint64_t>(strTargetFilename,
-            uint64_t(fIsovalue), vScale, vDomainSize, conv, vfColor
+            uint64_t(fIsovalue), vScale, vDomainSize, conv, vfColor, bStreamOutput
           )); break;
       }
     }
@@ -1565,10 +1904,7 @@ bool IOManager::ExtractIsosurface(const tuvok::UVFDataset* pSourceData,
     return false;
   }
 
-  bool bResult = pSourceData->ApplyFunction(iLODlevel,&MCBrick,
-                                            (void*)pMCData.get(), 1);
-
-  if (SysTools::FileExists(strTempFilename)) remove (strTempFilename.c_str());
+  bool bResult = pMCData->PerformMC(pSourceData, iLODlevel);
 
   if (bResult)
     return true;
@@ -2047,34 +2383,6 @@ bool IOManager::AnalyzeDataset(const string& strFilename, RangeInfo& info,
   }
 }
 
-struct MergeableDatasets : public std::binary_function<Dataset, Dataset, bool> {
-  bool operator()(const Dataset& a, const Dataset& b) const {
-    if(a.GetComponentCount() != b.GetComponentCount() ||
-       a.GetBrickOverlapSize() != b.GetBrickOverlapSize()) {
-      return false;
-    }
-
-    const uint64_t timesteps = a.GetNumberOfTimesteps();
-    if(timesteps != b.GetNumberOfTimesteps()) { return false; }
-
-    const unsigned LoDs = a.GetLODLevelCount();
-    if(LoDs != b.GetLODLevelCount()) { return false; }
-
-    for(uint64_t ts=0; ts < timesteps; ++ts) {
-      for(uint64_t level=0; level < LoDs; ++level) {
-        const size_t st_ts = static_cast<size_t>(ts);
-        const size_t st_level = static_cast<size_t>(level);
-        if(a.GetDomainSize() != b.GetDomainSize() ||
-           a.GetBrickCount(st_level, st_ts) != b.GetBrickCount(st_level, st_ts)) {
-          return false;
-        }
-      }
-    }
-
-    return true;
-  }
-};
-
 namespace {
   // interpolate a chunk of data into a new range.
   template<typename IForwIter, typename OForwIter, typename U>
@@ -175,11 +175,15 @@ public:
   bool ExportDataset(const tuvok::UVFDataset* pSourceData, uint64_t iLODlevel,
                      const std::string& strTargetFilename,
                      const std::string& strTempDir) const;
+  /// @param bStreamOutput write triangles while bricks are being processed
+  ///        if the target format supports it instead of building the whole
+  ///        mesh in memory first
   bool ExtractIsosurface(const tuvok::UVFDataset* pSourceData,
                          uint64_t iLODlevel, double fIsovalue,
                          const FLOATVECTOR4& vfColor,
                          const std::string& strTargetFilename,
-                         const std::string& strTempDir) const;
+                         const std::string& strTempDir,
+                         bool bStreamOutput = false) const;
   bool ExtractImageStack(const tuvok::UVFDataset* pSourceData,
                          const TransferFunction1D* pTrans,
                          uint64_t iLODlevel, 
@@ -253,6 +257,12 @@ public:
     m_iCompression = iCompression;
   }
 
+  /// picks a codec per brick instead of m_iCompression, see
+  /// ExtendedOctreeConverter::SetAdaptiveCompression
+  void SetAdaptiveCompression(bool bAdaptiveCompression) {
+    m_bAdaptiveCompression = bAdaptiveCompression;
+  }
+
   void SetCompressionLevel(uint32_t iCompressionLevel) {
     m_iCompressionLevel = iCompressionLevel;
   }
@@ -261,6 +271,21 @@ public:
     m_iLayout = iLayout;
   }
 
+  void SetPreFilter(uint32_t iPreFilter) {
+    m_iPreFilter = iPreFilter;
+  }
+
+  /// concurrent reads of the batched brick loads (Dataset::GetBricks, which
+  /// ReadRegion uses) of every octree opened from now on, see
+  /// ExtendedOctree::SetAsyncQueueDepth
+  void SetAsyncQueueDepth(uint32_t iQueueDepth);
+  uint32_t GetAsyncQueueDepth() const;
+
+  /// keeps conversions, merges and exports from flooding the page cache, see
+  /// tuvok::pagecache
+  void SetStreaming(bool bStreaming);
+  bool GetStreaming() const;
+
   bool GetClampToEdge() const {
     return m_bClampToEdge;
   }
@@ -280,6 +305,8 @@ private:
   uint32_t m_iCompression;
   uint32_t m_iCompressionLevel;
   uint32_t m_iLayout;
+  uint32_t m_iPreFilter;
+  bool m_bAdaptiveCompression;
   std::function<tuvok::Dataset* (const std::string&,
                                  tuvok::AbstrRenderer*)> m_LoadDS;
 
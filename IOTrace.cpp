@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "IOTrace.h"
+
+namespace tuvok {
+namespace iotrace {
+
+namespace {
+  struct Event {
+    uint64_t start;    ///< ns, see Now()
+    uint64_t duration; ///< ns, 0 for instant events
+    uint64_t arg;
+    uint32_t stage;
+  };
+
+  /// one entry of a ring.  The owner may overwrite it while a reader
+  /// copies it, so the fields are atomic and guarded by a sequence stamp:
+  /// 2n+1 while the n-th event of the thread is written, 2n+2 once it is
+  /// complete.  A reader keeps its copy only if the stamp was 2n+2 before
+  /// and after copying.
+  struct Slot {
+    Slot() : seq(0), start(0), duration(0), arg(0), stage(0) {}
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> duration;
+    std::atomic<uint64_t> arg;
+    std::atomic<uint32_t> stage;
+  };
+
+  /// ring buffer of one thread.  Only the owning thread writes to it; it
+  /// publishes events by bumping 'count'.
+  struct ThreadLog {
+    static const size_t capacity = 1 << 16;
+    explicit ThreadLog(uint32_t id) : tid(id), count(0), events(capacity) {}
+    const uint32_t tid;
+    std::atomic<uint64_t> count;
+    std::vector<Slot> events;
+  };
+
+  std::atomic<bool> enabled(false);
+  /// events which started before this are considered cleared.
+  std::atomic<uint64_t> cleared(0);
+  /// logs of all threads which ever recorded something; the logs outlive
+  /// their threads, so we can still export what they recorded.
+  std::mutex registry_guard;
+  std::vector<std::shared_ptr<ThreadLog>> registry;
+
+  ThreadLog& ThisThread() {
+    static thread_local std::shared_ptr<ThreadLog> log;
+    if(!log) {
+      std::lock_guard<std::mutex> lock(registry_guard);
+      log = std::make_shared<ThreadLog>(uint32_t(registry.size() + 1));
+      registry.push_back(log);
+    }
+    return *log;
+  }
+
+  void Push(Stage s, uint64_t iStart, uint64_t iDuration, uint64_t iArg) {
+    ThreadLog& log = ThisThread();
+    const uint64_t n = log.count.load(std::memory_order_relaxed);
+    Slot& e = log.events[size_t(n % ThreadLog::capacity)];
+    e.seq.store(2*n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.start.store(iStart, std::memory_order_relaxed);
+    e.duration.store(iDuration, std::memory_order_relaxed);
+    e.arg.store(iArg, std::memory_order_relaxed);
+    e.stage.store(uint32_t(s), std::memory_order_relaxed);
+    e.seq.store(2*n + 2, std::memory_order_release);
+    log.count.store(n + 1, std::memory_order_release);
+  }
+
+  struct ThreadEvents {
+    uint32_t tid;
+    std::vector<Event> events;
+  };
+
+  /// copies the n-th event of a thread out of its slot.
+  /// @returns false if the slot was overwritten (or was being written)
+  bool Copy(const Slot& slot, uint64_t n, Event& e) {
+    const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if(seq != 2*n + 2) return false;
+    e.start = slot.start.load(std::memory_order_relaxed);
+    e.duration = slot.duration.load(std::memory_order_relaxed);
+    e.arg = slot.arg.load(std::memory_order_relaxed);
+    e.stage = slot.stage.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == seq;
+  }
+
+  /// copies the events which are still in the rings.  Events which are
+  /// overwritten while we copy them are skipped; stop the I/O before
+  /// exporting for complete traces.
+  std::vector<ThreadEvents> Snapshot() {
+    std::vector<std::shared_ptr<ThreadLog>> logs;
+    {
+      std::lock_guard<std::mutex> lock(registry_guard);
+      logs = registry;
+    }
+    const uint64_t since = cleared.load();
+    std::vector<ThreadEvents> rv;
+    for(auto l = logs.cbegin(); l != logs.cend(); ++l) {
+      const ThreadLog& log = **l;
+      const uint64_t n = log.count.load(std::memory_order_acquire);
+      const uint64_t first = n > ThreadLog::capacity ?
+                             n - ThreadLog::capacity : 0;
+      ThreadEvents te;
+      te.tid = log.tid;
+      te.events.reserve(size_t(n - first));
+      for(uint64_t i = first; i < n; ++i) {
+        Event e;
+        if(Copy(log.events[size_t(i % ThreadLog::capacity)], i, e) &&
+           e.start >= since) {
+          te.events.push_back(e);
+        }
+      }
+      rv.push_back(te);
+    }
+    return rv;
+  }
+
+  bool IsInstant(uint32_t s) {
+    return s == TR_CACHE_HIT || s == TR_CACHE_MISS;
+  }
+}
+
+const char* StageName(Stage s) {
+  switch(s) {
+    case TR_DISK_READ:   return "disk_read";
+    case TR_DECODE:      return "decode";
+    case TR_CACHE_HIT:   return "cache_hit";
+    case TR_CACHE_MISS:  return "cache_miss";
+    case TR_SOURCE_READ: return "source_read";
+    case TR_COPY:        return "copy";
+    case TR_ENCODE:      return "encode";
+    case TR_STAGE_COUNT: break;
+  }
+  return "unknown";
+}
+
+void Enable(bool bEnable) { enabled.store(bEnable); }
+bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+void Clear() { cleared.store(Now()); }
+
+uint64_t Now() {
+  using namespace std::chrono;
+  return uint64_t(duration_cast<nanoseconds>(
+    steady_clock::now().time_since_epoch()
+  ).count());
+}
+
+void Record(Stage s, uint64_t iStart, uint64_t iArg) {
+  const uint64_t iEnd = Now();
+  Push(s, iStart, iEnd > iStart ? iEnd - iStart : 0, iArg);
+}
+
+void Instant(Stage s, uint64_t iArg) {
+  Push(s, Now(), 0, iArg);
+}
+
+bool WriteChromeTrace(const std::string& strFilename) {
+  const std::vector<ThreadEvents> threads = Snapshot();
+  uint64_t t0 = std::numeric_limits<uint64_t>::max();
+  for(auto t = threads.cbegin(); t != threads.cend(); ++t) {
+    for(auto e = t->events.cbegin(); e != t->events.cend(); ++e) {
+      t0 = std::min(t0, e->start);
+    }
+  }
+
+  std::ofstream out(strFilename.c_str());
+  if(!out) return false;
+  out << "{\"traceEvents\":[\n" << std::fixed << std::setprecision(3);
+  bool bFirst = true;
+  for(auto t = threads.cbegin(); t != threads.cend(); ++t) {
+    for(auto e = t->events.cbegin(); e != t->events.cend(); ++e) {
+      out << (bFirst ? "" : ",\n") << "{\"name\":\""
+          << StageName(Stage(e->stage)) << "\",\"cat\":\"io\",\"pid\":1,"
+          << "\"tid\":" << t->tid << ",\"ts\":" << (e->start - t0) / 1000.0;
+      if(IsInstant(e->stage)) {
+        out << ",\"ph\":\"i\",\"s\":\"t\"";
+      } else {
+        out << ",\"ph\":\"X\",\"dur\":" << e->duration / 1000.0;
+      }
+      out << ",\"args\":{\"arg\":" << e->arg << "}}";
+      bFirst = false;
+    }
+  }
+  out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+  return bool(out);
+}
+
+bool WriteSummary(const std::string& strFilename) {
+  std::vector<std::vector<uint64_t>> durations(TR_STAGE_COUNT);
+  const std::vector<ThreadEvents> threads = Snapshot();
+  for(auto t = threads.cbegin(); t != threads.cend(); ++t) {
+    for(auto e = t->events.cbegin(); e != t->events.cend(); ++e) {
+      if(e->stage < TR_STAGE_COUNT) {
+        durations[e->stage].push_back(e->duration);
+      }
+    }
+  }
+
+  std::ofstream out(strFilename.c_str());
+  if(!out) return false;
+  out << "{\n  \"stages\": {";
+  bool bFirst = true;
+  for(uint32_t s = 0; s < TR_STAGE_COUNT; ++s) {
+    std::vector<uint64_t>& d = durations[s];
+    if(d.empty()) continue;
+    out << (bFirst ? "\n" : ",\n") << "    \"" << StageName(Stage(s))
+        << "\": {\"count\": " << d.size();
+    bFirst = false;
+    if(IsInstant(s)) { out << "}"; continue; }
+
+    std::sort(d.begin(), d.end());
+    uint64_t iTotal = 0;
+    for(auto i = d.cbegin(); i != d.cend(); ++i) iTotal += *i;
+    const auto pct = [&d](double p) {
+      return d[std::min(d.size() - 1, size_t(p * double(d.size())))];
+    };
+    out << ", \"total_ns\": " << iTotal
+        << ", \"min_ns\": " << d.front() << ", \"max_ns\": " << d.back()
+        << ", \"mean_ns\": " << iTotal / d.size()
+        << ", \"p50_ns\": " << pct(0.5) << ", \"p90_ns\": " << pct(0.9)
+        << ", \"p99_ns\": " << pct(0.99);
+
+    // log2 buckets: [2^b, 2^(b+1)) ns, written as upper bound -> count
+    std::vector<uint64_t> hist(63, 0);
+    for(auto i = d.cbegin(); i != d.cend(); ++i) {
+      size_t b = 0;
+      for(uint64_t v = *i; v > 1; v >>= 1) ++b;
+      ++hist[std::min<size_t>(b, 62)];
+    }
+    out << ", \"histogram\": [";
+    bool bFirstBucket = true;
+    for(size_t b = 0; b < hist.size(); ++b) {
+      if(hist[b] == 0) continue;
+      out << (bFirstBucket ? "" : ", ") << "[" << (uint64_t(1) << (b+1))
+          << ", " << hist[b] << "]";
+      bFirstBucket = false;
+    }
+    out << "]}";
+  }
+  out << "\n  }\n}\n";
+  return bool(out);
+}
+
+} // namespace iotrace
+} // namespace tuvok
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Scientific Computing and Imaging Institute,
+   University of Utah.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
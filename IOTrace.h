@@ -0,0 +1,110 @@
+#ifndef TUVOK_IO_TRACE_H
+#define TUVOK_IO_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+namespace tuvok {
+/// Low overhead event recording for the brick I/O paths.
+/// Every thread records into its own ring buffer, so recording takes no
+/// locks and formats no strings; everything is turned into text only when
+/// the trace is written out.  The IO_TRACE_* macros compile to nothing
+/// unless TUVOK_IO_TRACE is defined, and record nothing until Enable(true)
+/// is called.
+namespace iotrace {
+
+enum Stage {
+  TR_DISK_READ=0, ///< reading (compressed) brick data from disk
+  TR_DECODE,      ///< decompressing / unfiltering a brick
+  TR_CACHE_HIT,   ///< rebricking: source brick was cached (instant)
+  TR_CACHE_MISS,  ///< rebricking: source brick had to be read (instant)
+  TR_SOURCE_READ, ///< rebricking: reading a source brick
+  TR_COPY,        ///< rebricking: copying a target brick out of its source
+  TR_ENCODE,      ///< conversion: compressing a brick
+  TR_STAGE_COUNT
+};
+
+/// @returns a short, printable name of the stage
+const char* StageName(Stage s);
+
+/// switches recording on or off at run time (off by default).
+void Enable(bool bEnable);
+bool Enabled();
+/// drops all events recorded so far.
+void Clear();
+
+/// records an event which started at 'iStart' (see Now) and ended now.
+void Record(Stage s, uint64_t iStart, uint64_t iArg);
+/// records an event without duration.
+void Instant(Stage s, uint64_t iArg);
+/// @returns a monotonic time stamp in nanoseconds
+uint64_t Now();
+
+/// Writes all events in Chrome's trace event format; load the result in
+/// chrome://tracing or Perfetto.
+bool WriteChromeTrace(const std::string& strFilename);
+/// Writes per stage latency statistics (count, min/max/mean, percentiles
+/// and a log2 histogram of the durations) as JSON.
+bool WriteSummary(const std::string& strFilename);
+
+/// times the enclosing scope, if recording is enabled.
+class Scope {
+public:
+  Scope(Stage s, uint64_t iArg=0) : m_eStage(s), m_iArg(iArg),
+                                    m_iStart(Enabled() ? Now() : 0) {}
+  ~Scope() { if(m_iStart != 0) Record(m_eStage, m_iStart, m_iArg); }
+private:
+  Scope(const Scope&);
+  Scope& operator=(const Scope&);
+  const Stage m_eStage;
+  const uint64_t m_iArg;
+  const uint64_t m_iStart;
+};
+
+} // namespace iotrace
+} // namespace tuvok
+
+#ifdef TUVOK_IO_TRACE
+# define IO_TRACE_CONCAT2(a, b) a##b
+# define IO_TRACE_CONCAT(a, b) IO_TRACE_CONCAT2(a, b)
+# define IO_TRACE_SCOPE(stage, arg) \
+    tuvok::iotrace::Scope IO_TRACE_CONCAT(iotrace_scope_, __LINE__)( \
+      tuvok::iotrace::stage, (arg))
+# define IO_TRACE_INSTANT(stage, arg) \
+    do { \
+      if(tuvok::iotrace::Enabled()) \
+        tuvok::iotrace::Instant(tuvok::iotrace::stage, (arg)); \
+    } while(0)
+#else
+# define IO_TRACE_SCOPE(stage, arg) do { } while(0)
+# define IO_TRACE_INSTANT(stage, arg) do { } while(0)
+#endif
+
+#endif // TUVOK_IO_TRACE_H
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Scientific Computing and Imaging Institute,
+   University of Utah.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
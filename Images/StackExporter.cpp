@@ -33,7 +33,10 @@
         University of Utah
 */
 #include "StdTuvokDefines.h"
+#include <cstring>
+#include <iomanip>
 #include <memory>
+#include <sstream>
 
 #ifndef TUVOK_NO_QT
  #include <QtGui/QImage>
@@ -41,6 +44,7 @@
 #endif
 
 #include "StackExporter.h"
+#include "../LinearIndexDataset.h"
 #include "Basics/SysTools.h"
 #include "Basics/LargeRAWFile.h"
 #include "Basics/nonstd.h"
@@ -76,6 +80,7 @@ bool StackExporter::WriteImage(unsigned char* pData,
     if (!out.Create()) return false;
     out.WriteRAW(pData, vSize.area()*iComponentCount);
     out.Close();
+    return true;
   }
 
 #ifndef TUVOK_NO_QT
@@ -138,9 +143,7 @@ bool StackExporter::WriteSlice(unsigned char* pData,
     }
 
     // write data to disk
-    std::string strCurrentTargetFilename = SysTools::FindNextSequenceName(strCurrentDiFilename);
-
-    return WriteImage(pData,strCurrentTargetFilename, vSize, iImageCompCount);
+    return WriteImage(pData,strCurrentDiFilename, vSize, iImageCompCount);
 }
 
 
@@ -232,7 +235,7 @@ bool StackExporter::WriteStacks(const std::string& strRAWFilename,
         }
       }
 
-      if (!WriteSlice(data.get(), pTrans, iBitWidth, strCurrentDirTargetFilename, vSize, fRescale, iComponentCount)) {
+      if (!WriteSlice(data.get(), pTrans, iBitWidth, SysTools::FindNextSequenceName(strCurrentDirTargetFilename), vSize, fRescale, iComponentCount)) {
         T_ERROR("Unable to write stack image %llu.",x);
         dataSource.Close();
         return false;
@@ -251,7 +254,7 @@ bool StackExporter::WriteStacks(const std::string& strRAWFilename,
         offset += vDomainSize.x*elemSize;
       }
 
-      if (!WriteSlice(data.get(), pTrans, iBitWidth, strCurrentDirTargetFilename, vSize, fRescale, iComponentCount)) {
+      if (!WriteSlice(data.get(), pTrans, iBitWidth, SysTools::FindNextSequenceName(strCurrentDirTargetFilename), vSize, fRescale, iComponentCount)) {
         T_ERROR("Unable to write stack image %llu.",y);
         dataSource.Close();
         return false;
@@ -270,7 +273,7 @@ bool StackExporter::WriteStacks(const std::string& strRAWFilename,
 
     dataSource.ReadRAW(data.get(), vDomainSize.x*vDomainSize.y*elemSize);
 
-    if (!WriteSlice(data.get(), pTrans, iBitWidth, strCurrentDirTargetFilename, vSize, fRescale, iComponentCount)) {
+    if (!WriteSlice(data.get(), pTrans, iBitWidth, SysTools::FindNextSequenceName(strCurrentDirTargetFilename), vSize, fRescale, iComponentCount)) {
       T_ERROR("Unable to write stack image %llu.",z);
       dataSource.Close();
       return false;
@@ -280,3 +283,195 @@ bool StackExporter::WriteStacks(const std::string& strRAWFilename,
   dataSource.Close();
   return true;
 }
+
+
+/*
+  ReadSlab:
+
+  Copies the part of every brick of slab iSlab along iAxis into pSlab that
+  is not overlap, pSlab is a dense vSlabSize volume whose origin is at
+  vSlabOffset in the LoD.
+*/
+bool StackExporter::ReadSlab(const tuvok::LinearIndexDataset& ds,
+                             size_t iLOD, size_t iAxis, unsigned int iSlab,
+                             const UINT64VECTOR3& vSlabOffset,
+                             const UINT64VECTOR3& vSlabSize,
+                             size_t iElemSize,
+                             unsigned char* pSlab) {
+  const UINTVECTOR3 vLayout = ds.GetBrickLayout(iLOD, 0);
+  const UINTVECTOR3 vOverlap = ds.GetBrickOverlapSize();
+  const UINT64VECTOR3 vBrickStride =
+    ds.GetEffectiveBrickSize(tuvok::BrickKey(0, iLOD, 0));
+
+  unsigned int vFirst[3] = {0, 0, 0};
+  unsigned int vEnd[3] = {vLayout.x, vLayout.y, vLayout.z};
+  vFirst[iAxis] = iSlab;
+  vEnd[iAxis] = iSlab+1;
+
+  std::vector<uint8_t> vBrick;
+  for (unsigned int bz = vFirst[2]; bz < vEnd[2]; ++bz) {
+    for (unsigned int by = vFirst[1]; by < vEnd[1]; ++by) {
+      for (unsigned int bx = vFirst[0]; bx < vEnd[0]; ++bx) {
+        const tuvok::BrickKey k =
+          ds.IndexFrom4D(UINTVECTOR4(bx, by, bz, unsigned(iLOD)), 0);
+        if (!ds.GetBrick(k, vBrick)) return false;
+
+        const UINT64VECTOR3 vBrickSize(ds.GetBrickVoxelCounts(k));
+        const UINT64VECTOR3 vInner = vBrickSize - UINT64VECTOR3(vOverlap)*2;
+        const UINT64VECTOR3 vTarget =
+          UINT64VECTOR3(bx, by, bz) * vBrickStride - vSlabOffset;
+
+        const size_t iRowSize = size_t(vInner.x) * iElemSize;
+        for (uint64_t z = 0; z < vInner.z; ++z) {
+          for (uint64_t y = 0; y < vInner.y; ++y) {
+            const uint64_t iSource = vOverlap.x +
+                                     (y + vOverlap.y) * vBrickSize.x +
+                                     (z + vOverlap.z) * vBrickSize.x *
+                                                        vBrickSize.y;
+            const uint64_t iDest = vTarget.x +
+                                   (y + vTarget.y) * vSlabSize.x +
+                                   (z + vTarget.z) * vSlabSize.x *
+                                                     vSlabSize.y;
+            memcpy(pSlab + size_t(iDest) * iElemSize,
+                   &vBrick[size_t(iSource) * iElemSize], iRowSize);
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/*
+  WriteSlab:
+
+  Writes every slice of the slab perpendicular to iAxis, the slices keep
+  the orientation of the raw based exporter (x: z/y, y: x/z, z: x/y). The
+  slices are independent so they are gathered and encoded in parallel,
+  file names carry the absolute slice index so the result does not
+  depend on the order in which the threads finish.
+*/
+bool StackExporter::WriteSlab(const unsigned char* pSlab,
+                              const UINT64VECTOR3& vSlabSize,
+                              size_t iAxis, uint64_t iFirstSlice,
+                              const std::string& strTargetFilename,
+                              const TransferFunction1D* pTrans,
+                              uint64_t iBitWidth,
+                              uint64_t iComponentCount,
+                              float fRescale) {
+  static const size_t iColAxis[3] = {2, 0, 0};
+  static const size_t iRowAxis[3] = {1, 2, 1};
+
+  const uint64_t vSize[3] = {vSlabSize.x, vSlabSize.y, vSlabSize.z};
+  const size_t iElemSize = size_t(iComponentCount * iBitWidth/8);
+  const size_t vStride[3] = {
+    iElemSize,
+    iElemSize * size_t(vSlabSize.x),
+    iElemSize * size_t(vSlabSize.x * vSlabSize.y)
+  };
+  const size_t c = iColAxis[iAxis];
+  const size_t r = iRowAxis[iAxis];
+  const UINT64VECTOR2 vImageSize(vSize[c], vSize[r]);
+
+  bool bResult = true;
+#pragma omp parallel
+  {
+    // WriteSlice expands the data to RGBA in place
+    std::vector<unsigned char> vSlice(size_t(4*vImageSize.area()*(iBitWidth/8)));
+
+#pragma omp for schedule(dynamic)
+    for (int s = 0; s < int(vSize[iAxis]); ++s) {
+      unsigned char* pTarget = &vSlice[0];
+      const unsigned char* pSource = pSlab + size_t(s) * vStride[iAxis];
+      for (uint64_t row = 0; row < vImageSize.y; ++row) {
+        const unsigned char* pRow = pSource + size_t(row) * vStride[r];
+        if (c == 0) {
+          memcpy(pTarget, pRow, size_t(vImageSize.x) * iElemSize);
+          pTarget += size_t(vImageSize.x) * iElemSize;
+        } else {
+          for (uint64_t col = 0; col < vImageSize.x; ++col) {
+            memcpy(pTarget, pRow + size_t(col) * vStride[c], iElemSize);
+            pTarget += iElemSize;
+          }
+        }
+      }
+
+      std::ostringstream index;
+      index << std::setw(5) << std::setfill('0') << (iFirstSlice + s);
+      if (!WriteSlice(&vSlice[0], pTrans, iBitWidth,
+                      SysTools::AppendFilename(strTargetFilename, index.str()),
+                      vImageSize, fRescale, iComponentCount)) {
+#pragma omp critical(StackExporterError)
+        bResult = false;
+      }
+    }
+  }
+  return bResult;
+}
+
+bool StackExporter::WriteStacks(const tuvok::LinearIndexDataset& ds,
+                                uint64_t iLODlevel,
+                                const std::string& strTargetFilename,
+                                const TransferFunction1D* pTrans,
+                                float fRescale,
+                                bool bAllDirs) {
+  const uint64_t iBitWidth = ds.GetBitWidth();
+  const uint64_t iComponentCount = ds.GetComponentCount();
+  if (iComponentCount > 4)  {
+    T_ERROR("Invalid channel count, no more than four components are accepted by the stack exporter.");
+    return false;
+  }
+  if (iBitWidth != 8 && iComponentCount > 1) {
+    T_ERROR("Invalid bit depth, only 8bit data is accepted by the stack exporter for multi channel data.");
+    return false;
+  }
+
+  const size_t iLOD = size_t(iLODlevel);
+  const size_t iElemSize = size_t(iComponentCount * iBitWidth/8);
+  const UINT64VECTOR3 vDomainSize = ds.GetDomainSize(iLOD);
+  const UINTVECTOR3 vLayout = ds.GetBrickLayout(iLOD, 0);
+  const UINT64VECTOR3 vBrickStride =
+    ds.GetEffectiveBrickSize(tuvok::BrickKey(0, iLOD, 0));
+
+  const uint64_t vDomain[3] = {vDomainSize.x, vDomainSize.y, vDomainSize.z};
+  const unsigned int vBricks[3] = {vLayout.x, vLayout.y, vLayout.z};
+  const uint64_t vStride[3] = {vBrickStride.x, vBrickStride.y, vBrickStride.z};
+  const char* pSuffix[3] = {"_x", "_y", "_z"};
+
+  std::vector<unsigned char> vSlab;
+  for (size_t iAxis = bAllDirs ? 0 : 2; iAxis < 3; ++iAxis) {
+    const std::string strDirFilename = bAllDirs ?
+      SysTools::AppendFilename(strTargetFilename, pSuffix[iAxis]) :
+      strTargetFilename;
+
+    for (unsigned int iSlab = 0; iSlab < vBricks[iAxis]; ++iSlab) {
+      uint64_t vOffset[3] = {0, 0, 0};
+      uint64_t vSize[3] = {vDomain[0], vDomain[1], vDomain[2]};
+      vOffset[iAxis] = iSlab * vStride[iAxis];
+      vSize[iAxis] = std::min(vStride[iAxis], vDomain[iAxis]-vOffset[iAxis]);
+      const UINT64VECTOR3 vSlabOffset(vOffset[0], vOffset[1], vOffset[2]);
+      const UINT64VECTOR3 vSlabSize(vSize[0], vSize[1], vSize[2]);
+
+      MESSAGE("Exporting %s-Axis Stack. Processing Images %llu to %llu of %llu",
+              iAxis == 0 ? "X" : (iAxis == 1 ? "Y" : "Z"),
+              vOffset[iAxis]+1, vOffset[iAxis]+vSize[iAxis], vDomain[iAxis]);
+
+      vSlab.resize(size_t(vSlabSize.volume()) * iElemSize);
+      if (!ReadSlab(ds, iLOD, iAxis, iSlab, vSlabOffset, vSlabSize,
+                    iElemSize, &vSlab[0])) {
+        T_ERROR("Unable to read brick data.");
+        return false;
+      }
+
+      if (!WriteSlab(&vSlab[0], vSlabSize, iAxis, vOffset[iAxis],
+                     strDirFilename, pTrans, iBitWidth, iComponentCount,
+                     fRescale)) {
+        T_ERROR("Unable to write stack images %llu to %llu.",
+                vOffset[iAxis], vOffset[iAxis]+vSize[iAxis]-1);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
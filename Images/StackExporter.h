@@ -44,6 +44,8 @@
 #include "../Basics/Vectors.h"
 #include "../TransferFunction1D.h"
 
+namespace tuvok { class LinearIndexDataset; }
+
 class StackExporter 
 {
 public:
@@ -59,6 +61,17 @@ public:
                           UINT64VECTOR3 vDomainSize,
                           bool bAllDirs);
 
+  /// writes the stacks directly from the bricks of a dataset without an
+  /// intermediate raw file. The volume is assembled one slab of bricks at
+  /// a time, every brick is read once per stack and the slices of a slab
+  /// are encoded in parallel.
+  static bool WriteStacks(const tuvok::LinearIndexDataset& ds,
+                          uint64_t iLODlevel,
+                          const std::string& strTargetFilename,
+                          const TransferFunction1D* pTrans,
+                          float fRescale,
+                          bool bAllDirs);
+
   static bool WriteImage(unsigned char* pData,
                   const std::string& strTargetFilename,
                   const UINT64VECTOR2& vSize,
@@ -93,6 +106,22 @@ protected:
                   unsigned int iPadcount,
                   unsigned char iValue);
 
+  static bool ReadSlab(const tuvok::LinearIndexDataset& ds,
+                       size_t iLOD, size_t iAxis, unsigned int iSlab,
+                       const UINT64VECTOR3& vSlabOffset,
+                       const UINT64VECTOR3& vSlabSize,
+                       size_t iElemSize,
+                       unsigned char* pSlab);
+
+  static bool WriteSlab(const unsigned char* pSlab,
+                        const UINT64VECTOR3& vSlabSize,
+                        size_t iAxis, uint64_t iFirstSlice,
+                        const std::string& strTargetFilename,
+                        const TransferFunction1D* pTrans,
+                        uint64_t iBitWidth,
+                        uint64_t iComponentCount,
+                        float fRescale);
+
   static bool WriteSlice(unsigned char* pData,
                   const TransferFunction1D* pTrans,
                   uint64_t iBitWidth,
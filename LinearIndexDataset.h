@@ -1,6 +1,10 @@
 #ifndef TUVOK_LINEAR_INDEX_DATASET_H
 #define TUVOK_LINEAR_INDEX_DATASET_H
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "BrickedDataset.h"
 
 namespace tuvok {
@@ -24,8 +28,146 @@ class LinearIndexDataset : public BrickedDataset {
     virtual BrickKey IndexFrom4D(const UINTVECTOR4& four,
                                  size_t timestep) const;
     virtual UINTVECTOR4 IndexTo4D(const BrickKey& key) const;
+
+    /// @returns true if GetBrick may be called from several threads at the
+    /// same time. Most file backends share a file position, so the default
+    /// is false.
+    virtual bool ConcurrentBrickReads() const { return false; }
+
+    /// Reads an axis aligned subvolume of the given LoD into a dense array.
+    /// Only the bricks that intersect the region are read, their overlap is
+    /// stripped and the pieces are copied into place in parallel. Bricks are
+    /// fetched in batches through GetBricks, so the read benefits from any
+    /// brick cache the dataset keeps and from reads that span several
+    /// bricks.
+    /// @param lod the level of detail, 0 is the finest
+    /// @param timestep the timestep to read from
+    /// @param vOffset first voxel of the region within the LoD
+    /// @param vSize size of the region in voxels
+    /// @param pOut receives vSize.volume()*GetComponentCount() values in
+    ///        x,y,z order, T must match the bit width of the data
+    /// @returns false if the region does not fit into the LoD, T does not
+    ///          match the data or a brick could not be read
+    template<class T>
+    bool ReadRegion(size_t lod, size_t timestep,
+                    const UINT64VECTOR3& vOffset, const UINT64VECTOR3& vSize,
+                    T* pOut) const;
 };
 
+template<class T>
+bool LinearIndexDataset::ReadRegion(size_t lod, size_t timestep,
+                                    const UINT64VECTOR3& vOffset,
+                                    const UINT64VECTOR3& vSize,
+                                    T* pOut) const {
+  if(sizeof(T)*8 != GetBitWidth() || vSize.volume() == 0) { return false; }
+  const UINT64VECTOR3 vDomain = GetDomainSize(lod, timestep);
+  for(size_t i=0; i < 3; ++i) {
+    if(vOffset[i] + vSize[i] > vDomain[i]) { return false; }
+  }
+
+  const UINTVECTOR3 vLayout = GetBrickLayout(lod, timestep);
+  const UINT64VECTOR3 vOverlap(GetBrickOverlapSize());
+  const UINT64VECTOR3 vStride =
+    GetEffectiveBrickSize(BrickKey(timestep, lod, 0));
+  const size_t iComponents = static_cast<size_t>(GetComponentCount());
+  const UINT64VECTOR3 vEnd = vOffset + vSize;
+
+  // the bricks whose inner (non-overlap) region intersects the request
+  std::vector<UINTVECTOR3> vBricks;
+  UINT64VECTOR3 vFirst, vLast;
+  for(size_t i=0; i < 3; ++i) {
+    vFirst[i] = vOffset[i] / vStride[i];
+    vLast[i] = std::min<uint64_t>((vEnd[i]-1) / vStride[i], vLayout[i]-1);
+  }
+  for(uint64_t z=vFirst.z; z <= vLast.z; ++z) {
+    for(uint64_t y=vFirst.y; y <= vLast.y; ++y) {
+      for(uint64_t x=vFirst.x; x <= vLast.x; ++x) {
+        vBricks.push_back(UINTVECTOR3(unsigned(x), unsigned(y), unsigned(z)));
+      }
+    }
+  }
+
+  // the bricks are read in small batches, so backends can fetch bricks which
+  // lie next to each other on disk with one read (see GetBricks). Each thread
+  // reads its batches and copies them into place; backends that are not
+  // thread safe read one batch at a time, then only the copy runs in
+  // parallel. A batch holds at most 16 bricks or 16 MB, and small regions
+  // are still spread over all cores.
+  const size_t iBrickElems =
+    size_t(GetMaxBrickSize().volume()) * iComponents;
+  const size_t iThreads =
+    std::max<size_t>(1, std::thread::hardware_concurrency());
+  const size_t iBatch = std::max<size_t>(1, std::min<size_t>(
+    std::min<size_t>(16, (size_t(16) << 20) / (iBrickElems * sizeof(T))),
+    (vBricks.size() + iThreads - 1) / iThreads));
+  const int iBatches = int((vBricks.size() + iBatch - 1) / iBatch);
+  const bool bSerialReads = !ConcurrentBrickReads();
+  std::atomic<bool> bOK(true);
+#pragma omp parallel
+  {
+    std::vector<T> vData;
+    std::vector<BrickKey> vKeys;
+    std::vector<void*> vTargets;
+#pragma omp for schedule(dynamic)
+    for(int c=0; c < iBatches; ++c) {
+      if(!bOK) { continue; }
+      const size_t iFirst = size_t(c) * iBatch;
+      const size_t iCount = std::min(iBatch, vBricks.size() - iFirst);
+      vData.resize(iCount * iBrickElems);
+      vKeys.clear();
+      vTargets.clear();
+      for(size_t i=0; i < iCount; ++i) {
+        const UINTVECTOR3& b = vBricks[iFirst + i];
+        vKeys.push_back(IndexFrom4D(UINTVECTOR4(b.x, b.y, b.z, unsigned(lod)),
+                                    timestep));
+        vTargets.push_back(&vData[i * iBrickElems]);
+      }
+
+      bool bRead;
+      if(bSerialReads) {
+#pragma omp critical(ReadRegionBrick)
+        bRead = GetBricks(vKeys, vTargets, iBrickElems * sizeof(T));
+      } else {
+        bRead = GetBricks(vKeys, vTargets, iBrickElems * sizeof(T));
+      }
+      if(!bRead) {
+        bOK = false;
+        continue;
+      }
+
+      for(size_t i=0; i < iCount; ++i) {
+        const UINTVECTOR3& b = vBricks[iFirst + i];
+        const UINT64VECTOR3 vBrickSize(GetBrickVoxelCounts(vKeys[i]));
+        const T* pBrick = &vData[i * iBrickElems];
+
+        // intersection of the request with the inner region of the brick
+        const UINT64VECTOR3 vOrigin = UINT64VECTOR3(b) * vStride;
+        UINT64VECTOR3 vLo, vHi;
+        for(size_t j=0; j < 3; ++j) {
+          vLo[j] = std::max(vOffset[j], vOrigin[j]);
+          vHi[j] = std::min(vEnd[j],
+                            vOrigin[j] + vBrickSize[j] - 2*vOverlap[j]);
+        }
+
+        const size_t iRow = size_t(vHi.x - vLo.x) * iComponents;
+        for(uint64_t z=vLo.z; z < vHi.z; ++z) {
+          for(uint64_t y=vLo.y; y < vHi.y; ++y) {
+            const uint64_t iSource = (vLo.x - vOrigin.x + vOverlap.x) +
+              (y - vOrigin.y + vOverlap.y) * vBrickSize.x +
+              (z - vOrigin.z + vOverlap.z) * vBrickSize.x * vBrickSize.y;
+            const uint64_t iTarget = (vLo.x - vOffset.x) +
+              (y - vOffset.y) * vSize.x +
+              (z - vOffset.z) * vSize.x * vSize.y;
+            const T* src = pBrick + size_t(iSource) * iComponents;
+            std::copy(src, src + iRow, pOut + size_t(iTarget) * iComponents);
+          }
+        }
+      }
+    }
+  }
+  return bOK;
+}
+
 }
 #endif
 /*
@@ -392,3 +392,70 @@ bool OBJGeoConverter::ConvertToNative(const Mesh& m,
 
   return true;
 }
+
+namespace {
+  /// writes vertices, normals and faces as they arrive, OBJ allows these to
+  /// be interleaved as long as a face only references earlier vertices
+  class OBJTriangleStream : public TriangleStream {
+  public:
+    OBJTriangleStream(const std::string& strTargetFilename,
+                      const std::string& strDesc) :
+      m_outStream(strTargetFilename.c_str()),
+      m_iVertices(0),
+      m_iTriangles(0)
+    {
+      m_outStream << "# " << strDesc << std::endl;
+    }
+
+    bool IsOpen() const { return m_outStream.is_open() && !m_outStream.fail(); }
+
+    virtual bool Append(const VertVec& vertices, const VertVec& normals,
+                        const IndexVec& indices) {
+      for (size_t i = 0;i<vertices.size();i++) {
+        m_outStream << "v "
+                    << vertices[i].x << " "
+                    << vertices[i].y << " "
+                    << vertices[i].z << "\n";
+      }
+      for (size_t i = 0;i<normals.size();i++) {
+        m_outStream << "vn "
+                    << normals[i].x << " "
+                    << normals[i].y << " "
+                    << normals[i].z << "\n";
+      }
+      // vertices and normals are appended in lockstep so they share indices
+      for (size_t i = 0;i+2<indices.size();i+=3) {
+        m_outStream << "f "
+                    << indices[i]+1   << "//" << indices[i]+1   << " "
+                    << indices[i+1]+1 << "//" << indices[i+1]+1 << " "
+                    << indices[i+2]+1 << "//" << indices[i+2]+1 << "\n";
+      }
+      m_iVertices += vertices.size();
+      m_iTriangles += indices.size()/3;
+      return !m_outStream.fail();
+    }
+
+    virtual bool Close() {
+      if (!m_outStream.is_open()) return false;
+      m_outStream << "# Vertices: " << m_iVertices << std::endl;
+      m_outStream << "# Primitives: " << m_iTriangles << std::endl;
+      m_outStream.close();
+      return !m_outStream.fail();
+    }
+
+  private:
+    std::ofstream m_outStream;
+    uint64_t      m_iVertices;
+    uint64_t      m_iTriangles;
+  };
+}
+
+std::shared_ptr<TriangleStream>
+OBJGeoConverter::CreateTriangleStream(const std::string& strTargetFilename,
+                                      const std::string& strDesc) const {
+  std::shared_ptr<OBJTriangleStream> stream(
+    new OBJTriangleStream(strTargetFilename, strDesc)
+  );
+  if (!stream->IsOpen()) return std::shared_ptr<TriangleStream>();
+  return stream;
+}
@@ -50,6 +50,10 @@ namespace tuvok {
       ConvertToMesh(const std::string& strFilename);
     virtual bool ConvertToNative(const Mesh& m,
                                  const std::string& strTargetFilename);
+    virtual std::shared_ptr<TriangleStream> CreateTriangleStream(
+      const std::string& strTargetFilename, const std::string& strDesc
+    ) const;
+    virtual bool CanStreamTriangles() const { return true; }
 
     virtual bool CanExportData() const { return true; }
     virtual bool CanImportData() const { return true; }
@@ -0,0 +1,113 @@
+#include "PageCache.h"
+#ifdef __linux__
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace tuvok {
+namespace pagecache {
+
+namespace {
+  std::atomic<bool> streaming(false);
+
+#ifdef __linux__
+  int OpenForAdvice(const std::string& strFilename) {
+    // the advice applies to the file, not to the descriptor it is given on
+    return open(strFilename.c_str(), O_RDONLY | O_CLOEXEC);
+  }
+
+  void DropPages(int fd, bool bWriteBack) {
+    if(bWriteBack) fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+#endif
+}
+
+void SetStreaming(bool bStreaming) { streaming.store(bStreaming); }
+bool Streaming() { return streaming.load(); }
+
+bool Drop(const std::string& strFilename, bool bWriteBack) {
+#ifdef __linux__
+  const int fd = OpenForAdvice(strFilename);
+  if(fd < 0) return false;
+  DropPages(fd, bWriteBack);
+  close(fd);
+  return true;
+#else
+  (void)strFilename; (void)bWriteBack;
+  return false;
+#endif
+}
+
+Stream::Stream() : m_iFD(-1), m_iWindow(DefaultWindow), m_iBytes(0) {}
+
+Stream::Stream(const std::string& strFilename, uint64_t iWindow) :
+  m_iFD(-1), m_iWindow(iWindow), m_iBytes(0)
+{
+  Open(strFilename, iWindow);
+}
+
+Stream::~Stream() { Close(); }
+
+void Stream::Open(const std::string& strFilename, uint64_t iWindow) {
+  Close();
+  m_iWindow = iWindow > 0 ? iWindow : DefaultWindow;
+  m_iBytes = 0;
+#ifdef __linux__
+  if(Streaming()) m_iFD = OpenForAdvice(strFilename);
+#else
+  (void)strFilename;
+#endif
+}
+
+void Stream::Close() {
+#ifdef __linux__
+  if(m_iFD >= 0) {
+    DropPages(m_iFD, false);
+    close(m_iFD);
+  }
+#endif
+  m_iFD = -1;
+}
+
+void Stream::Advance(uint64_t iBytes) {
+  if(m_iFD < 0) return;
+  const uint64_t iBefore = m_iBytes.fetch_add(iBytes,
+                                              std::memory_order_relaxed);
+#ifdef __linux__
+  if(iBefore / m_iWindow != (iBefore + iBytes) / m_iWindow)
+    DropPages(m_iFD, false);
+#else
+  (void)iBefore;
+#endif
+}
+
+} // namespace pagecache
+} // namespace tuvok
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Scientific Computing and Imaging Institute,
+   University of Utah.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
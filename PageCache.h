@@ -0,0 +1,95 @@
+#ifndef TUVOK_PAGE_CACHE_H
+#define TUVOK_PAGE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace tuvok {
+/// Keeps bulk conversions from flooding the operating system's page cache.
+/// A conversion streams the source, its temporary files and the output
+/// through the cache exactly once (or, for the bricked temp data, in an
+/// order the converter's own brick cache already covers), so keeping those
+/// pages around only evicts the working set of everything else running on
+/// the machine.  In streaming mode the converters periodically ask the
+/// kernel to write back and drop the pages of the files they work on.
+/// Only implemented on Linux (posix_fadvise); elsewhere everything here is
+/// a no-op.
+namespace pagecache {
+
+/// switches streaming mode on or off for all following conversions (off
+/// by default).
+void SetStreaming(bool bStreaming);
+bool Streaming();
+
+/// drops all cached pages of a file.  Dirty pages are written back first
+/// if bWriteBack is set, otherwise the kernel only starts writing them and
+/// they stay cached until that finished.
+/// @returns false if the file could not be opened or the platform does not
+///          support dropping pages
+bool Drop(const std::string& strFilename, bool bWriteBack);
+
+/// Drops the pages of one file while it is read or written: once the
+/// reported traffic crossed another iWindow bytes the whole file is dropped
+/// (which also starts the write back of its dirty pages, they go with the
+/// next window), and once more when the stream is closed.  Streams opened
+/// while streaming mode is off do nothing.  Advance may be called from
+/// several threads.
+class Stream {
+public:
+  static const uint64_t DefaultWindow = 64ull * 1024 * 1024;
+
+  Stream();
+  explicit Stream(const std::string& strFilename,
+                  uint64_t iWindow = DefaultWindow);
+  ~Stream();
+
+  /// starts tracking a file, closes the one tracked before
+  void Open(const std::string& strFilename, uint64_t iWindow = DefaultWindow);
+  /// drops the file one last time and stops tracking it
+  void Close();
+  bool IsOpen() const { return m_iFD >= 0; }
+
+  /// reports that iBytes of the file have been read or written
+  void Advance(uint64_t iBytes);
+
+private:
+  Stream(const Stream&);
+  Stream& operator=(const Stream&);
+
+  int m_iFD;
+  uint64_t m_iWindow;
+  std::atomic<uint64_t> m_iBytes;
+};
+
+} // namespace pagecache
+} // namespace tuvok
+
+#endif // TUVOK_PAGE_CACHE_H
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Scientific Computing and Imaging Institute,
+   University of Utah.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
@@ -35,6 +35,7 @@
 #include <fstream>
 #include <functional>
 #include <limits>
+#include <memory>
 #include <type_traits>
 #include "Basics/BStream.h"
 #include "Basics/LargeRAWFile.h"
@@ -42,6 +43,7 @@
 #include "UVF/Histogram1DDataBlock.h"
 #include "TuvokSizes.h"
 #include "AbstrConverter.h"
+#include "PageCache.h"
 
 namespace { // force internal linkage.
   // Figure out what factor we should multiply each element in the data set by
@@ -162,7 +164,8 @@ struct ios_data_src {
 
 template <typename T>
 struct raw_data_src {
-  raw_data_src(LargeRAWFile& r) : raw(r) {
+  raw_data_src(LargeRAWFile& r) : raw(r),
+    stream(std::make_shared<tuvok::pagecache::Stream>(r.GetFilename())) {
     if(!raw.IsOpen()) {
       throw std::runtime_error(__FILE__);
     }
@@ -171,13 +174,18 @@ struct raw_data_src {
 
   uint64_t size() { return raw.GetCurrentSize() / sizeof(T); }
   size_t read(unsigned char *data, size_t max_elems) {
-    return raw.ReadRAW(data, max_elems*sizeof(T))/sizeof(T);
+    const size_t bytes = raw.ReadRAW(data, max_elems*sizeof(T));
+    stream->Advance(bytes);
+    return bytes/sizeof(T);
   }
 
   void reset() {
     raw.SeekStart();
   }
-  private: LargeRAWFile& raw;
+  private:
+    LargeRAWFile& raw;
+    // shared, sources are passed around by value
+    std::shared_ptr<tuvok::pagecache::Stream> stream;
 };
 
 template <typename T>
@@ -358,6 +366,7 @@ static bool ApplyMapping(const uint64_t iElems,
 
   LargeRAWFile TargetData(strTargetFilename);
   TargetData.Create();
+  tuvok::pagecache::Stream targetStream(strTargetFilename);
 
   std::vector<U> targetData(iCurrentInCoreElems);
   std::vector<T> sourceData(iCurrentInCoreElems);
@@ -386,6 +395,7 @@ static bool ApplyMapping(const uint64_t iElems,
     }
 
     TargetData.WriteRAW((unsigned char*)&targetData[0], sizeof(U)*n_records);
+    targetStream.Advance(sizeof(U)*n_records);
   }
   assert(iPos == iElems);
 
@@ -513,6 +523,10 @@ static bool Quantize(LargeRAWFile& InputData,
   T* pInData = new T[iCurrentInCoreElems];
   U* pOutData = new U[iCurrentInCoreElems];
 
+  tuvok::pagecache::Stream inStream(InputData.GetFilename());
+  tuvok::pagecache::Stream outStream;
+  if (bDataWillbeChanged) outStream.Open(strTargetFilename);
+
   InputData.SeekStart();
   uint64_t iPos = 0;
   uint64_t iLastDisplayedPercent = 0;
@@ -522,6 +536,7 @@ static bool Quantize(LargeRAWFile& InputData,
                                      std::min((iSize - iPos)*sizeof(T),
                                      uint64_t(iCurrentInCoreSizeBytes)))/sizeof(T);
     if(iRead == 0) { break; } // bail if the read gave us nothing
+    inStream.Advance(iRead*sizeof(T));
 
     // calculate hist + quantize to output file.
     for(size_t i=0; i < iRead; ++i) {
@@ -560,9 +575,11 @@ static bool Quantize(LargeRAWFile& InputData,
       iLastDisplayedPercent = (100*iPos)/iSize;
     }
 
-    if (bDataWillbeChanged)
+    if (bDataWillbeChanged) {
       OutputData.WriteRAW(reinterpret_cast<unsigned char*>(pOutData),
                           sizeof(U)*iRead);
+      outStream.Advance(sizeof(U)*iRead);
+    }
   }
 
   delete[] pInData;
@@ -54,6 +54,7 @@
 #include "UVF/TOCBlock.h"
 #include "UVF/UVF.h"
 #include "TuvokIOError.h"
+#include "PageCache.h"
 #include "Quantize.h"
 
 using namespace std;
@@ -117,6 +118,8 @@ static std::string convert_endianness(const std::string& strFilename,
   size_t buffer_size = std::min<size_t>(static_cast<size_t>(byte_length),
                                         static_cast<size_t>(in_core_size));
   uint64_t bytes_converted = 0;
+  tuvok::pagecache::Stream inStream(strFilename);
+  tuvok::pagecache::Stream outStream(tmp_file);
 
   std::shared_ptr<unsigned char> buffer(
     new unsigned char[buffer_size],
@@ -141,6 +144,8 @@ static std::string convert_endianness(const std::string& strFilename,
                         __LINE__);
     }
     bytes_converted += static_cast<uint64_t>(bytes_written);
+    inStream.Advance(bytes_read);
+    outStream.Advance(bytes_written);
 
     MESSAGE("Performing endianness conversion"
             "\n%i%% complete",
@@ -429,6 +434,8 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
                                      uint32_t iBrickCompression,
                                      uint32_t iBrickCompressionLevel,
                                      uint32_t iBrickLayout,
+                                     uint32_t iBrickPreFilter,
+                                     bool bAdaptiveCompression,
                                      KVPairs* pKVPairs,
                                      const bool bQuantizeTo8Bit)
 {
@@ -610,7 +617,8 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
        size_t(Controller::ConstInstance().SysInfo().GetMaxUsableCPUMem()),
        MaxMinData, &Controller::Debug::Out(),
        COMPRESSION_TYPE(iBrickCompression), iBrickCompressionLevel,
-       LAYOUT_TYPE(iBrickLayout)) != true) {
+       LAYOUT_TYPE(iBrickLayout), PREFILTER_TYPE(iBrickPreFilter),
+       bAdaptiveCompression) != true) {
       T_ERROR("Brick generation failed, aborting.");
       uvfFile.Close();
       return false;
@@ -676,6 +684,10 @@ bool RAWConverter::ConvertRAWDataset(const string& strFilename,
   uvfFile.Close();
   blocks.clear();
 
+  // the UVF is written back before it leaves the cache, we are done with it
+  if (tuvok::pagecache::Streaming())
+    tuvok::pagecache::Drop(strTargetFilename, true);
+
   MESSAGE("Done!");
   return true;
 }
@@ -1133,6 +1145,8 @@ bool RAWConverter::ConvertToUVF(const std::string& strSourceFilename,
                                 uint32_t iBrickCompression,
                                 uint32_t iBrickCompressionLevel,
                                 uint32_t iBrickLayout,
+                                uint32_t iBrickPreFilter,
+                                bool bAdaptiveCompression,
                                 const bool bQuantizeTo8Bit)
 {
   std::list<std::string> files;
@@ -1140,7 +1154,8 @@ bool RAWConverter::ConvertToUVF(const std::string& strSourceFilename,
   return ConvertToUVF(files, strTargetFilename, strTempDir, bNoUserInteraction,
                       iTargetBrickSize, iTargetBrickOverlap, bUseMedian,
                       bClampToEdge, iBrickCompression, iBrickCompressionLevel,
-                      iBrickLayout, bQuantizeTo8Bit);
+                      iBrickLayout, iBrickPreFilter, bAdaptiveCompression,
+                      bQuantizeTo8Bit);
 }
 
 static void RemoveStdString(std::string s) { remove(s.c_str()); }
@@ -1156,6 +1171,8 @@ bool RAWConverter::ConvertToUVF(const std::list<std::string>& files,
                                 uint32_t iBrickCompression,
                                 uint32_t iBrickCompressionLevel,
                                 uint32_t iBrickLayout,
+                                uint32_t iBrickPreFilter,
+                                bool bAdaptiveCompression,
                                 const bool bQuantizeTo8Bit)
 {
   // all the parameters set here are just defaults, they should all be
@@ -1272,6 +1289,8 @@ bool RAWConverter::ConvertToUVF(const std::list<std::string>& files,
                                        iBrickCompression,
                                        iBrickCompressionLevel,
                                        iBrickLayout,
+                                       iBrickPreFilter,
+                                       bAdaptiveCompression,
                                        0,
                                        bQuantizeTo8Bit);
 
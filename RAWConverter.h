@@ -94,6 +94,8 @@ public:
                                 uint32_t iBrickCompression,
                                 uint32_t iBrickCompressionLevel,
                                 uint32_t iBrickLayout,
+                                uint32_t iBrickPreFilter,
+                                bool bAdaptiveCompression,
                                 KVPairs* pKVPairs = NULL,
                                 const bool bQuantizeTo8Bit=false);
 
@@ -138,6 +140,8 @@ public:
                             uint32_t iBrickCompression,
                             uint32_t iBrickCompressionLevel,
                             uint32_t iBrickLayout,
+                            uint32_t iBrickPreFilter,
+                            bool bAdaptiveCompression,
                             const bool bQuantizeTo8Bit);
 
   virtual bool ConvertToUVF(const std::list<std::string>& files,
@@ -151,6 +155,8 @@ public:
                             uint32_t iBrickCompression,
                             uint32_t iBrickCompressionLevel,
                             uint32_t iBrickLayout,
+                            uint32_t iBrickPreFilter,
+                            bool bAdaptiveCompression,
                             const bool bQuantizeTo8Bit);
 
   virtual bool Analyze(const std::string& strSourceFilename,
@@ -22,17 +22,108 @@
  DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <exception>
 #include <stdexcept>
 #include "ExtendedOctree.h"
 #include "Basics/nonstd.h"
 #include "Basics/Timer.h"
 #include "Controller/Controller.h"
 #include "Controller/StackTimer.h"
+#include "IOTrace.h"
 #include "ZlibCompression.h"
 #include "LzmaCompression.h"
 #include "Lz4Compression.h"
 #include "BzlibCompression.h"
 #include "LzhamCompression.h"
+#include "ZstdCompression.h"
+#include "PreFilter.h"
+#include "VolumeTools.h"
+#include "UringReader.h"
+#ifdef TUVOK_HAVE_IO_URING
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace {
+
+  /// Grow-only scratch memory for the brick decode path. Every thread owns
+  /// its own set, so steady state brick streaming does not allocate and
+  /// concurrent readers never share a buffer.
+  class StagingBuffer {
+  public:
+    StagingBuffer() : m_iSize(0) {}
+
+    /// @returns a buffer of at least iSize bytes, its contents are undefined
+    std::shared_ptr<uint8_t> Get(size_t iSize) {
+      if (iSize > m_iSize) {
+        m_pData.reset(new uint8_t[iSize], nonstd::DeleteArray<uint8_t>());
+        m_iSize = iSize;
+      }
+      return m_pData;
+    }
+
+    size_t Size() const { return m_iSize; }
+
+    /// frees the memory, users of earlier Gets keep theirs alive
+    void Release() {
+      m_pData.reset();
+      m_iSize = 0;
+    }
+
+  private:
+    std::shared_ptr<uint8_t> m_pData;
+    size_t m_iSize;
+  };
+
+  enum STAGING_BUFFER {
+    SB_COMPRESSED = 0, // the brick as it is stored on disk
+    SB_FILTERED,       // the decompressed but still pre-filtered brick
+    SB_RESIDUALS,      // intermediate result of combined pre-filters
+    SB_COALESCED,      // several neighboring bricks read at once
+    SB_COUNT
+  };
+
+  StagingBuffer& ThreadStaging(STAGING_BUFFER eBuffer) {
+    static thread_local std::array<StagingBuffer, SB_COUNT> buffers;
+    return buffers[eBuffer];
+  }
+
+  /// the buffers of the asynchronous reads of this thread, one per read in
+  /// flight, kept from one batch to the next
+  std::vector<StagingBuffer>& ThreadRangeBuffers() {
+    static thread_local std::vector<StagingBuffer> buffers;
+    return buffers;
+  }
+
+#ifdef TUVOK_HAVE_IO_URING
+  /// the ring of this thread, a ring must not be shared between threads.
+  /// It is kept from one batch to the next and only set up again if the
+  /// queue depth changes.
+  std::unique_ptr<UringReader>& ThreadRing(unsigned iQueueDepth) {
+    static thread_local std::unique_ptr<UringReader> reader;
+    static thread_local unsigned iDepth = 0;
+    if (reader && iDepth != iQueueDepth) reader.reset();
+    if (!reader) {
+      reader.reset(new UringReader(iQueueDepth));
+      iDepth = iQueueDepth;
+    }
+    return reader;
+  }
+#endif
+
+}
+
+#ifdef TUVOK_HAVE_IO_URING
+struct ExtendedOctree::AsyncFile {
+  explicit AsyncFile(int fd) : fd(fd) {}
+  ~AsyncFile() { if (fd >= 0) close(fd); }
+  const int fd;
+};
+#endif
+
+unsigned ExtendedOctree::ms_iDefaultAsyncQueueDepth = 64;
 
 ExtendedOctree::ExtendedOctree() :
   m_eComponentType(CT_UINT8), 
@@ -42,11 +133,12 @@ ExtendedOctree::ExtendedOctree() :
   m_vVolumeAspect(0,0,0), 
   m_iBrickSize(0,0,0), 
   m_iOverlap(0), 
-  m_iVersion(2), // increment version number here if something changes...
+  m_iVersion(ms_iCurrentVersion), // increment ms_iCurrentVersion if something changes...
   m_iSize(0),
   m_iCompressionLevel(4), // our default level for LZMA, it's fast and still compresses well
   m_iOffset(0), 
-  m_pLargeRAWFile()
+  m_pLargeRAWFile(),
+  m_iAsyncQueueDepth(ms_iDefaultAsyncQueueDepth)
 {}
 
 void ExtendedOctree::InitLzmaCompression()
@@ -89,6 +181,7 @@ bool ExtendedOctree::Open(LargeRAWFile_ptr pLargeRAWFile, uint64_t iOffset,
                           uint64_t iUVFFileVersion) {
   if (!pLargeRAWFile->IsOpen()) return false;
   m_pLargeRAWFile = pLargeRAWFile;
+  m_pAsyncFile.reset();
   m_iOffset = iOffset;
 
   const bool isBE = EndianConvert::IsBigEndian();
@@ -116,6 +209,8 @@ bool ExtendedOctree::Open(LargeRAWFile_ptr pLargeRAWFile, uint64_t iOffset,
     m_pLargeRAWFile->ReadData(m_iVersion, isBE);
     assert(m_iVersion != 0); // doesn't make sense, probably means corrupt file
     if (m_iVersion == 0) return false;
+    // written by a newer version of this code, we cannot interpret it
+    if (m_iVersion > ms_iCurrentVersion) return false;
   } else
     m_iVersion = 0; // version is not stored
 
@@ -145,8 +240,18 @@ bool ExtendedOctree::Open(LargeRAWFile_ptr pLargeRAWFile, uint64_t iOffset,
       m_pLargeRAWFile->ReadData(m_vTOC[i].m_iLength, isBE);
       uint32_t comp;
       m_pLargeRAWFile->ReadData(comp, isBE);
-      m_vTOC[i].m_eCompression = static_cast<COMPRESSION_TYPE>(comp);
+      // starting with version 3 the upper half holds the pre-filter
+      if (m_iVersion > 2) {
+        m_vTOC[i].m_eCompression = static_cast<COMPRESSION_TYPE>(comp & 0xFFFF);
+        m_vTOC[i].m_ePreFilter = static_cast<PREFILTER_TYPE>(comp >> 16);
+      } else {
+        m_vTOC[i].m_eCompression = static_cast<COMPRESSION_TYPE>(comp);
+        m_vTOC[i].m_ePreFilter = PF_NONE;
+      }
       m_pLargeRAWFile->ReadData(m_vTOC[i].m_iValidLength, isBE);
+      if (m_vTOC[i].m_eCompression == CT_CONSTANT)
+        m_vTOC[i].m_iValidLength =
+          ConvertConstantValue(m_vTOC[i].m_iValidLength, false);
       m_pLargeRAWFile->ReadData(m_vTOC[i].m_iAtlasSize.x, isBE);
       m_pLargeRAWFile->ReadData(m_vTOC[i].m_iAtlasSize.y, isBE);
     }
@@ -158,6 +263,7 @@ bool ExtendedOctree::Open(LargeRAWFile_ptr pLargeRAWFile, uint64_t iOffset,
       uint32_t comp;
       m_pLargeRAWFile->ReadData(comp, isBE);
       m_vTOC[i].m_eCompression = static_cast<COMPRESSION_TYPE>(comp);
+      m_vTOC[i].m_ePreFilter = PF_NONE;
       iLoDOffset += m_vTOC[i].m_iLength;
     }
   }
@@ -172,6 +278,7 @@ bool ExtendedOctree::Open(LargeRAWFile_ptr pLargeRAWFile, uint64_t iOffset,
  should not be used unless another open call is performed
 */
 void ExtendedOctree::Close() {
+  m_pAsyncFile.reset();
   if ( m_pLargeRAWFile != LargeRAWFile_ptr()) 
     m_pLargeRAWFile->Close();
 }
@@ -192,6 +299,9 @@ void ExtendedOctree::ComputeMetadata() {
   UINT64VECTOR3 vVolumeSize = m_vVolumeSize;
   DOUBLEVECTOR3 vAspect(1.0,1.0,1.0);
 
+  // the tree may have been opened before
+  m_vLODTable.clear();
+
   assert(this->GetMaxBrickSize()[0] > (2*m_iOverlap));
   assert(this->GetMaxBrickSize()[1] > (2*m_iOverlap));
   assert(this->GetMaxBrickSize()[2] > (2*m_iOverlap));
@@ -309,17 +419,35 @@ const TOCEntry& ExtendedOctree::GetBrickToCData(size_t index) const {
  Reads a brick from file and decompresses it if necessary. No magic here it 
  simply seeks to the position in the file, which is the header offset + the 
  brick-offset from the header, and then reads the data. Finally, checks if
- decompression is required.
+ decompression is required. Constant bricks never touch the file, their
+ value is replicated straight from the ToC.
 */ 
 void ExtendedOctree::GetBrickData(uint8_t* pData, uint64_t index) const {
 
   tuvok::Controller::Instance().IncrementPerfCounter(PERF_EO_BRICKS, 1.0);
 
+  if(m_vTOC[size_t(index)].m_eCompression == CT_CONSTANT) {
+    const size_t iVoxelSize = GetComponentTypeSize() *
+                              size_t(GetComponentCount());
+    const size_t iBrickSize = size_t(
+      ComputeBrickSize(IndexToBrickCoords(index)).volume() * iVoxelSize);
+    VolumeTools::FillConstant(pData, iBrickSize,
+      reinterpret_cast<const uint8_t*>(&m_vTOC[size_t(index)].m_iValidLength),
+      iVoxelSize);
+    return;
+  }
+
   if(m_vTOC[size_t(index)].m_eCompression == CT_NONE) {
     // not compressed, just read it directly into the buffer.
     tuvok::StackTimer t(PERF_EO_DISK_READ);
-    m_pLargeRAWFile->SeekPos(m_iOffset+m_vTOC[size_t(index)].m_iOffset);
-    m_pLargeRAWFile->ReadRAW(pData, m_vTOC[size_t(index)].m_iLength);
+    // the file position is shared, everything after the read may run in
+    // parallel
+#pragma omp critical(ExtendedOctreeRead)
+    {
+      IO_TRACE_SCOPE(TR_DISK_READ, m_vTOC[size_t(index)].m_iLength);
+      m_pLargeRAWFile->SeekPos(m_iOffset+m_vTOC[size_t(index)].m_iOffset);
+      m_pLargeRAWFile->ReadRAW(pData, m_vTOC[size_t(index)].m_iLength);
+    }
     return;
   }
 
@@ -330,15 +458,330 @@ void ExtendedOctree::GetBrickData(uint8_t* pData, uint64_t index) const {
     this->GetComponentCount() *
     this->GetComponentTypeSize();
 
-  std::shared_ptr<uint8_t> buf(new uint8_t[uncompressedSize],
-                               nonstd::DeleteArray<uint8_t>());
-  std::shared_ptr<uint8_t> out(pData, nonstd::null_deleter());
-  TimedStatement(PERF_EO_DISK_READ,
-    m_pLargeRAWFile->SeekPos(m_iOffset+m_vTOC[size_t(index)].m_iOffset);
-    m_pLargeRAWFile->ReadRAW(buf.get(), m_vTOC[size_t(index)].m_iLength);
-  );
+  std::shared_ptr<uint8_t> buf =
+    ThreadStaging(SB_COMPRESSED).Get(uncompressedSize);
+#pragma omp critical(ExtendedOctreeRead)
+  {
+    IO_TRACE_SCOPE(TR_DISK_READ, m_vTOC[size_t(index)].m_iLength);
+    TimedStatement(PERF_EO_DISK_READ,
+      m_pLargeRAWFile->SeekPos(m_iOffset+m_vTOC[size_t(index)].m_iOffset);
+      m_pLargeRAWFile->ReadRAW(buf.get(), m_vTOC[size_t(index)].m_iLength);
+    );
+  }
+  DecodeBrick(index, buf, pData);
+}
+
+/*
+ DecodeBrick:
+
+ Expands the data of a brick as they are stored on disk, i.e. decompresses
+ them and undoes the pre-filter, into 'pData'. Uncompressed bricks are
+ copied.
+*/
+void ExtendedOctree::DecodeBrick(uint64_t index, std::shared_ptr<uint8_t> buf,
+                                 uint8_t* pData) const {
+  const TOCEntry& record = m_vTOC[size_t(index)];
+  if (record.m_eCompression == CT_NONE) {
+    memcpy(pData, buf.get(), size_t(record.m_iLength));
+    return;
+  }
+
+  const size_t uncompressedSize =
+    this->ComputeBrickSize(this->IndexToBrickCoords(index)).volume() *
+    this->GetComponentCount() *
+    this->GetComponentTypeSize();
+
+  // aliasing an empty owner yields a non-owning pointer without the control
+  // block allocation a null_deleter would require
+  std::shared_ptr<uint8_t> out(std::shared_ptr<uint8_t>(), pData);
   tuvok::StackTimer decompress(PERF_EO_DECOMPRESSION);
-  switch (m_vTOC[size_t(index)].m_eCompression) {
+  IO_TRACE_SCOPE(TR_DECODE, index);
+  if (record.m_ePreFilter == PF_NONE) {
+    DecompressBrick(record.m_eCompression, buf, record.m_iLength,
+                    out, uncompressedSize);
+    return;
+  }
+
+  // expand into a second temporary buffer and undo the filter from there
+  std::shared_ptr<uint8_t> filtered =
+    ThreadStaging(SB_FILTERED).Get(uncompressedSize);
+  DecompressBrick(record.m_eCompression, buf, record.m_iLength,
+                  filtered, uncompressedSize);
+  RevertPreFilter(record.m_ePreFilter, filtered.get(), pData,
+                  uncompressedSize,
+                  ComputeBrickSize(IndexToBrickCoords(index)));
+}
+
+/*
+ GetBrickData (batch):
+
+ Plans the reads for a batch of bricks: the bricks are sorted by their
+ position in the file and neighbors are merged into one range as long as
+ the gap between them is at most iMaxGap bytes and the range does not grow
+ beyond iMaxReadSize. Constant bricks are filled from the ToC right away.
+ With io_uring support all ranges go through ReadRangesAsync, otherwise (or
+ if the ring cannot be set up) every range is fetched with a single seek
+ and read, then each of its bricks is decoded straight from the range
+ buffer. Lone bricks take the regular path then, which reads uncompressed
+ data without the extra copy.
+*/
+void ExtendedOctree::GetBrickData(const std::vector<UINT64VECTOR4>& vBrickCoords,
+                                  const std::vector<uint8_t*>& vData,
+                                  uint64_t iMaxGap,
+                                  uint64_t iMaxReadSize) const {
+  if (vBrickCoords.size() != vData.size())
+    throw std::runtime_error("brick batch and target buffers differ in size");
+
+  // (offset, position in the batch) of every brick that has to be read
+  std::vector<std::pair<uint64_t, size_t>> vPending;
+  vPending.reserve(vBrickCoords.size());
+  std::vector<uint64_t> vIndices(vBrickCoords.size());
+  for (size_t i = 0; i < vBrickCoords.size(); ++i) {
+    vIndices[i] = BrickCoordsToIndex(vBrickCoords[i]);
+    const TOCEntry& record = m_vTOC[size_t(vIndices[i])];
+    if (record.m_eCompression == CT_CONSTANT)
+      GetBrickData(vData[i], vIndices[i]);
+    else
+      vPending.push_back(std::make_pair(record.m_iOffset, i));
+  }
+  std::sort(vPending.begin(), vPending.end());
+
+  std::vector<BrickRange> vRanges;
+  for (size_t iFirst = 0; iFirst < vPending.size(); ) {
+    BrickRange range;
+    range.iBegin = vPending[iFirst].first;
+    range.iEnd = range.iBegin + m_vTOC[size_t(vIndices[vPending[iFirst].second])].m_iLength;
+    range.iFirst = iFirst;
+    size_t iLast = iFirst + 1;
+    for (; iLast < vPending.size(); ++iLast) {
+      const TOCEntry& record = m_vTOC[size_t(vIndices[vPending[iLast].second])];
+      const uint64_t iNewEnd = std::max(range.iEnd, record.m_iOffset + record.m_iLength);
+      if (record.m_iOffset > range.iEnd + iMaxGap || iNewEnd - range.iBegin > iMaxReadSize)
+        break;
+      range.iEnd = iNewEnd;
+    }
+    range.iLast = iFirst = iLast;
+    vRanges.push_back(range);
+  }
+
+  if (!vRanges.empty() && ReadRangesAsync(vRanges, vPending, vIndices, vData))
+    return;
+
+  for (auto r = vRanges.cbegin(); r != vRanges.cend(); ++r) {
+    if (r->iLast - r->iFirst == 1) {
+      const size_t i = vPending[r->iFirst].second;
+      GetBrickData(vData[i], vIndices[i]);
+      continue;
+    }
+
+    tuvok::Controller::Instance().IncrementPerfCounter(PERF_EO_BRICKS,
+                                                       double(r->iLast - r->iFirst));
+    std::shared_ptr<uint8_t> range =
+      ThreadStaging(SB_COALESCED).Get(size_t(r->iEnd - r->iBegin));
+#pragma omp critical(ExtendedOctreeRead)
+    {
+      IO_TRACE_SCOPE(TR_DISK_READ, r->iEnd - r->iBegin);
+      TimedStatement(PERF_EO_DISK_READ,
+        m_pLargeRAWFile->SeekPos(m_iOffset + r->iBegin);
+        m_pLargeRAWFile->ReadRAW(range.get(), r->iEnd - r->iBegin);
+      );
+    }
+    for (size_t b = r->iFirst; b < r->iLast; ++b) {
+      const size_t i = vPending[b].second;
+      // points into the range, which keeps the buffer alive
+      std::shared_ptr<uint8_t> buf(range, range.get() + (vPending[b].first - r->iBegin));
+      DecodeBrick(vIndices[i], buf, vData[i]);
+    }
+  }
+}
+
+/*
+ ReadRangesAsync:
+
+ Reads the ranges of a batch through io_uring: up to m_iAsyncQueueDepth
+ ranges (and at most 64 MB) are kept in flight on a file descriptor of our
+ own. Whenever some complete, the queue is topped up again before the
+ bricks of the completed ranges are decoded by the OpenMP threads, so the
+ device keeps working while we decode. The descriptor is kept with the
+ octree, the ring and the range buffers with the calling thread, so a
+ stream of batches sets none of them up again. Returns false without
+ reading anything if io_uring is not compiled in, not usable or disabled,
+ the caller falls back to blocking reads then.
+*/
+bool ExtendedOctree::ReadRangesAsync(const std::vector<BrickRange>& vRanges,
+                                     const std::vector<std::pair<uint64_t, size_t>>& vBricks,
+                                     const std::vector<uint64_t>& vIndices,
+                                     const std::vector<uint8_t*>& vData) const {
+#ifdef TUVOK_HAVE_IO_URING
+  if (m_iAsyncQueueDepth < 2 || IsInRWMode() || !UringReader::Available())
+    return false;
+
+  // a descriptor of our own, the shared file position of m_pLargeRAWFile
+  // is of no use for reads in flight
+  std::shared_ptr<AsyncFile> file;
+#pragma omp critical(ExtendedOctreeAsyncFile)
+  {
+    if (!m_pAsyncFile) {
+      const int fd = open(m_pLargeRAWFile->GetFilename().c_str(),
+                          O_RDONLY | O_CLOEXEC);
+      if (fd >= 0) m_pAsyncFile = std::make_shared<AsyncFile>(fd);
+    }
+    file = m_pAsyncFile;
+  }
+  if (!file) return false;
+
+  // fetched before the ring, which must go first at thread exit as it waits
+  // for reads in flight
+  std::vector<StagingBuffer>& vBuffers = ThreadRangeBuffers();
+  UringReader* reader;
+  try {
+    reader = ThreadRing(m_iAsyncQueueDepth).get();
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+  // buffer slot of each range, a slot is handed back once the bricks of
+  // its range are decoded. The queue is topped up while the completed ranges
+  // are decoded, so up to twice the queue depth are in use.
+  const size_t iSlots = 2 * size_t(reader->Depth());
+  if (vBuffers.size() < iSlots) vBuffers.resize(iSlots);
+  std::vector<size_t> vFree;
+  for (size_t i = iSlots; i > 0; --i) vFree.push_back(i - 1);
+  std::vector<size_t> vSlot(vRanges.size());
+
+  const uint64_t iMaxBytesInFlight = 64ull * 1024 * 1024;
+  uint64_t iBytesInFlight = 0;
+  size_t iNext = 0;
+  auto const fill = [&]() {
+    while (iNext < vRanges.size() && reader->InFlight() < reader->Depth() &&
+           !vFree.empty()) {
+      const uint64_t iLength = vRanges[iNext].iEnd - vRanges[iNext].iBegin;
+      if (reader->InFlight() > 0 && iBytesInFlight + iLength > iMaxBytesInFlight)
+        break;
+      vSlot[iNext] = vFree.back();
+      vFree.pop_back();
+      reader->Push(file->fd, m_iOffset + vRanges[iNext].iBegin,
+                   vBuffers[vSlot[iNext]].Get(size_t(iLength)).get(),
+                   size_t(iLength), iNext);
+      iBytesInFlight += iLength;
+      ++iNext;
+    }
+  };
+
+  try {
+    std::vector<uint64_t> vDone;
+    std::vector<std::pair<size_t, size_t>> vJobs; // (range, brick)
+    size_t iComplete = 0;
+    while (iComplete < vRanges.size()) {
+      fill();
+      vDone.clear();
+      {
+        tuvok::StackTimer t(PERF_EO_DISK_READ);
+        IO_TRACE_SCOPE(TR_DISK_READ, iBytesInFlight);
+        reader->Wait(vDone);
+      }
+      for (auto d = vDone.cbegin(); d != vDone.cend(); ++d)
+        iBytesInFlight -= vRanges[size_t(*d)].iEnd - vRanges[size_t(*d)].iBegin;
+      fill();
+
+      vJobs.clear();
+      for (auto d = vDone.cbegin(); d != vDone.cend(); ++d)
+        for (size_t b = vRanges[size_t(*d)].iFirst; b < vRanges[size_t(*d)].iLast; ++b)
+          vJobs.push_back(std::make_pair(size_t(*d), b));
+      tuvok::Controller::Instance().IncrementPerfCounter(PERF_EO_BRICKS,
+                                                         double(vJobs.size()));
+
+      // exceptions must not leave the parallel region
+      std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+      for (int64_t j = 0; j < int64_t(vJobs.size()); ++j) {
+        try {
+          const size_t r = vJobs[size_t(j)].first;
+          const std::pair<uint64_t, size_t>& brick = vBricks[vJobs[size_t(j)].second];
+          const uint64_t iLength = vRanges[r].iEnd - vRanges[r].iBegin;
+          // the slot is big enough already, Get does not touch it
+          std::shared_ptr<uint8_t> range = vBuffers[vSlot[r]].Get(size_t(iLength));
+          std::shared_ptr<uint8_t> buf(range, range.get() + (brick.first - vRanges[r].iBegin));
+          DecodeBrick(vIndices[brick.second], buf, vData[brick.second]);
+        } catch (...) {
+#pragma omp critical(ExtendedOctreeAsyncError)
+          if (!error) error = std::current_exception();
+        }
+      }
+      if (error) std::rethrow_exception(error);
+
+      for (auto d = vDone.cbegin(); d != vDone.cend(); ++d)
+        vFree.push_back(vSlot[size_t(*d)]);
+      iComplete += vDone.size();
+    }
+  } catch (...) {
+    // a failed batch may leave reads in flight into vBuffers, dropping the
+    // ring waits for them
+    ThreadRing(m_iAsyncQueueDepth).reset();
+    throw;
+  }
+
+  // keep no more than one batch worth of buffers around between batches
+  uint64_t iKept = 0;
+  for (auto b = vBuffers.begin(); b != vBuffers.end(); ++b) {
+    iKept += b->Size();
+    if (iKept > iMaxBytesInFlight) b->Release();
+  }
+  return true;
+#else
+  (void)vRanges; (void)vBricks; (void)vIndices; (void)vData;
+  return false;
+#endif
+}
+
+/*
+ RevertPreFilter:
+
+ Undoes the reversible transform that was applied to a brick before it
+ was compressed. The element size of the shuffles is the component size,
+ so the bytes of a multi byte value end up in separate planes.
+*/
+void ExtendedOctree::RevertPreFilter(PREFILTER_TYPE ePreFilter,
+                                     const uint8_t* src, uint8_t* dst,
+                                     size_t iSize,
+                                     const UINT64VECTOR3& vBrickSize) const {
+  const size_t iCompSize = GetComponentTypeSize();
+  switch (ePreFilter) {
+  case PF_NONE:
+    memcpy(dst, src, iSize);
+    break;
+  case PF_BYTESHUFFLE:
+    byteUnshuffle(src, dst, iSize, iCompSize);
+    break;
+  case PF_BITSHUFFLE:
+    bitUnshuffle(src, dst, iSize, iCompSize);
+    break;
+  case PF_DELTA3D:
+    delta3DDecode(src, dst, vBrickSize, iCompSize, size_t(m_iComponentCount));
+    break;
+  case PF_DELTA3D_BYTESHUFFLE: {
+    std::shared_ptr<uint8_t> residuals =
+      ThreadStaging(SB_RESIDUALS).Get(iSize);
+    byteUnshuffle(src, residuals.get(), iSize, iCompSize);
+    delta3DDecode(residuals.get(), dst, vBrickSize, iCompSize,
+                  size_t(m_iComponentCount));
+    break; }
+  default:
+    throw std::runtime_error("unknown pre-filter");
+  }
+}
+
+/*
+ DecompressBrick:
+
+ Expands a compressed brick into 'out', the decoder is selected by the
+ compression type stored in the brick's ToC entry.
+*/
+void ExtendedOctree::DecompressBrick(COMPRESSION_TYPE eCompression,
+                                     std::shared_ptr<uint8_t> buf,
+                                     uint64_t iCompressedSize,
+                                     std::shared_ptr<uint8_t> out,
+                                     size_t uncompressedSize) const {
+  switch (eCompression) {
   case CT_ZLIB:
     zDecompress(buf, out, uncompressedSize);
     break;
@@ -349,12 +792,13 @@ void ExtendedOctree::GetBrickData(uint8_t* pData, uint64_t index) const {
     lz4Decompress(buf, out, uncompressedSize);
     break;
   case CT_BZLIB:
-    bzDecompress(buf, size_t(m_vTOC[size_t(index)].m_iLength),
-                 out, uncompressedSize);
+    bzDecompress(buf, size_t(iCompressedSize), out, uncompressedSize);
     break;
   case CT_LZHAM:
-    lzhamDecompress(buf, size_t(m_vTOC[size_t(index)].m_iLength),
-                    out, uncompressedSize);
+    lzhamDecompress(buf, size_t(iCompressedSize), out, uncompressedSize);
+    break;
+  case CT_ZSTD:
+    zstdDecompress(buf, size_t(iCompressedSize), out, uncompressedSize);
     break;
   default:
     throw std::runtime_error("unknown compression format");
@@ -501,6 +945,7 @@ uint64_t ExtendedOctree::ComputeHeaderSize() const {
 void ExtendedOctree::WriteHeader(LargeRAWFile_ptr pLargeRAWFile,
                                  uint64_t iOffset) {
   m_pLargeRAWFile = pLargeRAWFile;
+  m_pAsyncFile.reset();
   m_iOffset = iOffset;
 
   assert(m_iComponentCount);
@@ -508,6 +953,19 @@ void ExtendedOctree::WriteHeader(LargeRAWFile_ptr pLargeRAWFile,
   assert(m_vVolumeAspect.volume() > 0);
   assert(m_iBrickSize.volume() > 0);
 
+  // constant bricks and pre-filters need version 3, version 2 shares its
+  // header layout so trees of that version that got such bricks (e.g. in an
+  // update) move up
+  if (m_iVersion == 2) {
+    for (size_t i = 0;i<m_vTOC.size();i++) {
+      if (m_vTOC[i].m_eCompression == CT_CONSTANT ||
+          m_vTOC[i].m_ePreFilter != PF_NONE) {
+        m_iVersion = 3;
+        break;
+      }
+    }
+  }
+
   // write global header
   const bool isBE = EndianConvert::IsBigEndian();
   m_pLargeRAWFile->SeekPos(m_iOffset);
@@ -537,8 +995,14 @@ void ExtendedOctree::WriteHeader(LargeRAWFile_ptr pLargeRAWFile,
     for (size_t i = 0;i<m_vTOC.size();i++) {
       m_pLargeRAWFile->WriteData(m_vTOC[i].m_iOffset, isBE);
       m_pLargeRAWFile->WriteData(m_vTOC[i].m_iLength, isBE);
-      m_pLargeRAWFile->WriteData(uint32_t(m_vTOC[i].m_eCompression), isBE);
-      m_pLargeRAWFile->WriteData(m_vTOC[i].m_iValidLength, isBE);
+      if (m_iVersion > 2)
+        m_pLargeRAWFile->WriteData(uint32_t(m_vTOC[i].m_eCompression) |
+                                   uint32_t(m_vTOC[i].m_ePreFilter) << 16, isBE);
+      else
+        m_pLargeRAWFile->WriteData(uint32_t(m_vTOC[i].m_eCompression), isBE);
+      m_pLargeRAWFile->WriteData(m_vTOC[i].m_eCompression == CT_CONSTANT
+        ? ConvertConstantValue(m_vTOC[i].m_iValidLength, true)
+        : m_vTOC[i].m_iValidLength, isBE);
       m_pLargeRAWFile->WriteData(m_vTOC[i].m_iAtlasSize.x, isBE);
       m_pLargeRAWFile->WriteData(m_vTOC[i].m_iAtlasSize.y, isBE);
     }
@@ -550,6 +1014,27 @@ void ExtendedOctree::WriteHeader(LargeRAWFile_ptr pLargeRAWFile,
   }
 }
 
+/*
+ ConvertConstantValue:
+
+ On little endian machines memory and file agree, nothing to do. Otherwise
+ the eight byte swap of ReadData/WriteData moved the bytes of the voxel to
+ the wrong end of the field, so when reading we undo that swap and then turn
+ every component into big endian, when writing we go the opposite way.
+*/
+uint64_t ExtendedOctree::ConvertConstantValue(uint64_t iValue,
+                                              bool bToFile) const {
+  if (!EndianConvert::IsBigEndian()) return iValue;
+
+  if (!bToFile) iValue = EndianConvert::Swap<uint64_t>(iValue);
+  uint8_t* pValue = reinterpret_cast<uint8_t*>(&iValue);
+  const size_t iComponentSize = GetComponentTypeSize();
+  for (uint64_t c = 0;c<m_iComponentCount;c++)
+    std::reverse(pValue + c*iComponentSize, pValue + (c+1)*iComponentSize);
+  if (bToFile) iValue = EndianConvert::Swap<uint64_t>(iValue);
+  return iValue;
+}
+
 /*
  GetComponentTypeSize:
  
@@ -593,7 +1078,7 @@ bool ExtendedOctree::ReOpenRW() {
   m_pLargeRAWFile->Close();
 
   // re-open in read/write mode
-  if (m_pLargeRAWFile->Open(true)) {
+  if (!m_pLargeRAWFile->Open(true)) {
     
     // if opening in rw failed, return to read only mode
     m_pLargeRAWFile->Open(false);
@@ -69,15 +69,30 @@ enum COMPRESSION_TYPE {
   CT_LZ4,         // brick is compressed using LZ4
   CT_BZLIB,       // brick is compressed using BZIP2
   CT_LZHAM,       // brick is compressed using LZHAM
+  CT_CONSTANT,    // brick holds a single value, stored in the ToC entry
+  CT_ZSTD,        // brick is compressed using Zstandard
   CT_UNKNOWN
 };
 
+/// This enum lists the reversible transforms that may be applied to a brick
+/// before it is compressed, they are undone transparently when reading
+enum PREFILTER_TYPE {
+  PF_NONE = 0,            // brick is stored as is
+  PF_BYTESHUFFLE,         // bytes are grouped by significance
+  PF_BITSHUFFLE,          // bits are grouped into bit planes
+  PF_DELTA3D,             // voxels are replaced by their 3D Lorenzo residuals
+  PF_DELTA3D_BYTESHUFFLE, // 3D Lorenzo residuals followed by a byte shuffle
+  PF_UNKNOWN
+};
+
 /// This enum lists the different layouts how bricks are ordered on disk
 enum LAYOUT_TYPE {
   LT_SCANLINE = 0,  // bricks are ordered in x, y, z scanline order where x is the fastest
   LT_MORTON,        // bricks are laid out according to Morton order (Z-order)
   LT_HILBERT,       // bricks are laid out according to Hilbert space-filling curve
   LT_RANDOM,        // bricks are laid out randomly, just to check the worst case
+  LT_LOD_INTERLEAVED, // coarsest brick first, every brick followed by its
+                      // children (in Hilbert order) and their subtrees
   LT_UNKNOWN
 };
 
@@ -100,7 +115,9 @@ struct TOCEntry {
   COMPRESSION_TYPE m_eCompression;
 
   /// valid bytes in this brick (used for streaming files)
-  /// for a complete brick m_iLength is equal to m_iValidLength
+  /// for a complete brick m_iLength is equal to m_iValidLength,
+  /// for a CT_CONSTANT brick (m_iLength is zero) this field holds
+  /// the raw bytes of the voxel value the brick is filled with
   uint64_t m_iValidLength;
 
   /// if this block is stored in "atlantified" format
@@ -110,6 +127,11 @@ struct TOCEntry {
   /// is equal to zero
   UINTVECTOR2 m_iAtlasSize;
 
+  /// the transform applied before compression, only used together with
+  /// a compression scheme. It is stored in the upper 16 bits of the
+  /// compression field in the file so the ToC layout does not change.
+  PREFILTER_TYPE m_ePreFilter;
+
   // Returns the size of this struct it is basically the
   // the sum of sizeof calls to all members as that may
   // be different from sizeof(TOCEntry) due to compilers
@@ -250,6 +272,15 @@ public:
   */
   const TOCEntry& GetBrickToCData(size_t index) const;
 
+  /**
+    Returns true iff the brick is stored as a single value in the ToC
+    @param vBrickCoords coordinates of a brick: x,y,z are the spacial coordinates, w is the LoD level
+    @return true iff the brick is a constant brick
+  */
+  bool IsConstantBrick(const UINT64VECTOR4& vBrickCoords) const {
+    return GetBrickToCData(vBrickCoords).m_eCompression == CT_CONSTANT;
+  }
+
   /**
     Returns the aspect ration of a specific brick, this does not include the global aspect ratio
     @param vBrickCoords coordinates of a brick: x,y,z are the spacial coordinates, w is the LoD level
@@ -264,6 +295,49 @@ public:
   */
   void GetBrickData(uint8_t* pData, const UINT64VECTOR4& vBrickCoords) const;
 
+  /**
+    use to get the raw (uncompressed) data of a batch of bricks, the bricks
+    are fetched in file order and bricks which lie close to each other on
+    disk are fetched with a single read, which pays off for the Morton and
+    Hilbert layouts and on file systems with a high per request cost; if
+    built with TUVOK_IO_URING the reads are kept in flight concurrently
+    (see SetAsyncQueueDepth) and decoding overlaps with the I/O
+    @param vBrickCoords coordinates of the bricks, in any order
+    @param vData target buffer for each brick, the user has to make sure each is big enough to hold its brick
+    @param iMaxGap two bricks are read together if at most this many bytes of other data lie between them
+    @param iMaxReadSize upper bound for the size (in bytes) of a single read, a single brick may still exceed it
+  */
+  void GetBrickData(const std::vector<UINT64VECTOR4>& vBrickCoords,
+                    const std::vector<uint8_t*>& vData,
+                    uint64_t iMaxGap = 64*1024,
+                    uint64_t iMaxReadSize = 8*1024*1024) const;
+
+  /**
+    Sets how many reads the batched GetBrickData keeps in flight, only has
+    an effect if io_uring support is compiled in (TUVOK_IO_URING)
+    @param iQueueDepth maximum number of concurrent reads, 0 or 1 disables asynchronous reads
+  */
+  void SetAsyncQueueDepth(unsigned iQueueDepth) {m_iAsyncQueueDepth = iQueueDepth;}
+
+  /**
+    Returns the maximum number of concurrent reads of the batched GetBrickData
+    @return the maximum number of concurrent reads
+  */
+  unsigned GetAsyncQueueDepth() const {return m_iAsyncQueueDepth;}
+
+  /**
+    Sets the queue depth that octrees constructed afterwards start with,
+    this is how IOManager::SetAsyncQueueDepth reaches the octrees inside
+    the datasets it opens
+    @param iQueueDepth maximum number of concurrent reads, 0 or 1 disables asynchronous reads
+  */
+  static void SetDefaultAsyncQueueDepth(unsigned iQueueDepth) {ms_iDefaultAsyncQueueDepth = iQueueDepth;}
+
+  /**
+    Returns the queue depth new octrees start with
+    @return the default maximum number of concurrent reads
+  */
+  static unsigned GetDefaultAsyncQueueDepth() {return ms_iDefaultAsyncQueueDepth;}
 
   /**
     Returns the global aspect ratio of the volume
@@ -335,6 +409,13 @@ private:
   /// extended octree file version
   uint32_t m_iVersion;
 
+  /// the version new trees are written with and the newest one we can
+  /// read, 3 added constant bricks (CT_CONSTANT) and pre-filters
+  static const uint32_t ms_iCurrentVersion = 3;
+
+  /// initial m_iAsyncQueueDepth of new octrees
+  static unsigned ms_iDefaultAsyncQueueDepth;
+
   /// total octree size including header, necessary to allow "random" brick locations
   uint64_t m_iSize;
 
@@ -347,6 +428,15 @@ private:
   /// pointer to the data file
   LargeRAWFile_ptr m_pLargeRAWFile;
 
+  /// maximum number of reads the batched GetBrickData keeps in flight
+  unsigned m_iAsyncQueueDepth;
+
+  /// descriptor of the data file for the asynchronous reads, opened by the
+  /// first batch that needs it and shared by all threads, dropped when the
+  /// file is closed or replaced
+  struct AsyncFile;
+  mutable std::shared_ptr<AsyncFile> m_pAsyncFile;
+
   /// the table of contents of the file, it holds the metadata for all bricks
   std::vector<TOCEntry> m_vTOC;
 
@@ -387,6 +477,17 @@ private:
   */
   void WriteHeader(LargeRAWFile_ptr pLargeRAWFile, uint64_t iOffset);
 
+  /**
+    Converts the value of a constant brick between the byte order of this
+    machine, which is what m_iValidLength holds in memory, and the file,
+    which stores each component little endian. ReadData and WriteData swap
+    the field as a whole, this puts the components back in place.
+    @param iValue the field as read by ReadData or to be passed to WriteData
+    @param bToFile true before writing, false after reading
+    @return the converted field
+  */
+  uint64_t ConvertConstantValue(uint64_t iValue, bool bToFile) const;
+
 
   /**
     Static method that returns the size of a type specified as a COMPONENT_TYPE enum
@@ -402,6 +503,61 @@ private:
   */
   void GetBrickData(uint8_t* pData, uint64_t index) const;
 
+  /**
+    turns the data of a brick as it is stored on disk into its raw data
+    @param index the index of the brick in the LoD table
+    @param buf the stored (compressed and/or pre-filtered) data of the brick
+    @param pData the target buffer, must be large enough to hold the brick
+  */
+  void DecodeBrick(uint64_t index, std::shared_ptr<uint8_t> buf,
+                   uint8_t* pData) const;
+
+  /// a part of the file which holds one or more bricks of a batched read
+  struct BrickRange {
+    uint64_t iBegin;  ///< first byte, relative to the octree
+    uint64_t iEnd;    ///< one past the last byte
+    size_t iFirst;    ///< first brick of the range in the offset sorted batch
+    size_t iLast;     ///< one past the last brick
+  };
+
+  /**
+    reads and decodes the ranges of a batch with asynchronous I/O
+    @param vRanges the ranges to read
+    @param vBricks (offset, position in the batch) of the bricks, sorted by offset
+    @param vIndices index of each brick of the batch in the LoD table
+    @param vData target buffer of each brick of the batch
+    @return false if asynchronous I/O is not available, nothing has been read then
+  */
+  bool ReadRangesAsync(const std::vector<BrickRange>& vRanges,
+                       const std::vector<std::pair<uint64_t, size_t>>& vBricks,
+                       const std::vector<uint64_t>& vIndices,
+                       const std::vector<uint8_t*>& vData) const;
+
+  /**
+    expands a compressed brick
+    @param eCompression the codec the brick was compressed with
+    @param buf the compressed data
+    @param iCompressedSize the size (in bytes) of the compressed data
+    @param out the target buffer, must be able to hold uncompressedSize bytes
+    @param uncompressedSize the size (in bytes) of the raw brick
+  */
+  void DecompressBrick(COMPRESSION_TYPE eCompression,
+                       std::shared_ptr<uint8_t> buf, uint64_t iCompressedSize,
+                       std::shared_ptr<uint8_t> out,
+                       size_t uncompressedSize) const;
+
+  /**
+    undoes the pre-filter of a brick
+    @param ePreFilter the transform that was applied before compression
+    @param src the filtered data
+    @param dst the target buffer, must be as large as src
+    @param iSize the size (in bytes) of the brick
+    @param vBrickSize the size (in voxels) of the brick
+  */
+  void RevertPreFilter(PREFILTER_TYPE ePreFilter, const uint8_t* src,
+                       uint8_t* dst, size_t iSize,
+                       const UINT64VECTOR3& vBrickSize) const;
+
   /** 
     returns true iff the large raw file holding this tree's
     data is is currently in RW mode
@@ -24,15 +24,22 @@
 
 // for find_if
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <memory>
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <stdexcept>
+#include <exception>
+#include <future>
+#include <thread>
 #include "Basics/MathTools.h"
 #include "Basics/ProgressTimer.h"
 #include "Basics/Timer.h"
 #include "Basics/PerfCounter.h"
 #include "Basics/nonstd.h"
+#include "IOTrace.h"
 #include "Controller/Controller.h"
 #include "DebugOut/AbstrDebugOut.h"
 #include "ExtendedOctreeConverter.h"
@@ -41,6 +48,15 @@
 #include "Lz4Compression.h"
 #include "BzlibCompression.h"
 #include "LzhamCompression.h"
+#include "ZstdCompression.h"
+#include "PreFilter.h"
+
+namespace {
+  // adaptive compression times at least this many decodes of a brick, and
+  // keeps decoding until this much time has passed
+  const unsigned iMinDecodeRuns = 3;
+  const double fMinDecodeSeconds = 0.002;
+}
 
 // simple/generic progress update message
 #define PROGRESS \
@@ -64,9 +80,67 @@ ExtendedOctreeConverter::ExtendedOctreeConverter(
     m_iMemLimit(iMemLimit),
     m_iCacheAccessCounter(0),
     m_pBrickStatVec(NULL),
+    m_ePreFilter(PF_NONE),
+    m_bAdaptiveCompression(false),
+    m_fAdaptiveMinDecodeThroughput(250.0),
+    m_fAdaptiveMinSavings(0.1),
     m_Progress(progress)
 {
   m_pProgressTimer->Start();
+
+  // default candidates for adaptive compression, ordered by decode speed
+  m_vAdaptiveCandidates.push_back(AdaptiveCandidate(CT_LZ4, 0));
+  m_vAdaptiveCandidates.push_back(AdaptiveCandidate(CT_ZSTD, 9));
+  m_vAdaptiveCandidates.push_back(AdaptiveCandidate(CT_LZMA, 0));
+}
+
+/*
+  SetPreFilter:
+
+  Selects the reversible transform that is applied to every brick before
+  it is compressed
+*/
+void ExtendedOctreeConverter::SetPreFilter(PREFILTER_TYPE ePreFilter) {
+  if (ePreFilter >= PF_UNKNOWN) {
+    m_Progress.Warning(_func_, "Unknown pre-filter requested (%d), "
+                       "disabling pre-filtering", ePreFilter);
+    ePreFilter = PF_NONE;
+  }
+  m_ePreFilter = ePreFilter;
+}
+
+/*
+  SetAdaptiveCompression:
+
+  Switches between the fixed compression method passed to Convert and the
+  per brick codec selection
+*/
+void ExtendedOctreeConverter::SetAdaptiveCompression(bool bAdaptiveCompression) {
+  m_bAdaptiveCompression = bAdaptiveCompression;
+}
+
+/*
+  SetAdaptiveCandidates:
+
+  Configures the codecs that are tried per brick if adaptive compression
+  is enabled
+*/
+void ExtendedOctreeConverter::SetAdaptiveCandidates(
+                          const std::vector<AdaptiveCandidate>& vCandidates,
+                          double fMinDecodeThroughput,
+                          double fMinSavings) {
+  m_vAdaptiveCandidates.clear();
+  for (auto c = vCandidates.cbegin(); c != vCandidates.cend(); ++c) {
+    if (c->eCompression == CT_NONE || c->eCompression == CT_CONSTANT ||
+        c->eCompression >= CT_UNKNOWN) {
+      m_Progress.Warning(_func_, "Ignoring invalid adaptive compression "
+                         "candidate (%d)", c->eCompression);
+      continue;
+    }
+    m_vAdaptiveCandidates.push_back(*c);
+  }
+  m_fAdaptiveMinDecodeThroughput = fMinDecodeThroughput;
+  m_fAdaptiveMinSavings = fMinSavings;
 }
 
 ExtendedOctreeConverter::~ExtendedOctreeConverter() {
@@ -167,8 +241,12 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
 
   SetupCache(e);
 
+  m_InputStream.Open(pLargeRAWFileIn->GetFilename());
+  m_OutputStream.Open(pLargeRAWFileOut->GetFilename());
+
   // brick (permute) the input data
   PermuteInputData(e, pLargeRAWFileIn, iInOffset, bClampToEdge);
+  m_InputStream.Close();
 
   // compute hierarchy
 
@@ -252,7 +330,7 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
     e.m_iSize = lastBrickInFile.m_iOffset + lastBrickInFile.m_iLength;
   }
 
-  if (m_eCompression >= CT_UNKNOWN) {
+  if (m_eCompression >= CT_UNKNOWN || m_eCompression == CT_CONSTANT) {
     m_Progress.Warning(_func_, "Unknown compression method requested (%d), "
                        "resetting to default zlib compression", m_eCompression);
     m_eCompression = CT_ZLIB;
@@ -274,6 +352,7 @@ bool ExtendedOctreeConverter::Convert(LargeRAWFile_ptr pLargeRAWFileIn,
 
   // remove part of the file used only for temp calculations
   pLargeRAWFileOut->Truncate(iOutOffset + e.m_iSize);
+  m_OutputStream.Close();
 
   m_fProgress = 1.0f;
 
@@ -357,6 +436,7 @@ void ExtendedOctreeConverter::GetInputBrick(std::vector<uint8_t>& vData,
 
       pLargeRAWFileIn->SeekPos(iCurrentInOffset);
       pLargeRAWFileIn->ReadRAW((uint8_t*)&vData[iOutOffset], iLineSize);
+      m_InputStream.Advance(iLineSize);
     }
   }
 
@@ -462,8 +542,825 @@ void ExtendedOctreeConverter::ClampToEdge(std::vector<uint8_t>& vData,
   }
 }
 
+/*
+  Merge:
+
+  Creates the metadata of the new tree from the first input, then walks
+  through the ToC of all trees in lockstep. Since the trees share their
+  layout brick i covers the same region in every one of them, so level 0
+  brick i of the result only depends on brick i of the inputs. The coarser
+  levels are down-sampled from the merged finer level with RecomputeBrick,
+  as combining the coarse input bricks would only approximate the hierarchy
+  of the merged data for non-linear combinations and for rounded averages.
+  Each result brick is compressed right away and appended to the file, so
+  unlike Convert no uncompressed temp data is ever written. Other layouts
+  than scanline are applied by permuting the finished bricks.
+*/
+bool ExtendedOctreeConverter::Merge(
+                      const std::vector<const ExtendedOctree*>& vTrees,
+                      bool (*combineFunc)(const std::vector<const uint8_t*>&,
+                                          uint8_t*, uint64_t, void*),
+                      void* pUserContext,
+                      LargeRAWFile_ptr pLargeRAWFileOut,
+                      uint64_t iOutOffset,
+                      BrickStatVec* stats,
+                      COMPRESSION_TYPE compression,
+                      uint32_t iCompressionLevel,
+                      bool bComputeMedian,
+                      bool bClampToEdge,
+                      LAYOUT_TYPE layout) {
+  if (vTrees.empty() || combineFunc == NULL) return false;
+
+  const ExtendedOctree& first = *vTrees[0];
+  for (size_t t = 1;t<vTrees.size();t++) {
+    const ExtendedOctree& other = *vTrees[t];
+    if (other.m_eComponentType != first.m_eComponentType ||
+        other.m_iComponentCount != first.m_iComponentCount ||
+        other.m_vVolumeSize != first.m_vVolumeSize ||
+        other.m_iBrickSize != first.m_iBrickSize ||
+        other.m_iOverlap != first.m_iOverlap ||
+        other.m_vTOC.size() != first.m_vTOC.size()) {
+      m_Progress.Error(_func_, "Octrees to merge differ in layout or type.");
+      return false;
+    }
+  }
+
+  m_pBrickStatVec = stats;
+  m_fProgress = 0.0f;
+  m_vBrickCache.clear();
+
+  ExtendedOctree e;
+  e.m_eComponentType = first.m_eComponentType;
+  e.m_iComponentCount = first.m_iComponentCount;
+  e.m_vVolumeSize = first.m_vVolumeSize;
+  e.m_vVolumeAspect = first.m_vVolumeAspect;
+  e.m_iBrickSize = first.m_iBrickSize;
+  e.m_iOverlap = first.m_iOverlap;
+  e.m_iOffset = iOutOffset;
+  e.m_pLargeRAWFile = pLargeRAWFileOut;
+  e.m_iCompressionLevel = iCompressionLevel;
+  e.ComputeMetadata();
+
+  m_eCompression = compression;
+  if (m_eCompression >= CT_UNKNOWN || m_eCompression == CT_CONSTANT) {
+    m_Progress.Warning(_func_, "Unknown compression method requested (%d), "
+                       "resetting to default zlib compression", m_eCompression);
+    m_eCompression = CT_ZLIB;
+  }
+  m_eLayout = layout;
+  if (m_eLayout >= LT_UNKNOWN) {
+    m_Progress.Warning(_func_, "Unknown brick layout requested (%d), resetting "
+                       "to default scanline order", m_eLayout);
+    m_eLayout = LT_SCANLINE;
+  }
+  // the permutation tells moved bricks from unprocessed ones by their stats
+  BrickStatVec vLocalStats;
+  if (m_eLayout != LT_SCANLINE && m_pBrickStatVec == NULL)
+    m_pBrickStatVec = &vLocalStats;
+
+  const size_t iVoxelSize = e.GetComponentTypeSize() *
+                            size_t(e.m_iComponentCount);
+  const size_t maxbricksize = static_cast<size_t>(e.m_iBrickSize.volume() *
+                                                  iVoxelSize);
+
+  std::vector<std::vector<uint8_t>> vInputData(
+    vTrees.size(), std::vector<uint8_t>(maxbricksize)
+  );
+  std::vector<const uint8_t*> vInput(vTrees.size());
+  for (size_t t = 0;t<vTrees.size();t++) vInput[t] = &vInputData[t][0];
+
+  std::shared_ptr<uint8_t> BrickData(new uint8_t[maxbricksize],
+                                     nonstd::DeleteArray<uint8_t>());
+  std::shared_ptr<uint8_t> compressed(new uint8_t[maxbricksize],
+                                      nonstd::DeleteArray<uint8_t>());
+  std::vector<uint8_t> vSourceData;
+
+  const size_t iBrickCount = first.m_vTOC.size();
+  const size_t iReportInterval = std::max<size_t>(1, iBrickCount/2000);
+  uint64_t iWriteOffset = e.ComputeHeaderSize();
+
+  for (size_t i = 0;i<iBrickCount;i++) {
+    const UINT64VECTOR4 coords = e.IndexToBrickCoords(i);
+    const uint64_t iBrickSize = e.ComputeBrickSize(coords).volume() *
+                                iVoxelSize;
+    if (coords.w == 0) {
+      for (size_t j = 0;j<vTrees.size();j++)
+        vTrees[j]->GetBrickData(&vInputData[j][0], i);
+
+      if (!combineFunc(vInput, BrickData.get(),
+                       iBrickSize/e.GetComponentTypeSize(), pUserContext)) {
+        m_Progress.Error(_func_, "Combining brick %llu failed.", uint64_t(i));
+        return false;
+      }
+    } else {
+      RecomputeBrick(e, coords, BrickData.get(), vSourceData,
+                     bComputeMedian, bClampToEdge);
+    }
+
+    AppendBrick(e, BrickData, iBrickSize, compressed, iWriteOffset);
+
+    if (i % iReportInterval == 0) {
+      m_fProgress = float(i) / iBrickCount;
+      std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
+      m_Progress.Message(_func_, "Merging bricks .. %5.2f%% (%s)",
+                         m_fProgress*100.0f, msg.c_str());
+    }
+  }
+
+  e.m_iSize = e.m_vTOC.back().m_iOffset + e.m_vTOC.back().m_iLength;
+  // all bricks are encoded already, so this only moves their payload
+  if (m_eLayout != LT_SCANLINE)
+    ComputeStatsCompressAndPermuteAll(e);
+  m_pBrickStatVec = stats;
+
+  e.WriteHeader(pLargeRAWFileOut, iOutOffset);
+  pLargeRAWFileOut->Truncate(iOutOffset + e.m_iSize);
+
+  m_fProgress = 1.0f;
+  return true;
+}
+
+void ExtendedOctreeConverter::AppendBrick(ExtendedOctree& tree,
+                                          std::shared_ptr<uint8_t> pData,
+                                          uint64_t iLength,
+                                          std::shared_ptr<uint8_t>& pCompressed,
+                                          uint64_t& iWriteOffset) {
+  const size_t i = tree.m_vTOC.size();
+  const TOCEntry t = {iWriteOffset, iLength, CT_NONE, iLength,
+                      UINTVECTOR2(0,0), PF_NONE};
+  tree.m_vTOC.push_back(t);
+
+  std::shared_ptr<uint8_t> data = EncodeBrick(tree, i, pData, iLength,
+                                              pCompressed);
+  if (tree.m_vTOC[i].m_iLength > 0) {
+    tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + iWriteOffset);
+    tree.m_pLargeRAWFile->WriteRAW(data.get(), tree.m_vTOC[i].m_iLength);
+  }
+  iWriteOffset += tree.m_vTOC[i].m_iLength;
+}
+
+bool ExtendedOctreeConverter::RewriteBrick(ExtendedOctree& tree,
+                                           uint64_t index,
+                                           std::shared_ptr<uint8_t> pData,
+                                           uint64_t iLength,
+                                           std::shared_ptr<uint8_t>& pCompressed,
+                                           bool bMayGrow) {
+  const size_t i = size_t(index);
+  const uint64_t iOldLength = tree.m_vTOC[i].m_iLength;
+  const TOCEntry t = {tree.m_vTOC[i].m_iOffset, iLength, CT_NONE, iLength,
+                      UINTVECTOR2(0,0), PF_NONE};
+  tree.m_vTOC[i] = t;
+
+  std::shared_ptr<uint8_t> data = EncodeBrick(tree, i, pData, iLength,
+                                              pCompressed);
+  if (tree.m_vTOC[i].m_iLength > iOldLength) {
+    if (!bMayGrow) return false;
+    // the old slot becomes unused space in the file
+    tree.m_vTOC[i].m_iOffset = tree.m_iSize;
+    tree.m_iSize += tree.m_vTOC[i].m_iLength;
+  }
+  if (tree.m_vTOC[i].m_iLength > 0) {
+    tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + tree.m_vTOC[i].m_iOffset);
+    tree.m_pLargeRAWFile->WriteRAW(data.get(), tree.m_vTOC[i].m_iLength);
+  }
+  return true;
+}
+
+std::shared_ptr<uint8_t> ExtendedOctreeConverter::EncodeBrick(
+                                          ExtendedOctree& tree,
+                                          uint64_t index,
+                                          std::shared_ptr<uint8_t> pData,
+                                          uint64_t iLength,
+                                          std::shared_ptr<uint8_t>& pCompressed) {
+  const size_t i = size_t(index);
+  if (m_pBrickStatVec)
+    BrickStat(m_pBrickStatVec, i, pData.get(), iLength,
+              size_t(tree.m_iComponentCount), tree.m_eComponentType);
+
+  if (EncodeConstantBrick(tree, i, pData.get(), iLength)) {
+    // nothing to write, the value is stored in the ToC
+  } else if (m_eCompression != CT_NONE) {
+    COMPRESSION_TYPE eUsed = CT_NONE;
+    PREFILTER_TYPE eFilterUsed = PF_NONE;
+    const uint64_t newlen = CompressBrick(tree, i, pData, iLength,
+                                          pCompressed, eUsed, eFilterUsed);
+    tree.m_vTOC[i].m_iLength = newlen;
+    tree.m_vTOC[i].m_eCompression = eUsed;
+    tree.m_vTOC[i].m_ePreFilter = eFilterUsed;
+    if (eUsed != CT_NONE) return pCompressed;
+  }
+  return pData;
+}
+
+/// @returns true if any brick of the tree is stored in atlas format
+static bool HasAtlasBricks(const ExtendedOctree& tree) {
+  uint64_t iBrickCount = 0;
+  for (uint64_t iLoD = 0;iLoD<tree.GetLODCount();iLoD++)
+    iBrickCount += tree.GetBrickCount(iLoD).volume();
+  for (uint64_t i = 0;i<iBrickCount;i++) {
+    const TOCEntry& t = tree.GetBrickToCData(size_t(i));
+    if (t.m_iAtlasSize.x != 0 && t.m_iAtlasSize.y != 0) return true;
+  }
+  return false;
+}
+
+/*
+ FootprintInFinestLoD:
+
+ Computes the box of level 0 voxels [vMin, vMax) a brick of the tree,
+ including its overlap, is computed from. Every level halves the axes that
+ are larger than one voxel, the last voxel of an odd axis covers just one
+ voxel of the finer level.
+*/
+static void FootprintInFinestLoD(const ExtendedOctree& tree,
+                                 const UINT64VECTOR4& vBrickCoords,
+                                 UINT64VECTOR3& vMin, UINT64VECTOR3& vMax) {
+  const UINT64VECTOR3 vBrickSize = tree.ComputeBrickSize(vBrickCoords);
+  const UINT64VECTOR3 vDomain = tree.GetLoDSize(vBrickCoords.w);
+  const UINT64VECTOR3 vInner(tree.GetMaxBrickSize().x - 2*tree.GetOverlap(),
+                             tree.GetMaxBrickSize().y - 2*tree.GetOverlap(),
+                             tree.GetMaxBrickSize().z - 2*tree.GetOverlap());
+  for (size_t a = 0;a<3;a++) {
+    const int64_t iStart = int64_t(vBrickCoords[a]*vInner[a]) -
+                           int64_t(tree.GetOverlap());
+    vMin[a] = uint64_t(std::max<int64_t>(iStart, 0));
+    vMax[a] = std::min<uint64_t>(uint64_t(iStart + int64_t(vBrickSize[a])),
+                                 vDomain[a]);
+  }
+  for (uint64_t iLoD = vBrickCoords.w;iLoD>0;iLoD--) {
+    const UINT64VECTOR3 vFiner = tree.GetLoDSize(iLoD-1);
+    for (size_t a = 0;a<3;a++) {
+      if (vFiner[a] > 1) {
+        vMin[a] *= 2;
+        vMax[a] = std::min<uint64_t>(vMax[a]*2, vFiner[a]);
+      }
+    }
+  }
+}
+
+/// @returns the position of a level 0 voxel in the normalized coordinates
+/// the crop plane is given in
+static FLOATVECTOR3 NormalizedCoords(const UINT64VECTOR3& vVoxel,
+                                     const UINT64VECTOR3& vDomain) {
+  return FLOATVECTOR3(float(vVoxel.x) / float(vDomain.x) - 0.5f,
+                      float(vVoxel.y) / float(vDomain.y) - 0.5f,
+                      float(vVoxel.z) / float(vDomain.z) - 0.5f);
+}
+
+/*
+ ClassifyBox:
+
+ Evaluates the plane at the eight corner voxels of a box, as the plane
+ equation is linear these bound all voxels in between. Returns -1 if no
+ voxel of the box is clipped, 1 if all of them are and 0 if the plane
+ passes through the box. Corners within rounding distance of the plane
+ count as intersected so the voxel test decides for them.
+*/
+static int ClassifyBox(const PLANE<float>& plane, const UINT64VECTOR3& vMin,
+                       const UINT64VECTOR3& vMax,
+                       const UINT64VECTOR3& vDomain) {
+  const float fEpsilon = 1e-5f * (std::fabs(plane.x) + std::fabs(plane.y) +
+                                  std::fabs(plane.z) + std::fabs(plane.w));
+  float fMin = std::numeric_limits<float>::max();
+  float fMax = -std::numeric_limits<float>::max();
+  for (int i = 0;i<8;i++) {
+    const UINT64VECTOR3 vCorner((i & 1) ? vMax.x-1 : vMin.x,
+                                (i & 2) ? vMax.y-1 : vMin.y,
+                                (i & 4) ? vMax.z-1 : vMin.z);
+    const FLOATVECTOR3 p = NormalizedCoords(vCorner, vDomain);
+    const float d = p.x*plane.x + p.y*plane.y + p.z*plane.z + plane.w;
+    fMin = std::min(fMin, d);
+    fMax = std::max(fMax, d);
+  }
+  if (fMin > fEpsilon) return 1;
+  if (fMax < -fEpsilon) return -1;
+  return 0;
+}
+
+/// @returns the voxel position nearest to i in [0, iSize)
+static int64_t ClampToDomain(int64_t i, uint64_t iSize) {
+  return std::min<int64_t>(std::max<int64_t>(i, 0), int64_t(iSize)-1);
+}
+
+/*
+ MaskBrick:
+
+ Clears all voxels of a level 0 brick that are clipped by the plane. Overlap
+ voxels outside of the domain are tested at the border voxel they were
+ copied from (or are zero already).
+*/
+static void MaskBrick(const ExtendedOctree& tree,
+                      const UINT64VECTOR4& vBrickCoords, uint8_t* pData,
+                      const PLANE<float>& plane) {
+  const UINT64VECTOR3 vBrickSize = tree.ComputeBrickSize(vBrickCoords);
+  const UINT64VECTOR3 vDomain = tree.GetLoDSize(0);
+  const size_t iVoxelSize = tree.GetComponentTypeSize() *
+                            size_t(tree.GetComponentCount());
+  int64_t iStart[3];
+  for (size_t a = 0;a<3;a++)
+    iStart[a] = int64_t(vBrickCoords[a]*(tree.GetMaxBrickSize()[a] -
+                                         2*tree.GetOverlap())) -
+                int64_t(tree.GetOverlap());
+
+  for (uint64_t z = 0;z<vBrickSize.z;z++) {
+    for (uint64_t y = 0;y<vBrickSize.y;y++) {
+      for (uint64_t x = 0;x<vBrickSize.x;x++) {
+        const UINT64VECTOR3 vVoxel(
+          uint64_t(ClampToDomain(iStart[0]+int64_t(x), vDomain.x)),
+          uint64_t(ClampToDomain(iStart[1]+int64_t(y), vDomain.y)),
+          uint64_t(ClampToDomain(iStart[2]+int64_t(z), vDomain.z)));
+        if (plane.clip(NormalizedCoords(vVoxel, vDomain)))
+          memset(pData + iVoxelSize*(x + y*vBrickSize.x +
+                                     z*vBrickSize.x*vBrickSize.y),
+                 0, iVoxelSize);
+      }
+    }
+  }
+}
+
+void ExtendedOctreeConverter::DownsampleRegion(const ExtendedOctree& tree,
+                                               bool bComputeMedian,
+                                               const uint8_t* pSourceData,
+                                               const UINT64VECTOR3& sourceSize,
+                                               const UINT64VECTOR3& sourceOffset,
+                                               const UINT64VECTOR3& sourceExtent,
+                                               uint8_t* pData,
+                                               const UINT64VECTOR3& targetSize,
+                                               const UINT64VECTOR3& targetOffset,
+                                               const UINT64VECTOR3& vFactor) {
+#define DOWNSAMPLE(T) \
+  do { \
+    if (bComputeMedian) \
+      DownsampleRegion<T, true>((const T*)pSourceData, sourceSize, \
+                                sourceOffset, sourceExtent, (T*)pData, \
+                                targetSize, targetOffset, vFactor, \
+                                tree.m_iComponentCount); \
+    else \
+      DownsampleRegion<T, false>((const T*)pSourceData, sourceSize, \
+                                 sourceOffset, sourceExtent, (T*)pData, \
+                                 targetSize, targetOffset, vFactor, \
+                                 tree.m_iComponentCount); \
+  } while(0)
+
+  switch (tree.m_eComponentType) {
+    case ExtendedOctree::CT_UINT8:   DOWNSAMPLE(uint8_t);  break;
+    case ExtendedOctree::CT_UINT16:  DOWNSAMPLE(uint16_t); break;
+    case ExtendedOctree::CT_UINT32:  DOWNSAMPLE(uint32_t); break;
+    case ExtendedOctree::CT_UINT64:  DOWNSAMPLE(uint64_t); break;
+    case ExtendedOctree::CT_INT8:    DOWNSAMPLE(int8_t);   break;
+    case ExtendedOctree::CT_INT16:   DOWNSAMPLE(int16_t);  break;
+    case ExtendedOctree::CT_INT32:   DOWNSAMPLE(int32_t);  break;
+    case ExtendedOctree::CT_INT64:   DOWNSAMPLE(int64_t);  break;
+    case ExtendedOctree::CT_FLOAT32: DOWNSAMPLE(float);    break;
+    case ExtendedOctree::CT_FLOAT64: DOWNSAMPLE(double);   break;
+  }
+#undef DOWNSAMPLE
+}
+
+/*
+ RecomputeBrick:
+
+ Produces the same brick as DownsampleBrick followed by FillOverlap, but
+ reads the finer level through the ToC of a finished tree. The in-domain
+ part of the brick, overlap included, is down-sampled from every finer
+ brick that covers it; since the brick cores have an even size the voxel
+ pairs never straddle two finer bricks. Overlap outside of the domain is
+ then clamped or cleared.
+*/
+void ExtendedOctreeConverter::RecomputeBrick(const ExtendedOctree& tree,
+                                             const UINT64VECTOR4& vBrickCoords,
+                                             uint8_t* pData,
+                                             std::vector<uint8_t>& vSourceData,
+                                             bool bComputeMedian,
+                                             bool bClampToEdge) {
+  assert(vBrickCoords.w > 0);
+  const size_t iVoxelSize = tree.GetComponentTypeSize() *
+                            size_t(tree.m_iComponentCount);
+  vSourceData.resize(size_t(tree.m_iBrickSize.volume() * iVoxelSize));
+
+  const uint64_t iOverlap = tree.m_iOverlap;
+  const UINT64VECTOR3 vBrickSize = tree.ComputeBrickSize(vBrickCoords);
+  const UINT64VECTOR3 vDomain = tree.GetLoDSize(vBrickCoords.w);
+  const UINT64VECTOR3 vFineDomain = tree.GetLoDSize(vBrickCoords.w-1);
+  const UINT64VECTOR3 vInner(tree.m_iBrickSize.x - 2*iOverlap,
+                             tree.m_iBrickSize.y - 2*iOverlap,
+                             tree.m_iBrickSize.z - 2*iOverlap);
+
+  int64_t iStart[3];
+  UINT64VECTOR3 vFactor, vFineMin, vFineMax, vFirst, vLast;
+  bool bInDomain = true;
+  for (size_t a = 0;a<3;a++) {
+    iStart[a] = int64_t(vBrickCoords[a]*vInner[a]) - int64_t(iOverlap);
+    const uint64_t iMin = uint64_t(std::max<int64_t>(iStart[a], 0));
+    const uint64_t iMax = std::min<uint64_t>(
+      uint64_t(iStart[a] + int64_t(vBrickSize[a])), vDomain[a]
+    );
+    bInDomain = bInDomain && iStart[a] >= 0 &&
+                iMin + vBrickSize[a] == iMax;
+    vFactor[a] = vFineDomain[a] > 1 ? 2 : 1;
+    vFineMin[a] = iMin*vFactor[a];
+    vFineMax[a] = std::min<uint64_t>(iMax*vFactor[a], vFineDomain[a]);
+    vFirst[a] = vFineMin[a] / vInner[a];
+    vLast[a] = (vFineMax[a]-1) / vInner[a];
+  }
+
+  for (uint64_t z = vFirst.z;z<=vLast.z;z++) {
+    for (uint64_t y = vFirst.y;y<=vLast.y;y++) {
+      for (uint64_t x = vFirst.x;x<=vLast.x;x++) {
+        const UINT64VECTOR4 sourceCoords(x, y, z, vBrickCoords.w-1);
+        const UINT64VECTOR3 sourceSize = tree.ComputeBrickSize(sourceCoords);
+        tree.GetBrickData(&vSourceData[0], sourceCoords);
+
+        UINT64VECTOR3 sourceOffset, sourceExtent, targetOffset;
+        for (size_t a = 0;a<3;a++) {
+          const uint64_t iCoreMin = sourceCoords[a]*vInner[a];
+          const uint64_t iCoreMax = iCoreMin + sourceSize[a] - 2*iOverlap;
+          const uint64_t iFrom = std::max(iCoreMin, vFineMin[a]);
+          const uint64_t iTo = std::min(iCoreMax, vFineMax[a]);
+          assert(iFrom % vFactor[a] == 0);
+          sourceOffset[a] = iOverlap + iFrom - iCoreMin;
+          sourceExtent[a] = iTo - iFrom;
+          targetOffset[a] = uint64_t(int64_t(iFrom / vFactor[a]) - iStart[a]);
+        }
+        DownsampleRegion(tree, bComputeMedian, &vSourceData[0], sourceSize,
+                         sourceOffset, sourceExtent, pData, vBrickSize,
+                         targetOffset, vFactor);
+      }
+    }
+  }
+
+  if (bInDomain) return;
+
+  for (uint64_t z = 0;z<vBrickSize.z;z++) {
+    for (uint64_t y = 0;y<vBrickSize.y;y++) {
+      for (uint64_t x = 0;x<vBrickSize.x;x++) {
+        const int64_t g[3] = {iStart[0]+int64_t(x), iStart[1]+int64_t(y),
+                              iStart[2]+int64_t(z)};
+        int64_t c[3];
+        for (size_t a = 0;a<3;a++)
+          c[a] = ClampToDomain(g[a], vDomain[a]);
+        if (c[0] == g[0] && c[1] == g[1] && c[2] == g[2]) continue;
+
+        uint8_t* pTarget = pData + iVoxelSize * (x + y*vBrickSize.x +
+                                                 z*vBrickSize.x*vBrickSize.y);
+        if (bClampToEdge) {
+          const uint8_t* pSource = pData + iVoxelSize * (
+              uint64_t(c[0]-iStart[0])
+            + uint64_t(c[1]-iStart[1])*vBrickSize.x
+            + uint64_t(c[2]-iStart[2])*vBrickSize.x*vBrickSize.y
+          );
+          memcpy(pTarget, pSource, iVoxelSize);
+        } else {
+          memset(pTarget, 0, iVoxelSize);
+        }
+      }
+    }
+  }
+}
+
+/*
+ Crop:
+
+ Walks through the bricks in index order, so all bricks of a finer level
+ are written before the first brick of the next level needs them. Every
+ brick is classified by the level 0 footprint of its voxels: bricks without
+ clipped voxels are copied from the input, payload and encoding included,
+ bricks that are clipped entirely are replaced by zeros and the remaining
+ bricks are masked (level 0) or down-sampled from the cropped finer level.
+*/
+bool ExtendedOctreeConverter::Crop(const ExtendedOctree& tree,
+                                   const PLANE<float>& plane,
+                                   LargeRAWFile_ptr pLargeRAWFileOut,
+                                   uint64_t iOutOffset,
+                                   BrickStatVec* stats,
+                                   const BrickStatVec* pInputStats,
+                                   COMPRESSION_TYPE compression,
+                                   bool bComputeMedian,
+                                   bool bClampToEdge) {
+  if (HasAtlasBricks(tree)) {
+    m_Progress.Error(_func_, "Cannot crop octrees in atlas format.");
+    return false;
+  }
+
+  m_pBrickStatVec = stats;
+  m_fProgress = 0.0f;
+  m_vBrickCache.clear();
+
+  ExtendedOctree e;
+  e.m_eComponentType = tree.m_eComponentType;
+  e.m_iComponentCount = tree.m_iComponentCount;
+  e.m_bPrecomputedNormals = tree.m_bPrecomputedNormals;
+  e.m_vVolumeSize = tree.m_vVolumeSize;
+  e.m_vVolumeAspect = tree.m_vVolumeAspect;
+  e.m_iBrickSize = tree.m_iBrickSize;
+  e.m_iOverlap = tree.m_iOverlap;
+  e.m_iOffset = iOutOffset;
+  e.m_pLargeRAWFile = pLargeRAWFileOut;
+  // copied LZMA bricks depend on the level of the input
+  e.m_iCompressionLevel = tree.m_iCompressionLevel;
+  e.ComputeMetadata();
+
+  m_eCompression = compression;
+  if (m_eCompression >= CT_UNKNOWN || m_eCompression == CT_CONSTANT) {
+    m_Progress.Warning(_func_, "Unknown compression method requested (%d), "
+                       "resetting to default zlib compression", m_eCompression);
+    m_eCompression = CT_ZLIB;
+  }
+
+  const size_t iComponentCount = size_t(e.m_iComponentCount);
+  const size_t iVoxelSize = e.GetComponentTypeSize() * iComponentCount;
+  const size_t maxbricksize = static_cast<size_t>(e.m_iBrickSize.volume() *
+                                                  iVoxelSize);
+  std::shared_ptr<uint8_t> BrickData(new uint8_t[maxbricksize],
+                                     nonstd::DeleteArray<uint8_t>());
+  std::shared_ptr<uint8_t> compressed(new uint8_t[maxbricksize],
+                                      nonstd::DeleteArray<uint8_t>());
+  std::vector<uint8_t> vSourceData;
+  std::vector<uint8_t> vPayload;
+
+  const size_t iBrickCount = tree.m_vTOC.size();
+  const size_t iReportInterval = std::max<size_t>(1, iBrickCount/2000);
+  uint64_t iWriteOffset = e.ComputeHeaderSize();
+  uint64_t iCopied = 0, iCleared = 0;
+
+  for (size_t i = 0;i<iBrickCount;i++) {
+    const UINT64VECTOR4 coords = e.IndexToBrickCoords(i);
+    const uint64_t iBrickSize = e.ComputeBrickSize(coords).volume() *
+                                iVoxelSize;
+    UINT64VECTOR3 vMin, vMax;
+    FootprintInFinestLoD(e, coords, vMin, vMax);
+    const int iSide = ClassifyBox(plane, vMin, vMax, e.m_vVolumeSize);
+
+    if (iSide < 0) {
+      // nothing clipped, take the brick as it is
+      TOCEntry t = tree.m_vTOC[i];
+      t.m_iOffset = iWriteOffset;
+      e.m_vTOC.push_back(t);
+      if (t.m_iLength > 0) {
+        vPayload.resize(size_t(t.m_iLength));
+#pragma omp critical(ExtendedOctreeRead)
+        {
+          tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset +
+                                        tree.m_vTOC[i].m_iOffset);
+          tree.m_pLargeRAWFile->ReadRAW(&vPayload[0], t.m_iLength);
+        }
+        pLargeRAWFileOut->SeekPos(iOutOffset + iWriteOffset);
+        pLargeRAWFileOut->WriteRAW(&vPayload[0], t.m_iLength);
+      }
+      iWriteOffset += t.m_iLength;
+
+      if (m_pBrickStatVec) {
+        if (pInputStats && pInputStats->size() >= (i+1)*iComponentCount) {
+          if (m_pBrickStatVec->size() < (i+1)*iComponentCount)
+            m_pBrickStatVec->resize((i+1)*iComponentCount);
+          std::copy(pInputStats->begin() + i*iComponentCount,
+                    pInputStats->begin() + (i+1)*iComponentCount,
+                    m_pBrickStatVec->begin() + i*iComponentCount);
+        } else {
+          tree.GetBrickData(BrickData.get(), i);
+          BrickStat(m_pBrickStatVec, i, BrickData.get(), iBrickSize,
+                    iComponentCount, e.m_eComponentType);
+        }
+      }
+      ++iCopied;
+    } else {
+      if (iSide > 0) {
+        memset(BrickData.get(), 0, size_t(iBrickSize));
+        ++iCleared;
+      } else if (coords.w == 0) {
+        tree.GetBrickData(BrickData.get(), i);
+        MaskBrick(e, coords, BrickData.get(), plane);
+      } else {
+        RecomputeBrick(e, coords, BrickData.get(), vSourceData,
+                       bComputeMedian, bClampToEdge);
+      }
+      AppendBrick(e, BrickData, iBrickSize, compressed, iWriteOffset);
+    }
+
+    if (i % iReportInterval == 0) {
+      m_fProgress = float(i) / iBrickCount;
+      std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
+      m_Progress.Message(_func_, "Cropping bricks .. %5.2f%% (%s)",
+                         m_fProgress*100.0f, msg.c_str());
+    }
+  }
+
+  m_Progress.Message(_func_, "Copied %llu, cleared %llu and recomputed %llu "
+                     "of %llu bricks", iCopied, iCleared,
+                     uint64_t(iBrickCount) - iCopied - iCleared,
+                     uint64_t(iBrickCount));
+
+  e.m_iSize = e.m_vTOC.back().m_iOffset + e.m_vTOC.back().m_iLength;
+  e.WriteHeader(pLargeRAWFileOut, iOutOffset);
+  pLargeRAWFileOut->Truncate(iOutOffset + e.m_iSize);
+
+  m_fProgress = 1.0f;
+  return true;
+}
+
+/*
+ UpdateBricks:
+
+ Tracks the core boxes of the replaced level 0 bricks through the levels,
+ every level halves them the same way it halves the domain. A brick of a
+ coarser level has to be recomputed if its voxels, overlap included,
+ intersect one of these boxes. The levels are processed from fine to
+ coarse so RecomputeBrick always reads the already updated finer level.
+ If the tree is followed by other data, the ToC entry and the payload of
+ every brick are saved before it is overwritten, so the update can be
+ undone when a brick does not fit into its slot.
+*/
+bool ExtendedOctreeConverter::UpdateBricks(ExtendedOctree& tree,
+                                           const std::vector<UINT64VECTOR4>& vBrickCoords,
+                                           const std::vector<std::shared_ptr<uint8_t>>& vBrickData,
+                                           BrickStatVec* stats,
+                                           std::vector<uint64_t>* pUpdatedBricks,
+                                           COMPRESSION_TYPE compression,
+                                           bool bComputeMedian,
+                                           bool bClampToEdge) {
+  if (vBrickCoords.size() != vBrickData.size()) {
+    m_Progress.Error(_func_, "Got %llu bricks but data for %llu bricks.",
+                     uint64_t(vBrickCoords.size()),
+                     uint64_t(vBrickData.size()));
+    return false;
+  }
+  if (HasAtlasBricks(tree)) {
+    m_Progress.Error(_func_, "Cannot update octrees in atlas format.");
+    return false;
+  }
+  // version 0 files have no ToC to point to moved bricks
+  if (tree.m_iVersion == 0) {
+    m_Progress.Error(_func_, "Cannot update octrees of version 0.");
+    return false;
+  }
+  const UINT64VECTOR3 vLoD0Count = tree.GetBrickCount(0);
+  for (size_t i = 0;i<vBrickCoords.size();i++) {
+    const UINT64VECTOR4& c = vBrickCoords[i];
+    if (c.w != 0 || c.x >= vLoD0Count.x || c.y >= vLoD0Count.y ||
+        c.z >= vLoD0Count.z) {
+      m_Progress.Error(_func_, "Brick (%llu, %llu, %llu, %llu) is not a "
+                       "brick of the finest level.", c.x, c.y, c.z, c.w);
+      return false;
+    }
+  }
+  // bricks that do not fit into their old slot are appended, unless that
+  // would overwrite whatever follows the tree
+  const bool bMayGrow = tree.m_pLargeRAWFile->GetCurrentSize() <=
+                        tree.m_iOffset + tree.m_iSize;
+
+  const bool bTreeWasInRWModeAlready = tree.IsInRWMode();
+  if (!bTreeWasInRWModeAlready && !tree.ReOpenRW()) {
+    m_Progress.Error(_func_, "Could not reopen octree file for writing.");
+    return false;
+  }
+
+  m_pBrickStatVec = stats;
+  m_fProgress = 0.0f;
+  m_vBrickCache.clear();
+
+  m_eCompression = compression;
+  if (m_eCompression >= CT_UNKNOWN || m_eCompression == CT_CONSTANT) {
+    m_Progress.Warning(_func_, "Unknown compression method requested (%d), "
+                       "resetting to default zlib compression", m_eCompression);
+    m_eCompression = CT_ZLIB;
+  }
+
+  const size_t iVoxelSize = tree.GetComponentTypeSize() *
+                            size_t(tree.m_iComponentCount);
+  const size_t maxbricksize = static_cast<size_t>(tree.m_iBrickSize.volume() *
+                                                  iVoxelSize);
+  std::shared_ptr<uint8_t> BrickData(new uint8_t[maxbricksize],
+                                     nonstd::DeleteArray<uint8_t>());
+  std::shared_ptr<uint8_t> compressed(new uint8_t[maxbricksize],
+                                      nonstd::DeleteArray<uint8_t>());
+  std::vector<uint8_t> vSourceData;
+
+  struct SavedBrick {
+    uint64_t index;
+    TOCEntry entry;
+    std::vector<uint8_t> payload;
+  };
+  std::vector<SavedBrick> vJournal;
+  BrickStatVec statsBackup;
+  if (!bMayGrow && stats) statsBackup = *stats;
+
+  // rewrites a brick, in place only mode saves the old version first
+  auto rewrite = [&](uint64_t index, std::shared_ptr<uint8_t> pData,
+                     uint64_t iLength) -> bool {
+    if (!bMayGrow) {
+      SavedBrick saved = {index, tree.m_vTOC[size_t(index)],
+                          std::vector<uint8_t>()};
+      saved.payload.resize(size_t(saved.entry.m_iLength));
+      if (!saved.payload.empty()) {
+        tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + saved.entry.m_iOffset);
+        tree.m_pLargeRAWFile->ReadRAW(&saved.payload[0],
+                                      saved.payload.size());
+      }
+      vJournal.push_back(saved);
+    }
+    return RewriteBrick(tree, index, pData, iLength, compressed, bMayGrow);
+  };
+
+  // restores the saved bricks, the latest first
+  auto undo = [&](const char* func) -> bool {
+    for (auto s = vJournal.rbegin();s != vJournal.rend();++s) {
+      tree.m_vTOC[size_t(s->index)] = s->entry;
+      if (!s->payload.empty()) {
+        tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + s->entry.m_iOffset);
+        tree.m_pLargeRAWFile->WriteRAW(&s->payload[0], s->payload.size());
+      }
+    }
+    if (stats) *stats = statsBackup;
+    m_Progress.Error(func, "A brick does not fit into its old slot and "
+                     "the octree cannot grow, the update was undone.");
+    if (!bTreeWasInRWModeAlready) tree.ReOpenR();
+    return false;
+  };
+
+  const uint64_t iOverlap = tree.m_iOverlap;
+  const UINT64VECTOR3 vInner(tree.m_iBrickSize.x - 2*iOverlap,
+                             tree.m_iBrickSize.y - 2*iOverlap,
+                             tree.m_iBrickSize.z - 2*iOverlap);
+
+  // the finest level is taken as it is
+  std::vector<std::pair<UINT64VECTOR3, UINT64VECTOR3>> vBoxes;
+  std::set<uint64_t> updated;
+  for (size_t i = 0;i<vBrickCoords.size();i++) {
+    const UINT64VECTOR4& c = vBrickCoords[i];
+    const UINT64VECTOR3 vBrickSize = tree.ComputeBrickSize(c);
+    const UINT64VECTOR3 vMin(c.x*vInner.x, c.y*vInner.y, c.z*vInner.z);
+    const UINT64VECTOR3 vMax(vMin.x + vBrickSize.x - 2*iOverlap,
+                             vMin.y + vBrickSize.y - 2*iOverlap,
+                             vMin.z + vBrickSize.z - 2*iOverlap);
+    vBoxes.push_back(std::make_pair(vMin, vMax));
+
+    const uint64_t index = tree.BrickCoordsToIndex(c);
+    if (!rewrite(index, vBrickData[i], vBrickSize.volume() * iVoxelSize))
+      return undo(_func_);
+    updated.insert(index);
+  }
+  uint64_t iRecomputed = 0;
+
+  for (uint64_t iLoD = 1;iLoD<tree.GetLODCount();iLoD++) {
+    const UINT64VECTOR3 vFinerDomain = tree.GetLoDSize(iLoD-1);
+    const UINT64VECTOR3 vBrickCount = tree.GetBrickCount(iLoD);
+
+    std::set<uint64_t> level;
+    for (size_t b = 0;b<vBoxes.size();b++) {
+      UINT64VECTOR3& vMin = vBoxes[b].first;
+      UINT64VECTOR3& vMax = vBoxes[b].second;
+      UINT64VECTOR3 vFirst, vLast;
+      for (size_t a = 0;a<3;a++) {
+        if (vFinerDomain[a] > 1) {
+          vMin[a] /= 2;
+          vMax[a] = (vMax[a]+1) / 2;
+        }
+        // brick i holds the voxels [i*inner-overlap, (i+1)*inner+overlap)
+        vFirst[a] = vMin[a] > iOverlap ? (vMin[a]-iOverlap) / vInner[a] : 0;
+        vLast[a] = std::min<uint64_t>((vMax[a]+iOverlap-1) / vInner[a],
+                                      vBrickCount[a]-1);
+      }
+      for (uint64_t z = vFirst.z;z<=vLast.z;z++)
+        for (uint64_t y = vFirst.y;y<=vLast.y;y++)
+          for (uint64_t x = vFirst.x;x<=vLast.x;x++)
+            level.insert(tree.BrickCoordsToIndex(UINT64VECTOR4(x,y,z,iLoD)));
+    }
+
+    for (auto i = level.begin();i != level.end();++i) {
+      const UINT64VECTOR4 coords = tree.IndexToBrickCoords(*i);
+      RecomputeBrick(tree, coords, BrickData.get(), vSourceData,
+                     bComputeMedian, bClampToEdge);
+      if (!rewrite(*i, BrickData,
+                   tree.ComputeBrickSize(coords).volume() * iVoxelSize))
+        return undo(_func_);
+    }
+    iRecomputed += level.size();
+    updated.insert(level.begin(), level.end());
+
+    m_fProgress = float(iLoD) / float(tree.GetLODCount());
+  }
+
+  m_Progress.Message(_func_, "Replaced %llu and recomputed %llu of %llu "
+                     "bricks", uint64_t(vBrickCoords.size()), iRecomputed,
+                     uint64_t(tree.m_vTOC.size()));
+
+  tree.WriteHeader(tree.m_pLargeRAWFile, tree.m_iOffset);
+
+  if (!bTreeWasInRWModeAlready && !tree.ReOpenR()) {
+    m_Progress.Error(_func_, "Could not reopen octree file read-only.");
+    return false;
+  }
+
+  if (pUpdatedBricks)
+    pUpdatedBricks->assign(updated.begin(), updated.end());
+
+  m_fProgress = 1.0f;
+  return true;
+}
+
 /// Computes max min statistics for each brick and rewrites 
-/// it using compression, if desired.
+/// it using compression, if desired. Bricks that hold a single value
+/// are turned into constant bricks and vanish from the data section.
 void ExtendedOctreeConverter::ComputeStatsAndCompressAll(ExtendedOctree& tree)
 {
   FlushCache(tree); // be sure we've got everything on disk.
@@ -480,84 +1377,54 @@ void ExtendedOctreeConverter::ComputeStatsAndCompressAll(ExtendedOctree& tree)
 
   size_t iReportInterval = std::max<size_t>(1, tree.m_vTOC.size()/2000);
 
-  if(m_eCompression == CT_NONE) {
-    // compression is disabled.  That makes our job pretty easy: only compute
-    // the brick stats
-    for(size_t i=0; i < tree.m_vTOC.size(); ++i) {
-      tree.GetBrickData(BrickData.get(), i);
-      BrickStat(m_pBrickStatVec, i, BrickData.get(), BrickSize(tree, i),
-                tree.m_iComponentCount, tree.m_eComponentType);
-
-      if (i % iReportInterval == 0) {
-        m_fProgress = float(i) / tree.m_vTOC.size();
-        std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
-        m_Progress.Message(_func_, "Statistic computation ... %5.2f%% (%s)",
-                           m_fProgress*100.0f, msg.c_str());
-      }
+  // bricks only ever shrink, so we can compact the file in-place: the
+  // write position never overtakes the read position of the next brick
+  uint64_t iWriteOffset = tree.m_vTOC.empty() ? 0 : tree.m_vTOC[0].m_iOffset;
+
+  // foreach brick:
+  //   load it up
+  //   turn it into a constant brick if it holds a single value, or
+  //   compress it
+  //   write payload (if it moved or changed)
+  //   update brick metadata based on what compression changed
+  for(size_t i=0; i < tree.m_vTOC.size(); ++i) {
+    tree.GetBrickData(BrickData.get(), i);
+    m_OutputStream.Advance(tree.m_vTOC[i].m_iLength);
+    const uint64_t iBrickSize = BrickSize(tree, i);
+    BrickStat(m_pBrickStatVec, i, BrickData.get(), iBrickSize,
+              tree.m_iComponentCount, tree.m_eComponentType);
+
+    std::shared_ptr<uint8_t> data = BrickData;
+    const bool bMoved = tree.m_vTOC[i].m_iOffset != iWriteOffset;
+    bool bChanged = false;
+
+    if (EncodeConstantBrick(tree, i, BrickData.get(), iBrickSize)) {
+      // nothing to write, the value is stored in the ToC
+    } else if (m_eCompression != CT_NONE) {
+      COMPRESSION_TYPE eUsed = CT_NONE;
+      PREFILTER_TYPE eFilterUsed = PF_NONE;
+      const uint64_t newlen = CompressBrick(tree, i, BrickData, iBrickSize,
+                                            compressed, eUsed, eFilterUsed);
+      tree.m_vTOC[i].m_iLength = newlen;
+      tree.m_vTOC[i].m_eCompression = eUsed;
+      tree.m_vTOC[i].m_ePreFilter = eFilterUsed;
+      if (eUsed != CT_NONE) data = compressed;
+      bChanged = true;
     }
-  } else {
-    std::array<uint8_t, 5> lzmaProps;
-
-    // foreach brick:
-    //   load it up
-    //   compress it
-    //   write compressed payload
-    //   update brick metadata based on what compression changed
-    for(size_t i=0; i < tree.m_vTOC.size(); ++i) {
-      tree.GetBrickData(BrickData.get(), i);
-      BrickStat(m_pBrickStatVec, i, BrickData.get(), BrickSize(tree, i),
-                tree.m_iComponentCount, tree.m_eComponentType);
-
-      uint64_t newlen = 0;
-      switch (m_eCompression) {
-      case CT_ZLIB:
-        newlen = zCompress(BrickData, BrickSize(tree, i), compressed,
-                           tree.m_iCompressionLevel); // 0..9 (0 no comp)
-        break;
-      case CT_LZMA:
-        newlen = lzmaCompress(BrickData, BrickSize(tree, i), compressed,
-                              lzmaProps, tree.m_iCompressionLevel - 1); // 0..9
-        assert(lzmaProps == tree.m_lzmaProps);
-        break;
-      case CT_LZ4:
-        newlen = lz4Compress(BrickData, BrickSize(tree, i), compressed,
-                             tree.m_iCompressionLevel > 5); // high or normal
-        break;
-      case CT_BZLIB:
-        newlen = bzCompress(BrickData, BrickSize(tree, i), compressed,
-                            tree.m_iCompressionLevel); // 1..9
-        break;
-      case CT_LZHAM:
-        newlen = lzhamCompress(BrickData, BrickSize(tree, i), compressed,
-                               tree.m_iCompressionLevel); // 0..10 (0 no comp)
-        break;
-      default:
-        throw std::runtime_error("unknown compression format");
-      }
-      std::shared_ptr<uint8_t> data;
 
-      if(newlen < BrickSize(tree, i)) {
-        tree.m_vTOC[i].m_iLength = newlen;
-        tree.m_vTOC[i].m_eCompression = m_eCompression;
-        data = compressed;
-      } else {
-        tree.m_vTOC[i].m_iLength = BrickSize(tree, i);
-        tree.m_vTOC[i].m_eCompression = CT_NONE;
-        data = BrickData;
-      }
-      if(i > 0) {
-        tree.m_vTOC[i].m_iOffset = tree.m_vTOC[i-1].m_iOffset +
-                                   tree.m_vTOC[i-1].m_iLength;
-      }
-      tree.m_pLargeRAWFile->SeekPos(tree.m_vTOC[i].m_iOffset);
+    tree.m_vTOC[i].m_iOffset = iWriteOffset;
+    if ((bMoved || bChanged) && tree.m_vTOC[i].m_iLength > 0) {
+      tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + tree.m_vTOC[i].m_iOffset);
       tree.m_pLargeRAWFile->WriteRAW(data.get(), tree.m_vTOC[i].m_iLength);
-      
-      if (i % iReportInterval == 0) {
-        m_fProgress = float(i) / tree.m_vTOC.size();
-        std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
-        m_Progress.Message(_func_, "Statistics and compression .. %5.2f%% (%s)",
-                           m_fProgress*100.0f, msg.c_str());
-      }
+      m_OutputStream.Advance(tree.m_vTOC[i].m_iLength);
+    }
+    iWriteOffset += tree.m_vTOC[i].m_iLength;
+
+    if (i % iReportInterval == 0) {
+      m_fProgress = float(i) / tree.m_vTOC.size();
+      std::string msg = m_pProgressTimer->GetProgressMessage(m_fProgress);
+      m_Progress.Message(_func_, "Statistics and compression .. %5.2f%% (%s)",
+                         m_fProgress*100.0f, msg.c_str());
     }
   }
 
@@ -565,6 +1432,227 @@ void ExtendedOctreeConverter::ComputeStatsAndCompressAll(ExtendedOctree& tree)
   tree.m_iSize = tree.m_vTOC.back().m_iOffset + tree.m_vTOC.back().m_iLength;
 }
 
+/*
+  EncodeConstantBrick:
+
+  If all voxels of the brick are equal and a voxel fits into the ToC
+  entry, the brick is turned into a CT_CONSTANT brick of length zero.
+  The offset is left alone so that the offset of the next brick can
+  still be computed as offset + length of the previous one.
+*/
+bool ExtendedOctreeConverter::EncodeConstantBrick(ExtendedOctree& tree,
+                                                  uint64_t index,
+                                                  const uint8_t* pData,
+                                                  uint64_t iLength)
+{
+  TOCEntry& record = tree.m_vTOC[size_t(index)];
+  const size_t iVoxelSize = tree.GetComponentTypeSize() *
+                            size_t(tree.m_iComponentCount);
+
+  // the value has to fit into the m_iValidLength field, version 0 files do
+  // not store that field at all and CT_CONSTANT needs version 3, which
+  // only version 2 trees can be upgraded to in place (see WriteHeader)
+  if (tree.m_iVersion < 2 || iVoxelSize > sizeof(record.m_iValidLength))
+    return false;
+  // atlantified bricks are read back as they are stored on disk
+  if (record.m_iAtlasSize.area() != 0)
+    return false;
+  if (!VolumeTools::IsConstant(pData, size_t(iLength), iVoxelSize))
+    return false;
+
+  record.m_iValidLength = 0;
+  memcpy(&record.m_iValidLength, pData, iVoxelSize);
+  record.m_iLength = 0;
+  record.m_eCompression = CT_CONSTANT;
+  return true;
+}
+
+/*
+  CompressBrick (static):
+
+  Compresses a brick with the given codec and level, this is the only
+  place that knows about the level conventions of the various codecs.
+  LZMA always uses the level of the tree as the decoder derives its
+  properties from that.
+*/
+uint64_t ExtendedOctreeConverter::CompressBrick(const ExtendedOctree& tree,
+                                               COMPRESSION_TYPE eCompression,
+                                               uint32_t iCompressionLevel,
+                                               std::shared_ptr<uint8_t> pData,
+                                               uint64_t iLength,
+                                               std::shared_ptr<uint8_t>& pCompressed)
+{
+  switch (eCompression) {
+  case CT_ZLIB:
+    return zCompress(pData, size_t(iLength), pCompressed,
+                     iCompressionLevel); // 0..9 (0 no comp)
+  case CT_LZMA: {
+    // we only use the encoded props for safety checks
+    // they should be identical for all bricks of the tree
+    std::array<uint8_t, 5> props;
+    const uint64_t iCompressed = lzmaCompress(pData, size_t(iLength),
+                                              pCompressed, props,
+                                              tree.m_iCompressionLevel - 1); // 0..9
+    assert(props == tree.m_lzmaProps);
+    return iCompressed; }
+  case CT_LZ4:
+    return lz4Compress(pData, size_t(iLength), pCompressed,
+                       iCompressionLevel > 5); // high or normal
+  case CT_BZLIB:
+    return bzCompress(pData, size_t(iLength), pCompressed,
+                      iCompressionLevel); // 1..9
+  case CT_LZHAM:
+    return lzhamCompress(pData, size_t(iLength), pCompressed,
+                         iCompressionLevel); // 0..10 (0 no comp)
+  case CT_ZSTD:
+    return zstdCompress(pData, size_t(iLength), pCompressed,
+                        iCompressionLevel); // 0..22 (0 default)
+  default:
+    throw std::runtime_error("unknown compression format");
+  }
+}
+
+/*
+  ApplyPreFilter (static):
+
+  Runs the reversible transform on a brick before it is compressed, this is
+  the inverse of ExtendedOctree::RevertPreFilter
+*/
+void ExtendedOctreeConverter::ApplyPreFilter(const ExtendedOctree& tree,
+                                             PREFILTER_TYPE ePreFilter,
+                                             const uint8_t* pData,
+                                             uint8_t* pFiltered,
+                                             uint64_t iLength,
+                                             const UINT64VECTOR3& vBrickSize)
+{
+  const size_t iCompSize = tree.GetComponentTypeSize();
+  switch (ePreFilter) {
+  case PF_NONE:
+    memcpy(pFiltered, pData, size_t(iLength));
+    break;
+  case PF_BYTESHUFFLE:
+    byteShuffle(pData, pFiltered, size_t(iLength), iCompSize);
+    break;
+  case PF_BITSHUFFLE:
+    bitShuffle(pData, pFiltered, size_t(iLength), iCompSize);
+    break;
+  case PF_DELTA3D:
+    delta3DEncode(pData, pFiltered, vBrickSize, iCompSize,
+                  size_t(tree.GetComponentCount()));
+    break;
+  case PF_DELTA3D_BYTESHUFFLE: {
+    std::vector<uint8_t> residuals(static_cast<size_t>(iLength));
+    delta3DEncode(pData, residuals.data(), vBrickSize, iCompSize,
+                  size_t(tree.GetComponentCount()));
+    byteShuffle(residuals.data(), pFiltered, size_t(iLength), iCompSize);
+    break; }
+  default:
+    throw std::runtime_error("unknown pre-filter");
+  }
+}
+
+/*
+  CompressBrick:
+
+  Compresses a brick according to the requested compression method of
+  this converter. eUsed returns the codec that was actually applied, it is
+  CT_NONE if compression did not make the brick any smaller in which case
+  pCompressed is undefined and the return value equals iLength. If a
+  pre-filter is set the brick is transformed before compression and
+  eFilterUsed reports the filter, it is always PF_NONE for a brick that
+  is stored uncompressed.
+
+  In adaptive mode every candidate codec is tried in the given order
+  (the fastest decoder should come first). A candidate is only accepted if
+  its decoder runs at least at the configured throughput (measured over
+  repeated decodes of the brick, a budget of 0 skips the measurement) and
+  if it shrinks the brick by the configured fraction compared to the best
+  result so far, so stronger codecs are only picked where they actually
+  pay off.
+*/
+uint64_t ExtendedOctreeConverter::CompressBrick(ExtendedOctree& tree,
+                                               uint64_t index,
+                                               std::shared_ptr<uint8_t> pData,
+                                               uint64_t iLength,
+                                               std::shared_ptr<uint8_t>& pCompressed,
+                                               COMPRESSION_TYPE& eUsed,
+                                               PREFILTER_TYPE& eFilterUsed)
+{
+  IO_TRACE_SCOPE(TR_ENCODE, index);
+  eUsed = CT_NONE;
+  eFilterUsed = PF_NONE;
+
+  const UINT64VECTOR3 vBrickSize =
+    tree.ComputeBrickSize(tree.IndexToBrickCoords(index));
+  // the pre-filter is stored in the ToC starting with version 3, older
+  // trees can only be upgraded from version 2 (see WriteHeader)
+  const PREFILTER_TYPE ePreFilter = (tree.m_iVersion < 2) ? PF_NONE
+                                                          : m_ePreFilter;
+  std::shared_ptr<uint8_t> pSource = pData;
+  if (ePreFilter != PF_NONE) {
+    pSource.reset(new uint8_t[size_t(iLength)],
+                  nonstd::DeleteArray<uint8_t>());
+    ApplyPreFilter(tree, ePreFilter, pData.get(), pSource.get(), iLength,
+                   vBrickSize);
+  }
+
+  if (!m_bAdaptiveCompression) {
+    const uint64_t iCompressed = CompressBrick(tree, m_eCompression,
+                                               tree.m_iCompressionLevel,
+                                               pSource, iLength, pCompressed);
+    if (iCompressed >= iLength) return iLength;
+    eUsed = m_eCompression;
+    eFilterUsed = ePreFilter;
+    return iCompressed;
+  }
+
+  uint64_t iBest = iLength;
+  std::shared_ptr<uint8_t> pCandidate;
+  std::shared_ptr<uint8_t> pDecoded(new uint8_t[size_t(iLength)],
+                                    nonstd::DeleteArray<uint8_t>());
+  std::shared_ptr<uint8_t> pReverted;
+  if (ePreFilter != PF_NONE)
+    pReverted.reset(new uint8_t[size_t(iLength)],
+                    nonstd::DeleteArray<uint8_t>());
+  for (auto c = m_vAdaptiveCandidates.cbegin();
+       c != m_vAdaptiveCandidates.cend(); ++c) {
+    const uint64_t iCompressed = CompressBrick(tree, c->eCompression,
+                                               c->iCompressionLevel,
+                                               pSource, iLength, pCandidate);
+    if (double(iCompressed) > double(iBest) * (1.0 - m_fAdaptiveMinSavings))
+      continue;
+
+    // measure how fast this brick decodes with the candidate codec, a
+    // single decode of a small brick is too short and too noisy to decide
+    // on, so repeat it until enough time has passed
+    if (m_fAdaptiveMinDecodeThroughput > 0.0) {
+      using namespace std::chrono;
+      const steady_clock::time_point start = steady_clock::now();
+      double fSeconds = 0.0;
+      unsigned iRuns = 0;
+      do {
+        tree.DecompressBrick(c->eCompression, pCandidate, iCompressed,
+                             pDecoded, size_t(iLength));
+        if (ePreFilter != PF_NONE)
+          tree.RevertPreFilter(ePreFilter, pDecoded.get(), pReverted.get(),
+                               size_t(iLength), vBrickSize);
+        ++iRuns;
+        fSeconds = duration<double>(steady_clock::now() - start).count();
+      } while (iRuns < iMinDecodeRuns || fSeconds < fMinDecodeSeconds);
+      if (double(iLength) * iRuns / (1024.0*1024.0) / fSeconds <
+          m_fAdaptiveMinDecodeThroughput)
+        continue;
+    }
+
+    iBest = iCompressed;
+    eUsed = c->eCompression;
+    eFilterUsed = ePreFilter;
+    pCompressed = pCandidate;
+    pCandidate.reset();
+  }
+  return iBest;
+}
+
 std::shared_ptr<uint8_t>
 ExtendedOctreeConverter::Fetch(ExtendedOctree& tree,
                                uint64_t iIndex,
@@ -576,6 +1664,7 @@ ExtendedOctreeConverter::Fetch(ExtendedOctree& tree,
     pData.reset(new uint8_t[record.m_iLength], nonstd::DeleteArray<uint8_t>());
   tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + record.m_iOffset);
   tree.m_pLargeRAWFile->ReadRAW(pData.get(), record.m_iLength);
+  m_OutputStream.Advance(record.m_iLength);
 
   // if we are touching the brick the first time compute statistics and compress
   if ((m_pBrickStatVec->size() < (iIndex+1) * tree.m_iComponentCount) ||
@@ -587,53 +1676,134 @@ ExtendedOctreeConverter::Fetch(ExtendedOctree& tree,
     BrickStat(m_pBrickStatVec, iIndex, pData.get(), record.m_iLength,
               tree.m_iComponentCount, tree.m_eComponentType);
 
-    // compress if desired
-    if (m_eCompression != CT_NONE) {
+    // constant bricks do not need any storage, otherwise compress if desired
+    if (EncodeConstantBrick(tree, iIndex, pData.get(), record.m_iLength)) {
+      // the value is stored in the ToC now
+    } else if (m_eCompression != CT_NONE) {
       std::shared_ptr<uint8_t> pCompressed;
-      // *Compress will always create a buffer sized like the input data
-      uint64_t iCompressed = 0;
-      switch (m_eCompression) {
-      case CT_ZLIB:
-        iCompressed = zCompress(pData, record.m_iLength, pCompressed,
-                                tree.m_iCompressionLevel); // 0..9 (0 no comp)
-        break;
-      case CT_LZMA: {
-        // we only use the encoded props for safety checks
-        // they should be identical for all bricks of the tree
-        std::array<uint8_t, 5> props;
-        iCompressed = lzmaCompress(pData, record.m_iLength, pCompressed,
-                                   props, tree.m_iCompressionLevel - 1); // 0..9
-        assert(props == tree.m_lzmaProps);
-        break; }
-      case CT_LZ4:
-        iCompressed = lz4Compress(pData, record.m_iLength, pCompressed,
-                                  tree.m_iCompressionLevel > 5); // high or normal
-        break;
-      case CT_BZLIB:
-        iCompressed = bzCompress(pData, record.m_iLength, pCompressed,
-                                 tree.m_iCompressionLevel); // 1..9
-        break;
-      case CT_LZHAM:
-        iCompressed = lzhamCompress(pData, record.m_iLength, pCompressed,
-                                    tree.m_iCompressionLevel); // 0..10 (0 no comp)
-        break;
-      default:
-        throw std::runtime_error("unknown compression format");
-      }
-      if (iCompressed < record.m_iLength) {
+      COMPRESSION_TYPE eUsed = CT_NONE;
+      PREFILTER_TYPE eFilterUsed = PF_NONE;
+      uint64_t const iCompressed = CompressBrick(tree, iIndex, pData,
+                                                 record.m_iLength, pCompressed,
+                                                 eUsed, eFilterUsed);
+      if (eUsed != CT_NONE) {
         if (!pBuffer) {
           pData.reset(new uint8_t[iCompressed], nonstd::DeleteArray<uint8_t>());
           memcpy(pData.get(), pCompressed.get(), iCompressed);
         } else
           pData = pCompressed;
         record.m_iLength = iCompressed;
-        record.m_eCompression = m_eCompression;
+        record.m_eCompression = eUsed;
+        record.m_ePreFilter = eFilterUsed;
       }
     }
   }
   return pData;
 }
 
+/*
+  ComputeBrickOrder:
+
+  Returns the 1D-indices of all bricks in the order they are written to
+  disk. The per level layouts store the levels one after another, finest
+  first, each following its own curve. LT_LOD_INTERLEAVED walks the tree
+  depth first from the coarsest level instead: each brick is followed by
+  its (up to eight) children, ordered along the Hilbert curve of their
+  level, and their subtrees. All bricks below a coarse brick therefore
+  occupy one contiguous byte range.
+*/
+std::vector<uint64_t> ExtendedOctreeConverter::ComputeBrickOrder(const ExtendedOctree& tree) const
+{
+  std::vector<uint64_t> vOrder;
+  vOrder.reserve(tree.m_vTOC.size());
+  uint64_t const iLoDCount = tree.GetLODCount();
+
+  if (m_eLayout == LT_LOD_INTERLEAVED) {
+    std::vector<std::shared_ptr<VolumeTools::Layout>> vCurves;
+    for (uint64_t lod = 0; lod < iLoDCount; ++lod)
+      vCurves.push_back(std::make_shared<VolumeTools::HilbertLayout>(tree.GetBrickCount(lod)));
+
+    typedef std::pair<uint64_t, UINT64VECTOR3> CurveBrick;
+    auto const byCurve = [](CurveBrick const& a, CurveBrick const& b) {
+      return a.first < b.first;
+    };
+
+    // bricks still to visit, the next one is at the back; the coarsest
+    // level usually is a single brick but we do not rely on that
+    std::vector<UINT64VECTOR4> vStack;
+    {
+      uint64_t const top = iLoDCount - 1;
+      UINT64VECTOR3 const domain = tree.GetBrickCount(top);
+      std::vector<CurveBrick> roots;
+      for (uint64_t z = 0; z < domain.z; ++z)
+        for (uint64_t y = 0; y < domain.y; ++y)
+          for (uint64_t x = 0; x < domain.x; ++x)
+            roots.push_back(CurveBrick(vCurves[top]->GetLinearIndex(UINT64VECTOR3(x,y,z)),
+                                       UINT64VECTOR3(x,y,z)));
+      std::sort(roots.begin(), roots.end(), byCurve);
+      for (auto r = roots.rbegin(); r != roots.rend(); ++r)
+        vStack.push_back(UINT64VECTOR4(r->second, top));
+    }
+
+    while (!vStack.empty()) {
+      UINT64VECTOR4 const brick = vStack.back();
+      vStack.pop_back();
+      vOrder.push_back(tree.BrickCoordsToIndex(brick));
+      if (brick.w == 0) continue;
+
+      // a brick covers the 2x2x2 bricks at twice its position on the next
+      // finer level, clipped against that level's brick count
+      uint64_t const childLoD = brick.w - 1;
+      UINT64VECTOR3 const domain = tree.GetBrickCount(childLoD);
+      CurveBrick children[8];
+      size_t iChildCount = 0;
+      for (uint64_t z = brick.z*2; z < std::min(brick.z*2+2, domain.z); ++z)
+        for (uint64_t y = brick.y*2; y < std::min(brick.y*2+2, domain.y); ++y)
+          for (uint64_t x = brick.x*2; x < std::min(brick.x*2+2, domain.x); ++x)
+            children[iChildCount++] = CurveBrick(vCurves[size_t(childLoD)]->GetLinearIndex(UINT64VECTOR3(x,y,z)),
+                                                 UINT64VECTOR3(x,y,z));
+      std::sort(children, children + iChildCount, byCurve);
+      for (size_t i = iChildCount; i > 0; --i)
+        vStack.push_back(UINT64VECTOR4(children[i-1].second, childLoD));
+    }
+    return vOrder;
+  }
+
+  for (uint64_t lod = 0; lod < iLoDCount; ++lod)
+  {
+    UINT64VECTOR3 const domain = tree.GetBrickCount(lod);
+    uint64_t const brickCount = domain.volume();
+
+    // instantiate the layout we want to use for the current level of detail
+    std::shared_ptr<VolumeTools::Layout> pLayout;
+    switch (m_eLayout) {
+    default:
+    case LT_SCANLINE: pLayout.reset(new VolumeTools::ScanlineLayout(domain)); break;
+    case LT_MORTON:   pLayout.reset(new VolumeTools::MortonLayout(domain));   break;
+    case LT_HILBERT:  pLayout.reset(new VolumeTools::HilbertLayout(domain));  break;
+    case LT_RANDOM:   pLayout.reset(new VolumeTools::RandomLayout(domain));   break;
+    }
+
+    // follow the layout until we completely filled the domain of the
+    // current level (brickCounter == brickCount)
+    uint64_t brickCounter = 0;
+    uint64_t layoutIndex  = 0;
+    while (brickCounter < brickCount)
+    {
+      UINT64VECTOR3 const position = pLayout->GetSpatialPosition(layoutIndex++);
+      if (position.x < domain.x &&
+          position.y < domain.y &&
+          position.z < domain.z)
+      {
+        // convert valid spatial position to our internal brick index
+        vOrder.push_back(tree.BrickCoordsToIndex(UINT64VECTOR4(position, lod)));
+        ++brickCounter;
+      }
+    }
+  }
+  return vOrder;
+}
+
 void ExtendedOctreeConverter::ComputeStatsCompressAndPermuteAll(ExtendedOctree& tree)
 {
   FlushCache(tree); // be sure we've got everything on disk.
@@ -674,190 +1844,175 @@ void ExtendedOctreeConverter::ComputeStatsCompressAndPermuteAll(ExtendedOctree&
     occupiedSpace.insert(occupiedSpace.cend(), Uint64Map::value_type(tree.m_vTOC[i].m_iOffset, i));
 #endif
 
+  // the order in which bricks end up in the file
+  std::vector<uint64_t> const vOrder = ComputeBrickOrder(tree);
+  assert(vOrder.size() == tree.m_vTOC.size());
+
   uint64_t iProgress = 0; // global brick progress counter
-  for (uint64_t lod = 0; lod < tree.GetLODCount(); ++lod)
+  for (size_t iOrder = 0; iOrder < vOrder.size(); ++iOrder)
   {
-    UINT64VECTOR3 const domain = tree.GetBrickCount(lod);
-    uint64_t const brickCount = domain.volume();
+    uint64_t const thisIndex = vOrder[iOrder];
+    TOCEntry& thisRecord = tree.m_vTOC[(size_t)thisIndex];
+    std::shared_ptr<uint8_t> thisData;
+
+    // retrieve next brick in layout order
+    auto c = cache.find(thisIndex);
+    if (c != cache.cend()) {
+      // found cached (compressed) brick
+      thisData = c->second;
+      assert(thisData && thisData.get());
+      cache.erase(c);
+    } else if (thisRecord.m_iOffset == IN_CORE) {
+      // brick was paged in earlier and turned out to be constant, it
+      // has no payload and was never put into the cache
+      assert(thisRecord.m_eCompression == CT_CONSTANT);
+    } else {
+      // load (compressed) brick from disk
+      uint64_t const iLength = thisRecord.m_iLength; // disk length before fetch
+      thisData = Fetch(tree, thisIndex, pUncompressed);
+      if (occupiedSpace.begin()->second != thisIndex) {
+#ifdef DETECTED_OS_WINDOWS
+        emptySpace.emplace(Uint64Map::value_type(thisRecord.m_iOffset, iLength));
+#else
+        emptySpace.insert(Uint64Map::value_type(thisRecord.m_iOffset, iLength));
+#endif
+      } else {
+        emptyLength += iLength; // we just fetched the next brick in file
+      }
+      size_t iSuccess = occupiedSpace.erase(thisRecord.m_iOffset);
+      assert(iSuccess);
+      if (iSuccess) {} // suppress local variable is initialized but not referenced warning
+      thisRecord.m_iOffset = IN_CORE;
+    }
 
-    // instantiate the layout we want to use for the current level of detail
-    std::shared_ptr<VolumeTools::Layout> pLayout;
-    switch (m_eLayout) {
-    default:
-    case LT_SCANLINE: pLayout.reset(new VolumeTools::ScanlineLayout(domain)); break;
-    case LT_MORTON:   pLayout.reset(new VolumeTools::MortonLayout(domain));   break;
-    case LT_HILBERT:  pLayout.reset(new VolumeTools::HilbertLayout(domain));  break;
-    case LT_RANDOM:   pLayout.reset(new VolumeTools::RandomLayout(domain));   break;
+    // eat empty space that might have opened up by removing some last occupier
+    {
+      uint64_t emptyOffset = writeOffset + emptyLength;
+      while (!emptySpace.empty() &&
+             emptySpace.begin()->first <= emptyOffset)
+      {
+        auto e = emptySpace.begin();
+        assert(e->first == emptyOffset); // just check to know if e->first < emptyOffset occurs sometimes
+        //emptyLength += e->second - (emptyOffset - e->first); // see above
+        emptyLength += e->second;
+        emptySpace.erase(e);
+        emptyOffset = writeOffset + emptyLength;
+      }
     }
 
-    // follow the layout and permute bricks until we completely filled
-    // the domain of the current level (brickCounter == brickCount)
-    uint64_t brickCounter = 0;
-    uint64_t layoutIndex  = 0;
-    while (brickCounter < brickCount)
+    // free up occupied space until the current brick fits
+    while (thisRecord.m_iLength > emptyLength)
     {
-      UINT64VECTOR3 const position = pLayout->GetSpatialPosition(layoutIndex++);
-      if (position.x < domain.x &&
-          position.y < domain.y &&
-          position.z < domain.z)
+      // fetch next occupier
+      auto o = occupiedSpace.begin();
+      uint64_t const pageInIndex = o->second;
+      TOCEntry& pageInRecord = tree.m_vTOC[(size_t)pageInIndex];
+      assert(pageInRecord.m_iOffset != IN_CORE);
+      assert(o->first == pageInRecord.m_iOffset);
+      assert(writeOffset + emptyLength == pageInRecord.m_iOffset);
+      uint64_t const iLength = pageInRecord.m_iLength; // disk length before fetch
+      std::shared_ptr<uint8_t> pageInData = Fetch(tree, pageInIndex);
+      emptyLength += iLength; // we just fetched the next brick in file
+      pageInRecord.m_iOffset = IN_CORE;
+      occupiedSpace.erase(o);
+
+      // eat empty space that might have opened up by removing the last occupier
+      uint64_t emptyOffset = writeOffset + emptyLength;
+      while (!emptySpace.empty() &&
+              emptySpace.begin()->first <= emptyOffset)
       {
-        // convert valid spatial position to our internal brick index
-        uint64_t const thisIndex = tree.BrickCoordsToIndex(UINT64VECTOR4(position, lod));
-        TOCEntry& thisRecord = tree.m_vTOC[(size_t)thisIndex];
-        std::shared_ptr<uint8_t> thisData;
-
-        // retrieve next brick in layout order
-        auto c = cache.find(thisIndex);
-        if (c != cache.cend()) {
-          // found cached (compressed) brick
-          thisData = c->second;
-          assert(thisData && thisData.get());
-          cache.erase(c);
-        } else {
-          // load (compressed) brick from disk
-          uint64_t const iLength = thisRecord.m_iLength; // disk length before fetch
-          thisData = Fetch(tree, thisIndex, pUncompressed);
-          if (occupiedSpace.begin()->second != thisIndex) {
-#ifdef DETECTED_OS_WINDOWS
-            emptySpace.emplace(Uint64Map::value_type(thisRecord.m_iOffset, iLength));
-#else
-            emptySpace.insert(Uint64Map::value_type(thisRecord.m_iOffset, iLength));
-#endif
+        auto e = emptySpace.begin();
+        assert(e->first == emptyOffset); // just check to know if e->first < emptyOffset occurs sometimes
+        //emptyLength += e->second - (emptyOffset - e->first); // see above
+        emptyLength += e->second;
+        emptySpace.erase(e);
+        emptyOffset = writeOffset + emptyLength;
+      }
+
+      // constant bricks have no payload, nothing to cache or page out
+      if (pageInRecord.m_eCompression == CT_CONSTANT)
+        continue;
+
+      // push paged in brick to cache
+      cacheSize += pageInRecord.m_iLength;
+      bool bSuccess = cache.insert(SimpleCache::value_type(pageInIndex, pageInData)).second;
+      if (bSuccess) {} // suppress local variable is initialized but not referenced warning
+      assert(bSuccess);
+
+      // check cache limit and page out as much bricks as necessary
+      while (!cache.empty() && cacheSize > m_iMemLimit)
+      {
+        // pop random brick from cache to be paged out
+        auto c = cache.begin();
+        uint64_t const pageOutIndex = c->first;
+        TOCEntry& pageOutRecord = tree.m_vTOC[(size_t)pageOutIndex];
+        assert(pageOutRecord.m_iOffset == IN_CORE);
+        std::shared_ptr<uint8_t> pageOutData = c->second;
+        assert(pageOutData && pageOutData.get());
+        cacheSize -= pageOutRecord.m_iLength;
+        cache.erase(c);
+
+        // 1) try to find next suitable empty space location from the back of the file
+        for (auto e = emptySpace.rbegin(); e != emptySpace.rend(); ++e) {
+          if (pageOutRecord.m_iLength > e->second) {
+            continue;
+          } else if (pageOutRecord.m_iLength < e->second) {
+            // Yay! we found suitable empty space but we need to split empty
+            // space from behind to not change the EST entry
+            e->second -= pageOutRecord.m_iLength;
+            pageOutRecord.m_iOffset = e->first + e->second;
           } else {
-            emptyLength += iLength; // we just fetched the next brick in file
+            // Yay! we found suitable empty space that fits perfectly
+            pageOutRecord.m_iOffset = e->first;
+            emptySpace.erase(--e.base()); // erasing a reverse iterator
           }
-          size_t iSuccess = occupiedSpace.erase(thisRecord.m_iOffset);
-          assert(iSuccess);
-          if (iSuccess) {} // suppress local variable is initialized but not referenced warning
-          thisRecord.m_iOffset = IN_CORE;
+          break;
         }
-
-        // eat empty space that might have opened up by removing some last occupier
-        {
-          uint64_t emptyOffset = writeOffset + emptyLength;
-          while (!emptySpace.empty() &&
-                 emptySpace.begin()->first <= emptyOffset)
+        // 2) try to use 1st order empty space until we barely fit thisRecord in there
+        if (pageOutRecord.m_iOffset == IN_CORE) {
+          if (emptyLength > thisRecord.m_iLength &&
+              emptyLength - thisRecord.m_iLength >= pageOutRecord.m_iLength)
           {
-            auto e = emptySpace.begin();
-            assert(e->first == emptyOffset); // just check to know if e->first < emptyOffset occurs sometimes
-            //emptyLength += e->second - (emptyOffset - e->first); // see above
-            emptyLength += e->second;
-            emptySpace.erase(e);
-            emptyOffset = writeOffset + emptyLength;
+            pageOutRecord.m_iOffset = emptyOffset - pageOutRecord.m_iLength;
+            emptyOffset -= pageOutRecord.m_iLength;
+            emptyLength -= pageOutRecord.m_iLength;
           }
         }
-
-        // free up occupied space until the current brick fits
-        while (thisRecord.m_iLength > emptyLength)
-        {
-          // fetch next occupier
-          auto o = occupiedSpace.begin();
-          uint64_t const pageInIndex = o->second;
-          TOCEntry& pageInRecord = tree.m_vTOC[(size_t)pageInIndex];
-          assert(pageInRecord.m_iOffset != IN_CORE);
-          assert(o->first == pageInRecord.m_iOffset);
-          assert(writeOffset + emptyLength == pageInRecord.m_iOffset);
-          uint64_t const iLength = pageInRecord.m_iLength; // disk length before fetch
-          std::shared_ptr<uint8_t> pageInData = Fetch(tree, pageInIndex);
-          emptyLength += iLength; // we just fetched the next brick in file
-          pageInRecord.m_iOffset = IN_CORE;
-          occupiedSpace.erase(o);
-
-          // eat empty space that might have opened up by removing the last occupier
-          uint64_t emptyOffset = writeOffset + emptyLength;
-          while (!emptySpace.empty() &&
-                  emptySpace.begin()->first <= emptyOffset)
-          {
-            auto e = emptySpace.begin();
-            assert(e->first == emptyOffset); // just check to know if e->first < emptyOffset occurs sometimes
-            //emptyLength += e->second - (emptyOffset - e->first); // see above
-            emptyLength += e->second;
-            emptySpace.erase(e);
-            emptyOffset = writeOffset + emptyLength;
-          }
-
-          // push paged in brick to cache
-          cacheSize += pageInRecord.m_iLength;
-          bool bSuccess = cache.insert(SimpleCache::value_type(pageInIndex, pageInData)).second;
-          if (bSuccess) {} // suppress local variable is initialized but not referenced warning
-          assert(bSuccess);
-
-          // check cache limit and page out as much bricks as necessary
-          while (!cache.empty() && cacheSize > m_iMemLimit)
-          {
-            // pop random brick from cache to be paged out
-            auto c = cache.begin();
-            uint64_t const pageOutIndex = c->first;
-            TOCEntry& pageOutRecord = tree.m_vTOC[(size_t)pageOutIndex];
-            assert(pageOutRecord.m_iOffset == IN_CORE);
-            std::shared_ptr<uint8_t> pageOutData = c->second;
-            assert(pageOutData && pageOutData.get());
-            cacheSize -= pageOutRecord.m_iLength;
-            cache.erase(c);
-
-            // 1) try to find next suitable empty space location from the back of the file
-            for (auto e = emptySpace.rbegin(); e != emptySpace.rend(); ++e) {
-              if (pageOutRecord.m_iLength > e->second) {
-                continue;
-              } else if (pageOutRecord.m_iLength < e->second) {
-                // Yay! we found suitable empty space but we need to split empty
-                // space from behind to not change the EST entry
-                e->second -= pageOutRecord.m_iLength;
-                pageOutRecord.m_iOffset = e->first + e->second;
-              } else {
-                // Yay! we found suitable empty space that fits perfectly
-                pageOutRecord.m_iOffset = e->first;
-                emptySpace.erase(--e.base()); // erasing a reverse iterator
-              }
-              break;
-            }
-            // 2) try to use 1st order empty space until we barely fit thisRecord in there
-            if (pageOutRecord.m_iOffset == IN_CORE) {
-              if (emptyLength > thisRecord.m_iLength &&
-                  emptyLength - thisRecord.m_iLength >= pageOutRecord.m_iLength)
-              {
-                pageOutRecord.m_iOffset = emptyOffset - pageOutRecord.m_iLength;
-                emptyOffset -= pageOutRecord.m_iLength;
-                emptyLength -= pageOutRecord.m_iLength;
-              }
-            }
-            // 3) final chance use tempOffset at the end of the file to page out memory
-            if (pageOutRecord.m_iOffset == IN_CORE) {
-              pageOutRecord.m_iOffset = tempOffset;
-              tempOffset += pageOutRecord.m_iLength;
-            }
-            // add new occupier even if we page out to the temp region at the end of file
-            bool bSuccess = occupiedSpace.insert(Uint64Map::value_type(pageOutRecord.m_iOffset, pageOutIndex)).second;
-            if (bSuccess) {} // suppress local variable is initialized but not referenced warning
-            assert(bSuccess);
-
-            // write brick to temporary position
-            tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + pageOutRecord.m_iOffset);
-            tree.m_pLargeRAWFile->WriteRAW(pageOutData.get(), pageOutRecord.m_iLength);
-
-          } // free up some cache
-        } // free up occupied space
-
-        // write brick to the correct layout position
-        thisRecord.m_iOffset = writeOffset;
-        tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + thisRecord.m_iOffset);
-        tree.m_pLargeRAWFile->WriteRAW(thisData.get(), thisRecord.m_iLength);
-        writeOffset += thisRecord.m_iLength;
-        emptyLength -= thisRecord.m_iLength;
-
-        // increment brick counter for the termination criterion
-        ++brickCounter;
-
-        // report progress
-        if (iProgress % iReportInterval == 0) {
-          m_fProgress = MathTools::lerp(float(iProgress) / tree.m_vTOC.size(), 0.0f,1.0f, 0.8f,1.0f);
-          PROGRESS;
+        // 3) final chance use tempOffset at the end of the file to page out memory
+        if (pageOutRecord.m_iOffset == IN_CORE) {
+          pageOutRecord.m_iOffset = tempOffset;
+          tempOffset += pageOutRecord.m_iLength;
         }
-        ++iProgress;
+        // add new occupier even if we page out to the temp region at the end of file
+        bool bSuccess = occupiedSpace.insert(Uint64Map::value_type(pageOutRecord.m_iOffset, pageOutIndex)).second;
+        if (bSuccess) {} // suppress local variable is initialized but not referenced warning
+        assert(bSuccess);
+
+        // write brick to temporary position
+        tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + pageOutRecord.m_iOffset);
+        tree.m_pLargeRAWFile->WriteRAW(pageOutData.get(), pageOutRecord.m_iLength);
+        m_OutputStream.Advance(pageOutRecord.m_iLength);
+
+      } // free up some cache
+    } // free up occupied space
+
+    // write brick to the correct layout position
+    thisRecord.m_iOffset = writeOffset;
+    if (thisRecord.m_iLength > 0) {
+      tree.m_pLargeRAWFile->SeekPos(tree.m_iOffset + thisRecord.m_iOffset);
+      tree.m_pLargeRAWFile->WriteRAW(thisData.get(), thisRecord.m_iLength);
+      m_OutputStream.Advance(thisRecord.m_iLength);
+    }
+    writeOffset += thisRecord.m_iLength;
+    emptyLength -= thisRecord.m_iLength;
 
-      } // valid spatial position check
-    } // reordering per level loop
-  } // level loop
+    // report progress
+    if (iProgress % iReportInterval == 0) {
+      m_fProgress = MathTools::lerp(float(iProgress) / tree.m_vTOC.size(), 0.0f,1.0f, 0.8f,1.0f);
+      PROGRESS;
+    }
+    ++iProgress;
+  } // brick order loop
 
   uint64_t const temporarySpace = tempOffset - tree.m_iSize;
   uint64_t const compressionGain = tree.m_iSize - writeOffset;
@@ -1007,6 +2162,7 @@ void ExtendedOctreeConverter::WriteBrickToDisk(ExtendedOctree &tree, uint8_t* pD
 
   tree.m_vTOC[index].m_iLength = length;
   tree.m_vTOC[index].m_eCompression = CT_NONE;
+  tree.m_vTOC[index].m_ePreFilter = PF_NONE;
   tree.m_pLargeRAWFile->WriteRAW(pData, tree.m_vTOC[index].m_iLength);
 }
 
@@ -1038,6 +2194,7 @@ void ExtendedOctreeConverter::GetBrick(uint8_t* pData, ExtendedOctree &tree,
                                        uint64_t index) {
   if (m_vBrickCache.empty()) {
     tree.GetBrickData(pData, index);
+    m_OutputStream.Advance(tree.m_vTOC[size_t(index)].m_iLength);
     return;
   }
 
@@ -1048,6 +2205,7 @@ void ExtendedOctreeConverter::GetBrick(uint8_t* pData, ExtendedOctree &tree,
 
     // read data from disk
     tree.GetBrickData(pData, index);
+    m_OutputStream.Advance(tree.m_vTOC[size_t(index)].m_iLength);
 
     // find cache entry to evict from cache
     cacheEntry = m_vBrickCache.begin();
@@ -1090,6 +2248,10 @@ void ExtendedOctreeConverter::GetBrick(uint8_t* pData, ExtendedOctree &tree,
   the data and write to disk.
 */
 void ExtendedOctreeConverter::SetBrick(uint8_t* pData, ExtendedOctree &tree, uint64_t index, bool bForceWrite) {
+  // every brick set is written sooner or later, close enough for the page
+  // cache stream which only needs a rough idea of the traffic
+  m_OutputStream.Advance(BrickSize(tree, index));
+
   if (m_vBrickCache.empty()) {
     WriteBrickToDisk(tree, pData, size_t(index));
     return;
@@ -1194,6 +2356,9 @@ void ExtendedOctreeConverter::CopyBrickToBrick(std::vector<uint8_t>& vSourceData
   from the diagonal neighbors. Consequently, after we have copied the data
   of the six direct neighbors we only need to consider one diagonal neighbors
   in the same plane and the three neighbors to fill the bottom right corner.
+  The overlap of these diagonal neighbors is not filled yet, so they must
+  not touch the low overlap along their third axis, which the x-1, y-1 and
+  z-1 neighbors have set correctly already.
 */
 void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, bool bClampToEdge) {
   UINT64VECTOR3 baseBricks = tree.GetBrickCount(iLoD);
@@ -1291,8 +2456,8 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
           GetBrick(&vSourceData[0], tree, sourceCoords);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
-                           UINT64VECTOR3(tree.m_iOverlap,tree.m_iOverlap,0), UINT64VECTOR3(targetBrickSize.x-tree.m_iOverlap,targetBrickSize.y-tree.m_iOverlap,0),
-                           UINT64VECTOR3(tree.m_iOverlap, tree.m_iOverlap, sourceBrickSize.z),
+                           UINT64VECTOR3(tree.m_iOverlap,tree.m_iOverlap,tree.m_iOverlap), UINT64VECTOR3(targetBrickSize.x-tree.m_iOverlap,targetBrickSize.y-tree.m_iOverlap,tree.m_iOverlap),
+                           UINT64VECTOR3(tree.m_iOverlap, tree.m_iOverlap, sourceBrickSize.z-tree.m_iOverlap),
                            iElementSize);
         }
 
@@ -1305,8 +2470,8 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
           GetBrick(&vSourceData[0], tree, sourceCoords);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
-                           UINT64VECTOR3(tree.m_iOverlap,0,tree.m_iOverlap), UINT64VECTOR3(targetBrickSize.x-tree.m_iOverlap,0,targetBrickSize.z-tree.m_iOverlap),
-                           UINT64VECTOR3(tree.m_iOverlap, sourceBrickSize.y, tree.m_iOverlap),
+                           UINT64VECTOR3(tree.m_iOverlap,tree.m_iOverlap,tree.m_iOverlap), UINT64VECTOR3(targetBrickSize.x-tree.m_iOverlap,tree.m_iOverlap,targetBrickSize.z-tree.m_iOverlap),
+                           UINT64VECTOR3(tree.m_iOverlap, sourceBrickSize.y-tree.m_iOverlap, tree.m_iOverlap),
                            iElementSize);
         }
         if (bHasBottomNeighbour && bHasBackNeighbour) {
@@ -1315,8 +2480,8 @@ void ExtendedOctreeConverter::FillOverlap(ExtendedOctree &tree, uint64_t iLoD, b
           GetBrick(&vSourceData[0], tree, sourceCoords);
 
           CopyBrickToBrick(vSourceData, sourceBrickSize, vTargetData, targetBrickSize,
-                           UINT64VECTOR3(0,tree.m_iOverlap,tree.m_iOverlap), UINT64VECTOR3(0,targetBrickSize.y-tree.m_iOverlap,targetBrickSize.z-tree.m_iOverlap),
-                           UINT64VECTOR3(sourceBrickSize.x, tree.m_iOverlap, tree.m_iOverlap),
+                           UINT64VECTOR3(tree.m_iOverlap,tree.m_iOverlap,tree.m_iOverlap), UINT64VECTOR3(tree.m_iOverlap,targetBrickSize.y-tree.m_iOverlap,targetBrickSize.z-tree.m_iOverlap),
+                           UINT64VECTOR3(sourceBrickSize.x-tree.m_iOverlap, tree.m_iOverlap, tree.m_iOverlap),
                            iElementSize);
         }
         if (bHasRightNeighbour && bHasBottomNeighbour && bHasBackNeighbour) {
@@ -1376,7 +2541,7 @@ void ExtendedOctreeConverter::PermuteInputData(ExtendedOctree &tree, LargeRAWFil
           tree.GetComponentTypeSize() *
           tree.GetComponentCount();
         TOCEntry t = {iCurrentOutOffset, iUncompressedBrickSize, CT_NONE,
-                      iUncompressedBrickSize, UINTVECTOR2(0,0)};
+                      iUncompressedBrickSize, UINTVECTOR2(0,0), PF_NONE};
         tree.m_vTOC.push_back(t);
 
         GetInputBrick(vData, tree, pLargeRAWFileIn, iInOffset, coords,
@@ -1400,76 +2565,149 @@ void ExtendedOctreeConverter::PermuteInputData(ExtendedOctree &tree, LargeRAWFil
 
  Flattens/un-bricks a given LoD level into a file, for example a call with
  iLODLevel = 0 will recover the exact original data file used tho build this
- tree. This method is very simple, it iterates over all bricks of the given
- LoD level (x,y,z for-loops) and for each brick it writes it's non-overlap
- values into the target file. Index magic is explained inside the function.
+ tree. The level is processed in slabs: a slab is a block of bricks of one
+ brick layer (z). If a whole layer fits into the slab budget the slab covers
+ the complete layer, otherwise as many full brick rows (y) as fit or, for
+ very wide volumes, a part of a single row. The bricks of a slab are decoded
+ in parallel and their non-overlap voxels are copied into a slab buffer that
+ has the layout of the output, the buffer is then written with one write per
+ slab, per slice or per scanline respectively. While a slab is written the
+ next one is already decoded into the second buffer.
 */
 bool ExtendedOctreeConverter::ExportToRAW(const ExtendedOctree &tree,
                                  const LargeRAWFile_ptr pLargeRAWFile,
-                                 uint64_t iLODLevel, uint64_t iOffset) {
+                                 uint64_t iLODLevel, uint64_t iOffset,
+                                 uint64_t iMaxSlabBytes) {
   if (iLODLevel >= tree.GetLODCount()) return false;
 
-  const size_t iVoxelSize =tree. GetComponentTypeSize() * size_t(tree.m_iComponentCount);
-  uint8_t *pBrickData = new uint8_t[size_t(tree.m_iBrickSize.volume() * iVoxelSize)];
-
+  const size_t iVoxelSize = tree.GetComponentTypeSize() * size_t(tree.m_iComponentCount);
+  const size_t iMaxBrickBytes = size_t(tree.m_iBrickSize.volume() * iVoxelSize);
   const UINT64VECTOR3 outSize = tree.m_vLODTable[size_t(iLODLevel)].m_iLODPixelSize;
+  const UINT64VECTOR3 bricksToExport = tree.GetBrickCount(iLODLevel);
+  const UINT64VECTOR3 inner = tree.m_iBrickSize - uint64_t(2*tree.m_iOverlap);
+
+  // choose the slab extent (in bricks) from the budget
+  const uint64_t iRowBytes = inner.y * inner.z * outSize.x * iVoxelSize;
+  const uint64_t iBrickBytes = inner.volume() * iVoxelSize;
+  uint64_t iSlabBricksX = bricksToExport.x;
+  uint64_t iSlabBricksY = 1;
+  if (iRowBytes <= iMaxSlabBytes) {
+    iSlabBricksY = std::min(bricksToExport.y, iMaxSlabBytes / iRowBytes);
+  } else {
+    iSlabBricksX = std::max<uint64_t>(1, iMaxSlabBytes / iBrickBytes);
+  }
+
+  const size_t iSlabBytes = size_t(std::min(
+    outSize.x, iSlabBricksX * inner.x) * std::min(outSize.y,
+    iSlabBricksY * inner.y) * std::min(outSize.z, inner.z) * iVoxelSize);
+  std::vector<uint8_t> vSlab[2] = {std::vector<uint8_t>(iSlabBytes),
+                                   std::vector<uint8_t>(iSlabBytes)};
+  std::future<bool> pendingWrite;
+  size_t iCurrent = 0;
 
-  UINT64VECTOR3 bricksToExport = tree.GetBrickCount(iLODLevel);
   for (uint64_t z = 0;z<bricksToExport.z;++z) {
-    for (uint64_t y = 0;y<bricksToExport.y;++y) {
-      for (uint64_t x = 0;x<bricksToExport.x;++x) {
-        const UINT64VECTOR4 coords(x,y,z, iLODLevel);
-        const UINT64VECTOR3 brickSize = tree.ComputeBrickSize(coords);
-
-        tree.GetBrickData(pBrickData, coords);
-
-        // compute the length of a scanline that is the non-overlap size
-        // times the size of a voxel
-        const size_t iLineSize = (size_t(brickSize.x)-tree.m_iOverlap*2) *iVoxelSize;
-
-        for (uint64_t bz = 0;bz<brickSize.z-2*tree.m_iOverlap;++bz) {
-          for (uint64_t by = 0;by<brickSize.y-2*tree.m_iOverlap;++by) {
-
-            // the offset into the target file is computed as follows:
-            // first the global offset into the file as specified by the user
-            // plus the scanline coordinate within th current brick (by, by)
-            // and the coordinates of the non-overlap part of the current
-            // brick x,y,z as usual x is used as is y is multiplied with x size
-            // z is multiplied with x- times y-size, since we are placing the
-            // brick inside the output file we have to use outSize
-            // finally we multiply the brick voxels with the voxelsize to
-            // get the offset in bytes
-            const uint64_t iOutOffset =  iOffset +
-              (
-                (    (x*(tree.m_iBrickSize.x-tree.m_iOverlap*2))) +
-                ((by+(y*(tree.m_iBrickSize.y-tree.m_iOverlap*2))) * outSize.x) +
-                ((bz+(z*(tree.m_iBrickSize.z-tree.m_iOverlap*2))) * outSize.x * outSize.y)
-              ) * iVoxelSize;
-
-            // the offset in the source data is computed as follows:
-            // skip the overlap in the scanline then skip to the current line by
-            // and the current slice by also skip their overlap as usual
-            // x is used as is, y is multiplied with x size, and
-            // z is multiplied with x- times y-size, since we are offsetting in
-            // inside the brick  we have to use brick's size
-            // finally we multiply the brick voxels with the voxel size to
-            // get the offset in bytes
-            const uint64_t iInOffset = (
-                                     tree.m_iOverlap  +
-                                ((by+tree.m_iOverlap) * brickSize.x) +
-                                ((bz+tree.m_iOverlap) * brickSize.x * brickSize.y)
-                               ) * iVoxelSize;
-
-            pLargeRAWFile->SeekPos(iOutOffset);
-            pLargeRAWFile->WriteRAW(pBrickData + iInOffset, iLineSize);
+    for (uint64_t y0 = 0;y0<bricksToExport.y;y0+=iSlabBricksY) {
+      for (uint64_t x0 = 0;x0<bricksToExport.x;x0+=iSlabBricksX) {
+        const uint64_t x1 = std::min(bricksToExport.x, x0+iSlabBricksX);
+        const uint64_t y1 = std::min(bricksToExport.y, y0+iSlabBricksY);
+
+        // voxel extent of the slab within the LoD
+        const UINT64VECTOR3 vStart(x0*inner.x, y0*inner.y, z*inner.z);
+        const UINT64VECTOR3 vExtent(
+          std::min(outSize.x, x1*inner.x) - vStart.x,
+          std::min(outSize.y, y1*inner.y) - vStart.y,
+          std::min(outSize.z, (z+1)*inner.z) - vStart.z
+        );
+
+        uint8_t* pSlab = &vSlab[iCurrent][0];
+        const int iSlabBrickCount = int((x1-x0) * (y1-y0));
+        std::exception_ptr pError;
+
+#pragma omp parallel
+        {
+          std::vector<uint8_t> vBrickData(iMaxBrickBytes);
+#pragma omp for schedule(dynamic)
+          for (int i = 0;i<iSlabBrickCount;++i) {
+            const uint64_t x = x0 + uint64_t(i) % (x1-x0);
+            const uint64_t y = y0 + uint64_t(i) / (x1-x0);
+            const UINT64VECTOR4 coords(x,y,z, iLODLevel);
+            const UINT64VECTOR3 brickSize = tree.ComputeBrickSize(coords);
+
+            try {
+              tree.GetBrickData(&vBrickData[0], coords);
+            } catch (...) {
+#pragma omp critical(ExportToRAWError)
+              pError = std::current_exception();
+              continue;
+            }
+
+            // compute the length of a scanline that is the non-overlap size
+            // times the size of a voxel
+            const size_t iLineSize = (size_t(brickSize.x)-tree.m_iOverlap*2) *iVoxelSize;
+
+            for (uint64_t bz = 0;bz<brickSize.z-2*tree.m_iOverlap;++bz) {
+              for (uint64_t by = 0;by<brickSize.y-2*tree.m_iOverlap;++by) {
+                // the non-overlap part of the brick is placed at its
+                // position relative to the slab start, the slab has the
+                // same scanline order as the output
+                const uint64_t iOutOffset = (
+                  ((x-x0)*inner.x) +
+                  (((y-y0)*inner.y + by) * vExtent.x) +
+                  (bz * vExtent.x * vExtent.y)
+                ) * iVoxelSize;
+
+                // skip the overlap in the scanline, line and slice
+                const uint64_t iInOffset = (
+                                         tree.m_iOverlap  +
+                                    ((by+tree.m_iOverlap) * brickSize.x) +
+                                    ((bz+tree.m_iOverlap) * brickSize.x * brickSize.y)
+                                   ) * iVoxelSize;
+
+                memcpy(pSlab + iOutOffset, &vBrickData[0] + iInOffset,
+                       iLineSize);
+              }
+            }
           }
         }
+
+        if (pError) {
+          if (pendingWrite.valid()) pendingWrite.wait();
+          std::rethrow_exception(pError);
+        }
+        if (pendingWrite.valid() && !pendingWrite.get()) return false;
+
+        // the slab is contiguous in the output if it spans full scanlines,
+        // and a single block if it spans full slices
+        pendingWrite = std::async(std::launch::async, [=]() -> bool {
+          const uint64_t iLine = vExtent.x * iVoxelSize;
+          const uint64_t iSlice = vExtent.y * iLine;
+          const uint64_t iChunk = (vExtent.x == outSize.x)
+                                  ? ((vExtent.y == outSize.y)
+                                     ? vExtent.z * iSlice : iSlice)
+                                  : iLine;
+          const uint64_t iChunkCount = (vExtent.volume() * iVoxelSize) / iChunk;
+          const uint64_t iLinesPerChunk = iChunk / iLine;
+          for (uint64_t c = 0;c<iChunkCount;++c) {
+            const uint64_t iFirstLine = c * iLinesPerChunk;
+            const uint64_t ly = iFirstLine % vExtent.y;
+            const uint64_t lz = iFirstLine / vExtent.y;
+            const uint64_t iTarget = iOffset + (
+              (vStart.x) +
+              ((vStart.y + ly) * outSize.x) +
+              ((vStart.z + lz) * outSize.x * outSize.y)
+            ) * iVoxelSize;
+            pLargeRAWFile->SeekPos(iTarget);
+            if (pLargeRAWFile->WriteRAW(pSlab + c * iChunk, iChunk) != iChunk)
+              return false;
+          }
+          return true;
+        });
+        iCurrent = 1 - iCurrent;
       }
     }
   }
 
-  delete [] pBrickData;
-  return true;
+  return !pendingWrite.valid() || pendingWrite.get();
 }
 
 /*
@@ -1495,10 +2733,8 @@ bool ExtendedOctreeConverter::ExportToRAW(const ExtendedOctree &tree,
 /*
  ApplyFunction:
 
- Applies a function to each brick of a given LoD level.
- This method simply iterates over all bricks of the given LoD
- level (x,y,z for-loops) and for each brick it writes hands the
- brick with (possibly modified) overlap to the supplied function.
+ Applies a function to each brick of a given LoD level, this is the
+ serial special case of the parallel version below.
 */
 bool ExtendedOctreeConverter::ApplyFunction(const ExtendedOctree &tree, uint64_t iLODLevel,
                                             bool (*brickFunc)(void* pData,
@@ -1506,36 +2742,122 @@ bool ExtendedOctreeConverter::ApplyFunction(const ExtendedOctree &tree, uint64_t
                                             const UINT64VECTOR3& vBrickOffset,
                                             void* pUserContext),
                                             void* pUserContext, uint32_t iOverlap) {
+  return ApplyFunction(tree, iLODLevel,
+                       [=](void* pData, const UINT64VECTOR3& vBrickSize,
+                           const UINT64VECTOR3& vBrickOffset) {
+                         return brickFunc(pData, vBrickSize, vBrickOffset,
+                                          pUserContext);
+                       },
+                       iOverlap, 1, true);
+}
 
+/*
+ ApplyFunction (parallel):
+
+ The bricks of the LoD are distributed over the workers in scanline
+ order. Each worker decodes its brick into its own buffer, only the
+ file access inside GetBrickData is serialized. In ordered mode the
+ calls to the user function go through an ordered section, so they
+ happen in brick order while the next bricks are already decoded.
+ Exceptions thrown while decoding or by the user function are passed
+ on to the caller once all workers have stopped.
+*/
+bool ExtendedOctreeConverter::ApplyFunction(const ExtendedOctree &tree,
+                                            uint64_t iLODLevel,
+                                            const BrickFunction& brickFunc,
+                                            uint32_t iOverlap,
+                                            unsigned int iThreadCount,
+                                            bool bOrdered) {
   if (iLODLevel >= tree.GetLODCount() || iOverlap > tree.m_iOverlap) return false;
 
-  uint32_t skipOverlap = tree.m_iOverlap-iOverlap;
-
+  const uint32_t skipOverlap = tree.m_iOverlap-iOverlap;
   const size_t iVoxelSize = tree.GetComponentTypeSize() * size_t(tree.m_iComponentCount);
-  uint8_t *pBrickData = new uint8_t[size_t(tree.m_iBrickSize.volume() * iVoxelSize)];
-
-  UINT64VECTOR3 bricksToExport = tree.GetBrickCount(iLODLevel);
-  for (uint64_t z = 0;z<bricksToExport.z;++z) {
-    for (uint64_t y = 0;y<bricksToExport.y;++y) {
-      for (uint64_t x = 0;x<bricksToExport.x;++x) {
-        const UINT64VECTOR4 coords(x,y,z, iLODLevel);
-        const UINT64VECTOR3 brickSize = tree.ComputeBrickSize(coords);
-
-        tree.GetBrickData(pBrickData, coords);
-        if (skipOverlap != 0) 
-          VolumeTools::RemoveBoundary(pBrickData, brickSize,
-                                      iVoxelSize, skipOverlap);
-
-        if(!brickFunc(pBrickData, brickSize-(2*skipOverlap), 
-                      coords.xyz()*(tree.m_iBrickSize-(4*skipOverlap)),pUserContext)) {
-          delete [] pBrickData;
-          return false;
+  const size_t iMaxBrickBytes = size_t(tree.m_iBrickSize.volume() * iVoxelSize);
+  const UINT64VECTOR3 vBrickStride = tree.m_iBrickSize - uint64_t(2*tree.m_iOverlap);
+
+  const UINT64VECTOR3 bricksToExport = tree.GetBrickCount(iLODLevel);
+  const int iBrickCount = int(bricksToExport.volume());
+
+  if (iThreadCount == 0)
+    iThreadCount = std::max(1u, std::thread::hardware_concurrency());
+  iThreadCount = std::min(iThreadCount, unsigned(std::max(1, iBrickCount)));
+
+  bool bOK = true;
+  std::exception_ptr pError;
+
+  // decodes brick i into pBrickData, returns its size and position
+  auto loadBrick = [&](int i, uint8_t* pBrickData, UINT64VECTOR3& vSize,
+                       UINT64VECTOR3& vOffset) {
+    const uint64_t x = uint64_t(i) % bricksToExport.x;
+    const uint64_t y = (uint64_t(i) / bricksToExport.x) % bricksToExport.y;
+    const uint64_t z = uint64_t(i) / (bricksToExport.x * bricksToExport.y);
+    const UINT64VECTOR4 coords(x,y,z, iLODLevel);
+    const UINT64VECTOR3 brickSize = tree.ComputeBrickSize(coords);
+
+    tree.GetBrickData(pBrickData, coords);
+    if (skipOverlap != 0)
+      VolumeTools::RemoveBoundary(pBrickData, brickSize,
+                                  iVoxelSize, skipOverlap);
+    vSize = brickSize-(2*skipOverlap);
+    vOffset = coords.xyz()*vBrickStride;
+  };
+
+#pragma omp parallel num_threads(iThreadCount)
+  {
+    std::vector<uint8_t> vBrickData(iMaxBrickBytes);
+    UINT64VECTOR3 vSize, vOffset;
+
+    if (bOrdered) {
+#pragma omp for ordered schedule(static,1)
+      for (int i = 0; i < iBrickCount; ++i) {
+        bool bLoaded = false;
+        std::exception_ptr pLoadError;
+        if (bOK) {
+          try {
+            loadBrick(i, &vBrickData[0], vSize, vOffset);
+            bLoaded = true;
+          } catch (...) {
+            pLoadError = std::current_exception();
+          }
+        }
+#pragma omp ordered
+        {
+          if (bOK && pLoadError) {
+            pError = pLoadError;
+            bOK = false;
+          } else if (bOK && bLoaded) {
+            try {
+              if (!brickFunc(&vBrickData[0], vSize, vOffset)) bOK = false;
+            } catch (...) {
+              pError = std::current_exception();
+              bOK = false;
+            }
+          }
+        }
+      }
+    } else {
+#pragma omp for schedule(dynamic)
+      for (int i = 0; i < iBrickCount; ++i) {
+        if (!bOK) continue;
+        try {
+          loadBrick(i, &vBrickData[0], vSize, vOffset);
+          if (!brickFunc(&vBrickData[0], vSize, vOffset)) {
+#pragma omp critical(ApplyFunctionError)
+            bOK = false;
+          }
+        } catch (...) {
+#pragma omp critical(ApplyFunctionError)
+          {
+            if (!pError) pError = std::current_exception();
+            bOK = false;
+          }
         }
       }
     }
   }
-  delete [] pBrickData;
-  return true;
+
+  if (pError) std::rethrow_exception(pError);
+  return bOK;
 }
 
 
@@ -1601,7 +2923,7 @@ bool ExtendedOctreeConverter::Atalasify(ExtendedOctree &tree,
     
     // write updated data to disk
     const uint64_t iUncompressedBrickSize = tree.ComputeBrickSize(tree.IndexToBrickCoords(iBrick)).volume() * tree.GetComponentTypeSize() * tree.GetComponentCount();
-    const TOCEntry t = {(e.m_vTOC.end()-1)->m_iLength+(e.m_vTOC.end()-1)->m_iOffset, iUncompressedBrickSize, CT_NONE, iUncompressedBrickSize, atlasSize};
+    const TOCEntry t = {(e.m_vTOC.end()-1)->m_iLength+(e.m_vTOC.end()-1)->m_iOffset, iUncompressedBrickSize, CT_NONE, iUncompressedBrickSize, atlasSize, PF_NONE};
     e.m_vTOC.push_back(t);
 
     WriteBrickToDisk(e, pData, iBrick);
@@ -1711,7 +3033,7 @@ bool ExtendedOctreeConverter::DeAtalasify(const ExtendedOctree &tree,
     
     // write updated data to disk
     const uint64_t iUncompressedBrickSize = tree.ComputeBrickSize(tree.IndexToBrickCoords(iBrick)).volume() * tree.GetComponentTypeSize() * tree.GetComponentCount();
-    const TOCEntry t = {(e.m_vTOC.end()-1)->m_iLength+(e.m_vTOC.end()-1)->m_iOffset, iUncompressedBrickSize, CT_NONE, iUncompressedBrickSize, UINTVECTOR2(0,0)};
+    const TOCEntry t = {(e.m_vTOC.end()-1)->m_iLength+(e.m_vTOC.end()-1)->m_iOffset, iUncompressedBrickSize, CT_NONE, iUncompressedBrickSize, UINTVECTOR2(0,0), PF_NONE};
     e.m_vTOC.push_back(t);
 
     WriteBrickToDisk(e, pData, iBrick);
@@ -31,6 +31,7 @@
 #include <functional>
 #include "ExtendedOctree.h"
 #include "VolumeTools.h"
+#include "PageCache.h"
 #include "Basics/MathTools.h"
 
 /*! \brief Stores brick statistics such as the minimum and maximum values
@@ -143,11 +144,146 @@ public:
                bool bComputeMedian,
                bool bClampToEdge,
                LAYOUT_TYPE layout);
+  /**
+    Builds a new tree with the same layout as a set of compatible input trees,
+    every brick of the new tree is computed from the corresponding bricks of the
+    inputs. Only the finest LoD is combined, the coarser LoDs are down-sampled
+    from the merged result so they match a conversion of the merged data. No
+    flat copy of the data is created.
+
+    @param vTrees the input trees, all must share component type and count, volume size, brick size and overlap
+    @param combineFunc called once per brick of the finest LoD with the (uncompressed) input bricks in the order of vTrees, must write iValueCount values to pOutput
+    @param pUserContext pointer to additional user data which is passed to combineFunc
+    @param pLargeRAWOutFile a large raw-file pointer to the target file for the processed data
+    @param iOutOffset bytes to precede the data in the target file
+    @param stats pointer to a vector to store the statistics of each brick, can be set to NULL to disable statistics computation
+    @param compression the desired compression method
+    @param iCompressionLevel if compression is used the higher the level the more the compression (e.g. LZMA: 0..9)
+    @param bComputeMedian use median as downsampling filter (uses average otherwise)
+    @param bClampToEdge use outer values to fill border (uses zeros otherwise)
+    @param layout brick ordering on disk
+    @return true if the merge succeeded, fails if the trees are incompatible or the combine function fails
+  */
+  bool Merge(const std::vector<const ExtendedOctree*>& vTrees,
+             bool (*combineFunc)(const std::vector<const uint8_t*>& vInput,
+                                 uint8_t* pOutput, uint64_t iValueCount,
+                                 void* pUserContext),
+             void* pUserContext,
+             LargeRAWFile_ptr pLargeRAWOutFile, uint64_t iOutOffset,
+             BrickStatVec* stats,
+             COMPRESSION_TYPE compression,
+             uint32_t iCompressionLevel,
+             bool bComputeMedian,
+             bool bClampToEdge,
+             LAYOUT_TYPE layout);
+
+  /**
+    Builds a copy of a tree in which all voxels on the clipped side of a plane
+    are set to zero. The work is done in brick space: bricks that lie entirely
+    on the kept side are copied without decoding them, bricks entirely on the
+    clipped side are cleared and only the bricks the plane passes through are
+    decoded, masked and compressed again. Bricks of the coarser LoDs are only
+    recomputed (from the next finer level of the result) if the plane passes
+    through their footprint in the finest level.
+
+    @param tree the input tree, must not be stored in atlas format
+    @param plane the clip plane in normalized volume coordinates i.e. voxel (x,y,z) is at (x/sizeX-0.5, y/sizeY-0.5, z/sizeZ-0.5), voxels for which plane.clip() holds are cleared
+    @param pLargeRAWOutFile a large raw-file pointer to the target file for the processed data
+    @param iOutOffset bytes to precede the data in the target file
+    @param stats pointer to a vector to store the statistics of each brick, can be set to NULL to disable statistics computation
+    @param pInputStats statistics of the input tree in the layout of stats, used for the copied bricks; if NULL they are decoded to compute their statistics
+    @param compression the compression method for recomputed bricks, copied bricks keep their encoding
+    @param bComputeMedian use median as downsampling filter (uses average otherwise), should match the filter the tree was built with
+    @param bClampToEdge use outer values to fill border (uses zeros otherwise), should match the setting the tree was built with
+    @return true if cropping succeeded, fails for atlantified input trees
+  */
+  bool Crop(const ExtendedOctree& tree, const PLANE<float>& plane,
+            LargeRAWFile_ptr pLargeRAWOutFile, uint64_t iOutOffset,
+            BrickStatVec* stats, const BrickStatVec* pInputStats,
+            COMPRESSION_TYPE compression,
+            bool bComputeMedian, bool bClampToEdge);
+
+  /**
+    Replaces bricks of the finest level of an existing tree and brings the
+    coarser LoDs up to date. Only the bricks whose voxels (overlap included)
+    depend on the core of a replaced brick are recomputed, so the cost is
+    proportional to the size of the edit rather than to the volume. The
+    tree is modified in place: payloads that still fit into their old slot
+    are overwritten, larger ones are appended to the end of the tree. A
+    tree that is followed by other data in its file (e.g. a ToC block of a
+    UVF) cannot grow, so every payload has to fit into its old slot. If one
+    does not, all bricks written so far are restored and the update fails.
+
+    @param tree the tree to update, must not be stored in atlas format
+    @param vBrickCoords coordinates of the replaced bricks, all of them in LoD 0
+    @param vBrickData the new data of each brick including its overlap, the overlap has to match the cores of the neighbours so every brick that changes (be it in its core or its overlap only) must be part of the list
+    @param stats pointer to the statistics of every brick of the tree, the entries of all rewritten bricks are replaced, can be set to NULL to disable statistics computation
+    @param pUpdatedBricks if not NULL receives the 1D-indices of all rewritten bricks in ascending order
+    @param compression the compression method for the rewritten bricks
+    @param bComputeMedian use median as downsampling filter (uses average otherwise), should match the filter the tree was built with
+    @param bClampToEdge use outer values to fill border (uses zeros otherwise), should match the setting the tree was built with
+    @return true if the update succeeded, fails for atlantified trees, invalid brick coordinates and for trees followed by other data if a brick outgrows its slot
+  */
+  bool UpdateBricks(ExtendedOctree& tree,
+                    const std::vector<UINT64VECTOR4>& vBrickCoords,
+                    const std::vector<std::shared_ptr<uint8_t>>& vBrickData,
+                    BrickStatVec* stats,
+                    std::vector<uint64_t>* pUpdatedBricks,
+                    COMPRESSION_TYPE compression,
+                    bool bComputeMedian, bool bClampToEdge);
+
   /**
     Call this method from a second thread during the conversion to check on the progress of the operation
   */
   float GetProgress() const {return m_fProgress;}
 
+  /// a codec/level pair tried per brick if adaptive compression is enabled
+  struct AdaptiveCandidate {
+    AdaptiveCandidate(COMPRESSION_TYPE eCompression, uint32_t iCompressionLevel) :
+      eCompression(eCompression),
+      iCompressionLevel(iCompressionLevel)
+    {}
+
+    /// the codec to try
+    COMPRESSION_TYPE eCompression;
+    /// the codec specific level, ignored for LZMA which always uses the
+    /// compression level of the tree as its decoder depends on it
+    uint32_t iCompressionLevel;
+  };
+
+  /**
+    Enables the per brick codec selection, each brick is then compressed
+    with the adaptive candidates (see SetAdaptiveCandidates) instead of the
+    compression method passed to Convert. The selected codec is stored per
+    brick, a compression method of CT_NONE still disables compression.
+    Defaults to false.
+
+    @param bAdaptiveCompression true to select a codec per brick
+  */
+  void SetAdaptiveCompression(bool bAdaptiveCompression);
+
+  /**
+    Configures the per brick codec selection used if adaptive compression
+    is enabled, by default LZ4, ZSTD and LZMA are tried with a decode budget
+    of 250 MB/s and 10% minimum savings
+
+    @param vCandidates the codecs to try, ordered by preference (fastest decoder first)
+    @param fMinDecodeThroughput minimum decode speed (in MB/s) a codec must reach on a brick to be used, 0 accepts any speed
+    @param fMinSavings fraction (0..1) by which a candidate must beat the best result so far
+  */
+  void SetAdaptiveCandidates(const std::vector<AdaptiveCandidate>& vCandidates,
+                             double fMinDecodeThroughput,
+                             double fMinSavings);
+
+  /**
+    Selects a reversible transform that is applied to each brick before it
+    is compressed (e.g. a byte shuffle for 16bit data), it is recorded per
+    brick in the ToC and ignored for uncompressed bricks. Defaults to PF_NONE.
+
+    @param ePreFilter the transform to apply
+  */
+  void SetPreFilter(PREFILTER_TYPE ePreFilter);
+
 
   /**
    Exports a specific LoD Level into a continuous raw file
@@ -254,17 +390,21 @@ public:
                           uint64_t iOffset);
 
   /**
-   Exports a specific LoD Level into a continuous raw file
+   Exports a specific LoD Level into a continuous raw file. The level is
+   assembled slab by slab in memory, so the file is written with a few
+   large sequential writes instead of one write per brick scanline.
 
    @param pointer to a LargeRAW file, file needs to be open, any existing data is overridden
    @param iLODLevel the level to be exported
    @param  iOffset the bytes to be skipped from the beginning of the file
+   @param iMaxSlabBytes upper bound for one slab buffer, two of them are in use at a time
    @return true iff the export was successful
    */
   static bool ExportToRAW(const ExtendedOctree &tree,
                           LargeRAWFile_ptr pLargeRAWFile,
                           uint64_t iLODLevel,
-                          uint64_t iOffset);
+                          uint64_t iOffset,
+                          uint64_t iMaxSlabBytes=uint64_t(256)*1024*1024);
 
  /**
    Exports a specific LoD Level brick by brick into a given function
@@ -283,6 +423,33 @@ public:
                                               void* pUserContext),
                             void* pUserContext, uint32_t iOverlap=0);
 
+  /// a per brick function: brick data, size of the brick (including the
+  /// requested overlap) and position of the brick's first non-overlap voxel
+  /// within the LoD, returning false aborts the traversal
+  typedef std::function<bool(void* pData,
+                             const UINT64VECTOR3& vBrickSize,
+                             const UINT64VECTOR3& vBrickOffset)> BrickFunction;
+
+ /**
+   Applies a function to every brick of a LoD level using several threads.
+   Bricks are decoded in parallel, every worker has a buffer of its own.
+
+   @param tree the octree to be processed
+   @param iLODLevel the level to be processed
+   @param brickFunc user function executed on the data
+   @param iOverlap number of overlap voxels to be included
+   @param iThreadCount number of workers, 0 uses one per core
+   @param bOrdered if true brickFunc is called in brick order and never
+          concurrently, decoding still runs ahead in parallel. Otherwise
+          brickFunc is called from all workers as soon as their brick is
+          decoded and has to be thread safe.
+   @return true iff every call of brickFunc succeeded
+   */
+  static bool ApplyFunction(const ExtendedOctree &tree, uint64_t iLODLevel,
+                            const BrickFunction& brickFunc,
+                            uint32_t iOverlap, unsigned int iThreadCount,
+                            bool bOrdered);
+
 public:
   /*! \brief A single brick cache entry
    *
@@ -395,6 +562,26 @@ private:
   /// if not NULL then the statistics for each brick are stored in this vector
   BrickStatVec* m_pBrickStatVec;
 
+  /// transform applied to bricks before they are compressed
+  PREFILTER_TYPE m_ePreFilter;
+
+  /// select a codec per brick from m_vAdaptiveCandidates
+  bool m_bAdaptiveCompression;
+
+  /// codecs tried per brick in adaptive mode
+  std::vector<AdaptiveCandidate> m_vAdaptiveCandidates;
+
+  /// minimum decode throughput (MB/s) of a codec in adaptive mode
+  double m_fAdaptiveMinDecodeThroughput;
+
+  /// minimum size reduction a stronger codec must achieve in adaptive mode
+  double m_fAdaptiveMinSavings;
+
+  /// drop the pages of the input and the output file during Convert if
+  /// streaming mode is on, see tuvok::pagecache
+  tuvok::pagecache::Stream m_InputStream;
+  tuvok::pagecache::Stream m_OutputStream;
+
   /// where to write progress information
   AbstrDebugOut& m_Progress;
 
@@ -406,6 +593,123 @@ private:
   /// and permutes brick ordering on disk, if desired.
   void ComputeStatsCompressAndPermuteAll(ExtendedOctree& tree);
 
+  /// Returns the 1D-indices of all bricks in the order of the requested
+  /// layout, i.e. in the order they are written to disk.
+  std::vector<uint64_t> ComputeBrickOrder(const ExtendedOctree& tree) const;
+
+  /**
+    Turns a brick into a constant brick if all its voxels are equal
+    and a voxel fits into the ToC entry
+
+    @param tree target extended octree
+    @param index the 1D-index of the brick
+    @param pData the uncompressed brick data
+    @param iLength size (IN BYTES) of the uncompressed brick
+    @return true iff the brick is now stored as a constant brick
+  */
+  static bool EncodeConstantBrick(ExtendedOctree& tree, uint64_t index,
+                                  const uint8_t* pData, uint64_t iLength);
+
+  /**
+    Appends the next brick to a tree that is written brick by brick in
+    index order: computes its statistics, encodes it as a constant brick
+    or compresses it and writes the payload behind the previous brick
+
+    @param tree target extended octree, its ToC must hold all previous bricks
+    @param pData the uncompressed brick data
+    @param iLength size (IN BYTES) of the uncompressed brick
+    @param pCompressed temp storage for the compressed brick
+    @param iWriteOffset offset of the brick relative to the tree, advanced by the bytes written
+  */
+  void AppendBrick(ExtendedOctree& tree, std::shared_ptr<uint8_t> pData,
+                   uint64_t iLength, std::shared_ptr<uint8_t>& pCompressed,
+                   uint64_t& iWriteOffset);
+
+  /**
+    Replaces a brick of a finished tree, the new payload is written to the
+    old slot if it fits and to the end of the tree otherwise
+
+    @param tree target extended octree, opened for writing
+    @param index the 1D-index of the brick
+    @param pData the uncompressed brick data
+    @param iLength size (IN BYTES) of the uncompressed brick
+    @param pCompressed temp storage for the compressed brick
+    @param bMayGrow if false a payload that does not fit into the old slot is not written
+    @return false if the payload did not fit and bMayGrow was false, the ToC entry of the brick is undefined then
+  */
+  bool RewriteBrick(ExtendedOctree& tree, uint64_t index,
+                    std::shared_ptr<uint8_t> pData, uint64_t iLength,
+                    std::shared_ptr<uint8_t>& pCompressed, bool bMayGrow);
+
+  /**
+    Computes the statistics of a brick and encodes it into the ToC entry at
+    index as constant brick, compressed or raw brick
+
+    @param tree target extended octree, the ToC entry must describe the raw brick
+    @param index the 1D-index of the brick
+    @param pData the uncompressed brick data
+    @param iLength size (IN BYTES) of the uncompressed brick
+    @param pCompressed temp storage for the compressed brick
+    @return the payload to write, either pData or pCompressed
+  */
+  std::shared_ptr<uint8_t> EncodeBrick(ExtendedOctree& tree, uint64_t index,
+                                       std::shared_ptr<uint8_t> pData,
+                                       uint64_t iLength,
+                                       std::shared_ptr<uint8_t>& pCompressed);
+
+  /**
+    Compresses a brick with a specific codec
+
+    @param tree target extended octree (provides the LZMA properties)
+    @param eCompression the codec to use
+    @param iCompressionLevel the codec specific compression level
+    @param pData the uncompressed brick data
+    @param iLength size (IN BYTES) of the uncompressed brick
+    @param pCompressed receives the compressed data
+    @return the size (IN BYTES) of the compressed brick
+  */
+  static uint64_t CompressBrick(const ExtendedOctree& tree,
+                                COMPRESSION_TYPE eCompression,
+                                uint32_t iCompressionLevel,
+                                std::shared_ptr<uint8_t> pData,
+                                uint64_t iLength,
+                                std::shared_ptr<uint8_t>& pCompressed);
+
+  /**
+    Applies a pre-filter to a brick
+
+    @param tree target extended octree (provides the component layout)
+    @param ePreFilter the transform to apply
+    @param pData the uncompressed brick data
+    @param pFiltered receives the transformed data, must hold iLength bytes
+    @param iLength size (IN BYTES) of the uncompressed brick
+    @param vBrickSize size (in voxels) of the brick
+  */
+  static void ApplyPreFilter(const ExtendedOctree& tree,
+                             PREFILTER_TYPE ePreFilter,
+                             const uint8_t* pData, uint8_t* pFiltered,
+                             uint64_t iLength,
+                             const UINT64VECTOR3& vBrickSize);
+
+  /**
+    Compresses a brick with the requested compression method and pre-filter,
+    selects a codec per brick in adaptive mode
+
+    @param tree target extended octree
+    @param index the 1D-index of the brick
+    @param pData the uncompressed brick data
+    @param iLength size (IN BYTES) of the uncompressed brick
+    @param pCompressed receives the compressed data
+    @param eUsed receives the codec applied, CT_NONE if the brick did not shrink
+    @param eFilterUsed receives the pre-filter applied
+    @return the size (IN BYTES) of the brick as it will be stored
+  */
+  uint64_t CompressBrick(ExtendedOctree& tree, uint64_t index,
+                         std::shared_ptr<uint8_t> pData, uint64_t iLength,
+                         std::shared_ptr<uint8_t>& pCompressed,
+                         COMPRESSION_TYPE& eUsed,
+                         PREFILTER_TYPE& eFilterUsed);
+
   // Could be also named like ComputeStatsAndCompressBrick().
   // Is internally used by ComputeStatsCompressAndPermuteAll() to fetch bricks
   // from disk, run the brick stats and compress it if desired.
@@ -628,6 +932,57 @@ private:
   template<class T, bool bComputeMedian> void ComputeHierarchy(ExtendedOctree &tree,
                                                                bool bClampToEdge);
 
+  /**
+    Down-samples a box of one brick into another brick with the same
+    filters DownsampleBricktoBrick applies, i.e. vFactor voxels per axis are
+    combined into one, fewer at the end of the box
+
+    @param pSourceData pointer to the source brick
+    @param sourceSize size of the source brick
+    @param sourceOffset first voxel of the box in the source brick
+    @param sourceExtent size of the box in the source brick
+    @param pData pointer to the target brick
+    @param targetSize size of the target brick
+    @param targetOffset where to place the down-sampled box in the target brick
+    @param vFactor 2 for every axis that is halved, 1 otherwise
+    @param iCompCount number of components per voxel
+  */
+  template<class T, bool bComputeMedian> static void DownsampleRegion(
+    const T* pSourceData, const UINT64VECTOR3& sourceSize,
+    const UINT64VECTOR3& sourceOffset, const UINT64VECTOR3& sourceExtent,
+    T* pData, const UINT64VECTOR3& targetSize,
+    const UINT64VECTOR3& targetOffset, const UINT64VECTOR3& vFactor,
+    uint64_t iCompCount);
+
+  /// calls DownsampleRegion for the component type of the tree
+  static void DownsampleRegion(const ExtendedOctree& tree,
+                               bool bComputeMedian,
+                               const uint8_t* pSourceData,
+                               const UINT64VECTOR3& sourceSize,
+                               const UINT64VECTOR3& sourceOffset,
+                               const UINT64VECTOR3& sourceExtent,
+                               uint8_t* pData,
+                               const UINT64VECTOR3& targetSize,
+                               const UINT64VECTOR3& targetOffset,
+                               const UINT64VECTOR3& vFactor);
+
+  /**
+    Recomputes a brick of a coarse LoD from the next finer LoD of the
+    same tree, including its overlap
+
+    @param tree the tree, all bricks of LoD vBrickCoords.w-1 must be on disk
+    @param vBrickCoords the brick to compute
+    @param pData receives the brick
+    @param vSourceData temp storage, resized to hold one brick
+    @param bComputeMedian use median as downsampling filter (uses average otherwise)
+    @param bClampToEdge use outer values to fill border (uses zeros otherwise)
+  */
+  static void RecomputeBrick(const ExtendedOctree& tree,
+                             const UINT64VECTOR4& vBrickCoords,
+                             uint8_t* pData,
+                             std::vector<uint8_t>& vSourceData,
+                             bool bComputeMedian, bool bClampToEdge);
+
 
   /**
     Computes the statistics of an array
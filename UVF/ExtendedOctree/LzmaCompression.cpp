@@ -127,18 +127,62 @@ size_t lzmaCompress(std::shared_ptr<uint8_t> src, size_t uncompressedBytes,
   return compressedBytes;
 }
 
+namespace {
+
+  /// decoder state that lives as long as its thread, this is LzmaDecode()
+  /// split up such that the probability tables are only reallocated if the
+  /// properties require a different size
+  class LzmaDecodeContext {
+  public:
+    LzmaDecodeContext() { LzmaDec_Construct(&m_dec); }
+    ~LzmaDecodeContext() { LzmaDec_FreeProbs(&m_dec, &g_AllocForLzma); }
+
+    SRes Decode(Byte* dest, SizeT* destLen, const Byte* src, SizeT* srcLen,
+                std::array<uint8_t, 5> const& encodedProps,
+                ELzmaStatus* status) {
+      SizeT const inSize = *srcLen;
+      SizeT const outSize = *destLen;
+      *srcLen = *destLen = 0;
+
+      // does not touch the tables if their size does not change
+      SRes res = LzmaDec_AllocateProbs(&m_dec, &encodedProps[0],
+                                       LZMA_PROPS_SIZE, &g_AllocForLzma);
+      if (res != SZ_OK)
+        return res;
+      m_dec.dic = dest;
+      m_dec.dicBufSize = outSize;
+      LzmaDec_Init(&m_dec);
+
+      *srcLen = inSize;
+      res = LzmaDec_DecodeToDic(&m_dec, outSize, src, srcLen,
+                                LZMA_FINISH_END, status);
+      if (res == SZ_OK && *status == LZMA_STATUS_NEEDS_MORE_INPUT)
+        res = SZ_ERROR_INPUT_EOF;
+
+      *destLen = m_dec.dicPos;
+      // the dictionary is the caller's buffer, never keep it around
+      m_dec.dic = NULL;
+      m_dec.dicBufSize = 0;
+      return res;
+    }
+
+  private:
+    CLzmaDec m_dec;
+  };
+
+}
+
 void lzmaDecompress(std::shared_ptr<uint8_t> src, std::shared_ptr<uint8_t>& dst,
                     size_t uncompressedBytes,
                     std::array<uint8_t, 5> const& encodedProps)
 {
+  static thread_local LzmaDecodeContext context;
+
   ELzmaStatus status;
   SizeT bytes = uncompressedBytes;
-  SRes res = LzmaDecode(dst.get(), &bytes,
-                        src.get(), &bytes,
-                        &encodedProps[0], LZMA_PROPS_SIZE,
-                        LZMA_FINISH_END,
-                        &status,
-                        &g_AllocForLzma);
+  SizeT srcBytes = uncompressedBytes;
+  SRes res = context.Decode(dst.get(), &bytes, src.get(), &srcBytes,
+                            encodedProps, &status);
 
   assert(bytes == uncompressedBytes);
   if (res != SZ_OK)
@@ -0,0 +1,191 @@
+#include <cstring>
+#include <stdexcept>
+#include "PreFilter.h"
+
+void byteShuffle(const uint8_t* src, uint8_t* dst, size_t iSize,
+                 size_t iElementSize)
+{
+  const size_t n = iSize / iElementSize;
+  for (size_t b = 0; b < iElementSize; ++b) {
+    uint8_t* plane = dst + b * n;
+    for (size_t i = 0; i < n; ++i)
+      plane[i] = src[i * iElementSize + b];
+  }
+  // a trailing partial element is kept as is
+  memcpy(dst + n * iElementSize, src + n * iElementSize,
+         iSize - n * iElementSize);
+}
+
+void byteUnshuffle(const uint8_t* src, uint8_t* dst, size_t iSize,
+                   size_t iElementSize)
+{
+  const size_t n = iSize / iElementSize;
+  for (size_t b = 0; b < iElementSize; ++b) {
+    const uint8_t* plane = src + b * n;
+    for (size_t i = 0; i < n; ++i)
+      dst[i * iElementSize + b] = plane[i];
+  }
+  memcpy(dst + n * iElementSize, src + n * iElementSize,
+         iSize - n * iElementSize);
+}
+
+void bitShuffle(const uint8_t* src, uint8_t* dst, size_t iSize,
+                size_t iElementSize)
+{
+  // only complete groups of eight elements are transposed, every bit plane
+  // then holds exactly n/8 bytes
+  const size_t n = (iSize / iElementSize) & ~size_t(7);
+  const size_t iPlaneSize = n / 8;
+  for (size_t b = 0; b < iElementSize; ++b) {
+    for (size_t k = 0; k < 8; ++k) {
+      uint8_t* plane = dst + (b * 8 + k) * iPlaneSize;
+      for (size_t i = 0; i < n; i += 8) {
+        const uint8_t* e = src + i * iElementSize + b;
+        uint8_t v = 0;
+        for (size_t j = 0; j < 8; ++j)
+          v |= uint8_t(((e[j * iElementSize] >> k) & 1) << j);
+        plane[i / 8] = v;
+      }
+    }
+  }
+  memcpy(dst + n * iElementSize, src + n * iElementSize,
+         iSize - n * iElementSize);
+}
+
+void bitUnshuffle(const uint8_t* src, uint8_t* dst, size_t iSize,
+                  size_t iElementSize)
+{
+  const size_t n = (iSize / iElementSize) & ~size_t(7);
+  const size_t iPlaneSize = n / 8;
+  memset(dst, 0, n * iElementSize);
+  for (size_t b = 0; b < iElementSize; ++b) {
+    for (size_t k = 0; k < 8; ++k) {
+      const uint8_t* plane = src + (b * 8 + k) * iPlaneSize;
+      for (size_t i = 0; i < n; i += 8) {
+        uint8_t* e = dst + i * iElementSize + b;
+        const uint8_t v = plane[i / 8];
+        for (size_t j = 0; j < 8; ++j)
+          e[j * iElementSize] |= uint8_t(((v >> j) & 1) << k);
+      }
+    }
+  }
+  memcpy(dst + n * iElementSize, src + n * iElementSize,
+         iSize - n * iElementSize);
+}
+
+/*
+  Lorenzo:
+
+  Predicts a component from its seven already visited neighbours, neighbours
+  outside of the brick count as zero so the predictor degrades to a 2D and
+  1D delta at the brick borders. 'v' must point to the component at
+  (x,y,z), sx, sy and sz are the strides between neighbours in elements.
+*/
+template<class T>
+static T Lorenzo(const T* v, uint64_t x, uint64_t y, uint64_t z,
+                 size_t sx, size_t sy, size_t sz)
+{
+  T p = 0;
+  if (x)           p += v[-ptrdiff_t(sx)];
+  if (y)           p += v[-ptrdiff_t(sy)];
+  if (z)           p += v[-ptrdiff_t(sz)];
+  if (x && y)      p -= v[-ptrdiff_t(sx+sy)];
+  if (x && z)      p -= v[-ptrdiff_t(sx+sz)];
+  if (y && z)      p -= v[-ptrdiff_t(sy+sz)];
+  if (x && y && z) p += v[-ptrdiff_t(sx+sy+sz)];
+  return p;
+}
+
+/*
+  Delta3D:
+
+  Computes (bEncode) or removes the residuals to the Lorenzo prediction,
+  the prediction is always made from the original values i.e. from 'src'
+  when encoding and from the already reconstructed 'dst' when decoding.
+*/
+template<class T>
+static void Delta3D(const uint8_t* src, uint8_t* dst,
+                    const UINT64VECTOR3& vBrickSize,
+                    size_t iComponentCount, bool bEncode)
+{
+  const T* in = reinterpret_cast<const T*>(src);
+  T* out = reinterpret_cast<T*>(dst);
+  const T* ref = bEncode ? in : out;
+
+  const size_t sx = iComponentCount;
+  const size_t sy = sx * size_t(vBrickSize.x);
+  const size_t sz = sy * size_t(vBrickSize.y);
+
+  size_t i = 0;
+  for (uint64_t z = 0; z < vBrickSize.z; ++z) {
+    for (uint64_t y = 0; y < vBrickSize.y; ++y) {
+      for (uint64_t x = 0; x < vBrickSize.x; ++x) {
+        for (size_t c = 0; c < iComponentCount; ++c, ++i) {
+          const T p = Lorenzo(ref + i, x, y, z, sx, sy, sz);
+          out[i] = bEncode ? T(in[i] - p) : T(in[i] + p);
+        }
+      }
+    }
+  }
+}
+
+static void Delta3D(const uint8_t* src, uint8_t* dst,
+                    const UINT64VECTOR3& vBrickSize,
+                    size_t iComponentSize, size_t iComponentCount,
+                    bool bEncode)
+{
+  switch (iComponentSize) {
+  case 1:
+    Delta3D<uint8_t>(src, dst, vBrickSize, iComponentCount, bEncode);
+    break;
+  case 2:
+    Delta3D<uint16_t>(src, dst, vBrickSize, iComponentCount, bEncode);
+    break;
+  case 4:
+    Delta3D<uint32_t>(src, dst, vBrickSize, iComponentCount, bEncode);
+    break;
+  case 8:
+    Delta3D<uint64_t>(src, dst, vBrickSize, iComponentCount, bEncode);
+    break;
+  default:
+    throw std::runtime_error("unsupported component size for delta filter");
+  }
+}
+
+void delta3DEncode(const uint8_t* src, uint8_t* dst,
+                   const UINT64VECTOR3& vBrickSize,
+                   size_t iComponentSize, size_t iComponentCount)
+{
+  Delta3D(src, dst, vBrickSize, iComponentSize, iComponentCount, true);
+}
+
+void delta3DDecode(const uint8_t* src, uint8_t* dst,
+                   const UINT64VECTOR3& vBrickSize,
+                   size_t iComponentSize, size_t iComponentCount)
+{
+  Delta3D(src, dst, vBrickSize, iComponentSize, iComponentCount, false);
+}
+
+/*
+ The MIT License
+ 
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
@@ -0,0 +1,110 @@
+#ifndef UVF_PREFILTER_H
+#define UVF_PREFILTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include "Basics/Vectors.h"
+
+/*
+  Reversible voxel-domain transforms that are applied to a brick before it
+  is handed to one of the compressors. None of them change the size of the
+  data, they only reorder or predict bytes such that the entropy coders see
+  longer runs and smaller values. 'src' and 'dst' must not overlap.
+*/
+
+/**
+  Groups the n-th byte of every element together (all low bytes first,
+  then all second bytes and so on).
+  @param  src the data to shuffle
+  @param  dst the output buffer, must hold iSize bytes
+  @param  iSize number of bytes in 'src'
+  @param  iElementSize size (in bytes) of a single element e.g. 2 for uint16
+  */
+void byteShuffle(const uint8_t* src, uint8_t* dst, size_t iSize,
+                 size_t iElementSize);
+
+/**
+  Inverse of byteShuffle.
+  @param  src the shuffled data
+  @param  dst the output buffer, must hold iSize bytes
+  @param  iSize number of bytes in 'src'
+  @param  iElementSize size (in bytes) of a single element e.g. 2 for uint16
+  */
+void byteUnshuffle(const uint8_t* src, uint8_t* dst, size_t iSize,
+                   size_t iElementSize);
+
+/**
+  Groups the n-th bit of every element together (bit planes). Elements that
+  do not fill a complete group of eight at the end are stored unchanged.
+  @param  src the data to shuffle
+  @param  dst the output buffer, must hold iSize bytes
+  @param  iSize number of bytes in 'src'
+  @param  iElementSize size (in bytes) of a single element e.g. 2 for uint16
+  */
+void bitShuffle(const uint8_t* src, uint8_t* dst, size_t iSize,
+                size_t iElementSize);
+
+/**
+  Inverse of bitShuffle.
+  @param  src the shuffled data
+  @param  dst the output buffer, must hold iSize bytes
+  @param  iSize number of bytes in 'src'
+  @param  iElementSize size (in bytes) of a single element e.g. 2 for uint16
+  */
+void bitUnshuffle(const uint8_t* src, uint8_t* dst, size_t iSize,
+                  size_t iElementSize);
+
+/**
+  Replaces every voxel component by its residual to the 3D Lorenzo
+  prediction from the already visited neighbours. The arithmetic is done
+  modulo 2^(8*iComponentSize) on the raw bits, so the transform is lossless
+  for every component type including floats.
+  @param  src the brick to transform
+  @param  dst the output buffer, must be as large as 'src'
+  @param  vBrickSize size of the brick in voxels
+  @param  iComponentSize size (in bytes) of a component, 1, 2, 4 or 8
+  @param  iComponentCount number of components per voxel
+  @throws std::runtime_error if the component size is not supported
+  */
+void delta3DEncode(const uint8_t* src, uint8_t* dst,
+                   const UINT64VECTOR3& vBrickSize,
+                   size_t iComponentSize, size_t iComponentCount);
+
+/**
+  Inverse of delta3DEncode.
+  @param  src the residuals
+  @param  dst the output buffer, must be as large as 'src'
+  @param  vBrickSize size of the brick in voxels
+  @param  iComponentSize size (in bytes) of a component, 1, 2, 4 or 8
+  @param  iComponentCount number of components per voxel
+  @throws std::runtime_error if the component size is not supported
+  */
+void delta3DDecode(const uint8_t* src, uint8_t* dst,
+                   const UINT64VECTOR3& vBrickSize,
+                   size_t iComponentSize, size_t iComponentCount);
+
+#endif /* UVF_PREFILTER_H */
+
+/*
+ The MIT License
+ 
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
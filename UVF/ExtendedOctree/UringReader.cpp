@@ -0,0 +1,261 @@
+/*
+ The MIT License
+ 
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
+#include "UringReader.h"
+
+#ifdef TUVOK_HAVE_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct UringReader::Slot {
+  struct iovec iov; // what is left to read, the kernel reads the vector
+                    // after submission so it has to stay put
+  int fd;
+  uint64_t iOffset;
+  uint64_t iTag;
+};
+
+namespace {
+  int uringSetup(unsigned iEntries, io_uring_params* p) {
+    return int(syscall(__NR_io_uring_setup, iEntries, p));
+  }
+
+  int uringEnter(int fd, unsigned iToSubmit, unsigned iMinComplete,
+                 unsigned iFlags) {
+    return int(syscall(__NR_io_uring_enter, fd, iToSubmit, iMinComplete,
+                       iFlags, NULL, 0));
+  }
+
+  template<typename T> T* ringField(void* pRing, uint32_t iOffset) {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(pRing) + iOffset);
+  }
+}
+
+bool UringReader::Available() {
+  // probe once, io_uring may be compiled out of the kernel or blocked by a
+  // seccomp filter (as in many containers)
+  static const bool bAvailable = []() {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    const int fd = uringSetup(1, &p);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+  }();
+  return bAvailable;
+}
+
+UringReader::UringReader(unsigned iQueueDepth) :
+  m_iRingFD(-1),
+  m_pSQRing(MAP_FAILED), m_iSQRingSize(0),
+  m_pCQRing(MAP_FAILED), m_iCQRingSize(0),
+  m_pSQEs(MAP_FAILED), m_iSQEsSize(0),
+  m_pSQHead(NULL), m_pSQTail(NULL), m_iSQMask(0), m_pSQArray(NULL),
+  m_pCQHead(NULL), m_pCQTail(NULL), m_iCQMask(0), m_pCQEs(NULL),
+  m_iInFlight(0),
+  m_iToSubmit(0)
+{
+  iQueueDepth = std::max(1u, iQueueDepth);
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  m_iRingFD = uringSetup(iQueueDepth, &p);
+  if (m_iRingFD < 0)
+    throw std::runtime_error(std::string("io_uring_setup failed: ") +
+                             strerror(errno));
+
+  m_iSQRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  m_iCQRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  const bool bSingleMap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (bSingleMap)
+    m_iSQRingSize = m_iCQRingSize = std::max(m_iSQRingSize, m_iCQRingSize);
+
+  m_pSQRing = mmap(NULL, m_iSQRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_iRingFD, IORING_OFF_SQ_RING);
+  if (m_pSQRing != MAP_FAILED && !bSingleMap)
+    m_pCQRing = mmap(NULL, m_iCQRingSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_iRingFD, IORING_OFF_CQ_RING);
+  m_iSQEsSize = p.sq_entries * sizeof(io_uring_sqe);
+  if (m_pSQRing != MAP_FAILED)
+    m_pSQEs = mmap(NULL, m_iSQEsSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_iRingFD, IORING_OFF_SQES);
+  if (m_pSQRing == MAP_FAILED || m_pSQEs == MAP_FAILED ||
+      (!bSingleMap && m_pCQRing == MAP_FAILED)) {
+    const int iError = errno;
+    Release();
+    throw std::runtime_error(std::string("mapping the io_uring failed: ") +
+                             strerror(iError));
+  }
+  void* pCQRing = bSingleMap ? m_pSQRing : m_pCQRing;
+
+  m_pSQHead  = ringField<unsigned>(m_pSQRing, p.sq_off.head);
+  m_pSQTail  = ringField<unsigned>(m_pSQRing, p.sq_off.tail);
+  m_iSQMask  = *ringField<unsigned>(m_pSQRing, p.sq_off.ring_mask);
+  m_pSQArray = ringField<unsigned>(m_pSQRing, p.sq_off.array);
+  m_pCQHead  = ringField<unsigned>(pCQRing, p.cq_off.head);
+  m_pCQTail  = ringField<unsigned>(pCQRing, p.cq_off.tail);
+  m_iCQMask  = *ringField<unsigned>(pCQRing, p.cq_off.ring_mask);
+  m_pCQEs    = ringField<io_uring_cqe>(pCQRing, p.cq_off.cqes);
+
+  // the completion ring holds (at least) as many entries as the submission
+  // ring, limiting the reads in flight to the latter means it never overflows
+  m_vSlots.resize(std::min(iQueueDepth, p.sq_entries));
+  for (unsigned i = unsigned(m_vSlots.size()); i > 0; --i)
+    m_vFreeSlots.push_back(i - 1);
+}
+
+UringReader::~UringReader() {
+  // the kernel may still write into buffers of reads in flight
+  Drain();
+  Release();
+}
+
+void UringReader::Release() {
+  if (m_pSQEs != MAP_FAILED) munmap(m_pSQEs, m_iSQEsSize);
+  if (m_pCQRing != MAP_FAILED) munmap(m_pCQRing, m_iCQRingSize);
+  if (m_pSQRing != MAP_FAILED) munmap(m_pSQRing, m_iSQRingSize);
+  if (m_iRingFD >= 0) close(m_iRingFD);
+  m_pSQEs = m_pCQRing = m_pSQRing = MAP_FAILED;
+  m_iRingFD = -1;
+}
+
+unsigned UringReader::Depth() const {
+  return unsigned(m_vSlots.size());
+}
+
+bool UringReader::Push(int fd, uint64_t iOffset, uint8_t* pData,
+                       size_t iLength, uint64_t iTag) {
+  if (m_vFreeSlots.empty()) return false;
+  const unsigned iSlot = m_vFreeSlots.back();
+  m_vFreeSlots.pop_back();
+
+  Slot& s = m_vSlots[iSlot];
+  s.iov.iov_base = pData;
+  s.iov.iov_len = iLength;
+  s.fd = fd;
+  s.iOffset = iOffset;
+  s.iTag = iTag;
+  ++m_iInFlight;
+  Queue(iSlot);
+  return true;
+}
+
+void UringReader::Queue(unsigned iSlot) {
+  // we are the only producer, the kernel only reads the tail
+  const unsigned iTail = *m_pSQTail;
+  const unsigned iIndex = iTail & m_iSQMask;
+  const Slot& s = m_vSlots[iSlot];
+
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(m_pSQEs) + iIndex;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READV; // IORING_OP_READ needs kernel 5.6
+  sqe->fd = s.fd;
+  sqe->off = s.iOffset;
+  sqe->addr = reinterpret_cast<uintptr_t>(&s.iov);
+  sqe->len = 1;
+  sqe->user_data = iSlot;
+  m_pSQArray[iIndex] = iIndex;
+  __atomic_store_n(m_pSQTail, iTail + 1, __ATOMIC_RELEASE);
+  ++m_iToSubmit;
+}
+
+void UringReader::Submit(unsigned iMinComplete) {
+  for (;;) {
+    const int r = uringEnter(m_iRingFD, m_iToSubmit, iMinComplete,
+                             IORING_ENTER_GETEVENTS);
+    if (r >= 0) {
+      m_iToSubmit -= std::min(m_iToSubmit, unsigned(r));
+      if (m_iToSubmit == 0) return;
+      continue; // the kernel took only some of the entries
+    }
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      throw std::runtime_error(std::string("io_uring_enter failed: ") +
+                               strerror(errno));
+    // entries may have been consumed before the wait was interrupted
+    const unsigned iHead = __atomic_load_n(m_pSQHead, __ATOMIC_ACQUIRE);
+    m_iToSubmit = *m_pSQTail - iHead;
+  }
+}
+
+void UringReader::Wait(std::vector<uint64_t>& vDone) {
+  if (m_iInFlight == 0) return;
+  Submit(1);
+
+  std::string strError;
+  unsigned iHead = *m_pCQHead;
+  const unsigned iTail = __atomic_load_n(m_pCQTail, __ATOMIC_ACQUIRE);
+  for (; iHead != iTail; ++iHead) {
+    const io_uring_cqe& cqe = static_cast<io_uring_cqe*>(m_pCQEs)[iHead & m_iCQMask];
+    const unsigned iSlot = unsigned(cqe.user_data);
+    Slot& s = m_vSlots[iSlot];
+
+    if (cqe.res > 0 && size_t(cqe.res) < s.iov.iov_len) {
+      // short read, ask for the rest
+      s.iov.iov_base = static_cast<uint8_t*>(s.iov.iov_base) + cqe.res;
+      s.iov.iov_len -= size_t(cqe.res);
+      s.iOffset += uint64_t(cqe.res);
+      Queue(iSlot);
+      continue;
+    }
+    if (cqe.res < 0)
+      strError = strerror(-cqe.res);
+    else if (cqe.res == 0 && s.iov.iov_len > 0)
+      strError = "unexpected end of file";
+    else
+      vDone.push_back(s.iTag);
+    m_vFreeSlots.push_back(iSlot);
+    --m_iInFlight;
+  }
+  __atomic_store_n(m_pCQHead, iHead, __ATOMIC_RELEASE);
+
+  if (!strError.empty())
+    throw std::runtime_error("brick read failed: " + strError);
+}
+
+void UringReader::Drain() {
+  // reads which were queued but never submitted are unknown to the kernel
+  while (m_iInFlight > m_iToSubmit) {
+    const int r = uringEnter(m_iRingFD, 0, 1, IORING_ENTER_GETEVENTS);
+    if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      return; // nothing sensible left to do, the ring is broken
+
+    unsigned iHead = *m_pCQHead;
+    const unsigned iTail = __atomic_load_n(m_pCQTail, __ATOMIC_ACQUIRE);
+    for (; iHead != iTail; ++iHead) {
+      const io_uring_cqe& cqe = static_cast<io_uring_cqe*>(m_pCQEs)[iHead & m_iCQMask];
+      m_vFreeSlots.push_back(unsigned(cqe.user_data));
+      --m_iInFlight;
+    }
+    __atomic_store_n(m_pCQHead, iHead, __ATOMIC_RELEASE);
+  }
+}
+
+#endif // TUVOK_HAVE_IO_URING
@@ -0,0 +1,125 @@
+#pragma once
+
+#ifndef URINGREADER_H
+#define URINGREADER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#if defined(TUVOK_IO_URING) && defined(__linux__)
+# define TUVOK_HAVE_IO_URING
+#endif
+
+#ifdef TUVOK_HAVE_IO_URING
+
+/*
+  A small submission/completion queue for file reads on top of Linux'
+  io_uring, talking to the kernel through the raw system calls so no
+  additional library is needed. Only compiled in if TUVOK_IO_URING is
+  defined on Linux (TUVOK_HAVE_IO_URING is set then); Available() tells at
+  run time whether the kernel (or a seccomp filter) lets us use it, callers
+  are expected to fall back to blocking reads otherwise.
+
+  A reader is not thread safe, every thread needs its own. Buffers handed
+  to Push must stay valid until their read was returned by Wait, the
+  destructor waits for all reads still in flight.
+*/
+class UringReader {
+public:
+  /// @returns true if io_uring support is compiled in and usable
+  static bool Available();
+
+  /**
+    sets up a ring
+    @param iQueueDepth maximum number of reads in flight
+    @throws std::runtime_error if the ring cannot be created
+  */
+  explicit UringReader(unsigned iQueueDepth);
+  ~UringReader();
+
+  /// @returns the number of reads that have been pushed but not returned
+  unsigned InFlight() const { return m_iInFlight; }
+  /// @returns the maximum number of reads in flight
+  unsigned Depth() const;
+
+  /**
+    queues a read, it is handed to the kernel with the next Wait
+    @param fd the file to read from
+    @param iOffset position (in bytes) in the file
+    @param pData target buffer
+    @param iLength number of bytes to read
+    @param iTag returned by Wait once the read is complete
+    @return false if the queue is full
+  */
+  bool Push(int fd, uint64_t iOffset, uint8_t* pData, size_t iLength,
+            uint64_t iTag);
+
+  /**
+    submits all queued reads and blocks until at least one read completed
+    (if any is in flight); short reads are resubmitted transparently
+    @param vDone receives the tags of all reads that are complete
+    @throws std::runtime_error if a read fails or hits the end of the file
+  */
+  void Wait(std::vector<uint64_t>& vDone);
+
+private:
+  UringReader(const UringReader&);
+  UringReader& operator=(const UringReader&);
+
+  struct Slot;
+  void Queue(unsigned iSlot);
+  void Submit(unsigned iMinComplete);
+  void Drain();
+  void Release();
+
+  int m_iRingFD;
+  void* m_pSQRing;
+  size_t m_iSQRingSize;
+  void* m_pCQRing;
+  size_t m_iCQRingSize;
+  void* m_pSQEs;
+  size_t m_iSQEsSize;
+  // pointers into the mapped rings
+  unsigned* m_pSQHead;
+  unsigned* m_pSQTail;
+  unsigned m_iSQMask;
+  unsigned* m_pSQArray;
+  unsigned* m_pCQHead;
+  unsigned* m_pCQTail;
+  unsigned m_iCQMask;
+  void* m_pCQEs;
+
+  std::vector<Slot> m_vSlots;
+  std::vector<unsigned> m_vFreeSlots;
+  unsigned m_iInFlight;
+  unsigned m_iToSubmit;
+};
+
+#endif // TUVOK_HAVE_IO_URING
+
+#endif // URINGREADER_H
+
+/*
+ The MIT License
+ 
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
@@ -16,11 +16,11 @@ bool Layout::ExceedsDomain(UINT64VECTOR3 const& vSpatialPosition)
   assert(vSpatialPosition.x < m_vDomainSize.x);
   assert(vSpatialPosition.y < m_vDomainSize.y);
   assert(vSpatialPosition.z < m_vDomainSize.z);
-  if (vSpatialPosition.x <= m_vDomainSize.x)
+  if (vSpatialPosition.x >= m_vDomainSize.x)
     return true;
-  if (vSpatialPosition.y <= m_vDomainSize.y)
+  if (vSpatialPosition.y >= m_vDomainSize.y)
     return true;
-  if (vSpatialPosition.z <= m_vDomainSize.z)
+  if (vSpatialPosition.z >= m_vDomainSize.z)
     return true;
   return false;
 }
@@ -207,6 +207,67 @@ void VolumeTools::RemoveBoundary(uint8_t *pBrickData,
   }
 }
 
+/*
+ CropBrick:
+
+ Same as RemoveBoundary but with independent offsets per side. Output rows
+ never start behind their input rows so the copy can run in place front to
+ back, memmove takes care of rows that overlap themselves.
+ */
+void VolumeTools::CropBrick(uint8_t *pBrickData,
+                            const UINT64VECTOR3& vBrickSize,
+                            size_t iVoxelSize,
+                            const UINT64VECTOR3& vOffset,
+                            const UINT64VECTOR3& vCropSize) {
+  for (uint64_t z = 0;z<vCropSize.z;++z) {
+    for (uint64_t y = 0;y<vCropSize.y;++y) {
+      size_t inOffset = size_t(iVoxelSize * ( vOffset.x +
+                                     (y+vOffset.y) * vBrickSize.x +
+                                     (z+vOffset.z) * vBrickSize.x*vBrickSize.y));
+      size_t outOffset = size_t(iVoxelSize * (y*vCropSize.x +
+                                     z*vCropSize.x*vCropSize.y));
+      memmove(pBrickData+outOffset, pBrickData+inOffset,
+              size_t(iVoxelSize*vCropSize.x));
+    }
+  }
+}
+
+/*
+ IsConstant:
+
+ A brick is constant iff it equals itself shifted by one voxel, so a single
+ memcmp of the brick against its own tail does the job.
+ */
+bool VolumeTools::IsConstant(const uint8_t *pBrickData,
+                             size_t iSizeInBytes, size_t iVoxelSize) {
+  if (iVoxelSize == 0 || iSizeInBytes <= iVoxelSize) return true;
+  return memcmp(pBrickData, pBrickData+iVoxelSize,
+                iSizeInBytes-iVoxelSize) == 0;
+}
+
+/*
+ FillConstant:
+
+ Writes the first voxel and then keeps doubling the filled region
+ with memcpy, this needs only a logarithmic number of copy calls.
+ */
+void VolumeTools::FillConstant(uint8_t *pBrickData, size_t iSizeInBytes,
+                               const uint8_t *pVoxel, size_t iVoxelSize) {
+  if (iSizeInBytes == 0) return;
+  if (iVoxelSize == 1) {
+    memset(pBrickData, *pVoxel, iSizeInBytes);
+    return;
+  }
+
+  size_t iFilled = std::min(iVoxelSize, iSizeInBytes);
+  memcpy(pBrickData, pVoxel, iFilled);
+  while (iFilled < iSizeInBytes) {
+    const size_t iChunk = std::min(iFilled, iSizeInBytes-iFilled);
+    memcpy(pBrickData+iFilled, pBrickData, iChunk);
+    iFilled += iChunk;
+  }
+}
+
 void VolumeTools::Atalasify(size_t iSizeInBytes,
                             const UINTVECTOR3& vMaxBrickSize,
                             const UINT64VECTOR3& vCurrBrickSize,
@@ -154,6 +154,51 @@ namespace VolumeTools {
                       size_t iVoxelSize, 
                       uint32_t iRemove);
 
+  /**
+    This function cuts an arbitrary box out of a brick in 3D format,
+    unlike RemoveBoundary the box need not be centered. The function
+    changes the given brick in-place, the box is stored at the
+    beginning of the array.
+
+    @param pBrickData the voxels of the brick, changes are made to
+                      this array in place
+    @param vBrickSize the 3D size of the brick
+    @param iVoxelSize the size (in bytes) of a voxel in the tree
+    @param vOffset the first voxel of the box
+    @param vCropSize the 3D size of the box, vOffset+vCropSize must
+                     not exceed vBrickSize
+  */
+  void CropBrick(uint8_t *pBrickData,
+                 const UINT64VECTOR3& vBrickSize,
+                 size_t iVoxelSize,
+                 const UINT64VECTOR3& vOffset,
+                 const UINT64VECTOR3& vCropSize);
+
+  /**
+    Checks whether all voxels of a brick hold the same value
+
+    @param pBrickData the voxels of the brick
+    @param iSizeInBytes total size of the brick
+    @param iVoxelSize the size (in bytes) of a voxel in the tree
+    @return true iff every voxel is bitwise equal to the first one
+  */
+  bool IsConstant(const uint8_t *pBrickData,
+                  size_t iSizeInBytes,
+                  size_t iVoxelSize);
+
+  /**
+    Fills a brick with a single voxel value
+
+    @param pBrickData the voxels of the brick to be filled
+    @param iSizeInBytes total size of the brick
+    @param pVoxel the value to be replicated
+    @param iVoxelSize the size (in bytes) of a voxel in the tree
+  */
+  void FillConstant(uint8_t *pBrickData,
+                    size_t iSizeInBytes,
+                    const uint8_t *pVoxel,
+                    size_t iVoxelSize);
+
 
   /**
    Computes the mean value ( (a+b)/2) of a and b or the median (just picking a) 
@@ -5,13 +5,37 @@
 #include "Basics/nonstd.h"
 #include "ZlibCompression.h"
 
-/** if you call 'inflateInit' on a stream, you must cause inflateEnd (even if
- * inflation fails) to cleanup internal zlib memory allocations. */
-struct CleanupZlibInStream {
-  void operator()(z_stream* strm) const {
-    inflateEnd(strm);
-    delete strm;
+/** inflate state that lives as long as its thread, bricks are decoded
+ * with inflateReset instead of a full inflateInit/inflateEnd cycle which
+ * would reallocate the 32K window for every brick. */
+class InflateContext {
+public:
+  InflateContext() : m_bInitialized(false) {
+    m_strm.zalloc = Z_NULL; m_strm.zfree = Z_NULL; m_strm.opaque = Z_NULL;
+    m_strm.avail_in = 0;
+    m_strm.next_in = Z_NULL;
+  }
+  ~InflateContext() {
+    if(m_bInitialized) inflateEnd(&m_strm);
   }
+
+  /// @returns a stream ready to inflate a new brick
+  z_stream* Acquire() {
+    if(!m_bInitialized) {
+      if(inflateInit(&m_strm) != Z_OK) {
+        assert("zlib initialization failed" && false);
+        throw std::runtime_error("zlib initialization failed");
+      }
+      m_bInitialized = true;
+    } else if(inflateReset(&m_strm) != Z_OK) {
+      throw std::runtime_error("zlib stream reset failed");
+    }
+    return &m_strm;
+  }
+
+private:
+  z_stream m_strm;
+  bool m_bInitialized;
 };
 
 
@@ -24,15 +48,8 @@ void zDecompress(std::shared_ptr<uint8_t> src, std::shared_ptr<uint8_t>& dst,
      * can't work.  Just bail for now. */
     throw std::runtime_error("expected uncompressed size too large");
   }
-  std::shared_ptr<z_stream> strm(new z_stream, CleanupZlibInStream());
-  strm->zalloc = Z_NULL; strm->zfree = Z_NULL; strm->opaque = Z_NULL;
-
-  strm->avail_in = 0;
-  strm->next_in = Z_NULL;
-  if(inflateInit(strm.get()) != Z_OK) {
-    assert("zlib initialization failed" && false);
-    throw std::runtime_error("zlib initialization failed");
-  }
+  static thread_local InflateContext context;
+  z_stream* strm = context.Acquire();
   strm->avail_in = static_cast<uInt>(uncompressedBytes);
   strm->next_in = src.get();
   strm->avail_out = static_cast<uInt>(uncompressedBytes);
@@ -49,7 +66,7 @@ void zDecompress(std::shared_ptr<uint8_t> src, std::shared_ptr<uint8_t>& dst,
     const uInt save = static_cast<uInt>(uncompressedBytes) - bytes;
     strm->avail_out = static_cast<uInt>(uncompressedBytes) - bytes;
     strm->next_out = dst.get() + bytes;
-    ret = inflate(strm.get(), Z_FINISH);
+    ret = inflate(strm, Z_FINISH);
     assert(ret != Z_STREAM_ERROR); // only happens w/ invalid params
     assert(ret != Z_MEM_ERROR); // only happens if 'out' is not big enough
     assert(ret != Z_BUF_ERROR); // ditto above, for our case (Z_FINISH)
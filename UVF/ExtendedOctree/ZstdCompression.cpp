@@ -0,0 +1,79 @@
+#include <stdexcept>
+#include <string>
+#include "Basics/nonstd.h"
+#include "ZstdCompression.h"
+
+#include "zstd.h"
+
+size_t zstdCompress(std::shared_ptr<uint8_t> src, size_t uncompressedBytes,
+                    std::shared_ptr<uint8_t>& dst,
+                    uint32_t compressionLevel)
+{
+  if (compressionLevel > uint32_t(ZSTD_maxCLevel()))
+    compressionLevel = uint32_t(ZSTD_maxCLevel());
+
+  size_t const upperBound = ZSTD_compressBound(uncompressedBytes);
+  if (ZSTD_isError(upperBound))
+    throw std::runtime_error("Input data too big for Zstd");
+
+  dst.reset(new uint8_t[upperBound], nonstd::DeleteArray<uint8_t>());
+  size_t const compressedBytes = ZSTD_compress(dst.get(), upperBound,
+                                               src.get(), uncompressedBytes,
+                                               int(compressionLevel));
+  if (ZSTD_isError(compressedBytes))
+    throw std::runtime_error(std::string("ZSTD_compress failed. ") +
+                             ZSTD_getErrorName(compressedBytes));
+  return compressedBytes;
+}
+
+namespace {
+
+  struct FreeDCtx {
+    void operator()(ZSTD_DCtx* dctx) const { ZSTD_freeDCtx(dctx); }
+  };
+
+}
+
+void zstdDecompress(std::shared_ptr<uint8_t> src, size_t compressedBytes,
+                    std::shared_ptr<uint8_t>& dst, size_t uncompressedBytes)
+{
+  // one decoder context per thread, creating it is the expensive part
+  static thread_local std::unique_ptr<ZSTD_DCtx, FreeDCtx> dctx(
+    ZSTD_createDCtx());
+  if (!dctx)
+    throw std::runtime_error("ZSTD_createDCtx failed");
+
+  size_t const outputSize = ZSTD_decompressDCtx(dctx.get(),
+                                                dst.get(), uncompressedBytes,
+                                                src.get(), compressedBytes);
+  if (ZSTD_isError(outputSize))
+    throw std::runtime_error(std::string("ZSTD_decompress failed. ") +
+                             ZSTD_getErrorName(outputSize));
+  else if (outputSize != uncompressedBytes)
+    throw std::runtime_error("Zstd decompression failed, output size does not "
+                             "match expected output size.");
+}
+
+/*
+ The MIT License
+ 
+ Copyright (c) 2011 Interactive Visualization and Data Analysis Group
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a
+ copy of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+ */
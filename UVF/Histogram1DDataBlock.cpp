@@ -161,6 +161,83 @@ void Histogram1DDataBlock::ComputeTemplate(const TOCBlock* source,
 }
 
 
+bool Histogram1DDataBlock::Update(const TOCBlock* source,
+                                  const UINT64VECTOR4& vBrickCoords,
+                                  const uint8_t* pOldData,
+                                  const uint8_t* pNewData) {
+  // same restrictions as in Compute
+  if (source->GetComponentType() == ExtendedOctree::CT_FLOAT32 ||
+      source->GetComponentType() == ExtendedOctree::CT_FLOAT64 ||
+      source->GetComponentTypeSize() > 4 ||
+      source->GetComponentCount() != 1) return false;
+
+  switch (source->GetComponentType()) {
+    case ExtendedOctree::CT_UINT8:
+      return UpdateTemplate<uint8_t>(source, vBrickCoords,
+                                     (const uint8_t*)pOldData,
+                                     (const uint8_t*)pNewData);
+    case ExtendedOctree::CT_UINT16:
+      return UpdateTemplate<uint16_t>(source, vBrickCoords,
+                                      (const uint16_t*)pOldData,
+                                      (const uint16_t*)pNewData);
+    case ExtendedOctree::CT_UINT32:
+      return UpdateTemplate<uint32_t>(source, vBrickCoords,
+                                      (const uint32_t*)pOldData,
+                                      (const uint32_t*)pNewData);
+    case ExtendedOctree::CT_INT8:
+      return UpdateTemplate<int8_t>(source, vBrickCoords,
+                                    (const int8_t*)pOldData,
+                                    (const int8_t*)pNewData);
+    case ExtendedOctree::CT_INT16:
+      return UpdateTemplate<int16_t>(source, vBrickCoords,
+                                     (const int16_t*)pOldData,
+                                     (const int16_t*)pNewData);
+    case ExtendedOctree::CT_INT32:
+      return UpdateTemplate<int32_t>(source, vBrickCoords,
+                                     (const int32_t*)pOldData,
+                                     (const int32_t*)pNewData);
+    default:
+      return false;
+  }
+}
+
+template <class T>
+bool Histogram1DDataBlock::UpdateTemplate(const TOCBlock* source,
+                                          const UINT64VECTOR4& vBrickCoords,
+                                          const T* pOldData,
+                                          const T* pNewData) {
+  size_t iCompcount = size_t(source->GetComponentCount());
+  uint32_t iOverlap = source->GetOverlap();
+  UINTVECTOR3 bricksize = UINTVECTOR3(source->GetBrickSize(vBrickCoords));
+
+  // the bin count is fixed (the block is rewritten in place), so make sure
+  // every new value has a bin before anything is changed
+  for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
+    for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
+      for (uint32_t x = iOverlap;x<bricksize.x-iOverlap;x++) {
+        size_t i = iCompcount*(x+y*bricksize.x+z*bricksize.x*bricksize.y);
+        if (size_t(pNewData[i]) >= m_vHistData.size()) return false;
+      }
+    }
+  }
+
+  for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
+    for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
+      for (uint32_t x = iOverlap;x<bricksize.x-iOverlap;x++) {
+        size_t i = iCompcount*(x+y*bricksize.x+z*bricksize.x*bricksize.y);
+        size_t oldVal = size_t(pOldData[i]);
+        size_t newVal = size_t(pNewData[i]);
+        if (oldVal == newVal) continue;
+
+        if (oldVal < m_vHistData.size() && m_vHistData[oldVal] > 0)
+          m_vHistData[oldVal]--;
+        m_vHistData[newVal]++;
+      }
+    }
+  }
+  return true;
+}
+
 size_t Histogram1DDataBlock::Compress(size_t maxTargetSize) {
   if (m_vHistData.size() > maxTargetSize) {
     // compute the smallest integer that reduces m_vHistData.size 
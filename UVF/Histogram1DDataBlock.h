@@ -21,6 +21,12 @@ public:
 
   bool Compute(const TOCBlock* source, uint64_t iLevel);
   bool Compute(const RasterDataBlock* source);
+  /// replaces the contribution of a brick of the level the histogram was
+  /// computed from, pOldData and pNewData hold the brick before and after
+  /// it was changed. The bin count is kept, so this fails (without touching
+  /// the histogram) if a new value lies beyond the last bin
+  bool Update(const TOCBlock* source, const UINT64VECTOR4& vBrickCoords,
+              const uint8_t* pOldData, const uint8_t* pNewData);
   const std::vector<uint64_t>& GetHistogram() const {return m_vHistData;}
   void SetHistogram(std::vector<uint64_t>& vHistData) {m_vHistData = vHistData;}
   size_t Compress(size_t maxTargetSize);
@@ -40,5 +46,8 @@ protected:
 
   template <class T> void ComputeTemplate(const TOCBlock* source,
                                           uint64_t iLevel);
+  template <class T> bool UpdateTemplate(const TOCBlock* source,
+                                         const UINT64VECTOR4& vBrickCoords,
+                                         const T* pOldData, const T* pNewData);
 };
 #endif // UVF_HISTOGRAM1DDATABLOCK_H
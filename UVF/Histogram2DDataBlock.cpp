@@ -451,6 +451,90 @@ void Histogram2DDataBlock::ComputeTemplate(const TOCBlock* source, double normal
 
 
 
+bool Histogram2DDataBlock::Update(const TOCBlock* source,
+                                  const UINT64VECTOR4& vBrickCoords,
+                                  const uint8_t* pOldData,
+                                  const uint8_t* pNewData,
+                                  double fMaxNonZeroValue) {
+  // same restrictions as in Compute
+  if (source->GetComponentType() == ExtendedOctree::CT_FLOAT32 ||
+    source->GetComponentType() == ExtendedOctree::CT_FLOAT64 ||
+    source->GetComponentTypeSize() > 4 ||
+    source->GetComponentCount() != 1 || m_vHistData.empty()) return false;
+
+  switch (source->GetComponentType()) {
+  case ExtendedOctree::CT_UINT8:
+    return UpdateTemplate<uint8_t>(source, double(std::numeric_limits<uint8_t>::max()), vBrickCoords, (const uint8_t*)pOldData, (const uint8_t*)pNewData, fMaxNonZeroValue);
+  case ExtendedOctree::CT_UINT16:
+    return UpdateTemplate<uint16_t>(source, double(std::numeric_limits<uint16_t>::max()), vBrickCoords, (const uint16_t*)pOldData, (const uint16_t*)pNewData, fMaxNonZeroValue);
+  case ExtendedOctree::CT_UINT32:
+    return UpdateTemplate<uint32_t>(source, double(std::numeric_limits<uint32_t>::max()), vBrickCoords, (const uint32_t*)pOldData, (const uint32_t*)pNewData, fMaxNonZeroValue);
+  case ExtendedOctree::CT_INT8:
+    return UpdateTemplate<int8_t>(source, double(std::numeric_limits<int8_t>::max()), vBrickCoords, (const int8_t*)pOldData, (const int8_t*)pNewData, fMaxNonZeroValue);
+  case ExtendedOctree::CT_INT16:
+    return UpdateTemplate<int16_t>(source, double(std::numeric_limits<int16_t>::max()), vBrickCoords, (const int16_t*)pOldData, (const int16_t*)pNewData, fMaxNonZeroValue);
+  case ExtendedOctree::CT_INT32:
+    return UpdateTemplate<int32_t>(source, double(std::numeric_limits<int32_t>::max()), vBrickCoords, (const int32_t*)pOldData, (const int32_t*)pNewData, fMaxNonZeroValue);
+  default:
+    return false;
+  }
+}
+
+template <class T>
+bool Histogram2DDataBlock::UpdateTemplate(const TOCBlock* source,
+                                          double normalizationFactor,
+                                          const UINT64VECTOR4& vBrickCoords,
+                                          const T* pOldData, const T* pNewData,
+                                          double fMaxNonZeroValue) {
+  size_t iCompcount = size_t(source->GetComponentCount());
+  uint32_t iOverlap = source->GetOverlap();
+  UINTVECTOR3 bricksize = UINTVECTOR3(source->GetBrickSize(vBrickCoords));
+  const size_t iHistoBinCount = m_vHistData.size();
+
+  // the bins depend on the maximum gradient magnitude, so make sure the new
+  // data does not exceed it before anything is changed
+  for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
+    for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
+      for (uint32_t x = iOverlap;x<bricksize.x-iOverlap;x++) {
+        const DOUBLEVECTOR3 vGradient = ComputeGradient(
+          pNewData, normalizationFactor, iCompcount, bricksize,
+          UINTVECTOR3(x,y,z)
+        );
+        if (float(vGradient.length()) > m_fMaxGradMagnitude) return false;
+      }
+    }
+  }
+
+  const T* pData[2] = {pOldData, pNewData};
+  for (size_t k = 0;k<2;k++) {
+    for (uint32_t z = iOverlap;z<bricksize.z-iOverlap;z++) {
+      for (uint32_t y = iOverlap;y<bricksize.y-iOverlap;y++) {
+        for (uint32_t x = iOverlap;x<bricksize.x-iOverlap;x++) {
+          const DOUBLEVECTOR3 vGradient = ComputeGradient(
+            pData[k], normalizationFactor, iCompcount, bricksize,
+            UINTVECTOR3(x,y,z)
+          );
+
+          size_t iCenter = size_t(x+bricksize.x*y+bricksize.x*bricksize.y*z);
+          size_t iGradientMagnitudeIndex = std::min<size_t>(255,size_t(vGradient.length()/m_fMaxGradMagnitude*255.0f));
+          size_t iValue = (fMaxNonZeroValue <= double(iHistoBinCount-1))
+                              ? size_t(pData[k][iCompcount*iCenter])
+                              : size_t(double(pData[k][iCompcount*iCenter]) * double(iHistoBinCount-1)/fMaxNonZeroValue);
+          if (iValue > iHistoBinCount-1) iValue = iHistoBinCount-1;
+
+          uint64_t& bin = m_vHistData[iValue][iGradientMagnitudeIndex];
+          if (k == 1)
+            bin++;
+          else if (bin > 0)
+            bin--;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+
 void Histogram2DDataBlock::CopyHeaderToFile(LargeRAWFile_ptr pStreamFile, uint64_t iOffset, bool bIsBigEndian, bool bIsLastBlock) {
   DataBlock::CopyHeaderToFile(pStreamFile, iOffset, bIsBigEndian, bIsLastBlock);
 
@@ -24,6 +24,15 @@ public:
                double fMaxNonZeroValue);
   bool Compute(const RasterDataBlock* source,
                size_t iHistoBinCount, double fMaxNonZeroValue);
+  /// replaces the contribution of a brick of the level the histogram was
+  /// computed from, keeping the bin count and the gradient normalization;
+  /// fails (without touching the histogram) if a gradient of the new data
+  /// exceeds the maximum the histogram was computed with, the histogram then
+  /// has to be recomputed. fMaxNonZeroValue has to be the value passed to
+  /// Compute
+  bool Update(const TOCBlock* source, const UINT64VECTOR4& vBrickCoords,
+              const uint8_t* pOldData, const uint8_t* pNewData,
+              double fMaxNonZeroValue);
 
   const std::vector<std::vector<uint64_t>>& GetHistogram() const {
     return m_vHistData;
@@ -62,5 +71,11 @@ protected:
   void ComputeTemplate(const TOCBlock* source, double normalizationFactor,
                        uint64_t iLevel, size_t iHistoBinCount,
                        double fMaxNonZeroValue);
+
+  template <class T>
+  bool UpdateTemplate(const TOCBlock* source, double normalizationFactor,
+                      const UINT64VECTOR4& vBrickCoords,
+                      const T* pOldData, const T* pNewData,
+                      double fMaxNonZeroValue);
 };
 #endif // UVF_HISTOGRAM2DDATABLOCK_H
@@ -193,3 +193,29 @@ void MaxMinDataBlock::SetDataFromFlatVector(BrickStatVec& source, uint64_t iComp
     }
   }
 }
+
+void MaxMinDataBlock::UpdateFromFlatVector(const BrickStatVec& source,
+                                           const std::vector<uint64_t>& vIndices,
+                                           uint64_t iComponentCount) {
+  const size_t stcc = size_t(iComponentCount);
+
+  for (size_t k = 0;k<vIndices.size();++k) {
+    const size_t i = size_t(vIndices[k]);
+    if (i >= m_vfMaxMinData.size() || (i+1)*stcc > source.size()) {
+      throw std::length_error("MaxMinDataBlock: Invalid maxmin index.");
+    }
+    for (size_t j = 0;j<stcc;++j) {
+      m_vfMaxMinData[i][j] = MinMaxBlock(source[i*stcc+j].minScalar,
+                                         source[i*stcc+j].maxScalar,
+                                        -std::numeric_limits<double>::max(),
+                                         std::numeric_limits<double>::max());
+    }
+  }
+
+  // the global values may shrink, so they are merged from scratch, this
+  // does not touch any brick data
+  ResetGlobal();
+  for (size_t i = 0;i<m_vfMaxMinData.size();++i)
+    for (size_t j = 0;j<m_vfMaxMinData[i].size();++j)
+      m_GlobalMaxMin[j].Merge(m_vfMaxMinData[i][j]);
+}
@@ -27,6 +27,11 @@ public:
   void StartNewValue();
   void MergeData(const std::vector<DOUBLEVECTOR4>& fMaxMinData);
   void SetDataFromFlatVector(BrickStatVec& source, uint64_t iComponentCount);
+  /// replaces the values of the given bricks by their entries in source
+  /// (which holds the statistics of all bricks) and updates the global values
+  void UpdateFromFlatVector(const BrickStatVec& source,
+                            const std::vector<uint64_t>& vIndices,
+                            uint64_t iComponentCount);
 
   const tuvok::MinMaxBlock& GetGlobalValue(size_t iComponent=0) const {
     return m_GlobalMaxMin[iComponent];
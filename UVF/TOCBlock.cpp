@@ -1,9 +1,13 @@
 #include <ios>
+#include <stdexcept>
 #include "TOCBlock.h"
 
 #include "MaxMinDataBlock.h"
+#include "Histogram1DDataBlock.h"
+#include "Histogram2DDataBlock.h"
 #include "DebugOut/AbstrDebugOut.h"
 #include "ExtendedOctree/ExtendedOctreeConverter.h"
+#include "PageCache.h"
 
 using namespace std;
 
@@ -67,6 +71,8 @@ uint64_t TOCBlock::CopyToFile(LargeRAWFile_ptr pStreamFile, uint64_t iOffset,
 
   uint64_t iDataSize = ComputeDataSize();
   m_pStreamFile->SeekPos(m_iOffsetToOctree);
+  tuvok::pagecache::Stream sourceStream(m_pStreamFile->GetFilename());
+  tuvok::pagecache::Stream targetStream(pStreamFile->GetFilename());
   unsigned char* pData = new unsigned char[size_t(min(iDataSize, BLOCK_COPY_SIZE))];
   for (uint64_t i = 0;i<iDataSize;i+=BLOCK_COPY_SIZE) {
     uint64_t iCopySize = min(BLOCK_COPY_SIZE, iDataSize-i);
@@ -78,6 +84,8 @@ uint64_t TOCBlock::CopyToFile(LargeRAWFile_ptr pStreamFile, uint64_t iOffset,
            "makes no sense.");
     bytes = pStreamFile->WriteRAW(pData, iCopySize);
     assert(bytes == iCopySize);
+    sourceStream.Advance(iCopySize);
+    targetStream.Advance(iCopySize);
   }
   delete [] pData;
 
@@ -117,7 +125,9 @@ bool TOCBlock::FlatDataToBrickedLOD(
   AbstrDebugOut* debugOut,
   COMPRESSION_TYPE ct,
   uint32_t iCompressionLevel,
-  LAYOUT_TYPE lt
+  LAYOUT_TYPE lt,
+  PREFILTER_TYPE pf,
+  bool bAdaptiveCompression
 ) {
   LargeRAWFile_ptr inFile(new LargeRAWFile(strSourceFile));
   if (!inFile->Open()) {
@@ -129,7 +139,8 @@ bool TOCBlock::FlatDataToBrickedLOD(
                               vVolumeSize, vScale, vMaxBrickSize,
                               iOverlap, bUseMedian, bClampToEdge,
                               iCacheSize, pMaxMinDatBlock, debugOut, ct,
-                              iCompressionLevel, lt);
+                              iCompressionLevel, lt, pf,
+                              bAdaptiveCompression);
 }
 
 bool TOCBlock::FlatDataToBrickedLOD(
@@ -146,7 +157,9 @@ bool TOCBlock::FlatDataToBrickedLOD(
   AbstrDebugOut* debugOut,
   COMPRESSION_TYPE ct,
   uint32_t iCompressionLevel,
-  LAYOUT_TYPE lt
+  LAYOUT_TYPE lt,
+  PREFILTER_TYPE pf,
+  bool bAdaptiveCompression
 ) {
   m_vMaxBrickSize = vMaxBrickSize;
   m_iOverlap = iOverlap;
@@ -168,6 +181,8 @@ bool TOCBlock::FlatDataToBrickedLOD(
   m_strDeleteTempFile = strTempFile;
   ExtendedOctreeConverter c(m_vMaxBrickSize, m_iOverlap, iCacheSize,
                             *debugOut);
+  c.SetPreFilter(pf);
+  c.SetAdaptiveCompression(bAdaptiveCompression);
   BrickStatVec statsVec;
 
   if (!pSourceData->IsOpen()) pSourceData->Open();
@@ -185,6 +200,224 @@ bool TOCBlock::FlatDataToBrickedLOD(
   return m_ExtendedOctree.Open(m_strDeleteTempFile, 0, m_iUVFFileVersion);
 }
 
+bool TOCBlock::MergeBricked(
+  const std::vector<const TOCBlock*>& vSources,
+  const std::string& strTempFile,
+  bool (*combineFunc)(const std::vector<const uint8_t*>&, uint8_t*, uint64_t,
+                      void*),
+  void* pUserContext,
+  std::shared_ptr<MaxMinDataBlock> pMaxMinDatBlock,
+  AbstrDebugOut* debugOut,
+  bool bUseMedian,
+  bool bClampToEdge,
+  COMPRESSION_TYPE ct,
+  uint32_t iCompressionLevel,
+  LAYOUT_TYPE lt
+) {
+  assert(debugOut != NULL);
+  if (vSources.empty()) return false;
+
+  m_vMaxBrickSize = UINT64VECTOR3(vSources[0]->GetMaxBrickSize());
+  m_iOverlap = vSources[0]->GetOverlap();
+
+  std::vector<const ExtendedOctree*> vTrees;
+  for (size_t i = 0;i<vSources.size();i++)
+    vTrees.push_back(&vSources[i]->m_ExtendedOctree);
+
+  LargeRAWFile_ptr outFile(new LargeRAWFile(strTempFile));
+  if (!outFile->Create()) {
+    debugOut->Error(_func_, "Could not create tempfile '%s'",
+                    strTempFile.c_str());
+    return false;
+  }
+  m_pStreamFile = outFile;
+  m_strDeleteTempFile = strTempFile;
+  ExtendedOctreeConverter c(m_vMaxBrickSize, m_iOverlap, 0, *debugOut);
+  BrickStatVec statsVec;
+
+  if(!c.Merge(vTrees, combineFunc, pUserContext, outFile, 0, &statsVec, ct,
+              iCompressionLevel, bUseMedian, bClampToEdge, lt)) {
+    debugOut->Error(_func_, "ExtOctree reported failed merge.");
+    return false;
+  }
+  outFile->Close(); // note, needed before the 'Open' below!
+
+  pMaxMinDatBlock->SetDataFromFlatVector(statsVec,
+                                         vSources[0]->GetComponentCount());
+  debugOut->Message(_func_, "opening UVF '%s'", m_strDeleteTempFile.c_str());
+  return m_ExtendedOctree.Open(m_strDeleteTempFile, 0, m_iUVFFileVersion);
+}
+
+/// converts the min/max data of all bricks of a block into the flat layout
+/// the converter uses, fails if the data does not cover every brick
+static bool StatsFromMaxMin(const TOCBlock& block,
+                            const MaxMinDataBlock& maxMin,
+                            BrickStatVec& stats) {
+  const size_t iComponentCount = size_t(block.GetComponentCount());
+  size_t iBrickCount = 0;
+  for (uint64_t iLoD = 0;iLoD<block.GetLoDCount();iLoD++)
+    iBrickCount += size_t(block.GetBrickCount(iLoD).volume());
+
+  stats.clear();
+  stats.reserve(iBrickCount*iComponentCount);
+  try {
+    for (size_t i = 0;i<iBrickCount;i++) {
+      for (size_t c = 0;c<iComponentCount;c++) {
+        const tuvok::MinMaxBlock& mm = maxMin.GetValue(i, c);
+        stats.push_back(BrickStats<double>(mm.minScalar, mm.maxScalar));
+      }
+    }
+  } catch(const std::length_error&) {
+    return false;
+  }
+  return true;
+}
+
+bool TOCBlock::CropBricked(
+  const TOCBlock& source,
+  const MaxMinDataBlock* pSourceMaxMin,
+  const std::string& strTempFile,
+  const PLANE<float>& plane,
+  std::shared_ptr<MaxMinDataBlock> pMaxMinDatBlock,
+  AbstrDebugOut* debugOut,
+  bool bComputeMedian,
+  bool bClampToEdge,
+  COMPRESSION_TYPE ct
+) {
+  assert(debugOut != NULL);
+
+  m_vMaxBrickSize = UINT64VECTOR3(source.GetMaxBrickSize());
+  m_iOverlap = source.GetOverlap();
+
+  // the min/max values of the source spare us decoding the copied bricks
+  const size_t iComponentCount = size_t(source.GetComponentCount());
+  BrickStatVec inputStats;
+  if (pSourceMaxMin && !StatsFromMaxMin(source, *pSourceMaxMin, inputStats)) {
+    debugOut->Warning(_func_, "Incomplete min/max data, recomputing it.");
+    inputStats.clear();
+  }
+
+  LargeRAWFile_ptr outFile(new LargeRAWFile(strTempFile));
+  if (!outFile->Create()) {
+    debugOut->Error(_func_, "Could not create tempfile '%s'",
+                    strTempFile.c_str());
+    return false;
+  }
+  m_pStreamFile = outFile;
+  m_strDeleteTempFile = strTempFile;
+  ExtendedOctreeConverter c(m_vMaxBrickSize, m_iOverlap, 0, *debugOut);
+  BrickStatVec statsVec;
+
+  if(!c.Crop(source.m_ExtendedOctree, plane, outFile, 0, &statsVec,
+             inputStats.empty() ? NULL : &inputStats, ct, bComputeMedian,
+             bClampToEdge)) {
+    debugOut->Error(_func_, "ExtOctree reported failed crop.");
+    return false;
+  }
+  outFile->Close(); // note, needed before the 'Open' below!
+
+  pMaxMinDatBlock->SetDataFromFlatVector(statsVec, iComponentCount);
+  debugOut->Message(_func_, "opening UVF '%s'", m_strDeleteTempFile.c_str());
+  return m_ExtendedOctree.Open(m_strDeleteTempFile, 0, m_iUVFFileVersion);
+}
+
+bool TOCBlock::UpdateBricks(
+  const std::vector<UINT64VECTOR4>& vBrickCoords,
+  const std::vector<std::shared_ptr<uint8_t>>& vBrickData,
+  MaxMinDataBlock* pMaxMinDatBlock,
+  Histogram1DDataBlock* pHist1D,
+  Histogram2DDataBlock* pHist2D,
+  AbstrDebugOut* debugOut,
+  bool bComputeMedian,
+  bool bClampToEdge,
+  COMPRESSION_TYPE ct
+) {
+  assert(debugOut != NULL);
+
+  const size_t iComponentCount = size_t(GetComponentCount());
+  BrickStatVec statsVec;
+  if (pMaxMinDatBlock &&
+      !StatsFromMaxMin(*this, *pMaxMinDatBlock, statsVec)) {
+    debugOut->Error(_func_, "Min/max data does not match the bricks.");
+    return false;
+  }
+  if (pHist2D && !pMaxMinDatBlock) {
+    debugOut->Error(_func_, "The 2D histogram can only be updated together "
+                    "with the min/max data.");
+    return false;
+  }
+
+  // the histograms are patched with the difference between the old and the
+  // new version of the replaced bricks
+  std::vector<std::vector<uint8_t>> vOldData;
+  if (pHist1D || pHist2D) {
+    const UINT64VECTOR3 vBrickCount = GetBrickCount(0);
+    vOldData.resize(vBrickCoords.size());
+    for (size_t i = 0;i<vBrickCoords.size();i++) {
+      const UINT64VECTOR4& c = vBrickCoords[i];
+      if (c.w != 0 || c.x >= vBrickCount.x || c.y >= vBrickCount.y ||
+          c.z >= vBrickCount.z) {
+        debugOut->Error(_func_, "Invalid brick coordinates.");
+        return false;
+      }
+      vOldData[i].resize(size_t(GetBrickSize(c).volume() *
+                                GetComponentTypeSize() * iComponentCount));
+      GetData(&vOldData[i][0], c);
+    }
+  }
+  const double fOldMax = pMaxMinDatBlock
+                         ? pMaxMinDatBlock->GetGlobalValue().maxScalar : 0.0;
+
+  // all blocks are rewritten in place, so none of them may change its size:
+  // the 1D histogram has to have a bin for every new value, this is checked
+  // (and patched) before the tree is touched
+  std::vector<uint64_t> vOldHist1D;
+  if (pHist1D) {
+    vOldHist1D = pHist1D->GetHistogram();
+    for (size_t i = 0;i<vBrickCoords.size();i++) {
+      if (!pHist1D->Update(this, vBrickCoords[i], &vOldData[i][0],
+                           vBrickData[i].get())) {
+        pHist1D->SetHistogram(vOldHist1D);
+        debugOut->Error(_func_, "New values exceed the 1D Histogram.");
+        return false;
+      }
+    }
+  }
+
+  ExtendedOctreeConverter c(UINT64VECTOR3(GetMaxBrickSize()), GetOverlap(),
+                            0, *debugOut);
+  std::vector<uint64_t> vUpdated;
+  if (!c.UpdateBricks(m_ExtendedOctree, vBrickCoords, vBrickData,
+                      pMaxMinDatBlock ? &statsVec : NULL, &vUpdated, ct,
+                      bComputeMedian, bClampToEdge)) {
+    if (pHist1D) pHist1D->SetHistogram(vOldHist1D);
+    debugOut->Error(_func_, "ExtOctree reported failed update.");
+    return false;
+  }
+  if (pMaxMinDatBlock)
+    pMaxMinDatBlock->UpdateFromFlatVector(statsVec, vUpdated, iComponentCount);
+
+  if (pHist2D) {
+    // the value bins depend on the global maximum, the bin count is kept
+    const double fMax = pMaxMinDatBlock->GetGlobalValue().maxScalar;
+    const size_t iBinCount = pHist2D->GetHistogram().size();
+    bool bPatched = fMax == fOldMax;
+    for (size_t i = 0;i<vBrickCoords.size() && bPatched;i++)
+      bPatched = pHist2D->Update(this, vBrickCoords[i], &vOldData[i][0],
+                                 vBrickData[i].get(), fMax);
+    if (!bPatched) {
+      debugOut->Message(_func_, "Value range or gradients changed, "
+                        "recomputing 2D Histogram.");
+      if (!pHist2D->Compute(this, 0, iBinCount, fMax)) {
+        debugOut->Error(_func_, "Computation of 2D Histogram failed!");
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 bool TOCBlock::BrickedLODToFlatData(
   uint64_t iLoD,
   const std::string& strTargetFile,
@@ -230,10 +463,25 @@ bool TOCBlock::ApplyFunction(uint64_t iLoD,
                                                 iOverlap);
 }
 
+bool TOCBlock::ApplyFunction(uint64_t iLoD,
+                        const ExtendedOctreeConverter::BrickFunction& brickFunc,
+                        uint32_t iOverlap,
+                        unsigned int iThreadCount,
+                        bool bOrdered) const {
+  return ExtendedOctreeConverter::ApplyFunction(m_ExtendedOctree, iLoD,
+                                                brickFunc, iOverlap,
+                                                iThreadCount, bOrdered);
+}
+
 void TOCBlock::GetData(uint8_t* pData, UINT64VECTOR4 coordinates) const {
   m_ExtendedOctree.GetBrickData(pData, coordinates);
 }
 
+void TOCBlock::GetData(const std::vector<UINT64VECTOR4>& vCoordinates,
+                       const std::vector<uint8_t*>& vData) const {
+  m_ExtendedOctree.GetBrickData(vCoordinates, vData);
+}
+
 UINT64VECTOR3 TOCBlock::GetBrickCount(uint64_t iLoD) const {
   return m_ExtendedOctree.GetBrickCount(iLoD);
 }
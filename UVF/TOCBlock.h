@@ -5,9 +5,12 @@
 
 #include "DataBlock.h"
 #include "ExtendedOctree/ExtendedOctree.h"
+#include "ExtendedOctree/ExtendedOctreeConverter.h"
 
 class AbstrDebugOut;
 class MaxMinDataBlock;
+class Histogram1DDataBlock;
+class Histogram2DDataBlock;
 
 class TOCBlock : public DataBlock
 {
@@ -41,7 +44,9 @@ public:
                             AbstrDebugOut* pDebugOut=NULL,
                             COMPRESSION_TYPE ct=CT_ZLIB,
                             uint32_t iCompressionLevel=4,
-                            LAYOUT_TYPE lt=LT_SCANLINE);
+                            LAYOUT_TYPE lt=LT_SCANLINE,
+                            PREFILTER_TYPE pf=PF_NONE,
+                            bool bAdaptiveCompression=false);
   bool FlatDataToBrickedLOD(LargeRAWFile_ptr pSourceData,
                             const std::string& strTempFile,
                             ExtendedOctree::COMPONENT_TYPE eType,
@@ -59,7 +64,54 @@ public:
                             AbstrDebugOut* pDebugOut=NULL,
                             COMPRESSION_TYPE ct=CT_ZLIB,
                             uint32_t iCompressionLevel=4,
-                            LAYOUT_TYPE lt=LT_SCANLINE);
+                            LAYOUT_TYPE lt=LT_SCANLINE,
+                            PREFILTER_TYPE pf=PF_NONE,
+                            bool bAdaptiveCompression=false);
+
+  /// combines the bricks of several compatible TOC blocks into this block,
+  /// see ExtendedOctreeConverter::Merge
+  bool MergeBricked(const std::vector<const TOCBlock*>& vSources,
+                    const std::string& strTempFile,
+                    bool (*combineFunc)(const std::vector<const uint8_t*>& vInput,
+                                        uint8_t* pOutput, uint64_t iValueCount,
+                                        void* pUserContext),
+                    void* pUserContext,
+                    std::shared_ptr<MaxMinDataBlock> pMaxMinDatBlock,
+                    AbstrDebugOut* pDebugOut,
+                    bool bUseMedian,
+                    bool bClampToEdge,
+                    COMPRESSION_TYPE ct=CT_ZLIB,
+                    uint32_t iCompressionLevel=4,
+                    LAYOUT_TYPE lt=LT_SCANLINE);
+
+  /// fills this block with a copy of another TOC block in which all voxels
+  /// clipped by the plane are zero, see ExtendedOctreeConverter::Crop
+  bool CropBricked(const TOCBlock& source,
+                   const MaxMinDataBlock* pSourceMaxMin,
+                   const std::string& strTempFile,
+                   const PLANE<float>& plane,
+                   std::shared_ptr<MaxMinDataBlock> pMaxMinDatBlock,
+                   AbstrDebugOut* pDebugOut,
+                   bool bComputeMedian,
+                   bool bClampToEdge,
+                   COMPRESSION_TYPE ct=CT_ZLIB);
+
+  /// replaces bricks of the finest level and recomputes only the coarser
+  /// bricks that depend on them, see ExtendedOctreeConverter::UpdateBricks.
+  /// The min/max data and the histograms (computed from level 0) are patched
+  /// instead of recomputed where possible, each of them may be NULL. As the
+  /// tree is followed by the other blocks of the UVF none of them may change
+  /// its size: every brick has to fit into its old slot and every new value
+  /// into a bin of the 1D histogram, otherwise nothing is changed.
+  bool UpdateBricks(const std::vector<UINT64VECTOR4>& vBrickCoords,
+                    const std::vector<std::shared_ptr<uint8_t>>& vBrickData,
+                    MaxMinDataBlock* pMaxMinDatBlock,
+                    Histogram1DDataBlock* pHist1D,
+                    Histogram2DDataBlock* pHist2D,
+                    AbstrDebugOut* pDebugOut,
+                    bool bComputeMedian,
+                    bool bClampToEdge,
+                    COMPRESSION_TYPE ct=CT_ZLIB);
 
   bool BrickedLODToFlatData(uint64_t iLoD,
                             const std::string& strTargetFile,
@@ -78,8 +130,18 @@ public:
                      void* pUserContext = NULL,
                      uint32_t iOverlap=0,
                      AbstrDebugOut* pDebugOut=NULL) const;
+  /// parallel variant, see ExtendedOctreeConverter::ApplyFunction
+  bool ApplyFunction(uint64_t iLoD,
+                     const ExtendedOctreeConverter::BrickFunction& brickFunc,
+                     uint32_t iOverlap,
+                     unsigned int iThreadCount,
+                     bool bOrdered) const;
 
   void GetData(uint8_t* pData, UINT64VECTOR4 coordinates) const;
+  /// batch variant: bricks which lie close to each other in the file are
+  /// read together, see ExtendedOctree::GetBrickData
+  void GetData(const std::vector<UINT64VECTOR4>& vCoordinates,
+               const std::vector<uint8_t*>& vData) const;
 
   uint64_t GetLoDCount() const;
   UINT64VECTOR3 GetBrickCount(uint64_t iLoD) const;
@@ -280,9 +280,13 @@ void UVF::ParseDataBlocks() {
                                        m_GlobalHeader.ulFileVersion);
     }
     
+    // the last block stores no offset to a next one, it ends with the file
+    const uint64_t iBlockSize = (d->ulOffsetToNextDataBlock != 0)
+                                ? d->ulOffsetToNextDataBlock
+                                : m_streamFile->GetCurrentSize() - iOffset;
     m_DataBlocks.push_back(std::shared_ptr<DataBlockListElem>(
       new DataBlockListElem(d, false, iOffset-m_GlobalHeader.GetDataPos(),
-                            d->ulOffsetToNextDataBlock)
+                            iBlockSize)
     ));
     iOffset += d->ulOffsetToNextDataBlock;
 
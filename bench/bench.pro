@@ -0,0 +1,25 @@
+TEMPLATE          = app
+win32:TEMPLATE    = vcapp
+CONFIG           += exceptions largefile link_prl qt rtti static stl warn_on
+TARGET            = iobench
+DEFINES          += _FILE_OFFSET_BITS=64
+DEPENDPATH       += . ../
+INCLUDEPATH      += ../ ../../ ../3rdParty/boost
+INCLUDEPATH      += ../../Basics
+QT               += core gui opengl
+QMAKE_LIBDIR     += ../../Build ../expressions
+LIBS             += -lTuvok -ltuvokexpr
+unix:LIBS        += -lz
+unix:!macx:LIBS  += -lrt -lGLU -lGL
+win32:LIBS       += shlwapi.lib
+unix:QMAKE_CXXFLAGS += -std=c++0x
+unix:!macx:QMAKE_CXXFLAGS += -fopenmp
+unix:!macx:QMAKE_LFLAGS += -fopenmp
+unix:QMAKE_CXXFLAGS += -fno-strict-aliasing
+unix:QMAKE_CFLAGS += -fno-strict-aliasing
+
+macx:QMAKE_CXXFLAGS += -stdlib=libc++ -mmacosx-version-min=10.7
+macx:QMAKE_CFLAGS += -mmacosx-version-min=10.7
+macx:LIBS        += -stdlib=libc++ -mmacosx-version-min=10.7 -framework CoreFoundation
+
+SOURCES += iobench.cpp
@@ -0,0 +1,830 @@
+/**
+  iobench: reproducible I/O benchmark for bricked (ExtendedOctree) datasets.
+
+  Synthesizes a raw volume of configurable size, type and entropy, converts
+  it with every compression / layout combination and measures conversion
+  time, file size and the read performance of a sequential, a random, a
+  LoD progressive (coarsest level first) and a region refinement brick
+  access pattern.  The results are written as JSON.
+
+  All random numbers come from a seeded std::mt19937_64 and are consumed
+  without std::*_distribution or std::shuffle, whose results differ between
+  standard libraries, so a given command line produces bit identical input
+  volumes and access orders on every platform.
+
+  Run "iobench --help" for the options.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "PageCache.h"
+#include "UVF/UVFBasic.h"
+#include "UVF/ExtendedOctree/ExtendedOctreeConverter.h"
+#include "DebugOut/ConsoleOut.h"
+
+namespace {
+
+// a codec the trees are converted with, 'adaptive' is no codec of its own
+// but lets the converter pick one of its candidates per brick
+struct Codec {
+  COMPRESSION_TYPE eCompression;
+  bool bAdaptive;
+};
+
+struct Options {
+  Options() :
+    vVolumeSize(256,256,256),
+    strType("u16"),
+    iComponents(1),
+    fEntropy(0.5),
+    fConstant(0.0),
+    iBrickSize(128),
+    iOverlap(2),
+    iMemMB(1024),
+    iLevel(1),
+    ePreFilter(PF_NONE),
+    iRepeat(3),
+    iRegions(8),
+    iBatch(1),
+    iMaxGap(64*1024),
+    iQueueDepth(64),
+    iSeed(42),
+    bCold(true),
+    bStream(false),
+    bKeep(false),
+    strDir("."),
+    strOut("")
+  {}
+
+  UINT64VECTOR3 vVolumeSize;
+  std::string strType;
+  uint64_t iComponents;
+  double fEntropy;    ///< fraction (0..1) of random low order bits per value
+  double fConstant;   ///< fraction (0..1) of z slices which are set to zero
+  uint64_t iBrickSize;
+  uint32_t iOverlap;
+  uint64_t iMemMB;
+  uint32_t iLevel;
+  PREFILTER_TYPE ePreFilter;
+  unsigned iRepeat;
+  uint64_t iRegions;  ///< regions read by the region_refine pattern
+  uint64_t iBatch;    ///< bricks requested per read call
+  uint64_t iMaxGap;   ///< gap up to which batched reads are merged
+  unsigned iQueueDepth; ///< concurrent batched reads (with io_uring)
+  uint64_t iSeed;
+  bool bCold;
+  bool bStream;       ///< convert in page cache streaming mode
+  bool bKeep;
+  std::vector<Codec> vCompression;
+  std::vector<LAYOUT_TYPE> vLayout;
+  std::string strDir;
+  std::string strOut;
+};
+
+struct TypeInfo {
+  const char* name;
+  ExtendedOctree::COMPONENT_TYPE type;
+  unsigned bits;
+  bool isFloat;
+};
+
+const TypeInfo types[] = {
+  {"u8",  ExtendedOctree::CT_UINT8,    8, false},
+  {"i8",  ExtendedOctree::CT_INT8,     8, false},
+  {"u16", ExtendedOctree::CT_UINT16,  16, false},
+  {"i16", ExtendedOctree::CT_INT16,   16, false},
+  {"u32", ExtendedOctree::CT_UINT32,  32, false},
+  {"i32", ExtendedOctree::CT_INT32,   32, false},
+  {"u64", ExtendedOctree::CT_UINT64,  64, false},
+  {"i64", ExtendedOctree::CT_INT64,   64, false},
+  {"f32", ExtendedOctree::CT_FLOAT32, 32, true},
+  {"f64", ExtendedOctree::CT_FLOAT64, 64, true},
+};
+
+const char* CompressionName(COMPRESSION_TYPE c) {
+  switch(c) {
+    case CT_NONE:     return "none";
+    case CT_ZLIB:     return "zlib";
+    case CT_LZMA:     return "lzma";
+    case CT_LZ4:      return "lz4";
+    case CT_BZLIB:    return "bzlib";
+    case CT_LZHAM:    return "lzham";
+    case CT_CONSTANT: return "constant";
+    case CT_ZSTD:     return "zstd";
+    default:          return "unknown";
+  }
+}
+
+const char* LayoutName(LAYOUT_TYPE l) {
+  switch(l) {
+    case LT_SCANLINE: return "scanline";
+    case LT_MORTON:   return "morton";
+    case LT_HILBERT:  return "hilbert";
+    case LT_RANDOM:   return "random";
+    case LT_LOD_INTERLEAVED: return "lod_interleaved";
+    default:          return "unknown";
+  }
+}
+
+const char* PreFilterName(PREFILTER_TYPE p) {
+  switch(p) {
+    case PF_NONE:                return "none";
+    case PF_BYTESHUFFLE:         return "byteshuffle";
+    case PF_BITSHUFFLE:          return "bitshuffle";
+    case PF_DELTA3D:             return "delta3d";
+    case PF_DELTA3D_BYTESHUFFLE: return "delta3d_byteshuffle";
+    default:                     return "unknown";
+  }
+}
+
+std::string CodecName(const Codec& c) {
+  return c.bAdaptive ? "adaptive" : CompressionName(c.eCompression);
+}
+
+// every codec a tree can be converted with; CT_CONSTANT is chosen per brick
+// by the converter and cannot be requested
+std::vector<Codec> AllCodecs() {
+  std::vector<Codec> v;
+  for(int c = CT_NONE; c < CT_UNKNOWN; ++c) {
+    if(c != CT_CONSTANT) {
+      const Codec codec = {COMPRESSION_TYPE(c), false};
+      v.push_back(codec);
+    }
+  }
+  const Codec adaptive = {CT_ZLIB, true};
+  v.push_back(adaptive);
+  return v;
+}
+
+std::vector<LAYOUT_TYPE> AllLayouts() {
+  std::vector<LAYOUT_TYPE> v;
+  for(int l = LT_SCANLINE; l < LT_UNKNOWN; ++l) {
+    v.push_back(LAYOUT_TYPE(l));
+  }
+  return v;
+}
+
+double Seconds(std::chrono::steady_clock::time_point a,
+               std::chrono::steady_clock::time_point b) {
+  return std::chrono::duration<double>(b - a).count();
+}
+
+uint64_t FileSize(const std::string& strFilename) {
+  LargeRAWFile f(strFilename);
+  if(!f.Open(false)) { return 0; }
+  uint64_t iSize = f.GetCurrentSize();
+  f.Close();
+  return iSize;
+}
+
+/// drops the file from the page cache so reads hit the disk; only clean
+/// pages can be dropped, which is all we have as the file was synced.
+void DropFromCache(const std::string& strFilename) {
+  tuvok::pagecache::Drop(strFilename, true);
+}
+
+// ---------------------------------------------------------------------------
+// volume synthesis
+
+/// smooth base field in [0,1]: a few low frequency waves, so that entropy 0
+/// gives a well compressible (but not constant) volume
+double Field(const UINT64VECTOR3& v, const UINT64VECTOR3& dom) {
+  const double pi = 3.14159265358979323846;
+  const double x = double(v.x) / double(std::max<uint64_t>(dom.x,1));
+  const double y = double(v.y) / double(std::max<uint64_t>(dom.y,1));
+  const double z = double(v.z) / double(std::max<uint64_t>(dom.z,1));
+  const double f = std::sin(2*pi*(x*1.5 + 0.1)) *
+                   std::cos(2*pi*(y*2.0 + 0.3*z)) *
+                   std::sin(2*pi*(z*1.0 + 0.25)) +
+                   0.25 * std::sin(2*pi*(x*7.0 + y*5.0 + z*3.0));
+  return std::min(1.0, std::max(0.0, 0.5 + f / 2.5));
+}
+
+/// replaces the low 'iNoiseBits' of the value's bit pattern by random bits
+template<typename U>
+U Noise(U v, unsigned iNoiseBits, std::mt19937_64& rng) {
+  if(iNoiseBits == 0) { return v; }
+  const unsigned bits = unsigned(sizeof(U) * 8);
+  const U mask = iNoiseBits >= bits ? U(~U(0)) : U((U(1) << iNoiseBits) - 1);
+  return U((v & U(~mask)) | (U(rng()) & mask));
+}
+
+template<typename T> struct Bits;
+template<> struct Bits<uint8_t>  { typedef uint8_t  U; };
+template<> struct Bits<int8_t>   { typedef uint8_t  U; };
+template<> struct Bits<uint16_t> { typedef uint16_t U; };
+template<> struct Bits<int16_t>  { typedef uint16_t U; };
+template<> struct Bits<uint32_t> { typedef uint32_t U; };
+template<> struct Bits<int32_t>  { typedef uint32_t U; };
+template<> struct Bits<uint64_t> { typedef uint64_t U; };
+template<> struct Bits<int64_t>  { typedef uint64_t U; };
+template<> struct Bits<float>    { typedef uint32_t U; };
+template<> struct Bits<double>   { typedef uint64_t U; };
+
+template<typename T> T Quantize(double f, bool isFloat) {
+  if(isFloat) { return T(f); }
+  // the top of the range does not round trip through a double for 64bit
+  // types, stay a little below it
+  const double lo = double(std::numeric_limits<T>::min());
+  const double hi = double(std::numeric_limits<T>::max()) * (1.0 - 1e-6);
+  return T(lo + f * (hi - lo));
+}
+
+/// writes the synthetic volume slice by slice to 'strFilename'; for floats
+/// the noise only touches the mantissa so no NaNs or infinities appear
+template<typename T>
+bool Synthesize(const std::string& strFilename, const Options& o,
+                const TypeInfo& ti) {
+  typedef typename Bits<T>::U U;
+  FILE* fp = fopen(strFilename.c_str(), "wb");
+  if(!fp) { return false; }
+
+  const UINT64VECTOR3& dom = o.vVolumeSize;
+  const unsigned iValueBits = ti.isFloat ? (ti.bits == 32 ? 23 : 52) : ti.bits;
+  const unsigned iNoiseBits = unsigned(o.fEntropy * iValueBits + 0.5);
+  const uint64_t iConstantSlices = uint64_t(o.fConstant * double(dom.z));
+
+  std::mt19937_64 rng(o.iSeed);
+  std::vector<T> slice(dom.x * dom.y * o.iComponents);
+  bool bOK = true;
+  for(uint64_t z = 0; z < dom.z && bOK; ++z) {
+    size_t i = 0;
+    for(uint64_t y = 0; y < dom.y; ++y) {
+      for(uint64_t x = 0; x < dom.x; ++x) {
+        const double f = Field(UINT64VECTOR3(x,y,z), dom);
+        for(uint64_t c = 0; c < o.iComponents; ++c, ++i) {
+          if(z < iConstantSlices) { slice[i] = T(0); continue; }
+          T v = Quantize<T>(f, ti.isFloat);
+          U u;
+          memcpy(&u, &v, sizeof(T));
+          u = Noise<U>(u, iNoiseBits, rng);
+          memcpy(&v, &u, sizeof(T));
+          slice[i] = v;
+        }
+      }
+    }
+    bOK = fwrite(&slice[0], sizeof(T), slice.size(), fp) == slice.size();
+  }
+  return fclose(fp) == 0 && bOK;
+}
+
+bool Synthesize(const std::string& strFilename, const Options& o,
+                const TypeInfo& ti) {
+  switch(ti.type) {
+    case ExtendedOctree::CT_UINT8:   return Synthesize<uint8_t>(strFilename, o, ti);
+    case ExtendedOctree::CT_INT8:    return Synthesize<int8_t>(strFilename, o, ti);
+    case ExtendedOctree::CT_UINT16:  return Synthesize<uint16_t>(strFilename, o, ti);
+    case ExtendedOctree::CT_INT16:   return Synthesize<int16_t>(strFilename, o, ti);
+    case ExtendedOctree::CT_UINT32:  return Synthesize<uint32_t>(strFilename, o, ti);
+    case ExtendedOctree::CT_INT32:   return Synthesize<int32_t>(strFilename, o, ti);
+    case ExtendedOctree::CT_UINT64:  return Synthesize<uint64_t>(strFilename, o, ti);
+    case ExtendedOctree::CT_INT64:   return Synthesize<int64_t>(strFilename, o, ti);
+    case ExtendedOctree::CT_FLOAT32: return Synthesize<float>(strFilename, o, ti);
+    case ExtendedOctree::CT_FLOAT64: return Synthesize<double>(strFilename, o, ti);
+  }
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// read passes
+
+enum Pattern {
+  PT_SEQUENTIAL = 0, ///< all bricks in ToC order (finest LoD first)
+  PT_RANDOM,         ///< all bricks in a seeded random permutation
+  PT_LOD_PROGRESSIVE,///< coarsest LoD first, each LoD in ToC order
+  PT_REGION_REFINE,  ///< a few random mid level bricks, each followed by
+                     ///< everything below it, coarse to fine
+  PT_COUNT
+};
+
+const char* PatternName(Pattern p) {
+  switch(p) {
+    case PT_SEQUENTIAL:      return "sequential";
+    case PT_RANDOM:          return "random";
+    case PT_LOD_PROGRESSIVE: return "lod_progressive";
+    case PT_REGION_REFINE:   return "region_refine";
+    default:                 return "unknown";
+  }
+}
+
+std::vector<uint64_t> BrickOrder(const ExtendedOctree& tree, Pattern p,
+                                 const Options& o) {
+  const uint64_t iSeed = o.iSeed;
+  std::vector<uint64_t> order;
+  std::vector<uint64_t> lodStart(1, 0);
+  for(uint64_t lod = 0; lod < tree.GetLODCount(); ++lod) {
+    lodStart.push_back(lodStart.back() + tree.GetBrickCount(lod).volume());
+  }
+  const uint64_t iTotal = lodStart.back();
+  order.reserve(size_t(iTotal));
+
+  switch(p) {
+    case PT_SEQUENTIAL:
+      for(uint64_t i = 0; i < iTotal; ++i) { order.push_back(i); }
+      break;
+    case PT_RANDOM: {
+      for(uint64_t i = 0; i < iTotal; ++i) { order.push_back(i); }
+      // Fisher-Yates; the slight modulo bias is irrelevant here, being
+      // reproducible everywhere is not
+      std::mt19937_64 rng(iSeed);
+      for(uint64_t i = iTotal; i > 1; --i) {
+        std::swap(order[size_t(i-1)], order[size_t(rng() % i)]);
+      }
+      break;
+    }
+    case PT_LOD_PROGRESSIVE:
+      for(uint64_t lod = tree.GetLODCount(); lod > 0; --lod) {
+        for(uint64_t i = lodStart[lod-1]; i < lodStart[lod]; ++i) {
+          order.push_back(i);
+        }
+      }
+      break;
+    case PT_REGION_REFINE: {
+      // what a viewer does when zooming into a part of the volume it has
+      // shown coarsely so far: pick bricks on a medium level and refine
+      // each of them level by level down to the full resolution
+      const uint64_t iTop = tree.GetLODCount() / 2;
+      const UINT64VECTOR3 top = tree.GetBrickCount(iTop);
+      std::vector<uint64_t> candidates;
+      for(uint64_t i = 0; i < top.volume(); ++i) { candidates.push_back(i); }
+      std::mt19937_64 rng(iSeed);
+      const uint64_t iRegions = std::min<uint64_t>(o.iRegions,
+                                                   candidates.size());
+      for(uint64_t r = 0; r < iRegions; ++r) {
+        std::swap(candidates[size_t(r)],
+                  candidates[size_t(r + rng() % (candidates.size() - r))]);
+        const uint64_t i = candidates[size_t(r)];
+        const UINT64VECTOR3 p(i % top.x, (i / top.x) % top.y,
+                              i / (top.x * top.y));
+        for(uint64_t lod = iTop + 1; lod > 0; --lod) {
+          const uint64_t s = uint64_t(1) << (iTop - (lod-1));
+          const UINT64VECTOR3 domain = tree.GetBrickCount(lod-1);
+          for(uint64_t z = p.z*s; z < std::min((p.z+1)*s, domain.z); ++z) {
+            for(uint64_t y = p.y*s; y < std::min((p.y+1)*s, domain.y); ++y) {
+              for(uint64_t x = p.x*s; x < std::min((p.x+1)*s, domain.x); ++x) {
+                order.push_back(tree.BrickCoordsToIndex(
+                                  UINT64VECTOR4(x, y, z, lod-1)));
+              }
+            }
+          }
+        }
+      }
+      break;
+    }
+    default: break;
+  }
+  return order;
+}
+
+struct PassResult {
+  PassResult() : iBricks(0), iBytes(0), iDiskBytes(0), fSeconds(0),
+                 iChecksum(0) {}
+  uint64_t iBricks;
+  uint64_t iBytes;     ///< uncompressed bytes delivered (per repetition)
+  uint64_t iDiskBytes; ///< bytes stored in the file (per repetition)
+  double fSeconds;     ///< median over the repetitions
+  std::vector<double> vLatency; ///< per brick, in seconds, all repetitions
+  uint64_t iChecksum;  ///< FNV-1a over all bricks in ToC order
+};
+
+uint64_t FNV(uint64_t h, const uint8_t* p, size_t n) {
+  for(size_t i = 0; i < n; ++i) { h = (h ^ p[i]) * 0x100000001b3ULL; }
+  return h;
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+  if(sorted.empty()) { return 0; }
+  const size_t i = size_t(p * double(sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size()-1)];
+}
+
+/// reads every brick once per repetition in the given order, in batches of
+/// o.iBatch bricks; the pass time is the sum of the read call times, which
+/// excludes the checksum. Latencies are per call.
+PassResult ReadPass(const std::string& strFilename, Pattern p,
+                    const Options& o) {
+  PassResult r;
+  std::vector<double> vPassSeconds;
+  for(unsigned rep = 0; rep < o.iRepeat; ++rep) {
+    if(o.bCold) { DropFromCache(strFilename); }
+
+    ExtendedOctree tree;
+    if(!tree.Open(strFilename, 0, UVFVERSION)) {
+      throw std::runtime_error("could not open " + strFilename);
+    }
+    tree.SetAsyncQueueDepth(o.iQueueDepth);
+    const std::vector<uint64_t> order = BrickOrder(tree, p, o);
+    const size_t iVoxelBytes = tree.GetComponentTypeSize() *
+                               size_t(tree.GetComponentCount());
+    const size_t iMaxBrickBytes = size_t(tree.GetMaxBrickSize().volume()) *
+                                  iVoxelBytes;
+    std::vector<uint8_t> data(iMaxBrickBytes * size_t(o.iBatch));
+
+    uint64_t iChecksum = 0xcbf29ce484222325ULL;
+    double fPass = 0;
+    r.iBricks = order.size();
+    r.iBytes = r.iDiskBytes = 0;
+    std::vector<UINT64VECTOR4> vCoords;
+    std::vector<uint8_t*> vData;
+    for(size_t i = 0; i < order.size(); i += vCoords.size()) {
+      vCoords.clear();
+      vData.clear();
+      for(size_t j = i; j < order.size() && vCoords.size() < o.iBatch; ++j) {
+        vData.push_back(&data[0] + vCoords.size() * iMaxBrickBytes);
+        vCoords.push_back(tree.IndexToBrickCoords(order[j]));
+      }
+
+      const std::chrono::steady_clock::time_point t0 =
+        std::chrono::steady_clock::now();
+      if(o.iBatch == 1) {
+        tree.GetBrickData(vData[0], vCoords[0]);
+      } else {
+        tree.GetBrickData(vCoords, vData, o.iMaxGap);
+      }
+      const double dt = Seconds(t0, std::chrono::steady_clock::now());
+      fPass += dt;
+      r.vLatency.push_back(dt);
+
+      for(size_t j = 0; j < vCoords.size(); ++j) {
+        const size_t iBytes = size_t(tree.ComputeBrickSize(vCoords[j]).volume()) *
+                              iVoxelBytes;
+        r.iBytes += iBytes;
+        r.iDiskBytes += tree.GetBrickToCData(size_t(order[i+j])).m_iLength;
+        if(p == PT_SEQUENTIAL) { iChecksum = FNV(iChecksum, vData[j], iBytes); }
+      }
+    }
+    if(p == PT_SEQUENTIAL) { r.iChecksum = iChecksum; }
+    vPassSeconds.push_back(fPass);
+    tree.Close();
+  }
+  std::sort(vPassSeconds.begin(), vPassSeconds.end());
+  r.fSeconds = vPassSeconds.empty() ? 0 : vPassSeconds[vPassSeconds.size()/2];
+  std::sort(r.vLatency.begin(), r.vLatency.end());
+  return r;
+}
+
+// ---------------------------------------------------------------------------
+// output
+
+std::string JSONNumber(double d) {
+  if(!(d == d) || d > 1e300 || d < -1e300) { return "null"; }
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.6g", d);
+  return buf;
+}
+
+std::string JSONString(const std::string& s) {
+  std::string r = "\"";
+  for(size_t i = 0; i < s.size(); ++i) {
+    const char c = s[i];
+    if(c == '"' || c == '\\') { r += '\\'; r += c; }
+    else if(c == '\n') { r += "\\n"; }
+    else if(static_cast<unsigned char>(c) < 0x20) { r += ' '; }
+    else { r += c; }
+  }
+  return r + "\"";
+}
+
+std::string PassJSON(const PassResult& r) {
+  const double MB = 1024.0 * 1024.0;
+  std::ostringstream s;
+  char cs[32];
+  snprintf(cs, sizeof(cs), "%016llx", (unsigned long long)r.iChecksum);
+  s << "{\"bricks\": " << r.iBricks
+    << ", \"bytes\": " << r.iBytes
+    << ", \"disk_bytes\": " << r.iDiskBytes
+    << ", \"seconds\": " << JSONNumber(r.fSeconds)
+    << ", \"mb_per_s\": "
+    << JSONNumber(r.fSeconds > 0 ? r.iBytes / MB / r.fSeconds : 0)
+    << ", \"bricks_per_s\": "
+    << JSONNumber(r.fSeconds > 0 ? r.iBricks / r.fSeconds : 0)
+    << ", \"latency_us\": {"
+    << "\"min\": " << JSONNumber(Percentile(r.vLatency, 0.0) * 1e6)
+    << ", \"p50\": " << JSONNumber(Percentile(r.vLatency, 0.5) * 1e6)
+    << ", \"p90\": " << JSONNumber(Percentile(r.vLatency, 0.9) * 1e6)
+    << ", \"p99\": " << JSONNumber(Percentile(r.vLatency, 0.99) * 1e6)
+    << ", \"max\": " << JSONNumber(Percentile(r.vLatency, 1.0) * 1e6)
+    << "}";
+  if(r.iChecksum != 0) { s << ", \"checksum\": \"" << cs << "\""; }
+  s << "}";
+  return s.str();
+}
+
+// ---------------------------------------------------------------------------
+// command line
+
+void Usage(const char* argv0) {
+  fprintf(stderr,
+    "usage: %s [options]\n"
+    "  --size X Y Z        volume size (256 256 256)\n"
+    "  --type T            u8 i8 u16 i16 u32 i32 u64 i64 f32 f64 (u16)\n"
+    "  --components N      components per voxel (1)\n"
+    "  --entropy E         fraction 0..1 of random low order bits (0.5)\n"
+    "  --constant F        fraction 0..1 of zero z slices (0)\n"
+    "  --brick N           brick size including overlap (128)\n"
+    "  --overlap N         brick overlap (2)\n"
+    "  --mem MB            converter memory limit (1024)\n"
+    "  --level N           compression level (1)\n"
+    "  --prefilter P       none byteshuffle bitshuffle delta3d\n"
+    "                      delta3d_byteshuffle (none)\n"
+    "  --compression LIST  comma separated codecs (all)\n"
+    "  --layout LIST       comma separated layouts (all)\n"
+    "  --repeat N          read passes per pattern (3)\n"
+    "  --regions N         regions refined per region_refine pass (8)\n"
+    "  --batch N           bricks requested per read call (1)\n"
+    "  --gap BYTES         merge batched reads up to this gap (65536)\n"
+    "  --queue N           batched reads kept in flight, if built with\n"
+    "                      TUVOK_IO_URING; 1 disables async reads (64)\n"
+    "  --seed N            random seed (42)\n"
+    "  --warm              do not drop files from the page cache\n"
+    "  --stream            keep conversions out of the page cache\n"
+    "  --dir PATH          directory for temporary files (.)\n"
+    "  --keep              keep the generated files\n"
+    "  --out FILE          write JSON to FILE instead of stdout\n",
+    argv0);
+}
+
+std::vector<std::string> Split(const std::string& s) {
+  std::vector<std::string> v;
+  std::string cur;
+  for(size_t i = 0; i <= s.size(); ++i) {
+    if(i == s.size() || s[i] == ',') {
+      if(!cur.empty()) { v.push_back(cur); }
+      cur.clear();
+    } else {
+      cur += s[i];
+    }
+  }
+  return v;
+}
+
+bool ParseArgs(int argc, char* argv[], Options& o) {
+  for(int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    const int iLeft = argc - i - 1;
+    if(a == "--size" && iLeft >= 3) {
+      o.vVolumeSize = UINT64VECTOR3(strtoull(argv[i+1], NULL, 10),
+                                    strtoull(argv[i+2], NULL, 10),
+                                    strtoull(argv[i+3], NULL, 10));
+      i += 3;
+    } else if(a == "--type" && iLeft >= 1) {
+      o.strType = argv[++i];
+    } else if(a == "--components" && iLeft >= 1) {
+      o.iComponents = strtoull(argv[++i], NULL, 10);
+    } else if(a == "--entropy" && iLeft >= 1) {
+      o.fEntropy = atof(argv[++i]);
+    } else if(a == "--constant" && iLeft >= 1) {
+      o.fConstant = atof(argv[++i]);
+    } else if(a == "--brick" && iLeft >= 1) {
+      o.iBrickSize = strtoull(argv[++i], NULL, 10);
+    } else if(a == "--overlap" && iLeft >= 1) {
+      o.iOverlap = uint32_t(strtoul(argv[++i], NULL, 10));
+    } else if(a == "--mem" && iLeft >= 1) {
+      o.iMemMB = strtoull(argv[++i], NULL, 10);
+    } else if(a == "--level" && iLeft >= 1) {
+      o.iLevel = uint32_t(strtoul(argv[++i], NULL, 10));
+    } else if(a == "--prefilter" && iLeft >= 1) {
+      const std::string p = argv[++i];
+      o.ePreFilter = PF_UNKNOWN;
+      for(int f = PF_NONE; f < PF_UNKNOWN; ++f) {
+        if(p == PreFilterName(PREFILTER_TYPE(f))) {
+          o.ePreFilter = PREFILTER_TYPE(f);
+        }
+      }
+      if(o.ePreFilter == PF_UNKNOWN) {
+        fprintf(stderr, "unknown pre-filter '%s'\n", p.c_str());
+        return false;
+      }
+    } else if(a == "--compression" && iLeft >= 1) {
+      const std::vector<std::string> names = Split(argv[++i]);
+      const std::vector<Codec> all = AllCodecs();
+      for(size_t n = 0; n < names.size(); ++n) {
+        size_t c = 0;
+        while(c < all.size() && names[n] != CodecName(all[c])) { ++c; }
+        if(c == all.size()) {
+          fprintf(stderr, "unknown compression '%s'\n", names[n].c_str());
+          return false;
+        }
+        o.vCompression.push_back(all[c]);
+      }
+    } else if(a == "--layout" && iLeft >= 1) {
+      const std::vector<std::string> names = Split(argv[++i]);
+      const std::vector<LAYOUT_TYPE> all = AllLayouts();
+      for(size_t n = 0; n < names.size(); ++n) {
+        size_t l = 0;
+        while(l < all.size() && names[n] != LayoutName(all[l])) { ++l; }
+        if(l == all.size()) {
+          fprintf(stderr, "unknown layout '%s'\n", names[n].c_str());
+          return false;
+        }
+        o.vLayout.push_back(all[l]);
+      }
+    } else if(a == "--repeat" && iLeft >= 1) {
+      o.iRepeat = unsigned(strtoul(argv[++i], NULL, 10));
+    } else if(a == "--regions" && iLeft >= 1) {
+      o.iRegions = strtoull(argv[++i], NULL, 10);
+    } else if(a == "--batch" && iLeft >= 1) {
+      o.iBatch = strtoull(argv[++i], NULL, 10);
+    } else if(a == "--gap" && iLeft >= 1) {
+      o.iMaxGap = strtoull(argv[++i], NULL, 10);
+    } else if(a == "--queue" && iLeft >= 1) {
+      o.iQueueDepth = unsigned(strtoul(argv[++i], NULL, 10));
+    } else if(a == "--seed" && iLeft >= 1) {
+      o.iSeed = strtoull(argv[++i], NULL, 10);
+    } else if(a == "--warm") {
+      o.bCold = false;
+    } else if(a == "--stream") {
+      o.bStream = true;
+    } else if(a == "--keep") {
+      o.bKeep = true;
+    } else if(a == "--dir" && iLeft >= 1) {
+      o.strDir = argv[++i];
+    } else if(a == "--out" && iLeft >= 1) {
+      o.strOut = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  if(o.vCompression.empty()) { o.vCompression = AllCodecs(); }
+  if(o.vLayout.empty()) { o.vLayout = AllLayouts(); }
+  if(o.vVolumeSize.volume() == 0 || o.iComponents == 0 || o.iRepeat == 0 ||
+     o.iBatch == 0 || o.iBatch > 65536 ||
+     o.fEntropy < 0 || o.fEntropy > 1 || o.fConstant < 0 || o.fConstant > 1 ||
+     o.iBrickSize <= 2*uint64_t(o.iOverlap)) {
+    fprintf(stderr, "invalid parameters\n");
+    return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+  Options o;
+  if(!ParseArgs(argc, argv, o)) {
+    Usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  const TypeInfo* ti = NULL;
+  for(size_t i = 0; i < sizeof(types)/sizeof(types[0]); ++i) {
+    if(o.strType == types[i].name) { ti = &types[i]; }
+  }
+  if(!ti) {
+    fprintf(stderr, "unknown type '%s'\n", o.strType.c_str());
+    return EXIT_FAILURE;
+  }
+
+  const std::string strRaw = o.strDir + "/iobench.raw";
+  fprintf(stderr, "synthesizing %llux%llux%llu %s volume...\n",
+          (unsigned long long)o.vVolumeSize.x,
+          (unsigned long long)o.vVolumeSize.y,
+          (unsigned long long)o.vVolumeSize.z, ti->name);
+  if(!Synthesize(strRaw, o, *ti)) {
+    fprintf(stderr, "could not write %s\n", strRaw.c_str());
+    return EXIT_FAILURE;
+  }
+  const uint64_t iRawBytes = FileSize(strRaw);
+  tuvok::pagecache::SetStreaming(o.bStream);
+
+  ConsoleOut dbg;
+  dbg.SetOutput(true, false, false, false);
+
+  std::ostringstream json;
+  json << "{\n  \"benchmark\": \"iobench\",\n  \"version\": 1,\n"
+       << "  \"config\": {"
+       << "\"size\": [" << o.vVolumeSize.x << ", " << o.vVolumeSize.y
+       << ", " << o.vVolumeSize.z << "]"
+       << ", \"type\": " << JSONString(ti->name)
+       << ", \"components\": " << o.iComponents
+       << ", \"entropy\": " << JSONNumber(o.fEntropy)
+       << ", \"constant\": " << JSONNumber(o.fConstant)
+       << ", \"brick\": " << o.iBrickSize
+       << ", \"overlap\": " << o.iOverlap
+       << ", \"mem_mb\": " << o.iMemMB
+       << ", \"level\": " << o.iLevel
+       << ", \"prefilter\": " << JSONString(PreFilterName(o.ePreFilter))
+       << ", \"repeat\": " << o.iRepeat
+       << ", \"regions\": " << o.iRegions
+       << ", \"batch\": " << o.iBatch
+       << ", \"gap\": " << o.iMaxGap
+       << ", \"queue\": " << o.iQueueDepth
+       << ", \"seed\": " << o.iSeed
+       << ", \"cold\": " << (o.bCold ? "true" : "false")
+       << ", \"stream\": " << (o.bStream ? "true" : "false")
+       << ", \"raw_bytes\": " << iRawBytes
+       << "},\n  \"results\": [";
+
+  bool bFirst = true;
+  for(size_t c = 0; c < o.vCompression.size(); ++c) {
+    for(size_t l = 0; l < o.vLayout.size(); ++l) {
+      const Codec& codec = o.vCompression[c];
+      const LAYOUT_TYPE eLayout = o.vLayout[l];
+      const std::string strOct = o.strDir + "/iobench_" +
+                                 CodecName(codec) + "_" +
+                                 LayoutName(eLayout) + ".oct";
+      fprintf(stderr, "%s / %s...\n", CodecName(codec).c_str(),
+              LayoutName(eLayout));
+
+      json << (bFirst ? "\n" : ",\n")
+           << "    {\"compression\": " << JSONString(CodecName(codec))
+           << ", \"layout\": " << JSONString(LayoutName(eLayout));
+      bFirst = false;
+
+      // codecs which are not compiled in or fail on this data are reported,
+      // not fatal
+      try {
+        const std::chrono::steady_clock::time_point t0 =
+          std::chrono::steady_clock::now();
+        bool bOK;
+        {
+          BrickStatVec stats;
+          ExtendedOctreeConverter conv(UINT64VECTOR3(o.iBrickSize,
+                                                     o.iBrickSize,
+                                                     o.iBrickSize),
+                                       o.iOverlap, o.iMemMB * 1024 * 1024,
+                                       dbg);
+          conv.SetPreFilter(o.ePreFilter);
+          conv.SetAdaptiveCompression(codec.bAdaptive);
+          bOK = conv.Convert(strRaw, 0, ti->type, o.iComponents,
+                             o.vVolumeSize, DOUBLEVECTOR3(1,1,1), strOct, 0,
+                             &stats, codec.eCompression, o.iLevel, false, false, eLayout);
+        }
+        const double fConvert = Seconds(t0, std::chrono::steady_clock::now());
+        if(!bOK) { throw std::runtime_error("conversion failed"); }
+
+        const uint64_t iFileBytes = FileSize(strOct);
+        json << ", \"status\": \"ok\""
+             << ", \"convert_seconds\": " << JSONNumber(fConvert)
+             << ", \"convert_mb_per_s\": "
+             << JSONNumber(fConvert > 0 ?
+                           iRawBytes / (1024.0*1024.0) / fConvert : 0)
+             << ", \"file_bytes\": " << iFileBytes
+             << ", \"ratio\": "
+             << JSONNumber(iFileBytes ? double(iRawBytes) / iFileBytes : 0)
+             << ", \"reads\": {";
+        for(int p = 0; p < PT_COUNT; ++p) {
+          const PassResult r = ReadPass(strOct, Pattern(p), o);
+          json << (p ? ", " : "") << JSONString(PatternName(Pattern(p)))
+               << ": " << PassJSON(r);
+        }
+        json << "}";
+      } catch(const std::exception& e) {
+        json << ", \"status\": \"error\", \"error\": " << JSONString(e.what());
+      } catch(...) {
+        json << ", \"status\": \"error\", \"error\": \"unknown\"";
+      }
+      json << "}";
+      if(!o.bKeep) { remove(strOct.c_str()); }
+    }
+  }
+  json << "\n  ]\n}\n";
+  if(!o.bKeep) { remove(strRaw.c_str()); }
+
+  if(o.strOut.empty()) {
+    fputs(json.str().c_str(), stdout);
+  } else {
+    FILE* fp = fopen(o.strOut.c_str(), "w");
+    if(!fp || fputs(json.str().c_str(), fp) < 0 || fclose(fp) != 0) {
+      fprintf(stderr, "could not write %s\n", o.strOut.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+/*
+   For more information, please see: http://software.sci.utah.edu
+
+   The MIT License
+
+   Copyright (c) 2013 Scientific Computing and Imaging Institute,
+   University of Utah.
+
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the "Software"),
+   to deal in the Software without restriction, including without limitation
+   the rights to use, copy, modify, merge, publish, distribute, sublicense,
+   and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included
+   in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+   THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+*/
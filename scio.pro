@@ -3,10 +3,15 @@ win32:TEMPLATE    = vclib
 CONFIG            = create_prl exceptions largefile rtti static staticlib stl
 CONFIG           += warn_on
 DEFINES          += TUVOK_NO_QT
+DEFINES          += ZSTD_DISABLE_ASM
+# records brick I/O events, see IOTrace.h
+#DEFINES         += TUVOK_IO_TRACE
+# batched brick reads through io_uring (Linux only), see UringReader.h
+#DEFINES         += TUVOK_IO_URING
 TARGET            = tuvokio
 win32 { DESTDIR   = Build }
 OBJECTS_DIR       = Build/objects
-d = ../Basics ../ 3rdParty/cxxtest 3rdParty/boost 3rdParty exception .
+d = ../Basics ../ 3rdParty/cxxtest 3rdParty/boost 3rdParty 3rdParty/zstd exception .
 DEPENDPATH        = $$d
 INCLUDEPATH       = $$d
 LIBS              = -Lexpressions -ltuvokexpr
@@ -143,6 +148,32 @@ SOURCES += \
   ./3rdParty/tiff/tif_warning.c \
   ./3rdParty/tiff/tif_write.c \
   ./3rdParty/tiff/tif_zip.c \
+  ./3rdParty/zstd/common/debug.c \
+  ./3rdParty/zstd/common/entropy_common.c \
+  ./3rdParty/zstd/common/error_private.c \
+  ./3rdParty/zstd/common/fse_decompress.c \
+  ./3rdParty/zstd/common/pool.c \
+  ./3rdParty/zstd/common/threading.c \
+  ./3rdParty/zstd/common/xxhash.c \
+  ./3rdParty/zstd/common/zstd_common.c \
+  ./3rdParty/zstd/compress/fse_compress.c \
+  ./3rdParty/zstd/compress/hist.c \
+  ./3rdParty/zstd/compress/huf_compress.c \
+  ./3rdParty/zstd/compress/zstd_compress.c \
+  ./3rdParty/zstd/compress/zstd_compress_literals.c \
+  ./3rdParty/zstd/compress/zstd_compress_sequences.c \
+  ./3rdParty/zstd/compress/zstd_compress_superblock.c \
+  ./3rdParty/zstd/compress/zstd_double_fast.c \
+  ./3rdParty/zstd/compress/zstd_fast.c \
+  ./3rdParty/zstd/compress/zstd_lazy.c \
+  ./3rdParty/zstd/compress/zstd_ldm.c \
+  ./3rdParty/zstd/compress/zstd_opt.c \
+  ./3rdParty/zstd/compress/zstd_preSplit.c \
+  ./3rdParty/zstd/compress/zstdmt_compress.c \
+  ./3rdParty/zstd/decompress/huf_decompress.c \
+  ./3rdParty/zstd/decompress/zstd_ddict.c \
+  ./3rdParty/zstd/decompress/zstd_decompress.c \
+  ./3rdParty/zstd/decompress/zstd_decompress_block.c \
   ./AbstrConverter.cpp \
   ./AbstrGeoConverter.cpp \
   ./AnalyzeConverter.cpp \
@@ -162,6 +193,7 @@ SOURCES += \
   ./Images/StackExporter.cpp \
   ./InveonConverter.cpp \
   ./IOManager.cpp \
+  ./IOTrace.cpp \
   ./KeyValueFileParser.cpp \
   ./KitwareConverter.cpp \
   ./MedAlyVisFiberTractGeoConverter.cpp \
@@ -169,6 +201,7 @@ SOURCES += \
   ./MobileGeoConverter.cpp \
   ./NRRDConverter.cpp \
   ./OBJGeoConverter.cpp \
+  ./PageCache.cpp \
   ./PLYGeoConverter.cpp \
   ./StLGeoConverter.cpp \
   ./XML3DGeoConverter.cpp \
@@ -191,6 +224,9 @@ SOURCES += \
   ./UVF/MaxMinDataBlock.cpp \
   ./UVF/ExtendedOctree/ExtendedOctree.cpp
   ./UVF/ExtendedOctree/ExtendedOctreeConverter.cpp
+  ./UVF/ExtendedOctree/PreFilter.cpp
+  ./UVF/ExtendedOctree/UringReader.cpp
+  ./UVF/ExtendedOctree/ZstdCompression.cpp
   ./UVF/ExtendedOctree/VolumeTools.cpp
   ./uvfMesh.cpp \
   ./UVF/RasterDataBlock.cpp \
@@ -234,12 +270,51 @@ HEADERS += \
   ./3rdParty/tiff/uvcode.h \
   ./3rdParty/zlib/zconf.h \
   ./3rdParty/zlib/zlib.h \
+  ./3rdParty/zstd/common/allocations.h \
+  ./3rdParty/zstd/common/bits.h \
+  ./3rdParty/zstd/common/bitstream.h \
+  ./3rdParty/zstd/common/compiler.h \
+  ./3rdParty/zstd/common/cpu.h \
+  ./3rdParty/zstd/common/debug.h \
+  ./3rdParty/zstd/common/error_private.h \
+  ./3rdParty/zstd/common/fse.h \
+  ./3rdParty/zstd/common/huf.h \
+  ./3rdParty/zstd/common/mem.h \
+  ./3rdParty/zstd/common/pool.h \
+  ./3rdParty/zstd/common/portability_macros.h \
+  ./3rdParty/zstd/common/threading.h \
+  ./3rdParty/zstd/common/xxhash.h \
+  ./3rdParty/zstd/common/zstd_deps.h \
+  ./3rdParty/zstd/common/zstd_internal.h \
+  ./3rdParty/zstd/common/zstd_trace.h \
+  ./3rdParty/zstd/compress/clevels.h \
+  ./3rdParty/zstd/compress/hist.h \
+  ./3rdParty/zstd/compress/zstd_compress_internal.h \
+  ./3rdParty/zstd/compress/zstd_compress_literals.h \
+  ./3rdParty/zstd/compress/zstd_compress_sequences.h \
+  ./3rdParty/zstd/compress/zstd_compress_superblock.h \
+  ./3rdParty/zstd/compress/zstd_cwksp.h \
+  ./3rdParty/zstd/compress/zstd_double_fast.h \
+  ./3rdParty/zstd/compress/zstd_fast.h \
+  ./3rdParty/zstd/compress/zstd_lazy.h \
+  ./3rdParty/zstd/compress/zstd_ldm.h \
+  ./3rdParty/zstd/compress/zstd_ldm_geartab.h \
+  ./3rdParty/zstd/compress/zstd_opt.h \
+  ./3rdParty/zstd/compress/zstd_preSplit.h \
+  ./3rdParty/zstd/compress/zstdmt_compress.h \
+  ./3rdParty/zstd/decompress/zstd_ddict.h \
+  ./3rdParty/zstd/decompress/zstd_decompress_block.h \
+  ./3rdParty/zstd/decompress/zstd_decompress_internal.h \
+  ./3rdParty/zstd/zstd.h \
+  ./3rdParty/zstd/zstdVersion.h \
+  ./3rdParty/zstd/zstd_errors.h \
   ./AbstrConverter.h \
   ./AbstrGeoConverter.h \
   ./AnalyzeConverter.h \
   ./BOVConverter.h \
   ./BrickedDataset.h \
   ./Brick.h \
+  ./DataMerger.h \
   ./Dataset.h \
   ./DICOM/DICOMParser.h \
   ./DirectoryParser.h \
@@ -258,6 +333,7 @@ HEADERS += \
   ./Images/StackExporter.h \
   ./InveonConverter.h \
   ./IOManager.h \
+  ./IOTrace.h \
   ./KeyValueFileParser.h \
   ./KitwareConverter.h \
   ./MedAlyVisFiberTractGeoConverter.h \
@@ -265,6 +341,7 @@ HEADERS += \
   ./MobileGeoConverter.h \
   ./NRRDConverter.h \
   ./OBJGeoConverter.h \
+  ./PageCache.h \
   ./PLYGeoConverter.h \
   ./StLGeoConverter.h \
   ./XML3DGeoConverter.h \
@@ -301,6 +378,9 @@ HEADERS += \
   ./UVF/UVFTables.h \
   ./UVF/ExtendedOctree/ExtendedOctree.h
   ./UVF/ExtendedOctree/ExtendedOctreeConverter.h
+  ./UVF/ExtendedOctree/PreFilter.h
+  ./UVF/ExtendedOctree/UringReader.h
+  ./UVF/ExtendedOctree/ZstdCompression.h
   ./UVF/ExtendedOctree/VolumeTools.h
   ./VariantArray.h \
   ./VFFConverter.h \
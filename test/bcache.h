@@ -1,5 +1,8 @@
 #include <array>
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include <cxxtest/TestSuite.h>
 #include "BrickCache.h"
 #include "Controller/Controller.h"
@@ -107,6 +110,53 @@ namespace {
   }
 }
 
+// counts every allocation of the test program, so we can check that a loop
+// does not allocate.
+static std::atomic<size_t> n_allocations(0);
+void* operator new(size_t bytes) {
+  ++n_allocations;
+  void* mem = malloc(bytes == 0 ? 1 : bytes);
+  if(mem == NULL) { throw std::bad_alloc(); }
+  return mem;
+}
+void operator delete(void* mem) throw() { free(mem); }
+
+// once the cache is full, streaming more bricks through it must neither
+// allocate nor hold more than the bricks it reports in 'size'.
+void recycle_steady_state() {
+  BrickCache c;
+  const size_t elems = 32*32*32;
+  const size_t n_bricks = 8;
+  const size_t budget = n_bricks * elems * sizeof(uint16_t);
+  size_t i = 0;
+  for(; i < n_bricks; ++i) {
+    std::vector<uint16_t> data(elems, uint16_t(i));
+    c.add(BrickKey(0,0,i), data);
+  }
+  TS_ASSERT_EQUALS(c.size(), budget);
+
+  const size_t before = n_allocations;
+  for(; i < 4*n_bricks; ++i) {
+    std::vector<uint16_t> data;
+    c.recycle(data);
+    TS_ASSERT_EQUALS(data.capacity(), elems);
+    TS_ASSERT_EQUALS(c.size(), budget - elems*sizeof(uint16_t));
+    data.resize(elems);
+    std::fill(data.begin(), data.end(), uint16_t(i));
+    c.add(BrickKey(0,0,i), data);
+    TS_ASSERT_EQUALS(c.size(), budget);
+  }
+  TS_ASSERT_EQUALS(n_allocations - before, 0U);
+
+  // the last bricks are still there.
+  const uint16_t* last = static_cast<const uint16_t*>(
+    c.lookup(BrickKey(0,0,i-1), uint16_t(42))
+  );
+  TS_ASSERT(last != NULL);
+  if(last) { TS_ASSERT_EQUALS(last[elems-1], uint16_t(i-1)); }
+  while(c.size() > 0) { c.remove(); }
+}
+
 // this is really a benchmark, not a test per se...
 void add_many() {
   BrickCache c;
@@ -138,5 +188,6 @@ public:
   void test_sizes() { sizes(); }
   void test_lookup_bug() { lookup_bug(); }
   void test_lookup_bug16() { lookup_bug16(); }
+  void test_recycle_steady_state() { recycle_steady_state(); }
 //  void test_add_many() { add_many(); }
 };
@@ -0,0 +1,520 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/nonstd.h"
+#include "Controller/Controller.h"
+#include "DataMerger.h"
+#include "IOManager.h"
+#include "RAWConverter.h"
+#include "uvfDataset.h"
+#include "UVF/Histogram1DDataBlock.h"
+#include "UVF/Histogram2DDataBlock.h"
+#include "UVF/MaxMinDataBlock.h"
+#include "UVF/TOCBlock.h"
+#include "UVF/UVF.h"
+#include "util-test.h"
+
+namespace {
+  // writes the given values to a (temporary) raw file and returns its name
+  template<typename T>
+  std::string write_volume(const std::vector<T>& data) {
+    std::ofstream ofs;
+    const std::string fn = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(&data[0]),
+              std::streamsize(data.size()*sizeof(T)));
+    ofs.close();
+    return fn;
+  }
+
+  // a unique file name with the given extension, the file does not exist
+  std::string tmp_name(const std::string& ext) {
+    std::ofstream ofs;
+    const std::string fn = mk_tmpfile(ofs, std::ios::out);
+    ofs.close();
+    std::remove(fn.c_str());
+    return fn + ext;
+  }
+
+  // converts a raw uint8 volume into a UVF with the given brick size
+  std::string convert_volume(const std::string& raw, const UINT64VECTOR3& vSize,
+                             uint64_t iBrickSize) {
+    const std::string uvf = tmp_name(".uvf");
+    TS_ASSERT(RAWConverter::ConvertRAWDataset(raw, uvf, ".", 0, 8, 1, 1,
+                                              false, false, false, vSize,
+                                              FLOATVECTOR3(1,1,1), "desc",
+                                              "iotest", iBrickSize, 2, false,
+                                              false, 0, 0, 0, 0, false));
+    return uvf;
+  }
+
+  // a ball around a point that is not on the voxel grid, the values fall
+  // off smoothly so the surface has no ambiguous cells
+  std::vector<uint8_t> ball(const UINT64VECTOR3& vSize, double fRadius) {
+    std::vector<uint8_t> data(size_t(vSize.volume()));
+    const double c[3] = { vSize.x/2.0 + 0.3, vSize.y/2.0 - 0.2,
+                          vSize.z/2.0 + 0.1 };
+    for(uint64_t z=0; z < vSize.z; ++z)
+    for(uint64_t y=0; y < vSize.y; ++y)
+    for(uint64_t x=0; x < vSize.x; ++x) {
+      const double d = std::sqrt((x-c[0])*(x-c[0]) + (y-c[1])*(y-c[1]) +
+                                 (z-c[2])*(z-c[2]));
+      const double v = 128.0 + (fRadius - d) * 20.0;
+      data[size_t((z*vSize.y + y)*vSize.x + x)] =
+        uint8_t(std::min(255.0, std::max(0.0, v)));
+    }
+    return data;
+  }
+
+  // the vertices and triangles of an OBJ file, 'forward' tells if every
+  // face only referenced vertices that were defined before it
+  struct obj_mesh {
+    obj_mesh() : forward(true) {}
+    std::vector<std::string> vertices;
+    std::vector<uint32_t> indices;
+    bool forward;
+  };
+
+  obj_mesh read_obj(const std::string& fn) {
+    obj_mesh m;
+    std::ifstream ifs(fn.c_str());
+    std::string line;
+    while(std::getline(ifs, line)) {
+      if(line.compare(0, 2, "v ") == 0) {
+        m.vertices.push_back(line.substr(2));
+      } else if(line.compare(0, 2, "f ") == 0) {
+        std::istringstream iss(line.substr(2));
+        std::string corner;
+        while(iss >> corner) {
+          const uint32_t i = uint32_t(atoi(corner.c_str()) - 1);
+          m.forward = m.forward && i < m.vertices.size();
+          m.indices.push_back(i);
+        }
+      }
+    }
+    return m;
+  }
+
+  // number of edges that are not shared by exactly two triangles
+  size_t open_edges(const obj_mesh& m) {
+    std::map<std::pair<uint32_t,uint32_t>, size_t> edges;
+    for(size_t i=0; i+2 < m.indices.size(); i+=3) {
+      for(size_t e=0; e < 3; ++e) {
+        const uint32_t a = m.indices[i+e];
+        const uint32_t b = m.indices[i+(e+1)%3];
+        ++edges[std::make_pair(std::min(a,b), std::max(a,b))];
+      }
+    }
+    size_t iOpen = 0;
+    for(auto e=edges.cbegin(); e != edges.cend(); ++e) {
+      if(e->second != 2) { ++iOpen; }
+    }
+    return iOpen;
+  }
+
+  // the blocks of the (single) timestep of a UVF, valid while it is open
+  struct uvf_blocks {
+    uvf_blocks() : toc(NULL), hist1d(NULL), hist2d(NULL), maxmin(NULL) {}
+    const TOCBlock* toc;
+    const Histogram1DDataBlock* hist1d;
+    const Histogram2DDataBlock* hist2d;
+    const MaxMinDataBlock* maxmin;
+  };
+
+  uvf_blocks find_blocks(const UVF& uvf) {
+    uvf_blocks b;
+    for(uint64_t i=0; i < uvf.GetDataBlockCount(); ++i) {
+      const DataBlock* block = uvf.GetDataBlock(i).get();
+      switch(block->GetBlockSemantic()) {
+        case UVFTables::BS_TOC_BLOCK:
+          b.toc = static_cast<const TOCBlock*>(block); break;
+        case UVFTables::BS_1D_HISTOGRAM:
+          b.hist1d = static_cast<const Histogram1DDataBlock*>(block); break;
+        case UVFTables::BS_2D_HISTOGRAM:
+          b.hist2d = static_cast<const Histogram2DDataBlock*>(block); break;
+        case UVFTables::BS_MAXMIN_VALUES:
+          b.maxmin = static_cast<const MaxMinDataBlock*>(block); break;
+        default: break;
+      }
+    }
+    return b;
+  }
+
+  // a level 0 brick of a uint8 volume including its overlap, voxels outside
+  // of the domain are zero just like in a tree built without clamping
+  std::vector<uint8_t> brick_of(const std::vector<uint8_t>& data,
+                                const UINT64VECTOR3& vSize,
+                                const TOCBlock& toc,
+                                const UINT64VECTOR4& coords) {
+    const UINT64VECTOR3 vBrickSize = toc.GetBrickSize(coords);
+    const int64_t iOverlap = int64_t(toc.GetOverlap());
+    const int64_t iCore = int64_t(toc.GetMaxBrickSize().x) - 2*iOverlap;
+    std::vector<uint8_t> brick(size_t(vBrickSize.volume()), 0);
+    for(uint64_t z=0; z < vBrickSize.z; ++z)
+    for(uint64_t y=0; y < vBrickSize.y; ++y)
+    for(uint64_t x=0; x < vBrickSize.x; ++x) {
+      const int64_t sx = int64_t(coords.x)*iCore + int64_t(x) - iOverlap;
+      const int64_t sy = int64_t(coords.y)*iCore + int64_t(y) - iOverlap;
+      const int64_t sz = int64_t(coords.z)*iCore + int64_t(z) - iOverlap;
+      if(sx < 0 || sy < 0 || sz < 0 || sx >= int64_t(vSize.x) ||
+         sy >= int64_t(vSize.y) || sz >= int64_t(vSize.z)) { continue; }
+      brick[size_t((z*vBrickSize.y + y)*vBrickSize.x + x)] =
+        data[size_t((sz*vSize.y + sy)*vSize.x + sx)];
+    }
+    return brick;
+  }
+
+  uint64_t file_size(const std::string& fn) {
+    std::ifstream ifs(fn.c_str(), std::ios::binary | std::ios::ate);
+    return uint64_t(ifs.tellg());
+  }
+
+  std::string extract(const UVFDataset& ds, double fIsovalue,
+                      bool bStreamOutput) {
+    const std::string obj = tmp_name(".obj");
+    const IOManager& iom = Controller::Const().IOMan();
+    TS_ASSERT(iom.ExtractIsosurface(&ds, 0, fIsovalue,
+                                    FLOATVECTOR4(1,1,1,1), obj, ".",
+                                    bStreamOutput));
+    return obj;
+  }
+}
+
+// a surface that crosses many bricks must come out welded: no vertex is
+// written twice and the closed surface has no open edges, just like the
+// surface extracted from a single brick. Streaming only changes the order
+// of the lines in the file, not the mesh.
+void tisosurface_welding() {
+  const UINT64VECTOR3 vSize(30, 30, 30);
+  const std::string raw = write_volume(ball(vSize, 9.0));
+  const std::string bricked = convert_volume(raw, vSize, 16);
+  const std::string single = convert_volume(raw, vSize, 64);
+
+  std::string objs[3];
+  {
+    UVFDataset dsBricked(bricked, 64, false, false);
+    UVFDataset dsSingle(single, 64, false, false);
+    TS_ASSERT(dsBricked.GetBrickLayout(0, 0).volume() > 1);
+    TS_ASSERT_EQUALS(dsSingle.GetBrickLayout(0, 0).volume(), 1U);
+    objs[0] = extract(dsBricked, 128.5, false);
+    objs[1] = extract(dsBricked, 128.5, true);
+    objs[2] = extract(dsSingle, 128.5, false);
+  }
+  const obj_mesh buffered = read_obj(objs[0]);
+  const obj_mesh streamed = read_obj(objs[1]);
+  const obj_mesh reference = read_obj(objs[2]);
+
+  TS_ASSERT(!buffered.vertices.empty());
+  const std::set<std::string> unique(buffered.vertices.begin(),
+                                     buffered.vertices.end());
+  TS_ASSERT_EQUALS(unique.size(), buffered.vertices.size());
+  TS_ASSERT_EQUALS(open_edges(buffered), size_t(0));
+  TS_ASSERT_EQUALS(open_edges(reference), size_t(0));
+  TS_ASSERT_EQUALS(buffered.vertices.size(), reference.vertices.size());
+  TS_ASSERT_EQUALS(buffered.indices.size(), reference.indices.size());
+
+  TS_ASSERT(streamed.forward);
+  TS_ASSERT(streamed.vertices == buffered.vertices);
+  TS_ASSERT(streamed.indices == buffered.indices);
+
+  std::remove(raw.c_str());
+  std::remove(bricked.c_str());
+  std::remove(single.c_str());
+  for(size_t i=0; i < 3; ++i) { std::remove(objs[i].c_str()); }
+}
+
+// scaled values and sums stick to the limits of the type, at both ends
+void tmerge_saturation() {
+  TS_ASSERT_EQUALS(MergeTransform<uint8_t>(200, 2.0, 0.0), uint8_t(255));
+  TS_ASSERT_EQUALS(MergeTransform<uint8_t>(10, 1.0, -20.0), uint8_t(0));
+  TS_ASSERT_EQUALS(MergeTransform<uint8_t>(10, 0.5, 4.0), uint8_t(7));
+  TS_ASSERT_EQUALS(MergeTransform<int8_t>(-100, 2.0, 0.0), int8_t(-128));
+  TS_ASSERT_EQUALS(MergeTransform<int8_t>(100, 2.0, 0.0), int8_t(127));
+  TS_ASSERT_EQUALS(MergeTransform<int16_t>(-7, 3.0, 1.0), int16_t(-18));
+  TS_ASSERT_DELTA(MergeTransform<float>(-2.5f, 2.0, 1.0), -3.0f, 1e-6f);
+
+  TS_ASSERT_EQUALS(MergeAdd<uint8_t>(200, 100), uint8_t(255));
+  TS_ASSERT_EQUALS(MergeAdd<uint8_t>(200, 55), uint8_t(255));
+  TS_ASSERT_EQUALS(MergeAdd<uint8_t>(100, 27), uint8_t(127));
+  TS_ASSERT_EQUALS(MergeAdd<int16_t>(30000, 10000), int16_t(32767));
+  TS_ASSERT_EQUALS(MergeAdd<int16_t>(-30000, -10000), int16_t(-32768));
+  TS_ASSERT_EQUALS(MergeAdd<int16_t>(-30000, 10000), int16_t(-20000));
+  TS_ASSERT_EQUALS(MergeAdd<uint64_t>(std::numeric_limits<uint64_t>::max(), 1),
+                   std::numeric_limits<uint64_t>::max());
+}
+
+// combines the sources one value at a time, the reference for MergeCombine
+template <typename T>
+std::vector<T> merge_reference(const std::vector<MergeDataset>& files,
+                               const std::vector<std::vector<T>>& sources,
+                               bool bUseMaxMode) {
+  std::vector<T> out(sources[0].size());
+  for(size_t j=0; j < out.size(); ++j) {
+    out[j] = MergeTransform(sources[0][j], files[0].fScale, files[0].fBias);
+    for(size_t i=1; i < sources.size(); ++i) {
+      const T v = MergeTransform(sources[i][j], files[i].fScale,
+                                 files[i].fBias);
+      out[j] = bUseMaxMode ? std::max(out[j], v) : MergeAdd(out[j], v);
+    }
+  }
+  return out;
+}
+
+// the chunked merge, with and without the identity fast path, must give
+// what combining every value on its own gives; the data spans several
+// chunks and ends in a partial one
+template <typename T>
+void merge_combine(const std::vector<MergeDataset>& files) {
+  const size_t iCount = (1<<17) + 123;
+  std::vector<std::vector<T>> sources(files.size(), std::vector<T>(iCount));
+  std::vector<const T*> ptrs;
+  for(size_t i=0; i < sources.size(); ++i) {
+    for(size_t j=0; j < iCount; ++j) {
+      sources[i][j] = T(((j+1) * (i+7) * 2654435761U) >> 20);
+    }
+    ptrs.push_back(&sources[i][0]);
+  }
+  for(size_t mode=0; mode < 2; ++mode) {
+    std::vector<T> out(iCount);
+    MergeCombine(files, ptrs, &out[0], iCount, mode == 1);
+    TS_ASSERT(out == merge_reference(files, sources, mode == 1));
+  }
+}
+
+void tmerge_combine() {
+  std::vector<MergeDataset> identity(3);
+  merge_combine<uint8_t>(identity);
+  merge_combine<int16_t>(identity);
+  merge_combine<float>(identity);
+
+  std::vector<MergeDataset> scaled(identity);
+  scaled[1].fScale = 3.0;
+  scaled[2].fBias = -100.0;
+  merge_combine<uint8_t>(scaled);
+  merge_combine<int16_t>(scaled);
+  merge_combine<float>(scaled);
+}
+
+// the single pass merge of raw files, headers skipped, must write the
+// combined values of all inputs
+void tdata_merger() {
+  const size_t iCount = 1000;
+  std::vector<int16_t> a(iCount), b(iCount);
+  for(size_t i=0; i < iCount; ++i) {
+    a[i] = int16_t(int(i)*60 - 30000);
+    b[i] = int16_t(30000 - int(i)*60);
+  }
+  const std::string fnA = write_volume(a);
+  // 'b' is stored behind a 16 byte header
+  std::vector<int16_t> withHeader(8, int16_t(-1));
+  withHeader.insert(withHeader.end(), b.begin(), b.end());
+  const std::string fnB = write_volume(withHeader);
+
+  std::vector<MergeDataset> files;
+  files.push_back(MergeDataset(fnA, 0, false, 1.0, 0.0));
+  files.push_back(MergeDataset(fnB, 16, false, 2.0, 10.0));
+  for(size_t mode=0; mode < 2; ++mode) {
+    const std::string target = tmp_name(".raw");
+    DataMerger<int16_t> merger(files, target, iCount, &Controller::Instance(),
+                               mode == 1);
+    TS_ASSERT(merger.IsOK());
+
+    std::ifstream ifs(target.c_str(), std::ios::binary);
+    std::vector<int16_t> merged(iCount);
+    ifs.read(reinterpret_cast<char*>(&merged[0]),
+             std::streamsize(iCount*sizeof(int16_t)));
+    TS_ASSERT_EQUALS(ifs.gcount(), std::streamsize(iCount*sizeof(int16_t)));
+    ifs.close();
+    for(size_t i=0; i < iCount; ++i) {
+      const int16_t v = MergeTransform<int16_t>(b[i], 2.0, 10.0);
+      TS_ASSERT_EQUALS(merged[i], mode == 1 ? std::max(a[i], v)
+                                            : MergeAdd(a[i], v));
+    }
+    std::remove(target.c_str());
+  }
+  std::remove(fnA.c_str());
+  std::remove(fnB.c_str());
+}
+
+// a batch of octree bricks, in any order, must read just like the bricks one
+// at a time; ReadRegion goes through such batches.
+void tbatched_reads() {
+  const UINT64VECTOR3 vSize(30, 30, 30);
+  const std::vector<uint8_t> data = ball(vSize, 9.0);
+  const std::string raw = write_volume(data);
+  const std::string uvf = convert_volume(raw, vSize, 16);
+  // blocking reads, then reads kept in flight by io_uring where built in;
+  // the depth reaches the octrees of datasets opened afterwards
+  IOManager& iom = Controller::Instance().IOMan();
+  const uint32_t iDefaultDepth = iom.GetAsyncQueueDepth();
+  const uint32_t depths[] = {0, 8};
+  for(size_t d=0; d < 2; ++d) {
+    iom.SetAsyncQueueDepth(depths[d]);
+    UVFDataset ds(uvf, 64, false, false);
+    TS_ASSERT(ds.GetBrickLayout(0, 0).volume() > 1);
+    const size_t iBytes = size_t(ds.GetMaxBrickSize().volume());
+
+    std::vector<BrickKey> vKeys;
+    for(auto b=ds.BricksBegin(); b != ds.BricksEnd(); ++b) {
+      vKeys.push_back(b->first);
+    }
+    std::reverse(vKeys.begin(), vKeys.end());
+    std::vector<uint8_t> batch(vKeys.size() * iBytes, 0);
+    std::vector<void*> vTargets;
+    for(size_t i=0; i < vKeys.size(); ++i) {
+      vTargets.push_back(&batch[i * iBytes]);
+    }
+    TS_ASSERT(ds.GetBricks(vKeys, vTargets, iBytes));
+    for(size_t i=0; i < vKeys.size(); ++i) {
+      std::vector<uint8_t> single;
+      TS_ASSERT(ds.GetBrick(vKeys[i], single));
+      TS_ASSERT(std::equal(single.begin(), single.end(), &batch[i * iBytes]));
+    }
+
+    std::vector<uint8_t> region(size_t(vSize.volume()));
+    TS_ASSERT(ds.ReadRegion(0, 0, UINT64VECTOR3(0,0,0), vSize, &region[0]));
+    TS_ASSERT(region == data);
+    const UINT64VECTOR3 vOffset(3, 11, 7), vPart(20, 13, 17);
+    std::vector<uint8_t> part(size_t(vPart.volume()));
+    TS_ASSERT(ds.ReadRegion(0, 0, vOffset, vPart, &part[0]));
+    bool bSame = true;
+    for(uint64_t z=0; z < vPart.z; ++z)
+    for(uint64_t y=0; y < vPart.y; ++y)
+    for(uint64_t x=0; x < vPart.x; ++x) {
+      const uint64_t src = ((z+vOffset.z)*vSize.y + y+vOffset.y)*vSize.x +
+                           x+vOffset.x;
+      bSame &= part[size_t((z*vPart.y + y)*vPart.x + x)] == data[size_t(src)];
+    }
+    TS_ASSERT(bSame);
+  }
+  iom.SetAsyncQueueDepth(iDefaultDepth);
+  std::remove(raw.c_str());
+  std::remove(uvf.c_str());
+}
+
+// replacing the bricks of an edited box of a UVF rewrites the file in place:
+// it keeps its size, passes the checksum test and holds the same bricks,
+// min/max values and 1D histogram as a conversion of the edited data. The
+// 2D histogram keeps its bins.
+void tupdate_bricks() {
+  const UINT64VECTOR3 vSize(30, 30, 30);
+  const std::vector<uint8_t> data = ball(vSize, 9.0);
+  std::vector<uint8_t> edited = data;
+  for(uint64_t z=8; z < 14; ++z)
+  for(uint64_t y=8; y < 14; ++y)
+  for(uint64_t x=8; x < 14; ++x) {
+    edited[size_t((z*vSize.y + y)*vSize.x + x)] = uint8_t(40 + x + y + z);
+  }
+  const std::string raw = write_volume(data);
+  const std::string rawEdited = write_volume(edited);
+  const std::string uvf = convert_volume(raw, vSize, 16);
+  const std::string reference = convert_volume(rawEdited, vSize, 16);
+  const uint64_t iFileSize = file_size(uvf);
+
+  // every level 0 brick that changes, in its core or its overlap only
+  std::vector<UINT64VECTOR4> vCoords;
+  std::vector<std::shared_ptr<uint8_t>> vData;
+  uint64_t iBrickCount = 0;
+  {
+    UVF file(std::wstring(uvf.begin(), uvf.end()));
+    TS_ASSERT(file.Open(false, false, false));
+    const TOCBlock* toc = find_blocks(file).toc;
+    TS_ASSERT(toc != NULL);
+    const UINT64VECTOR3 vBricks = toc->GetBrickCount(0);
+    iBrickCount = vBricks.volume();
+    for(uint64_t z=0; z < vBricks.z; ++z)
+    for(uint64_t y=0; y < vBricks.y; ++y)
+    for(uint64_t x=0; x < vBricks.x; ++x) {
+      const UINT64VECTOR4 coords(x, y, z, 0);
+      const std::vector<uint8_t> brick = brick_of(edited, vSize, *toc, coords);
+      std::vector<uint8_t> stored(brick.size());
+      toc->GetData(&stored[0], coords);
+      TS_ASSERT(brick_of(data, vSize, *toc, coords) == stored);
+      if(brick == stored) { continue; }
+      std::shared_ptr<uint8_t> p(new uint8_t[brick.size()],
+                                 nonstd::DeleteArray<uint8_t>());
+      std::copy(brick.begin(), brick.end(), p.get());
+      vCoords.push_back(coords);
+      vData.push_back(p);
+    }
+    file.Close();
+  }
+  TS_ASSERT(!vCoords.empty());
+  TS_ASSERT(vCoords.size() < iBrickCount);
+
+  {
+    UVFDataset ds(uvf, 64, false, false);
+    TS_ASSERT(ds.UpdateBricks(0, vCoords, vData, false, false, CT_NONE));
+  }
+  TS_ASSERT_EQUALS(file_size(uvf), iFileSize);
+
+  UVF updated(std::wstring(uvf.begin(), uvf.end()));
+  UVF converted(std::wstring(reference.begin(), reference.end()));
+  std::string strProblem;
+  TS_ASSERT(updated.Open(false, true, false, &strProblem));
+  TS_ASSERT(converted.Open(false, false, false));
+  const uvf_blocks a = find_blocks(updated);
+  const uvf_blocks b = find_blocks(converted);
+  TS_ASSERT(a.toc && a.hist1d && a.hist2d && a.maxmin);
+  TS_ASSERT(b.toc && b.hist1d && b.hist2d && b.maxmin);
+
+  TS_ASSERT_EQUALS(a.toc->GetLoDCount(), b.toc->GetLoDCount());
+  size_t iIndex = 0;
+  for(uint64_t lod=0; lod < a.toc->GetLoDCount(); ++lod) {
+    const UINT64VECTOR3 vBricks = a.toc->GetBrickCount(lod);
+    for(uint64_t z=0; z < vBricks.z; ++z)
+    for(uint64_t y=0; y < vBricks.y; ++y)
+    for(uint64_t x=0; x < vBricks.x; ++x, ++iIndex) {
+      const UINT64VECTOR4 coords(x, y, z, lod);
+      std::vector<uint8_t> ba(size_t(a.toc->GetBrickSize(coords).volume()));
+      std::vector<uint8_t> bb(ba.size());
+      a.toc->GetData(&ba[0], coords);
+      b.toc->GetData(&bb[0], coords);
+      TS_ASSERT(ba == bb);
+      TS_ASSERT_EQUALS(a.maxmin->GetValue(iIndex).minScalar,
+                       b.maxmin->GetValue(iIndex).minScalar);
+      TS_ASSERT_EQUALS(a.maxmin->GetValue(iIndex).maxScalar,
+                       b.maxmin->GetValue(iIndex).maxScalar);
+    }
+  }
+  TS_ASSERT_EQUALS(a.maxmin->GetGlobalValue().minScalar,
+                   b.maxmin->GetGlobalValue().minScalar);
+  TS_ASSERT_EQUALS(a.maxmin->GetGlobalValue().maxScalar,
+                   b.maxmin->GetGlobalValue().maxScalar);
+  TS_ASSERT(a.hist1d->GetHistogram() == b.hist1d->GetHistogram());
+
+  const std::vector<std::vector<uint64_t>>& h2 = a.hist2d->GetHistogram();
+  TS_ASSERT_EQUALS(h2.size(), b.hist2d->GetHistogram().size());
+  uint64_t iVoxels = 0;
+  for(size_t i=0; i < h2.size(); ++i) {
+    TS_ASSERT_EQUALS(h2[i].size(), size_t(256));
+    for(size_t j=0; j < h2[i].size(); ++j) { iVoxels += h2[i][j]; }
+  }
+  TS_ASSERT_EQUALS(iVoxels, vSize.volume());
+
+  updated.Close();
+  converted.Close();
+  std::remove(raw.c_str());
+  std::remove(rawEdited.c_str());
+  std::remove(uvf.c_str());
+  std::remove(reference.c_str());
+}
+
+class IOManagerTests : public CxxTest::TestSuite {
+public:
+  void test_isosurface_welding() { tisosurface_welding(); }
+  void test_merge_saturation() { tmerge_saturation(); }
+  void test_merge_combine() { tmerge_combine(); }
+  void test_data_merger() { tdata_merger(); }
+  void test_update_bricks() { tupdate_bricks(); }
+  void test_batched_reads() { tbatched_reads(); }
+};
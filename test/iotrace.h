@@ -0,0 +1,139 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <cxxtest/TestSuite.h>
+#include "IOTrace.h"
+
+using namespace tuvok::iotrace;
+
+namespace {
+  std::string slurp_text(const std::string& fn) {
+    std::ifstream ifs(fn.c_str());
+    return std::string(std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>());
+  }
+
+  size_t occurrences(const std::string& text, const std::string& what) {
+    size_t n = 0;
+    for(size_t at = text.find(what); at != std::string::npos;
+        at = text.find(what, at + what.size())) {
+      ++n;
+    }
+    return n;
+  }
+
+  // the number following '"key": ' in the summary of 'stage'; 0 if there is
+  // no such entry.
+  uint64_t summary_value(const std::string& summary, const char* stage,
+                         const char* key) {
+    const size_t entry = summary.find(std::string("\"") + stage + "\": {");
+    if(entry == std::string::npos) { return 0; }
+    const size_t end = summary.find('}', entry);
+    const std::string field = std::string("\"") + key + "\": ";
+    const size_t at = summary.find(field, entry);
+    if(at == std::string::npos || at > end) { return 0; }
+    std::istringstream value(summary.substr(at + field.size()));
+    uint64_t v = 0;
+    value >> v;
+    return v;
+  }
+
+  const uint64_t ms = 1000000; // ns
+}
+
+// durations of 1..100ms give known percentiles; instants and scopes are only
+// counted.
+void trace_summary() {
+  Enable(true);
+  Clear();
+  // every event must start after the Clear.
+  std::this_thread::sleep_for(std::chrono::milliseconds(120));
+  for(uint64_t i=1; i <= 100; ++i) {
+    Record(TR_DECODE, Now() - i*ms, i);
+  }
+  for(uint64_t i=0; i < 7; ++i) { Instant(TR_CACHE_HIT, i); }
+  for(uint64_t i=0; i < 3; ++i) { Instant(TR_CACHE_MISS, i); }
+  for(uint64_t i=0; i < 5; ++i) { Scope copy(TR_COPY, i); }
+  Enable(false);
+  { Scope ignored(TR_COPY, 42); }
+
+  const std::string trace = ".iotrace-test.json";
+  const std::string summary = ".iotrace-test-summary.json";
+  TS_ASSERT(WriteChromeTrace(trace));
+  TS_ASSERT(WriteSummary(summary));
+  const std::string tr = slurp_text(trace);
+  const std::string su = slurp_text(summary);
+  std::remove(trace.c_str());
+  std::remove(summary.c_str());
+
+  TS_ASSERT_EQUALS(occurrences(tr, "\"name\":\"decode\""), 100U);
+  TS_ASSERT_EQUALS(occurrences(tr, "\"name\":\"cache_hit\""), 7U);
+  TS_ASSERT_EQUALS(occurrences(tr, "\"name\":\"cache_miss\""), 3U);
+  TS_ASSERT_EQUALS(occurrences(tr, "\"name\":\"copy\""), 5U);
+  TS_ASSERT_EQUALS(occurrences(tr, "\"ph\":\"i\""), 10U);
+  TS_ASSERT_EQUALS(occurrences(tr, "\"ph\":\"X\""), 105U);
+  TS_ASSERT_EQUALS(occurrences(tr, "\"name\":\"disk_read\""), 0U);
+
+  TS_ASSERT_EQUALS(summary_value(su, "decode", "count"), 100U);
+  TS_ASSERT_EQUALS(summary_value(su, "cache_hit", "count"), 7U);
+  TS_ASSERT_EQUALS(summary_value(su, "cache_miss", "count"), 3U);
+  TS_ASSERT_EQUALS(summary_value(su, "copy", "count"), 5U);
+  TS_ASSERT_EQUALS(su.find("\"disk_read\""), std::string::npos);
+
+  // Record measures up to its own Now(), which is a bit after ours.
+  const uint64_t slack = ms / 2;
+  const uint64_t p50 = summary_value(su, "decode", "p50_ns");
+  const uint64_t p90 = summary_value(su, "decode", "p90_ns");
+  const uint64_t p99 = summary_value(su, "decode", "p99_ns");
+  const uint64_t lo = summary_value(su, "decode", "min_ns");
+  const uint64_t hi = summary_value(su, "decode", "max_ns");
+  TS_ASSERT(51*ms <= p50 && p50 < 51*ms + slack);
+  TS_ASSERT(91*ms <= p90 && p90 < 91*ms + slack);
+  TS_ASSERT(100*ms <= p99 && p99 < 100*ms + slack);
+  TS_ASSERT(1*ms <= lo && lo < 1*ms + slack);
+  TS_ASSERT(100*ms <= hi && hi < 100*ms + slack);
+}
+
+// snapshots taken while other threads wrap around their rings must only
+// contain complete events: a hit always carries 1111, a miss 2222.
+void trace_concurrent() {
+  Enable(true);
+  Clear();
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  std::atomic<bool> done(false);
+  std::thread writers[2];
+  for(size_t t=0; t < 2; ++t) {
+    writers[t] = std::thread([&done]() {
+      while(!done) {
+        Instant(TR_CACHE_HIT, 1111);
+        Instant(TR_CACHE_MISS, 2222);
+      }
+    });
+  }
+  const std::string trace = ".iotrace-test-concurrent.json";
+  for(size_t i=0; i < 5; ++i) {
+    TS_ASSERT(WriteChromeTrace(trace));
+    const std::string tr = slurp_text(trace);
+    TS_ASSERT_EQUALS(occurrences(tr, "\"name\":\"cache_hit\""),
+                     occurrences(tr, "\"arg\":1111}"));
+    TS_ASSERT_EQUALS(occurrences(tr, "\"name\":\"cache_miss\""),
+                     occurrences(tr, "\"arg\":2222}"));
+    TS_ASSERT_EQUALS(occurrences(tr, "\"ph\":\"i\""),
+                     occurrences(tr, "\"name\":\""));
+  }
+  done = true;
+  for(size_t t=0; t < 2; ++t) { writers[t].join(); }
+  Enable(false);
+  std::remove(trace.c_str());
+}
+
+class IOTraceTests : public CxxTest::TestSuite {
+public:
+  void test_summary() { trace_summary(); }
+  void test_concurrent() { trace_concurrent(); }
+};
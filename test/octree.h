@@ -0,0 +1,1106 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "Basics/nonstd.h"
+#include "Controller/Controller.h"
+#include "PageCache.h"
+#include "UVF/UVFBasic.h"
+#include "UVF/ExtendedOctree/ExtendedOctreeConverter.h"
+#include "UVF/ExtendedOctree/PreFilter.h"
+#include "UVF/ExtendedOctree/ZstdCompression.h"
+#include "util-test.h"
+
+namespace {
+  // writes the given values to a (temporary) raw file and returns its name
+  template<typename T>
+  std::string write_raw(const std::vector<T>& data) {
+    std::ofstream ofs;
+    const std::string fn = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(&data[0]),
+              std::streamsize(data.size()*sizeof(T)));
+    ofs.close();
+    return fn;
+  }
+
+  struct convert_opts {
+    convert_opts() : vBrickSize(16,16,16), iOverlap(2),
+      eCompression(CT_ZLIB), iLevel(1), ePreFilter(PF_NONE),
+      fMinDecodeThroughput(0.0), eLayout(LT_SCANLINE), bMedian(false),
+      bClamp(false) {}
+    UINT64VECTOR3 vBrickSize;
+    uint32_t iOverlap;
+    COMPRESSION_TYPE eCompression;
+    uint32_t iLevel;
+    PREFILTER_TYPE ePreFilter;
+    /// if not empty a codec is selected per brick from these
+    std::vector<ExtendedOctreeConverter::AdaptiveCandidate> vAdaptive;
+    /// decode budget (MB/s) of the adaptive selection, 0 disables it
+    double fMinDecodeThroughput;
+    LAYOUT_TYPE eLayout;
+    bool bMedian;
+    bool bClamp;
+  };
+
+  // converts a raw file into a new (temporary) octree file
+  std::string convert(const std::string& raw, ExtendedOctree::COMPONENT_TYPE ct,
+                      uint64_t iComponentCount, const UINT64VECTOR3& vSize,
+                      const convert_opts& opts = convert_opts(),
+                      BrickStatVec* pStats = NULL) {
+    std::ofstream ofs;
+    const std::string fn = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+    ofs.close();
+    BrickStatVec localStats;
+    BrickStatVec& stats = pStats ? *pStats : localStats;
+    ExtendedOctreeConverter conv(opts.vBrickSize, opts.iOverlap, 1<<24,
+                                 Controller::Debug::Out());
+    conv.SetPreFilter(opts.ePreFilter);
+    if(!opts.vAdaptive.empty()) {
+      // no decode budget by default, timings would make the selection flaky
+      conv.SetAdaptiveCompression(true);
+      conv.SetAdaptiveCandidates(opts.vAdaptive, opts.fMinDecodeThroughput,
+                                 0.1);
+    }
+    TS_ASSERT(conv.Convert(raw, 0, ct, iComponentCount, vSize,
+                           DOUBLEVECTOR3(1,1,1), fn, 0, &stats,
+                           opts.eCompression, opts.iLevel, opts.bMedian,
+                           opts.bClamp,
+                           opts.eLayout));
+    return fn;
+  }
+
+  // the content of a file
+  std::vector<char> read_file(const std::string& fn) {
+    std::ifstream ifs(fn.c_str(), std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(ifs)),
+                             std::istreambuf_iterator<char>());
+  }
+
+  // the number of bytes brick 'k' occupies once uncompressed
+  size_t brick_bytes(const ExtendedOctree& tree, const UINT64VECTOR4& k) {
+    return size_t(tree.ComputeBrickSize(k).volume() *
+                  tree.GetComponentTypeSize() * tree.GetComponentCount());
+  }
+
+  // checks every level 0 brick of the tree against the flat source data,
+  // voxels outside of the domain are expected to be zero (no clamping).
+  // The last brick along each axis must hold at least 'overlap' voxels, the
+  // converter does not clip the overlap of the bricks before it.
+  template<typename T>
+  void check_lod0(const ExtendedOctree& tree, const std::vector<T>& data,
+                  uint64_t iComponentCount, const UINT64VECTOR3& vSize) {
+    const UINT64VECTOR3 bc = tree.GetBrickCount(0);
+    const UINT64VECTOR3 bs(tree.GetMaxBrickSize());
+    const int64_t ov = int64_t(tree.GetOverlap());
+    std::vector<T> brick(bs.volume()*iComponentCount);
+    for(uint64_t i=0; i < bc.volume(); ++i) {
+      const UINT64VECTOR4 k(i%bc.x, (i/bc.x)%bc.y, i/(bc.x*bc.y), 0);
+      const UINT64VECTOR3 sz = tree.ComputeBrickSize(k);
+      tree.GetBrickData(reinterpret_cast<uint8_t*>(&brick[0]), k);
+      size_t mismatches = 0;
+      for(uint64_t z=0; z < sz.z; ++z)
+      for(uint64_t y=0; y < sz.y; ++y)
+      for(uint64_t x=0; x < sz.x; ++x) {
+        const int64_t g[3] = {
+          int64_t(k.x*(bs.x-2*ov)+x) - ov,
+          int64_t(k.y*(bs.y-2*ov)+y) - ov,
+          int64_t(k.z*(bs.z-2*ov)+z) - ov
+        };
+        const bool inside = g[0] >= 0 && g[0] < int64_t(vSize.x) &&
+                            g[1] >= 0 && g[1] < int64_t(vSize.y) &&
+                            g[2] >= 0 && g[2] < int64_t(vSize.z);
+        for(uint64_t c=0; c < iComponentCount; ++c) {
+          const T expected = inside ?
+            data[((g[2]*vSize.y + g[1])*vSize.x + g[0])*iComponentCount + c] :
+            T(0);
+          if(brick[((z*sz.y+y)*sz.x+x)*iComponentCount+c] != expected) {
+            ++mismatches;
+          }
+        }
+      }
+      TS_ASSERT_EQUALS(mismatches, size_t(0));
+    }
+  }
+
+  // checks that two trees with the same layout store identical data
+  void check_trees_equal(const ExtendedOctree& a, const ExtendedOctree& b) {
+    TS_ASSERT_EQUALS(a.GetLODCount(), b.GetLODCount());
+    TS_ASSERT_EQUALS(a.GetComponentTypeSize(), b.GetComponentTypeSize());
+    TS_ASSERT_EQUALS(a.GetComponentCount(), b.GetComponentCount());
+    const uint64_t bytes = a.GetMaxBrickSize().volume() *
+                           a.GetComponentTypeSize() * a.GetComponentCount();
+    std::vector<uint8_t> da(bytes), db(bytes);
+    for(uint64_t lod=0; lod < a.GetLODCount(); ++lod) {
+      const UINT64VECTOR3 bc = a.GetBrickCount(lod);
+      TS_ASSERT_EQUALS(bc, b.GetBrickCount(lod));
+      for(uint64_t i=0; i < bc.volume(); ++i) {
+        const UINT64VECTOR4 k(i%bc.x, (i/bc.x)%bc.y, i/(bc.x*bc.y), lod);
+        a.GetBrickData(&da[0], k);
+        b.GetBrickData(&db[0], k);
+        TS_ASSERT(std::equal(da.begin(), da.begin()+brick_bytes(a, k),
+                             db.begin()));
+      }
+    }
+  }
+
+  // a volume in which the first half is a single value and the rest varies
+  template<typename T>
+  std::vector<T> half_constant(const UINT64VECTOR3& vSize,
+                               uint64_t iComponentCount, T constant) {
+    std::vector<T> data(vSize.volume()*iComponentCount);
+    for(size_t i=0; i < data.size(); ++i) {
+      const size_t voxel = i / size_t(iComponentCount);
+      data[i] = (voxel < data.size()/(2*iComponentCount)) ?
+        T(constant + T(i % iComponentCount)) :
+        T(voxel % 97 + i % iComponentCount);
+    }
+    return data;
+  }
+
+  // a smooth ramp with a little noise, i.e. data the pre-filters are made for
+  template<typename T>
+  std::vector<T> noisy_ramp(const UINT64VECTOR3& vSize,
+                            uint64_t iComponentCount) {
+    std::vector<T> data(vSize.volume()*iComponentCount);
+    size_t i = 0;
+    for(uint64_t z=0; z < vSize.z; ++z)
+    for(uint64_t y=0; y < vSize.y; ++y)
+    for(uint64_t x=0; x < vSize.x; ++x)
+    for(uint64_t c=0; c < iComponentCount; ++c, ++i) {
+      const uint32_t noise = (uint32_t(i) * 2654435761U) >> 29;
+      data[i] = T(x + 3*y + 5*z + 7*c + noise);
+    }
+    return data;
+  }
+
+  template<typename T>
+  void prefilter_roundtrip(ExtendedOctree::COMPONENT_TYPE ct,
+                           uint64_t iComponentCount) {
+    const UINT64VECTOR3 vSize(29, 23, 19);
+    const std::vector<T> data = noisy_ramp<T>(vSize, iComponentCount);
+    const std::string raw = write_raw(data);
+
+    for(int pf=PF_NONE; pf < PF_UNKNOWN; ++pf) {
+      // odd brick sizes, so the shuffles see incomplete groups at the end
+      convert_opts opts;
+      opts.vBrickSize = UINT64VECTOR3(13, 11, 9);
+      opts.ePreFilter = PREFILTER_TYPE(pf);
+      const std::string oct = convert(raw, ct, iComponentCount, vSize, opts);
+
+      ExtendedOctree tree;
+      TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+      uint64_t filtered = 0;
+      for(size_t i=0; i < size_t(tree.GetBrickCount(0).volume()); ++i) {
+        const TOCEntry& toc = tree.GetBrickToCData(i);
+        TS_ASSERT(toc.m_ePreFilter == PF_NONE || toc.m_ePreFilter == pf);
+        if(toc.m_ePreFilter != PF_NONE) { ++filtered; }
+      }
+      if(pf != PF_NONE) { TS_ASSERT_LESS_THAN(0U, filtered); }
+      check_lod0(tree, data, iComponentCount, vSize);
+      tree.Close();
+      std::remove(oct.c_str());
+    }
+    std::remove(raw.c_str());
+  }
+
+  template<typename T>
+  void constant_bricks(ExtendedOctree::COMPONENT_TYPE ct,
+                       uint64_t iComponentCount, T constant) {
+    const UINT64VECTOR3 vSize(51, 43, 67);
+    const std::vector<T> data = half_constant(vSize, iComponentCount, constant);
+    const std::string raw = write_raw(data);
+    const std::string oct = convert(raw, ct, iComponentCount, vSize);
+
+    ExtendedOctree tree;
+    TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+    const UINT64VECTOR3 bc = tree.GetBrickCount(0);
+    uint64_t constants = 0;
+    for(uint64_t i=0; i < bc.volume(); ++i) {
+      const UINT64VECTOR4 k(i%bc.x, (i/bc.x)%bc.y, i/(bc.x*bc.y), 0);
+      if(tree.IsConstantBrick(k)) { ++constants; }
+    }
+    TS_ASSERT_LESS_THAN(0U, constants);
+    TS_ASSERT_LESS_THAN(constants, bc.volume());
+    check_lod0(tree, data, iComponentCount, vSize);
+    tree.Close();
+
+    std::remove(raw.c_str());
+    std::remove(oct.c_str());
+  }
+}
+
+// constant bricks are stored in the ToC only, but must come back with
+// exactly the value that went in, for any type that fits into the ToC
+void tconstant_bricks() {
+  constant_bricks<uint8_t>(ExtendedOctree::CT_UINT8, 1, 42);
+  constant_bricks<int16_t>(ExtendedOctree::CT_INT16, 1, -1234);
+  constant_bricks<uint16_t>(ExtendedOctree::CT_UINT16, 3, 4711);
+  constant_bricks<uint32_t>(ExtendedOctree::CT_UINT32, 2, 0xDEADBEEF);
+  constant_bricks<float>(ExtendedOctree::CT_FLOAT32, 1, 1.5f);
+  constant_bricks<double>(ExtendedOctree::CT_FLOAT64, 1, -0.25);
+}
+
+// every pre-filter must be undone exactly by its inverse, independent of
+// whether the size is a multiple of the element or group size
+void tprefilter_functions() {
+  const size_t sizes[] = {1, 2, 4, 8};
+  const UINT64VECTOR3 vBrickSize(7, 5, 3);
+  for(size_t s=0; s < sizeof(sizes)/sizeof(sizes[0]); ++s) {
+    for(size_t comps=1; comps <= 3; ++comps) {
+      const size_t iSize = size_t(vBrickSize.volume()) * comps * sizes[s];
+      std::vector<uint8_t> src(iSize), filtered(iSize), reverted(iSize);
+      for(size_t i=0; i < iSize; ++i) {
+        src[i] = uint8_t((i * 2654435761U) >> 24);
+      }
+
+      byteShuffle(&src[0], &filtered[0], iSize, sizes[s]);
+      byteUnshuffle(&filtered[0], &reverted[0], iSize, sizes[s]);
+      TS_ASSERT(src == reverted);
+
+      bitShuffle(&src[0], &filtered[0], iSize, sizes[s]);
+      bitUnshuffle(&filtered[0], &reverted[0], iSize, sizes[s]);
+      TS_ASSERT(src == reverted);
+
+      delta3DEncode(&src[0], &filtered[0], vBrickSize, sizes[s], comps);
+      delta3DDecode(&filtered[0], &reverted[0], vBrickSize, sizes[s], comps);
+      TS_ASSERT(src == reverted);
+    }
+  }
+}
+
+// filter -> compress -> decompress -> revert must reproduce the input for
+// every filter and component type
+void tprefilter_roundtrip() {
+  prefilter_roundtrip<uint8_t>(ExtendedOctree::CT_UINT8, 1);
+  prefilter_roundtrip<int8_t>(ExtendedOctree::CT_INT8, 1);
+  prefilter_roundtrip<uint16_t>(ExtendedOctree::CT_UINT16, 1);
+  prefilter_roundtrip<int16_t>(ExtendedOctree::CT_INT16, 3);
+  prefilter_roundtrip<uint32_t>(ExtendedOctree::CT_UINT32, 1);
+  prefilter_roundtrip<int32_t>(ExtendedOctree::CT_INT32, 1);
+  prefilter_roundtrip<uint64_t>(ExtendedOctree::CT_UINT64, 1);
+  prefilter_roundtrip<int64_t>(ExtendedOctree::CT_INT64, 1);
+  prefilter_roundtrip<float>(ExtendedOctree::CT_FLOAT32, 2);
+  prefilter_roundtrip<double>(ExtendedOctree::CT_FLOAT64, 1);
+}
+
+// zstd has to reproduce its input for any size, including incompressible
+// data and sizes that are not a multiple of anything
+void tzstd_functions() {
+  const size_t sizes[] = {1, 7, 4096, 65537};
+  const uint32_t levels[] = {0, 1, 19, 100};
+  for(size_t s=0; s < sizeof(sizes)/sizeof(sizes[0]); ++s) {
+    for(size_t l=0; l < sizeof(levels)/sizeof(levels[0]); ++l) {
+      for(int noise=0; noise < 2; ++noise) {
+        std::shared_ptr<uint8_t> src(new uint8_t[sizes[s]],
+                                     nonstd::DeleteArray<uint8_t>());
+        for(size_t i=0; i < sizes[s]; ++i) {
+          src.get()[i] = noise ? uint8_t((i * 2654435761U) >> 24)
+                               : uint8_t(i / 64);
+        }
+        std::shared_ptr<uint8_t> compressed;
+        const size_t iCompressed = zstdCompress(src, sizes[s], compressed,
+                                                levels[l]);
+        std::shared_ptr<uint8_t> dst(new uint8_t[sizes[s]],
+                                     nonstd::DeleteArray<uint8_t>());
+        zstdDecompress(compressed, iCompressed, dst, sizes[s]);
+        TS_ASSERT(std::equal(src.get(), src.get()+sizes[s], dst.get()));
+      }
+    }
+  }
+}
+
+// a ZSTD compressed tree must hold exactly the same bricks, on every level,
+// as an uncompressed one
+template<typename T>
+static void zstd_tree(ExtendedOctree::COMPONENT_TYPE ct,
+                      uint64_t iComponentCount, uint32_t iLevel) {
+  const UINT64VECTOR3 vSize(40, 33, 27);
+  const std::vector<T> data = noisy_ramp<T>(vSize, iComponentCount);
+  const std::string raw = write_raw(data);
+
+  convert_opts opts;
+  opts.eCompression = CT_NONE;
+  const std::string ref = convert(raw, ct, iComponentCount, vSize, opts);
+  opts.eCompression = CT_ZSTD;
+  opts.iLevel = iLevel;
+  const std::string oct = convert(raw, ct, iComponentCount, vSize, opts);
+
+  ExtendedOctree reference, tree;
+  TS_ASSERT(reference.Open(ref, 0, UVFVERSION));
+  TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+  uint64_t zstd = 0;
+  for(size_t i=0; i < size_t(tree.GetBrickCount(0).volume()); ++i) {
+    if(tree.GetBrickToCData(i).m_eCompression == CT_ZSTD) { ++zstd; }
+  }
+  TS_ASSERT_LESS_THAN(0U, zstd);
+  check_lod0(tree, data, iComponentCount, vSize);
+  check_trees_equal(reference, tree);
+  reference.Close();
+  tree.Close();
+
+  std::remove(raw.c_str());
+  std::remove(ref.c_str());
+  std::remove(oct.c_str());
+}
+
+void tzstd_roundtrip() {
+  zstd_tree<uint8_t>(ExtendedOctree::CT_UINT8, 1, 0);
+  zstd_tree<uint16_t>(ExtendedOctree::CT_UINT16, 1, 1);
+  zstd_tree<int16_t>(ExtendedOctree::CT_INT16, 3, 9);
+  zstd_tree<float>(ExtendedOctree::CT_FLOAT32, 1, 19);
+  zstd_tree<double>(ExtendedOctree::CT_FLOAT64, 2, 3);
+}
+
+// adaptive compression picks a codec per brick, but what ends up in the ToC
+// must always be a concrete codec the reader can decode
+void tadaptive_concrete_codecs() {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  std::vector<uint16_t> data = noisy_ramp<uint16_t>(vSize, 1);
+  // some incompressible noise, so not every brick ends up with one codec
+  for(size_t i=data.size()/2; i < data.size(); ++i) {
+    data[i] = uint16_t((i * 2654435761U) >> 16);
+  }
+  const std::string raw = write_raw(data);
+
+  convert_opts opts;
+  typedef ExtendedOctreeConverter::AdaptiveCandidate candidate;
+  opts.vAdaptive.push_back(candidate(CT_LZ4, 0));
+  opts.vAdaptive.push_back(candidate(CT_ZSTD, 9));
+  opts.vAdaptive.push_back(candidate(CT_ZLIB, 9));
+  const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize,
+                                  opts);
+
+  ExtendedOctree tree;
+  TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+  uint64_t iBricks = 0;
+  for(uint64_t lod=0; lod < tree.GetLODCount(); ++lod) {
+    iBricks += tree.GetBrickCount(lod).volume();
+  }
+  for(size_t i=0; i < size_t(iBricks); ++i) {
+    const COMPRESSION_TYPE ct = tree.GetBrickToCData(i).m_eCompression;
+    TS_ASSERT(ct == CT_NONE || ct == CT_CONSTANT || ct == CT_LZ4 ||
+              ct == CT_ZSTD || ct == CT_ZLIB);
+  }
+  check_lod0(tree, data, 1, vSize);
+  tree.Close();
+  std::remove(oct.c_str());
+
+  // no decoder is that fast, however coarse the clock: every brick has to
+  // end up uncompressed
+  opts.fMinDecodeThroughput = 1e12;
+  const std::string slow = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize,
+                                   opts);
+  TS_ASSERT(tree.Open(slow, 0, UVFVERSION));
+  for(size_t i=0; i < size_t(iBricks); ++i) {
+    const COMPRESSION_TYPE ct = tree.GetBrickToCData(i).m_eCompression;
+    TS_ASSERT(ct == CT_NONE || ct == CT_CONSTANT);
+  }
+  check_lod0(tree, data, 1, vSize);
+  tree.Close();
+
+  std::remove(raw.c_str());
+  std::remove(slow.c_str());
+}
+
+// sums the bricks of all inputs, the values in the tests never overflow
+static bool sum_bricks(const std::vector<const uint8_t*>& vInput,
+                       uint8_t* pOutput, uint64_t iValueCount, void*) {
+  uint16_t* out = reinterpret_cast<uint16_t*>(pOutput);
+  std::fill(out, out+iValueCount, uint16_t(0));
+  for(size_t t=0; t < vInput.size(); ++t) {
+    const uint16_t* in = reinterpret_cast<const uint16_t*>(vInput[t]);
+    for(uint64_t i=0; i < iValueCount; ++i) { out[i] += in[i]; }
+  }
+  return true;
+}
+
+// merging in brick space must give the same tree, coarse levels included,
+// as converting the merged data, with any filter and layout
+static void merge_tree(const convert_opts& opts) {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  const std::vector<uint16_t> a = noisy_ramp<uint16_t>(vSize, 1);
+  std::vector<uint16_t> b(a.size()), sum(a.size());
+  for(size_t i=0; i < b.size(); ++i) {
+    // odd values, so averaging the inputs separately would round differently
+    b[i] = uint16_t(((i * 2654435761U) >> 22) | 1);
+    sum[i] = uint16_t(a[i] + b[i]);
+  }
+  const std::string rawA = write_raw(a);
+  const std::string rawB = write_raw(b);
+  const std::string rawSum = write_raw(sum);
+  const std::string octA = convert(rawA, ExtendedOctree::CT_UINT16, 1, vSize,
+                                   opts);
+  const std::string octB = convert(rawB, ExtendedOctree::CT_UINT16, 1, vSize,
+                                   opts);
+  const std::string ref = convert(rawSum, ExtendedOctree::CT_UINT16, 1, vSize,
+                                  opts);
+
+  ExtendedOctree treeA, treeB;
+  TS_ASSERT(treeA.Open(octA, 0, UVFVERSION));
+  TS_ASSERT(treeB.Open(octB, 0, UVFVERSION));
+  std::vector<const ExtendedOctree*> vTrees;
+  vTrees.push_back(&treeA);
+  vTrees.push_back(&treeB);
+
+  std::ofstream ofs;
+  const std::string merged = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+  ofs.close();
+  {
+    LargeRAWFile_ptr out(new LargeRAWFile(merged));
+    TS_ASSERT(out->Create());
+    BrickStatVec stats;
+    ExtendedOctreeConverter conv(opts.vBrickSize, opts.iOverlap, 1<<24,
+                                 Controller::Debug::Out());
+    TS_ASSERT(conv.Merge(vTrees, sum_bricks, NULL, out, 0, &stats,
+                         opts.eCompression, opts.iLevel, opts.bMedian,
+                         opts.bClamp, opts.eLayout));
+    out->Close();
+  }
+  treeA.Close();
+  treeB.Close();
+
+  ExtendedOctree reference, tree;
+  TS_ASSERT(reference.Open(ref, 0, UVFVERSION));
+  TS_ASSERT(tree.Open(merged, 0, UVFVERSION));
+  if(!opts.bClamp) { check_lod0(tree, sum, 1, vSize); }
+  check_trees_equal(reference, tree);
+  reference.Close();
+  tree.Close();
+
+  const std::string files[] = {rawA, rawB, rawSum, octA, octB, ref, merged};
+  for(size_t i=0; i < sizeof(files)/sizeof(files[0]); ++i) {
+    std::remove(files[i].c_str());
+  }
+}
+
+void tmerge_matches_conversion() {
+  convert_opts opts;
+  merge_tree(opts);
+  opts.bMedian = true;
+  opts.bClamp = true;
+  merge_tree(opts);
+  opts.eLayout = LT_HILBERT;
+  merge_tree(opts);
+  opts.eLayout = LT_LOD_INTERLEAVED;
+  opts.eCompression = CT_NONE;
+  merge_tree(opts);
+}
+
+// assembles a LoD from the cores of its bricks, one brick at a time
+static std::vector<uint8_t> lod_from_bricks(const ExtendedOctree& tree,
+                                            uint64_t lod) {
+  const UINT64VECTOR3 vSize = tree.GetLoDSize(lod);
+  const UINT64VECTOR3 bc = tree.GetBrickCount(lod);
+  const UINT64VECTOR3 bs(tree.GetMaxBrickSize());
+  const uint64_t ov = tree.GetOverlap();
+  const size_t voxel = size_t(tree.GetComponentTypeSize() *
+                              tree.GetComponentCount());
+  std::vector<uint8_t> volume(size_t(vSize.volume())*voxel);
+  std::vector<uint8_t> brick(size_t(bs.volume())*voxel);
+  for(uint64_t i=0; i < bc.volume(); ++i) {
+    const UINT64VECTOR4 k(i%bc.x, (i/bc.x)%bc.y, i/(bc.x*bc.y), lod);
+    const UINT64VECTOR3 sz = tree.ComputeBrickSize(k);
+    tree.GetBrickData(&brick[0], k);
+    for(uint64_t z=0; z < sz.z-2*ov; ++z)
+    for(uint64_t y=0; y < sz.y-2*ov; ++y) {
+      const uint64_t gx = k.x*(bs.x-2*ov);
+      const uint64_t gy = k.y*(bs.y-2*ov) + y;
+      const uint64_t gz = k.z*(bs.z-2*ov) + z;
+      std::copy(&brick[size_t(((z+ov)*sz.y + y+ov)*sz.x + ov)*voxel],
+                &brick[size_t(((z+ov)*sz.y + y+ov)*sz.x + sz.x-ov)*voxel],
+                &volume[size_t((gz*vSize.y + gy)*vSize.x + gx)*voxel]);
+    }
+  }
+  return volume;
+}
+
+// the slab export has to produce the same file as assembling the bricks
+// one by one, for any slab budget: a single brick, part of a brick row,
+// a few rows or the whole level at once
+void texport_slabs() {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  const std::vector<uint16_t> data = noisy_ramp<uint16_t>(vSize, 2);
+  const std::string raw = write_raw(data);
+  const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 2, vSize);
+
+  ExtendedOctree tree;
+  TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+  // the core of a brick and a row of brick cores along x, 2 x 16 bit each
+  const uint64_t iBrickBytes = 12*12*12*4;
+  const uint64_t iRowBytes = 12*12*45*4;
+  const uint64_t budgets[] = {1, 2*iBrickBytes, 2*iRowBytes,
+                              uint64_t(256)*1024*1024};
+  const uint64_t iOffset = 13;
+  for(uint64_t lod=0; lod < tree.GetLODCount(); ++lod) {
+    const std::vector<uint8_t> expected = lod_from_bricks(tree, lod);
+    for(size_t b=0; b < sizeof(budgets)/sizeof(budgets[0]); ++b) {
+      std::ofstream ofs;
+      const std::string fn = mk_tmpfile(ofs, std::ios::out|std::ios::binary);
+      ofs.close();
+      {
+        LargeRAWFile_ptr out(new LargeRAWFile(fn));
+        TS_ASSERT(out->Create(iOffset + expected.size()));
+        TS_ASSERT(ExtendedOctreeConverter::ExportToRAW(tree, out, lod,
+                                                       iOffset, budgets[b]));
+        out->Close();
+      }
+      std::ifstream ifs(fn.c_str(), std::ios::in | std::ios::binary);
+      std::vector<uint8_t> exported(expected.size());
+      ifs.seekg(std::streamoff(iOffset));
+      ifs.read(reinterpret_cast<char*>(&exported[0]),
+               std::streamsize(exported.size()));
+      TS_ASSERT(ifs.good());
+      TS_ASSERT(exported == expected);
+      ifs.close();
+      std::remove(fn.c_str());
+    }
+  }
+  // level 0 is the input itself
+  TS_ASSERT(lod_from_bricks(tree, 0) ==
+            std::vector<uint8_t>(reinterpret_cast<const uint8_t*>(&data[0]),
+                                 reinterpret_cast<const uint8_t*>(&data[0]) +
+                                 data.size()*sizeof(uint16_t)));
+  tree.Close();
+
+  std::remove(raw.c_str());
+  std::remove(oct.c_str());
+}
+
+// cropping in brick space must give the same tree, coarse levels and
+// brick statistics included, as converting the cropped data
+static void crop_tree(const PLANE<float>& plane, const convert_opts& opts) {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  std::vector<uint16_t> data = noisy_ramp<uint16_t>(vSize, 1);
+  // a constant corner, so some copied bricks are constant bricks
+  for(size_t i=0; i < data.size()/4; ++i) { data[i] = 17; }
+  std::vector<uint16_t> cropped(data);
+  for(uint64_t z=0; z < vSize.z; ++z)
+  for(uint64_t y=0; y < vSize.y; ++y)
+  for(uint64_t x=0; x < vSize.x; ++x) {
+    const FLOATVECTOR3 p(float(x)/float(vSize.x) - 0.5f,
+                         float(y)/float(vSize.y) - 0.5f,
+                         float(z)/float(vSize.z) - 0.5f);
+    if(plane.clip(p)) { cropped[size_t((z*vSize.y + y)*vSize.x + x)] = 0; }
+  }
+  const std::string raw = write_raw(data);
+  const std::string rawCropped = write_raw(cropped);
+  BrickStatVec inStats, refStats, stats;
+  const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize,
+                                  opts, &inStats);
+  const std::string ref = convert(rawCropped, ExtendedOctree::CT_UINT16, 1,
+                                  vSize, opts, &refStats);
+
+  ExtendedOctree tree;
+  TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+  std::ofstream ofs;
+  const std::string fn = mk_tmpfile(ofs, std::ios::out | std::ios::binary);
+  ofs.close();
+  {
+    LargeRAWFile_ptr out(new LargeRAWFile(fn));
+    TS_ASSERT(out->Create());
+    ExtendedOctreeConverter conv(opts.vBrickSize, opts.iOverlap, 1<<24,
+                                 Controller::Debug::Out());
+    TS_ASSERT(conv.Crop(tree, plane, out, 0, &stats, &inStats,
+                        opts.eCompression, opts.bMedian, opts.bClamp));
+    out->Close();
+  }
+  tree.Close();
+
+  ExtendedOctree reference, result;
+  TS_ASSERT(reference.Open(ref, 0, UVFVERSION));
+  TS_ASSERT(result.Open(fn, 0, UVFVERSION));
+  if(!opts.bClamp) { check_lod0(result, cropped, 1, vSize); }
+  check_trees_equal(reference, result);
+  TS_ASSERT_EQUALS(stats.size(), refStats.size());
+  for(size_t i=0; i < std::min(stats.size(), refStats.size()); ++i) {
+    TS_ASSERT_EQUALS(stats[i].minScalar, refStats[i].minScalar);
+    TS_ASSERT_EQUALS(stats[i].maxScalar, refStats[i].maxScalar);
+  }
+  reference.Close();
+  result.Close();
+
+  const std::string files[] = {raw, rawCropped, oct, ref, fn};
+  for(size_t i=0; i < sizeof(files)/sizeof(files[0]); ++i) {
+    std::remove(files[i].c_str());
+  }
+}
+
+void tcrop_matches_conversion() {
+  // axis aligned, oblique, nothing and everything clipped
+  const PLANE<float> planes[] = {
+    PLANE<float>(1, 0, 0, -0.1f),
+    PLANE<float>(0.3f, -0.7f, 0.5f, 0.05f),
+    PLANE<float>(0, 0, 1, -1),
+    PLANE<float>(0, 1, 0, 1)
+  };
+  for(size_t i=0; i < sizeof(planes)/sizeof(planes[0]); ++i) {
+    convert_opts opts;
+    crop_tree(planes[i], opts);
+    opts.bMedian = true;
+    opts.bClamp = true;
+    crop_tree(planes[i], opts);
+  }
+}
+
+// replacing level 0 bricks in place has to give the same tree, coarse
+// levels and brick statistics included, as converting the edited data; the
+// file has to reopen with the new data
+static void update_tree(const convert_opts& opts) {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  const std::vector<uint16_t> data = noisy_ramp<uint16_t>(vSize, 1);
+  // noise in a box, its bricks no longer fit into their old slots
+  std::vector<uint16_t> edited(data);
+  for(uint64_t z=5; z < 20; ++z)
+  for(uint64_t y=10; y < 17; ++y)
+  for(uint64_t x=20; x < 41; ++x) {
+    const size_t i = size_t((z*vSize.y + y)*vSize.x + x);
+    edited[i] = uint16_t((i * 2654435761U) >> 16);
+  }
+  const std::string raw = write_raw(data);
+  const std::string rawEdited = write_raw(edited);
+  BrickStatVec stats, refStats;
+  const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize,
+                                  opts, &stats);
+  const std::string ref = convert(rawEdited, ExtendedOctree::CT_UINT16, 1,
+                                  vSize, opts, &refStats);
+
+  ExtendedOctree tree, reference;
+  TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+  TS_ASSERT(reference.Open(ref, 0, UVFVERSION));
+  // every brick that changed, be it in its core or in its overlap only
+  std::vector<UINT64VECTOR4> vCoords;
+  std::vector<std::shared_ptr<uint8_t>> vData;
+  const UINT64VECTOR3 bc = tree.GetBrickCount(0);
+  const size_t iMaxBytes = size_t(tree.GetMaxBrickSize().volume()*2);
+  std::vector<uint8_t> old(iMaxBytes);
+  for(uint64_t i=0; i < bc.volume(); ++i) {
+    const UINT64VECTOR4 k(i%bc.x, (i/bc.x)%bc.y, i/(bc.x*bc.y), 0);
+    std::shared_ptr<uint8_t> brick(new uint8_t[iMaxBytes],
+                                   nonstd::DeleteArray<uint8_t>());
+    tree.GetBrickData(&old[0], k);
+    reference.GetBrickData(brick.get(), k);
+    if(!std::equal(old.begin(), old.begin()+brick_bytes(tree, k),
+                   brick.get())) {
+      vCoords.push_back(k);
+      vData.push_back(brick);
+    }
+  }
+  TS_ASSERT_LESS_THAN(0U, vCoords.size());
+  TS_ASSERT_LESS_THAN(vCoords.size(), size_t(bc.volume()));
+
+  std::vector<uint64_t> vUpdated;
+  {
+    ExtendedOctreeConverter conv(opts.vBrickSize, opts.iOverlap, 1<<24,
+                                 Controller::Debug::Out());
+    TS_ASSERT(conv.UpdateBricks(tree, vCoords, vData, &stats, &vUpdated,
+                                opts.eCompression, opts.bMedian,
+                                opts.bClamp));
+  }
+  TS_ASSERT_LESS_THAN(vCoords.size(), vUpdated.size());
+  tree.Close();
+
+  ExtendedOctree result;
+  TS_ASSERT(result.Open(oct, 0, UVFVERSION));
+  if(!opts.bClamp) { check_lod0(result, edited, 1, vSize); }
+  check_trees_equal(reference, result);
+  TS_ASSERT_EQUALS(stats.size(), refStats.size());
+  for(size_t i=0; i < std::min(stats.size(), refStats.size()); ++i) {
+    TS_ASSERT_EQUALS(stats[i].minScalar, refStats[i].minScalar);
+    TS_ASSERT_EQUALS(stats[i].maxScalar, refStats[i].maxScalar);
+  }
+  result.Close();
+  reference.Close();
+
+  // trees followed by other data, e.g. inside of a UVF, are updated in
+  // place only. Uncompressed bricks keep their size, the compressed noise
+  // does not fit and the update has to leave the file untouched.
+  const std::string embedded = convert(raw, ExtendedOctree::CT_UINT16, 1,
+                                       vSize, opts);
+  {
+    std::ofstream app(embedded.c_str(), std::ios::out | std::ios::binary |
+                                        std::ios::app);
+    app << "trailing block";
+  }
+  const std::vector<char> before = read_file(embedded);
+  TS_ASSERT(result.Open(embedded, 0, UVFVERSION));
+  {
+    ExtendedOctreeConverter conv(opts.vBrickSize, opts.iOverlap, 1<<24,
+                                 Controller::Debug::Out());
+    const bool bFits = opts.eCompression == CT_NONE;
+    TS_ASSERT_EQUALS(conv.UpdateBricks(result, vCoords, vData, NULL, NULL,
+                                       opts.eCompression, opts.bMedian,
+                                       opts.bClamp), bFits);
+    result.Close();
+    const std::vector<char> after = read_file(embedded);
+    TS_ASSERT_EQUALS(after.size(), before.size());
+    if(bFits) {
+      const std::string tail("trailing block");
+      TS_ASSERT(std::equal(tail.begin(), tail.end(), after.end()-tail.size()));
+      TS_ASSERT(result.Open(embedded, 0, UVFVERSION));
+      TS_ASSERT(reference.Open(ref, 0, UVFVERSION));
+      check_trees_equal(reference, result);
+      reference.Close();
+      result.Close();
+    } else {
+      TS_ASSERT(after == before);
+    }
+  }
+  std::remove(embedded.c_str());
+
+  const std::string files[] = {raw, rawEdited, oct, ref};
+  for(size_t i=0; i < sizeof(files)/sizeof(files[0]); ++i) {
+    std::remove(files[i].c_str());
+  }
+}
+
+void tupdate_matches_conversion() {
+  convert_opts opts;
+  update_tree(opts);
+  opts.bMedian = true;
+  opts.bClamp = true;
+  update_tree(opts);
+  opts.eCompression = CT_NONE;
+  update_tree(opts);
+}
+
+// collects the byte range and the payload size of a brick and all bricks
+// below it; returns false if a brick precedes its parent in the file
+static bool subtree_range(const ExtendedOctree& tree, const UINT64VECTOR4& k,
+                          uint64_t& iBegin, uint64_t& iEnd,
+                          uint64_t& iBytes) {
+  const TOCEntry& t = tree.GetBrickToCData(k);
+  bool bOrdered = true;
+  if(t.m_iLength > 0) {
+    iBegin = std::min(iBegin, t.m_iOffset);
+    iEnd = std::max(iEnd, t.m_iOffset + t.m_iLength);
+    iBytes += t.m_iLength;
+  }
+  if(k.w == 0) { return bOrdered; }
+  const UINT64VECTOR3 bc = tree.GetBrickCount(k.w-1);
+  for(uint64_t z=k.z*2; z < std::min(k.z*2+2, bc.z); ++z)
+  for(uint64_t y=k.y*2; y < std::min(k.y*2+2, bc.y); ++y)
+  for(uint64_t x=k.x*2; x < std::min(k.x*2+2, bc.x); ++x) {
+    const UINT64VECTOR4 child(x, y, z, k.w-1);
+    const TOCEntry& c = tree.GetBrickToCData(child);
+    if(t.m_iLength > 0 && c.m_iLength > 0 && c.m_iOffset < t.m_iOffset) {
+      bOrdered = false;
+    }
+    bOrdered = subtree_range(tree, child, iBegin, iEnd, iBytes) && bOrdered;
+  }
+  return bOrdered;
+}
+
+// every layout only moves bricks around, the data must stay the same; the
+// LoD-interleaved layout must store each subtree in one contiguous range
+void tlayout_roundtrip() {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  const std::vector<uint16_t> data = noisy_ramp<uint16_t>(vSize, 1);
+  const std::string raw = write_raw(data);
+  convert_opts opts;
+  // small bricks, so the tree is a few levels deep
+  opts.vBrickSize = UINT64VECTOR3(8, 8, 8);
+  opts.iOverlap = 1;
+  const std::string ref = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize,
+                                  opts);
+  ExtendedOctree reference;
+  TS_ASSERT(reference.Open(ref, 0, UVFVERSION));
+
+  for(int lt=LT_SCANLINE+1; lt < LT_UNKNOWN; ++lt) {
+    opts.eLayout = LAYOUT_TYPE(lt);
+    const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize,
+                                    opts);
+    ExtendedOctree tree;
+    TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+    check_lod0(tree, data, 1, vSize);
+    check_trees_equal(reference, tree);
+
+    if(opts.eLayout == LT_LOD_INTERLEAVED) {
+      TS_ASSERT_LESS_THAN(2U, tree.GetLODCount());
+      for(uint64_t lod=1; lod < tree.GetLODCount(); ++lod) {
+        const UINT64VECTOR3 lbc = tree.GetBrickCount(lod);
+        for(uint64_t i=0; i < lbc.volume(); ++i) {
+          const UINT64VECTOR4 k(i%lbc.x, (i/lbc.x)%lbc.y, i/(lbc.x*lbc.y), lod);
+          uint64_t iBegin = std::numeric_limits<uint64_t>::max();
+          uint64_t iEnd = 0, iBytes = 0;
+          TS_ASSERT(subtree_range(tree, k, iBegin, iEnd, iBytes));
+          if(iBytes > 0) { TS_ASSERT_EQUALS(iEnd - iBegin, iBytes); }
+        }
+      }
+    }
+    tree.Close();
+    std::remove(oct.c_str());
+  }
+  reference.Close();
+  std::remove(ref.c_str());
+  std::remove(raw.c_str());
+}
+
+// reads all bricks of the tree in one batch, in a scrambled order and with
+// one brick requested twice, and compares them to single brick reads
+static void check_batch(const ExtendedOctree& tree, uint64_t iMaxGap,
+                        uint64_t iMaxReadSize) {
+  std::vector<UINT64VECTOR4> vCoords;
+  for(uint64_t lod=0; lod < tree.GetLODCount(); ++lod) {
+    const UINT64VECTOR3 bc = tree.GetBrickCount(lod);
+    for(uint64_t i=0; i < bc.volume(); ++i) {
+      vCoords.push_back(UINT64VECTOR4(i%bc.x, (i/bc.x)%bc.y,
+                                      i/(bc.x*bc.y), lod));
+    }
+  }
+  for(size_t i=0; i < vCoords.size(); ++i) {
+    std::swap(vCoords[i], vCoords[(i * 2654435761U) % vCoords.size()]);
+  }
+  vCoords.push_back(vCoords[vCoords.size()/2]);
+
+  const size_t iMaxBytes = size_t(tree.GetMaxBrickSize().volume() *
+                                  tree.GetComponentTypeSize() *
+                                  tree.GetComponentCount());
+  std::vector<std::vector<uint8_t>> vBatch(vCoords.size(),
+                                           std::vector<uint8_t>(iMaxBytes));
+  std::vector<uint8_t*> vData;
+  for(size_t i=0; i < vBatch.size(); ++i) { vData.push_back(&vBatch[i][0]); }
+  tree.GetBrickData(vCoords, vData, iMaxGap, iMaxReadSize);
+
+  std::vector<uint8_t> single(iMaxBytes);
+  size_t mismatches = 0;
+  for(size_t i=0; i < vCoords.size(); ++i) {
+    tree.GetBrickData(&single[0], vCoords[i]);
+    if(!std::equal(single.begin(), single.begin()+brick_bytes(tree, vCoords[i]),
+                   vBatch[i].begin())) {
+      ++mismatches;
+    }
+  }
+  TS_ASSERT_EQUALS(mismatches, size_t(0));
+}
+
+// batched reads must return exactly what single brick reads return, no
+// matter how the bricks are grouped into reads: one read per brick, ranges
+// with and without gaps, reads capped below the size of a brick, and with
+// synchronous reads as well as few or many reads in flight
+void tbatched_reads() {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  const std::vector<uint16_t> data = half_constant<uint16_t>(vSize, 1, 300);
+  const std::string raw = write_raw(data);
+  const LAYOUT_TYPE layouts[] = {LT_SCANLINE, LT_HILBERT, LT_LOD_INTERLEAVED};
+  for(size_t l=0; l < sizeof(layouts)/sizeof(layouts[0]); ++l) {
+    convert_opts opts;
+    opts.vBrickSize = UINT64VECTOR3(8, 8, 8);
+    opts.iOverlap = 1;
+    opts.eLayout = layouts[l];
+    const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize,
+                                    opts);
+    const unsigned depths[] = {0, 1, 2, 4, 64};
+    for(size_t d=0; d < sizeof(depths)/sizeof(depths[0]); ++d) {
+      // the default is what IOManager::SetAsyncQueueDepth sets
+      ExtendedOctree::SetDefaultAsyncQueueDepth(depths[d]);
+      ExtendedOctree tree;
+      TS_ASSERT_EQUALS(tree.GetAsyncQueueDepth(), depths[d]);
+      TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+      check_batch(tree, 0, 1);
+      check_batch(tree, 0, 8*1024*1024);
+      check_batch(tree, 100, 4096);
+      check_batch(tree, 64*1024, 8*1024*1024);
+      check_batch(tree, std::numeric_limits<uint64_t>::max()/2,
+                  std::numeric_limits<uint64_t>::max());
+      tree.Close();
+    }
+    std::remove(oct.c_str());
+  }
+  ExtendedOctree::SetDefaultAsyncQueueDepth(64);
+  std::remove(raw.c_str());
+}
+
+// a volume made of 4x4x4 blocks of equal values, so the first coarse
+// levels are known exactly: voxel p of LoD l (l <= 2) is block(p*2^l/4)
+static uint16_t block_value(uint64_t x, uint64_t y, uint64_t z) {
+  return uint16_t((((z*97 + y)*89 + x) * 2654435761U) >> 20);
+}
+
+// every voxel of every brick of the first three LoDs, overlap edges and
+// corners included, must match the source data. Coarse bricks get their
+// overlap from their neighbours, the diagonal ones included, so the volume
+// is not brick aligned and LoD 1 has two bricks along each axis.
+void tconvert_overlap() {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  std::vector<uint16_t> data(size_t(vSize.volume()));
+  for(uint64_t z=0; z < vSize.z; ++z)
+  for(uint64_t y=0; y < vSize.y; ++y)
+  for(uint64_t x=0; x < vSize.x; ++x) {
+    data[size_t((z*vSize.y + y)*vSize.x + x)] = block_value(x/4, y/4, z/4);
+  }
+  const std::string raw = write_raw(data);
+  const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize);
+
+  ExtendedOctree tree;
+  TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+  TS_ASSERT(tree.GetLODCount() > 2);
+  TS_ASSERT_EQUALS(tree.GetBrickCount(1), UINT64VECTOR3(2, 2, 2));
+  const UINT64VECTOR3 bs(tree.GetMaxBrickSize());
+  const int64_t ov = int64_t(tree.GetOverlap());
+  std::vector<uint16_t> brick(size_t(bs.volume()));
+  for(uint64_t lod=0; lod < std::min<uint64_t>(3, tree.GetLODCount()); ++lod) {
+    const UINT64VECTOR3 vLoDSize = tree.GetLoDSize(lod);
+    const UINT64VECTOR3 bc = tree.GetBrickCount(lod);
+    size_t mismatches = 0;
+    for(uint64_t i=0; i < bc.volume(); ++i) {
+      const UINT64VECTOR4 k(i%bc.x, (i/bc.x)%bc.y, i/(bc.x*bc.y), lod);
+      const UINT64VECTOR3 sz = tree.ComputeBrickSize(k);
+      tree.GetBrickData(reinterpret_cast<uint8_t*>(&brick[0]), k);
+      for(uint64_t z=0; z < sz.z; ++z)
+      for(uint64_t y=0; y < sz.y; ++y)
+      for(uint64_t x=0; x < sz.x; ++x) {
+        const int64_t g[3] = {
+          int64_t(k.x*(bs.x-2*ov)+x) - ov,
+          int64_t(k.y*(bs.y-2*ov)+y) - ov,
+          int64_t(k.z*(bs.z-2*ov)+z) - ov
+        };
+        if(g[0] < 0 || g[0] >= int64_t(vLoDSize.x) ||
+           g[1] < 0 || g[1] >= int64_t(vLoDSize.y) ||
+           g[2] < 0 || g[2] >= int64_t(vLoDSize.z)) {
+          continue;
+        }
+        const uint16_t expected = block_value((uint64_t(g[0]) << lod) / 4,
+                                              (uint64_t(g[1]) << lod) / 4,
+                                              (uint64_t(g[2]) << lod) / 4);
+        if(brick[size_t((z*sz.y+y)*sz.x+x)] != expected) { ++mismatches; }
+      }
+    }
+    TS_ASSERT_EQUALS(mismatches, size_t(0));
+  }
+  tree.Close();
+  std::remove(raw.c_str());
+  std::remove(oct.c_str());
+}
+
+// the parallel ApplyFunction has to report every brick of the LoD once, with
+// its size and the position of its first non-overlap voxel (brick index
+// times brick size minus twice the overlap), for any requested overlap and
+// independent of threads and ordering.
+void tapply_function() {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  std::vector<uint16_t> data(size_t(vSize.volume()));
+  for(uint64_t z=0; z < vSize.z; ++z)
+  for(uint64_t y=0; y < vSize.y; ++y)
+  for(uint64_t x=0; x < vSize.x; ++x) {
+    data[size_t((z*vSize.y + y)*vSize.x + x)] = block_value(x/4, y/4, z/4);
+  }
+  const std::string raw = write_raw(data);
+  const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 1, vSize);
+
+  ExtendedOctree tree;
+  TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+  const UINT64VECTOR3 bc = tree.GetBrickCount(0);
+  const uint64_t ov = tree.GetOverlap();
+  const UINT64VECTOR3 stride = UINT64VECTOR3(tree.GetMaxBrickSize()) - 2*ov;
+  const unsigned threads[] = { 1, 4 };
+  const uint32_t overlaps[] = { 0, 1, uint32_t(ov) };
+  for(size_t t=0; t < 2; ++t)
+  for(size_t ordered=0; ordered < 2; ++ordered)
+  for(size_t o=0; o < 3; ++o) {
+    const int64_t req = int64_t(overlaps[o]);
+    std::mutex m;
+    std::vector<uint64_t> seen;
+    size_t mismatches = 0;
+    TS_ASSERT(ExtendedOctreeConverter::ApplyFunction(tree, 0,
+      [&](void* pData, const UINT64VECTOR3& vBrickSize,
+          const UINT64VECTOR3& vOffset) {
+        std::lock_guard<std::mutex> lock(m);
+        const UINT64VECTOR3 k = vOffset / stride;
+        const uint64_t i = (k.z*bc.y + k.y)*bc.x + k.x;
+        seen.push_back(i);
+        if(k*stride != vOffset || i >= bc.volume()) { ++mismatches; return true; }
+        const UINT64VECTOR3 sz = tree.ComputeBrickSize(UINT64VECTOR4(k, 0)) -
+                                 2*(ov-uint64_t(req));
+        if(sz != vBrickSize) { ++mismatches; return true; }
+        const uint16_t* brick = static_cast<const uint16_t*>(pData);
+        for(uint64_t z=0; z < sz.z; ++z)
+        for(uint64_t y=0; y < sz.y; ++y)
+        for(uint64_t x=0; x < sz.x; ++x) {
+          const int64_t g[3] = { int64_t(vOffset.x+x) - req,
+                                 int64_t(vOffset.y+y) - req,
+                                 int64_t(vOffset.z+z) - req };
+          if(g[0] < 0 || g[0] >= int64_t(vSize.x) ||
+             g[1] < 0 || g[1] >= int64_t(vSize.y) ||
+             g[2] < 0 || g[2] >= int64_t(vSize.z)) {
+            continue;
+          }
+          if(brick[size_t((z*sz.y+y)*sz.x+x)] !=
+             block_value(uint64_t(g[0])/4, uint64_t(g[1])/4, uint64_t(g[2])/4)) {
+            ++mismatches;
+          }
+        }
+        return true;
+      }, uint32_t(req), threads[t], ordered != 0));
+    TS_ASSERT_EQUALS(mismatches, size_t(0));
+    TS_ASSERT_EQUALS(seen.size(), size_t(bc.volume()));
+    if(!ordered) { std::sort(seen.begin(), seen.end()); }
+    for(size_t i=0; i < seen.size(); ++i) {
+      TS_ASSERT_EQUALS(seen[i], uint64_t(i));
+    }
+  }
+  tree.Close();
+  std::remove(raw.c_str());
+  std::remove(oct.c_str());
+}
+
+// streaming mode only changes what stays in the page cache: the octree and
+// the brick statistics have to match those of a normal conversion
+void tstreaming_conversion() {
+  const UINT64VECTOR3 vSize(45, 39, 29);
+  const std::vector<uint16_t> data = noisy_ramp<uint16_t>(vSize, 2);
+  const std::string raw = write_raw(data);
+  const LAYOUT_TYPE layouts[] = {LT_SCANLINE, LT_LOD_INTERLEAVED};
+  for(size_t l=0; l < sizeof(layouts)/sizeof(layouts[0]); ++l) {
+    convert_opts opts;
+    opts.eLayout = layouts[l];
+    BrickStatVec refStats, stats;
+    const std::string ref = convert(raw, ExtendedOctree::CT_UINT16, 2, vSize,
+                                    opts, &refStats);
+    // what IOManager::SetStreaming switches
+    tuvok::pagecache::SetStreaming(true);
+    const std::string oct = convert(raw, ExtendedOctree::CT_UINT16, 2, vSize,
+                                    opts, &stats);
+    tuvok::pagecache::SetStreaming(false);
+
+    ExtendedOctree tree, reference;
+    TS_ASSERT(tree.Open(oct, 0, UVFVERSION));
+    TS_ASSERT(reference.Open(ref, 0, UVFVERSION));
+    check_trees_equal(reference, tree);
+    tree.Close();
+    reference.Close();
+
+    TS_ASSERT_EQUALS(stats.size(), refStats.size());
+    for(size_t i=0; i < std::min(stats.size(), refStats.size()); ++i) {
+      TS_ASSERT_EQUALS(stats[i].minScalar, refStats[i].minScalar);
+      TS_ASSERT_EQUALS(stats[i].maxScalar, refStats[i].maxScalar);
+    }
+    std::remove(oct.c_str());
+    std::remove(ref.c_str());
+  }
+  std::remove(raw.c_str());
+}
+
+class OctreeTests : public CxxTest::TestSuite {
+public:
+  void test_constant_bricks() { tconstant_bricks(); }
+  void test_prefilter_functions() { tprefilter_functions(); }
+  void test_prefilter_roundtrip() { tprefilter_roundtrip(); }
+  void test_adaptive_concrete_codecs() { tadaptive_concrete_codecs(); }
+  void test_zstd_functions() { tzstd_functions(); }
+  void test_zstd_roundtrip() { tzstd_roundtrip(); }
+  void test_merge_matches_conversion() { tmerge_matches_conversion(); }
+  void test_export_slabs() { texport_slabs(); }
+  void test_crop_matches_conversion() { tcrop_matches_conversion(); }
+  void test_update_matches_conversion() { tupdate_matches_conversion(); }
+  void test_layout_roundtrip() { tlayout_roundtrip(); }
+  void test_batched_reads() { tbatched_reads(); }
+  void test_streaming_conversion() { tstreaming_conversion(); }
+  void test_convert_overlap() { tconvert_overlap(); }
+  void test_apply_function() { tapply_function(); }
+};
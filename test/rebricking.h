@@ -1,11 +1,21 @@
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <vector>
 #include <cxxtest/TestSuite.h>
 #include "Basics/SysTools.h"
 #include "Controller/Controller.h"
 #include "DynamicBrickingDS.h"
+#include "Images/StackExporter.h"
 #include "RAWConverter.h"
+#include "TransferFunction1D.h"
 #include "uvfDataset.h"
 #include "util-test.h"
 
@@ -31,7 +41,7 @@ static void mk_uvf(const char* filename, const char* uvf) {
                                   1, false, false, false,
                                   UINT64VECTOR3(8,8,1), FLOATVECTOR3(1,1,1),
                                   "desc", "iotest", 16, 2, true, false, 0,0,
-                                  0, NULL, false);
+                                  0, 0, false, NULL, false);
 }
 
 // creates an 8x8x1 uvf test data set and returns it.
@@ -415,6 +425,144 @@ void tminmax_dynamic() {
   TS_ASSERT_DELTA(mm.maxScalar, 63.0, 0.001);
 }
 
+// MM_PRECOMPUTE reads every source brick once and computes the min/max of
+// all target bricks it holds; the results, ghost voxels included, must be
+// exactly what MM_DYNAMIC computes from the brick data.
+static void compare_minmax(std::shared_ptr<LinearIndexDataset> src,
+                           const std::array<size_t, 3>& bsize) {
+  DynamicBrickingDS pre(src, bsize, cacheBytes,
+                        DynamicBrickingDS::MM_PRECOMPUTE);
+  DynamicBrickingDS dyn(src, bsize, cacheBytes,
+                        DynamicBrickingDS::MM_DYNAMIC);
+  TS_ASSERT_EQUALS(pre.GetTotalBrickCount(), dyn.GetTotalBrickCount());
+  for(auto b=dyn.BricksBegin(); b != dyn.BricksEnd(); ++b) {
+    const MinMaxBlock p = pre.MaxMinForKey(b->first);
+    const MinMaxBlock d = dyn.MaxMinForKey(b->first);
+    TS_ASSERT_EQUALS(p.minScalar, d.minScalar);
+    TS_ASSERT_EQUALS(p.maxScalar, d.maxScalar);
+  }
+}
+
+// an octree backed UVF is processed in parallel, any other source (here the
+// UVF rebricked once more) on a single thread.
+void tminmax_precompute() {
+  // a cache directory that does not exist: the min/max are computed every
+  // time instead of being loaded from a sidecar of an earlier run
+  std::ofstream ofs;
+  const std::string tmp = mk_tmpfile(ofs, std::ios::out);
+  ofs.close();
+  std::remove(tmp.c_str());
+  DynamicBrickingDS::SetMinMaxCacheDir(tmp + ".nonexistent");
+
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  TS_ASSERT(ds->IsTOCBlock());
+  std::shared_ptr<DynamicBrickingDS> rebricked(
+    new DynamicBrickingDS(ds, {{16,16,16}}, cacheBytes)
+  );
+  const std::array<size_t, 3> bsizes[] = {
+    {{6,16,16}}, {{16,8,16}}, {{8,6,16}}
+  };
+  for(size_t i=0; i < sizeof(bsizes)/sizeof(bsizes[0]); ++i) {
+    compare_minmax(ds, bsizes[i]);
+    compare_minmax(rebricked, bsizes[i]);
+  }
+
+  // the 2 voxel wide cores see two more columns on either side
+  DynamicBrickingDS pre(ds, {{6,16,16}}, cacheBytes,
+                        DynamicBrickingDS::MM_PRECOMPUTE);
+  TS_ASSERT_DELTA(pre.MaxMinForKey(BrickKey(0,0,0)).minScalar, 0.0, 0.001);
+  TS_ASSERT_DELTA(pre.MaxMinForKey(BrickKey(0,0,0)).maxScalar, 59.0, 0.001);
+  TS_ASSERT_DELTA(pre.MaxMinForKey(BrickKey(0,0,1)).maxScalar, 61.0, 0.001);
+  DynamicBrickingDS::SetMinMaxCacheDir("");
+}
+
+namespace {
+  // where to find things in the min/max sidecar; see MMHeader and MMRecord
+  // in DynamicBrickingDS.cpp.
+  const size_t mm_version_at = 8;
+  const size_t mm_hash_at = 32;
+  const size_t mm_header_size = 72;
+  const size_t mm_record_size = 40;
+  const size_t mm_max_at = 32; // within a record
+
+  std::vector<char> slurp(const std::string& fn) {
+    std::ifstream ifs(fn.c_str(), std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(ifs),
+                             std::istreambuf_iterator<char>());
+  }
+  void spill(const std::string& fn, const std::vector<char>& d) {
+    std::ofstream ofs(fn.c_str(), std::ios::binary | std::ios::trunc);
+    ofs.write(d.data(), d.size());
+  }
+  template<typename T> void poke(std::vector<char>& d, size_t at, T v) {
+    TS_ASSERT_LESS_THAN_EQUALS(at+sizeof(T), d.size());
+    memcpy(&d[at], &v, sizeof(T));
+  }
+}
+
+// the first MM_PRECOMPUTE saves a sidecar which later ones map and use; a
+// sidecar for another source, of another version or a truncated one is
+// ignored and replaced.
+void tminmax_sidecar() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  const std::string source = ds->Filename();
+  const std::string sidecar = SysTools::GetPath(source) + "." +
+    SysTools::GetFilename(source) + ".6x16x16.minmax";
+  std::remove(sidecar.c_str());
+  const std::array<size_t, 3> bsize = {{6,16,16}};
+  const BrickKey first(0,0,0);
+
+  size_t n_bricks;
+  {
+    DynamicBrickingDS dyn(ds, bsize, cacheBytes,
+                          DynamicBrickingDS::MM_PRECOMPUTE);
+    n_bricks = dyn.GetTotalBrickCount();
+    TS_ASSERT_DELTA(dyn.MaxMinForKey(first).maxScalar, 59.0, 0.001);
+  }
+  const std::vector<char> orig = slurp(sidecar);
+  TS_ASSERT_EQUALS(orig.size(), mm_header_size + n_bricks*mm_record_size);
+
+  // the records are sorted, the first is brick (0,0,0).  If we see a value
+  // planted there, it came from the sidecar.
+  std::vector<char> d = orig;
+  poke(d, mm_header_size + mm_max_at, 1000.0);
+  spill(sidecar, d);
+  {
+    DynamicBrickingDS dyn(ds, bsize, cacheBytes,
+                          DynamicBrickingDS::MM_PRECOMPUTE);
+    TS_ASSERT_DELTA(dyn.MaxMinForKey(first).maxScalar, 1000.0, 0.001);
+    TS_ASSERT_DELTA(dyn.MaxMinForKey(BrickKey(0,0,1)).maxScalar, 61.0,
+                    0.001);
+  }
+
+  // the rest must be recomputed, and the sidecar rewritten as it was.
+  std::vector<std::vector<char>> broken;
+  d = orig; // stale source stamp
+  poke(d, mm_header_size + mm_max_at, 1000.0);
+  poke(d, mm_hash_at, uint64_t(42));
+  broken.push_back(d);
+  d = orig; // newer version
+  poke(d, mm_header_size + mm_max_at, 1000.0);
+  poke(d, mm_version_at, uint64_t(2));
+  broken.push_back(d);
+  d = orig; // last record cut short
+  poke(d, mm_header_size + mm_max_at, 1000.0);
+  d.resize(d.size() - 8);
+  broken.push_back(d);
+  d.resize(mm_header_size / 2); // not even a header
+  broken.push_back(d);
+  for(size_t i=0; i < broken.size(); ++i) {
+    spill(sidecar, broken[i]);
+    {
+      DynamicBrickingDS dyn(ds, bsize, cacheBytes,
+                            DynamicBrickingDS::MM_PRECOMPUTE);
+      TS_ASSERT_DELTA(dyn.MaxMinForKey(first).maxScalar, 59.0, 0.001);
+    }
+    TS_ASSERT(slurp(sidecar) == orig);
+  }
+  std::remove(sidecar.c_str());
+}
+
 void tcache_disable() {
   std::shared_ptr<UVFDataset> ds = mk8x8testdata();
   DynamicBrickingDS dynamic(ds, {{6,16,16}}, cacheBytes);
@@ -501,6 +649,186 @@ void tmulti_component() {
   }
 }
 
+// reads a region that spans several rebricked bricks and checks it against
+// the source array.
+void tread_region() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  DynamicBrickingDS dynamic(ds, {{6,16,16}}, cacheBytes);
+
+  const UINT64VECTOR3 offset(1,2,0);
+  const UINT64VECTOR3 size(5,4,1);
+  std::vector<uint8_t> region(size.volume());
+  TS_ASSERT(dynamic.ReadRegion(0, 0, offset, size, &region[0]));
+  for(size_t y=0; y < size[1]; ++y) {
+    for(size_t x=0; x < size[0]; ++x) {
+      TS_ASSERT_EQUALS(region[y*size[0] + x],
+                       data[y+offset[1]][x+offset[0]]);
+    }
+  }
+
+  // the region must lie within the domain
+  TS_ASSERT(!dynamic.ReadRegion(0, 0, UINT64VECTOR3(4,0,0),
+                                UINT64VECTOR3(5,1,1), &region[0]));
+}
+
+// views must see the same data GetBrick copies out, with and without cache.
+void tbrick_view() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  const size_t sizes[] = { 0, cacheBytes };
+  for(size_t i=0; i < 2; ++i) {
+    DynamicBrickingDS dynamic(ds, {{6,16,16}}, sizes[i]);
+    for(auto b=dynamic.BricksBegin(); b != dynamic.BricksEnd(); ++b) {
+      std::vector<uint8_t> copy;
+      DynamicBrickingDS::BrickView<uint8_t> view;
+      TS_ASSERT(dynamic.GetBrick(b->first, copy));
+      TS_ASSERT(dynamic.GetBrickView(b->first, view));
+      const UINTVECTOR3 bs = b->second.n_voxels;
+      TS_ASSERT_EQUALS(view.extents[0], bs[0]);
+      TS_ASSERT_EQUALS(view.extents[1], bs[1]);
+      TS_ASSERT_EQUALS(view.extents[2], bs[2]);
+      for(size_t z=0; z < bs[2]; ++z) {
+        for(size_t y=0; y < bs[1]; ++y) {
+          for(size_t x=0; x < bs[0]; ++x) {
+            TS_ASSERT_EQUALS(view(x,y,z), copy[(z*bs[1] + y)*bs[0] + x]);
+          }
+        }
+      }
+    }
+  }
+}
+
+// reading into raw memory must give what the vector interface gives, also
+// once the cache starts recycling bricks.
+void traw_brick() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  // room for a single source brick: every miss evicts another brick.
+  DynamicBrickingDS dynamic(ds, {{6,16,16}}, ds->GetMaxBrickSize().volume());
+  std::vector<uint8_t> mem(6*12*5);
+  for(size_t pass=0; pass < 2; ++pass) {
+    for(auto b=dynamic.BricksBegin(); b != dynamic.BricksEnd(); ++b) {
+      std::vector<uint8_t> copy;
+      TS_ASSERT(dynamic.GetBrick(b->first, copy));
+      TS_ASSERT(copy.size() <= mem.size());
+      TS_ASSERT(dynamic.GetBrick(b->first, mem.data(), mem.size()));
+      TS_ASSERT(std::equal(copy.begin(), copy.end(), mem.begin()));
+    }
+  }
+  // too little memory
+  TS_ASSERT(!dynamic.GetBrick(BrickKey(0,0,0), mem.data(), 16));
+}
+
+// reads the red channel of a raw RGBA slice written by the stack exporter
+static std::vector<uint8_t> read_slice(const std::string& fn) {
+  std::ifstream ifs(fn.c_str(), std::ios::binary);
+  std::vector<uint8_t> rgba((std::istreambuf_iterator<char>(ifs)),
+                            std::istreambuf_iterator<char>());
+  std::vector<uint8_t> red;
+  for(size_t i=0; i < rgba.size(); i+=4) { red.push_back(rgba[i]); }
+  return red;
+}
+
+// every slice of all three stacks must show the source data, whether the
+// volume is one brick or split into several. The transfer function maps
+// each value to the same intensity in red.
+void tstack_export() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  DynamicBrickingDS dynamic(ds, {{6,16,16}}, cacheBytes);
+  TransferFunction1D tf(256);
+  for(size_t i=0; i < tf.GetSize(); ++i) {
+    tf.SetColor(i, FLOATVECTOR4((i+0.5f)/255.0f, 0.0f, 0.0f, 1.0f));
+  }
+
+  const LinearIndexDataset* sources[] = { ds.get(), &dynamic };
+  const char* suffix[] = { "_x", "_y", "_z" };
+  const size_t slices[] = { 8, 8, 1 };
+  // the image axes of each stack (x: z/y, y: x/z, z: x/y)
+  const size_t width[] = { 1, 8, 8 };
+  const size_t height[] = { 8, 1, 8 };
+  for(size_t src=0; src < 2; ++src) {
+    const std::string target = "stack.raw";
+    TS_ASSERT(StackExporter::WriteStacks(*sources[src], 0, target, &tf, 1.0f,
+                                         true));
+    for(size_t axis=0; axis < 3; ++axis) {
+      for(size_t s=0; s < slices[axis]; ++s) {
+        std::ostringstream index;
+        index << std::setw(5) << std::setfill('0') << s;
+        const std::string fn = SysTools::AppendFilename(
+          SysTools::AppendFilename(target, suffix[axis]), index.str()
+        );
+        const std::vector<uint8_t> slice = read_slice(fn);
+        TS_ASSERT_EQUALS(slice.size(), width[axis]*height[axis]);
+        for(size_t i=0; i < std::min(slice.size(),
+                                     width[axis]*height[axis]); ++i) {
+          const size_t col = i % width[axis];
+          const size_t row = i / width[axis];
+          const size_t x = axis == 0 ? s : col;
+          const size_t y = axis == 0 ? row : (axis == 1 ? s : row);
+          TS_ASSERT_EQUALS(slice[i], data[y][x]);
+        }
+        std::remove(fn.c_str());
+      }
+    }
+  }
+}
+
+// ApplyFunction must visit the rebricked bricks, not the source brick, with
+// their own sizes and positions.  The 2 voxel wide cores split the 8 voxel
+// wide volume into four bricks.
+void tapply_function() {
+  std::shared_ptr<UVFDataset> ds = mk8x8testdata();
+  DynamicBrickingDS dynamic(ds, {{6,16,16}}, cacheBytes);
+  TS_ASSERT_EQUALS(dynamic.GetBrickLayout(0, 0), UINTVECTOR3(4,1,1));
+
+  const unsigned threads[] = { 1, 4 };
+  const uint64_t overlaps[] = { 0, 2 };
+  for(size_t t=0; t < 2; ++t) {
+    for(size_t ordered=0; ordered < 2; ++ordered) {
+      for(size_t o=0; o < 2; ++o) {
+        const uint64_t ov = overlaps[o];
+        std::mutex m;
+        std::vector<uint64_t> seen;
+        TS_ASSERT(dynamic.ApplyFunction(0,
+          [&](void* pData, const UINT64VECTOR3& vSize,
+              const UINT64VECTOR3& vOffset) {
+            std::lock_guard<std::mutex> lock(m);
+            const uint16_t* d = static_cast<const uint16_t*>(pData);
+            TS_ASSERT_EQUALS(vSize, UINT64VECTOR3(2+2*ov, 8+2*ov, 1+2*ov));
+            TS_ASSERT_EQUALS(vOffset[0] % 2, 0ULL);
+            TS_ASSERT_EQUALS(vOffset[1], 0ULL);
+            TS_ASSERT_EQUALS(vOffset[2], 0ULL);
+            // compare the core, it starts 'ov' voxels into the brick
+            const size_t slice = size_t(vSize[0]*vSize[1]);
+            for(size_t y=0; y < 8; ++y) {
+              for(size_t x=0; x < 2; ++x) {
+                const size_t idx = ov*slice + (y+ov)*vSize[0] + x+ov;
+                TS_ASSERT_EQUALS(d[idx], data[y][vOffset[0]+x]);
+              }
+            }
+            seen.push_back(vOffset[0]);
+            return true;
+          }, ov, threads[t], ordered != 0));
+
+        TS_ASSERT_EQUALS(seen.size(), 4U);
+        if(!ordered) { std::sort(seen.begin(), seen.end()); }
+        for(size_t i=0; i < std::min<size_t>(seen.size(), 4); ++i) {
+          TS_ASSERT_EQUALS(seen[i], 2*i);
+        }
+      }
+    }
+  }
+
+  // more overlap than stored, and early termination
+  TS_ASSERT(!dynamic.ApplyFunction(0,
+    [](void*, const UINT64VECTOR3&, const UINT64VECTOR3&) { return true; },
+    3));
+  size_t calls = 0;
+  TS_ASSERT(!dynamic.ApplyFunction(0,
+    [&](void*, const UINT64VECTOR3&, const UINT64VECTOR3&) {
+      return ++calls < 2;
+    }, 0, 1, true));
+  TS_ASSERT_EQUALS(calls, 2U);
+}
+
 class RebrickerTests : public CxxTest::TestSuite {
 public:
   void test_simple() { tsimple(); }
@@ -521,8 +849,15 @@ public:
   void test_brick_sizes() { tbsizes(); }
   void test_precompute() { tprecompute(); }
   void test_minmax_dynamic() { tminmax_dynamic(); }
+  void test_minmax_precompute() { tminmax_precompute(); }
+  void test_minmax_sidecar() { tminmax_sidecar(); }
   void test_cache_disable() { tcache_disable(); }
   void test_engine_four() { tengine_four(); }
   void test_rmi_bench() { rmi_bench(); }
   void test_rescale() { trescale(); }
+  void test_read_region() { tread_region(); }
+  void test_brick_view() { tbrick_view(); }
+  void test_raw_brick() { traw_brick(); }
+  void test_stack_export() { tstack_export(); }
+  void test_apply_function() { tapply_function(); }
 };
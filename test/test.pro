@@ -51,7 +51,8 @@ contains(QMAKE_PRL_CONFIG, shared) {
   QTPLUGIN += qgif qjpeg
 }
 
-TEST_HEADERS=quantize.h largefile.h rebricking.h cbi.h bcache.h
+TEST_HEADERS=quantize.h largefile.h rebricking.h cbi.h bcache.h octree.h \
+             iomanager.h iotrace.h
 
 TG_PARAMS=--have-eh --abort-on-fail --no-static-init --error-printer
 alltests.target = alltests.cpp
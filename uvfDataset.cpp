@@ -42,6 +42,7 @@
 #include "UVF/KeyValuePairDataBlock.h"
 #include "UVF/Histogram2DDataBlock.h"
 #include "UVF/GeometryDataBlock.h"
+#include "UVF/TOCBlock.h"
 #include "uvfMesh.h"
 
 using namespace boost;
@@ -943,6 +944,29 @@ bool UVFDataset::ApplyFunction(uint64_t iLODLevel,
   }
 }
 
+bool UVFDataset::ApplyFunction(uint64_t iLODLevel,
+                               const BrickFunction& brickFunc,
+                               uint64_t iOverlap,
+                               unsigned int iThreadCount,
+                               bool bOrdered) const {
+  // raster data blocks have no parallel traversal
+  if (!m_bToCBlock) {
+    return Dataset::ApplyFunction(iLODLevel, brickFunc, iOverlap,
+                                  iThreadCount, bOrdered);
+  }
+
+  bool okay = true;
+  for(std::vector<Timestep*>::const_iterator ts = m_timesteps.begin();
+    ts != m_timesteps.end(); ++ts) {
+    const TOCTimestep* toc_ts = static_cast<TOCTimestep*>(*ts);
+    okay &= toc_ts->GetDB()->ApplyFunction(
+              iLODLevel, brickFunc, uint32_t(iOverlap),
+              iThreadCount, bOrdered
+            );
+  }
+  return okay;
+}
+
 // BrickKey's index is 1D. For UVF's RDB, we've got a 3D index.  When
 // we create the brick index to satisfy the interface, we do so in a
 // reversible way.  This methods reverses the 1D into into UVF's 3D
@@ -1468,15 +1492,113 @@ bool UVFDataset::AppendMesh(std::shared_ptr<const Mesh> meshIn) {
 
 
 
+/*
+  CropBricked:
+
+  Builds a new UVF file with one cropped ToC block per timestep next to the
+  histograms and min/max data of the cropped blocks. Bricks that are
+  recomputed get zlib compressed like the flattened path would do.
+*/
+bool UVFDataset::CropBricked(const PLANE<float>& plane,
+                             const std::string& strTargetFilename,
+                             const std::string& strTempDir,
+                             bool bUseMedianFilter, bool bClampToEdge) const
+{
+  wstring wstrUVFName(strTargetFilename.begin(), strTargetFilename.end());
+  UVF uvfFile(wstrUVFName);
+
+  GlobalHeader uvfGlobalHeader;
+  uvfGlobalHeader.bIsBigEndian = EndianConvert::IsBigEndian();
+  uvfGlobalHeader.ulChecksumSemanticsEntry = UVFTables::CS_MD5;
+  uvfFile.SetGlobalHeader(uvfGlobalHeader);
+
+  // the blocks have to stay alive until the file is written, each ToC block
+  // removes its temp file once it is released
+  std::vector<std::shared_ptr<DataBlock>> vBlocks;
+  const size_t iComponentCount = size_t(GetComponentCount());
+  bool bOK = true;
+
+  for (size_t ts = 0;ts<m_timesteps.size();ts++) {
+    const TOCTimestep* pTimestep =
+      static_cast<const TOCTimestep*>(m_timesteps[ts]);
+
+    std::shared_ptr<MaxMinDataBlock> maxmin(
+      new MaxMinDataBlock(iComponentCount)
+    );
+    std::shared_ptr<TOCBlock> dataVolume(new TOCBlock(UVF::ms_ulReaderVersion));
+    dataVolume->strBlockID = std::string("Cropped ") +
+                             pTimestep->GetDB()->strBlockID;
+
+    std::string tmpfile;
+    {
+      ostringstream tmpfn;
+      tmpfn << strTempDir << ts << "croppedFile.tmp";
+      tmpfile = tmpfn.str();
+    }
+
+    MESSAGE("Cropping bricks of timestep %u ...", unsigned(ts));
+    if (!dataVolume->CropBricked(*pTimestep->GetDB(), pTimestep->m_pMaxMinData,
+                                 tmpfile, plane, maxmin,
+                                 &Controller::Debug::Out(), bUseMedianFilter,
+                                 bClampToEdge, CT_ZLIB)) {
+      bOK = false;
+      break;
+    }
+    uvfFile.AddDataBlock(dataVolume);
+    vBlocks.push_back(dataVolume);
+
+    // do not compute histograms when we are dealing with color data
+    if (iComponentCount != 4 && iComponentCount != 3) {
+      MESSAGE("Computing 1D Histogram...");
+      std::shared_ptr<Histogram1DDataBlock> hist1d(new Histogram1DDataBlock());
+      std::shared_ptr<Histogram2DDataBlock> hist2d(new Histogram2DDataBlock());
+      if (!hist1d->Compute(dataVolume.get(), 0)) {
+        T_ERROR("Computation of 1D Histogram failed!");
+        bOK = false;
+        break;
+      }
+      MESSAGE("Computing 2D Histogram...");
+      if (!hist2d->Compute(dataVolume.get(), 0, hist1d->GetHistogram().size(),
+                           maxmin->GetGlobalValue().maxScalar)) {
+        T_ERROR("Computation of 2D Histogram failed!");
+        bOK = false;
+        break;
+      }
+      uvfFile.AddDataBlock(hist1d);
+      uvfFile.AddDataBlock(hist2d);
+      vBlocks.push_back(hist1d);
+      vBlocks.push_back(hist2d);
+    } else {
+      WARNING("Multicomponent data; skipping histogram computations.");
+    }
+    uvfFile.AddDataBlock(maxmin);
+    vBlocks.push_back(maxmin);
+  }
+
+  if (bOK) {
+    std::shared_ptr<KeyValuePairDataBlock> metaPairs(
+      new KeyValuePairDataBlock()
+    );
+    const std::vector<std::pair<std::string, std::string>> vMetadata =
+      GetMetadata();
+    for (auto i = vMetadata.begin();i != vMetadata.end();++i)
+      metaPairs->AddPair(i->first, i->second);
+    uvfFile.AddDataBlock(metaPairs);
+
+    MESSAGE("Writing UVF file...");
+    bOK = uvfFile.Create();
+  }
+  uvfFile.Close();
+  vBlocks.clear();
+
+  if (!bOK && SysTools::FileExists(strTargetFilename))
+    remove(strTargetFilename.c_str());
+  return bOK;
+}
+
 bool UVFDataset::Crop(const PLANE<float>& plane, const std::string& strTempDir,
                       bool bKeepOldData, bool bUseMedianFilter, bool bClampToEdge)
 {
-  MESSAGE("Flattening dataset");
-  string strTempRawFilename = SysTools::FindNextSequenceName(
-    strTempDir + "crop-tmp.raw"
-  );
-  Export(0, strTempRawFilename , false);
-
   MESSAGE("Cropping at plane (%g %g %g %g)", plane.x, plane.y, plane.z,
                                              plane.w);
   FLOATMATRIX4 m;
@@ -1485,6 +1607,24 @@ bool UVFDataset::Crop(const PLANE<float>& plane, const std::string& strTempDir,
   PLANE<float> scaleInvariantPlane = plane;
   scaleInvariantPlane.transformIT(m);
 
+  string strTempFilename = SysTools::FindNextSequenceName(Filename());
+
+  // octrees are cropped brick by brick, only the bricks the plane passes
+  // through are touched
+  if (m_bToCBlock) {
+    if (CropBricked(scaleInvariantPlane, strTempFilename, strTempDir,
+                    bUseMedianFilter, bClampToEdge)) {
+      return ReplaceCroppedFile(strTempFilename, bKeepOldData);
+    }
+    WARNING("Cropping the bricks failed, cropping the flattened data instead.");
+  }
+
+  MESSAGE("Flattening dataset");
+  string strTempRawFilename = SysTools::FindNextSequenceName(
+    strTempDir + "crop-tmp.raw"
+  );
+  Export(0, strTempRawFilename , false);
+
   TempFile dataFile(strTempRawFilename);
   if (!dataFile.Open(true)) {
     T_ERROR("Unable to open flattened data.");
@@ -1550,8 +1690,6 @@ bool UVFDataset::Crop(const PLANE<float>& plane, const std::string& strTempDir,
   dataFile.Close();
 
   MESSAGE("Rebuilding UVF data");
-  string strTempFilename = SysTools::FindNextSequenceName(Filename());
-
   std::string strDesc = std::string("Cropped ") + std::string(Name());
   std::string strSource = SysTools::GetFilename(Filename());
 
@@ -1564,11 +1702,20 @@ bool UVFDataset::Crop(const PLANE<float>& plane, const std::string& strTempDir,
       bClampToEdge,
       1 /* compress with zlib*/,
       4 /* use default compression level for LZMA*/,
-      0 /* default scanline layout*/)) {
+      0 /* default scanline layout*/,
+      0 /* no pre-filter*/,
+      false /* fixed compression*/)) {
     T_ERROR("Unable to convert cropped data back to UVF");
     return false;
   }
 
+  return ReplaceCroppedFile(strTempFilename, bKeepOldData);
+}
+
+/// replaces the file of this dataset by the cropped file and reopens it
+bool UVFDataset::ReplaceCroppedFile(const std::string& strTempFilename,
+                                    bool bKeepOldData)
+{
   MESSAGE("Replacing original UVF by the new one");
   Close();
 
@@ -1648,6 +1795,94 @@ bool UVFDataset::SaveRescaleFactors() {
   return true;
 }
 
+/// looks up the index of a block of the file, the histograms and the min/max
+/// data of a timestep are only known by their address
+static bool FindBlockIndex(const UVF* pFile, const DataBlock* pBlock,
+                           size_t& iIndex) {
+  for (size_t block = 0;block<pFile->GetDataBlockCount();++block) {
+    if (pFile->GetDataBlock(block).get() == pBlock) {
+      iIndex = block;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool UVFDataset::UpdateBricks(
+  size_t timestep,
+  const std::vector<UINT64VECTOR4>& vBrickCoords,
+  const std::vector<std::shared_ptr<uint8_t>>& vBrickData,
+  bool bUseMedianFilter, bool bClampToEdge, COMPRESSION_TYPE ct)
+{
+  if (!m_bToCBlock) {
+    T_ERROR("Only bricks of octree based files can be updated.");
+    return false;
+  }
+  if (timestep >= m_timesteps.size()) {
+    T_ERROR("Invalid timestep %u", static_cast<unsigned>(timestep));
+    return false;
+  }
+
+  // the blocks have to be looked up again once the file is reopened
+  const Timestep* pTimestep = m_timesteps[timestep];
+  const size_t iTOCIndex = pTimestep->block_number;
+  size_t iHist1DIndex = 0, iHist2DIndex = 0, iMaxMinIndex = 0;
+  const bool bHist1D = pTimestep->m_pHist1DDataBlock &&
+    FindBlockIndex(m_pDatasetFile, pTimestep->m_pHist1DDataBlock,
+                   iHist1DIndex);
+  const bool bHist2D = pTimestep->m_pHist2DDataBlock &&
+    FindBlockIndex(m_pDatasetFile, pTimestep->m_pHist2DDataBlock,
+                   iHist2DIndex);
+  const bool bMaxMin = pTimestep->m_pMaxMinData &&
+    FindBlockIndex(m_pDatasetFile, pTimestep->m_pMaxMinData, iMaxMinIndex);
+
+  Close();
+
+  MESSAGE("Attempting to reopen file in readwrite mode.");
+
+  try {
+    Open(false,true,false);
+  } catch(const Exception&) {
+    T_ERROR("Read/write mode failed, maybe file is write protected?");
+    Open(false,false,false);
+    return false;
+  }
+  MESSAGE("Successfully reopened file in readwrite mode.");
+
+  // the bricks are rewritten in place, the other blocks keep their size so
+  // they are written back over their old version, only the header of the
+  // ToC block is marked to get the checksum updated
+  TOCBlock* tocb = static_cast<TOCBlock*>(
+    m_pDatasetFile->GetDataBlockRW(iTOCIndex, true)
+  );
+  Histogram1DDataBlock* hist1d = bHist1D
+    ? static_cast<Histogram1DDataBlock*>(
+        m_pDatasetFile->GetDataBlockRW(iHist1DIndex, false))
+    : NULL;
+  Histogram2DDataBlock* hist2d = bHist2D
+    ? static_cast<Histogram2DDataBlock*>(
+        m_pDatasetFile->GetDataBlockRW(iHist2DIndex, false))
+    : NULL;
+  MaxMinDataBlock* maxmin = bMaxMin
+    ? static_cast<MaxMinDataBlock*>(
+        m_pDatasetFile->GetDataBlockRW(iMaxMinIndex, false))
+    : NULL;
+
+  MESSAGE("Updating %u bricks ...", static_cast<unsigned>(vBrickCoords.size()));
+  const bool bOK = tocb->UpdateBricks(vBrickCoords, vBrickData, maxmin,
+                                      hist1d, hist2d,
+                                      &Controller::Debug::Out(),
+                                      bUseMedianFilter, bClampToEdge, ct);
+  if (!bOK) T_ERROR("Updating the bricks failed.");
+
+  MESSAGE("Writing changes to disk");
+  Close();
+  MESSAGE("Reopening in read-only mode");
+  Open(false,false,false);
+
+  return bOK;
+}
+
 bool UVFDataset::CanRead(const std::string&,
                          const std::vector<int8_t>& bytes) const
 {
@@ -1715,6 +1950,82 @@ bool UVFDataset::GetBrick(const BrickKey& k, std::vector<double>& vData) const {
   return GetBrickTemplate<double>(k,vData);
 }
 
+/// @returns true if an octree brick fits into 'iBytes'; an atlas may be
+/// larger than the brick it holds.
+static bool TOCBrickFits(const TOCBlock* tb, const UINT64VECTOR4& coords,
+                         size_t iBytes) {
+  const uint64_t iVoxelBytes = tb->GetComponentTypeSize() *
+                               tb->GetComponentCount();
+  const uint64_t iNeeded = iVoxelBytes *
+    std::max(tb->GetBrickSize(coords).volume(),
+             uint64_t(tb->GetAtlasSize(coords).area()));
+  if (iNeeded > iBytes) {
+    T_ERROR("brick needs %llu bytes, only %llu given", iNeeded,
+            static_cast<uint64_t>(iBytes));
+    return false;
+  }
+  return true;
+}
+
+/// unpacks an octree brick which was stored as an atlas, in place.
+static void TOCDeAtlasify(const TOCBlock* tb, const UINT64VECTOR4& coords,
+                          uint8_t* pData) {
+  if (tb->GetAtlasSize(coords).area() == 0) return;
+  const uint64_t iBrickBytes = tb->GetComponentTypeSize() *
+                               tb->GetComponentCount() *
+                               tb->GetBrickSize(coords).volume();
+  VolumeTools::DeAtalasify(size_t(iBrickBytes), tb->GetAtlasSize(coords),
+                           tb->GetMaxBrickSize(), tb->GetBrickSize(coords),
+                           pData, pData);
+}
+
+// octree bricks are decompressed straight into the caller's memory; other
+// data goes through the vector interface.
+bool UVFDataset::GetBrick(const BrickKey& k, void* pData, size_t iBytes) const {
+  if (!m_bToCBlock) return Dataset::GetBrick(k, pData, iBytes);
+
+  const UINT64VECTOR4 coords = KeyToTOCVector(k);
+  const TOCTimestep* ts = static_cast<TOCTimestep*>(m_timesteps[std::get<0>(k)]);
+  if (!TOCBrickFits(ts->GetDB(), coords, iBytes)) return false;
+
+  uint8_t* pTarget = static_cast<uint8_t*>(pData);
+  ts->GetDB()->GetData(pTarget, coords);
+  TOCDeAtlasify(ts->GetDB(), coords, pTarget);
+  return true;
+}
+
+// the bricks of each timestep go to its octree as one batch.
+bool UVFDataset::GetBricks(const std::vector<BrickKey>& vKeys,
+                           const std::vector<void*>& vData,
+                           size_t iBytes) const {
+  if (!m_bToCBlock || vKeys.size() != vData.size())
+    return Dataset::GetBricks(vKeys, vData, iBytes);
+
+  std::vector<UINT64VECTOR4> vCoords;
+  std::vector<uint8_t*> vTargets;
+  std::vector<bool> vDone(vKeys.size(), false);
+  for (size_t first = 0; first < vKeys.size(); ++first) {
+    if (vDone[first]) continue;
+    const size_t iTimestep = std::get<0>(vKeys[first]);
+    const TOCBlock* tb =
+      static_cast<TOCTimestep*>(m_timesteps[iTimestep])->GetDB();
+    vCoords.clear();
+    vTargets.clear();
+    for (size_t i = first; i < vKeys.size(); ++i) {
+      if (vDone[i] || std::get<0>(vKeys[i]) != iTimestep) continue;
+      const UINT64VECTOR4 coords = KeyToTOCVector(vKeys[i]);
+      if (!TOCBrickFits(tb, coords, iBytes)) return false;
+      vCoords.push_back(coords);
+      vTargets.push_back(static_cast<uint8_t*>(vData[i]));
+      vDone[i] = true;
+    }
+    tb->GetData(vCoords, vTargets);
+    for (size_t i = 0; i < vCoords.size(); ++i)
+      TOCDeAtlasify(tb, vCoords[i], vTargets[i]);
+  }
+  return true;
+}
+
 std::pair<FLOATVECTOR3, FLOATVECTOR3> UVFDataset::GetTextCoords(BrickTable::const_iterator brick, bool bUseOnlyPowerOfTwo) const {
   if (m_bToCBlock) {
     const UINT64VECTOR4 coords = KeyToTOCVector(brick->first);
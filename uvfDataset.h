@@ -118,6 +118,11 @@ public:
   virtual bool GetBrick(const BrickKey&, std::vector<int32_t>&) const;
   virtual bool GetBrick(const BrickKey&, std::vector<float>&) const;
   virtual bool GetBrick(const BrickKey&, std::vector<double>&) const;
+  virtual bool GetBrick(const BrickKey&, void* pData, size_t iBytes) const;
+  /// octree bricks are fetched in file order, with neighbors read together
+  virtual bool GetBricks(const std::vector<BrickKey>& vKeys,
+                         const std::vector<void*>& vData,
+                         size_t iBytes) const;
 
   /// Acceleration queries.
   virtual bool ContainsData(const BrickKey &k, double isoval) const;
@@ -166,6 +171,11 @@ public:
                                           void* pUserContext),
                         void *pUserContext= NULL,
                         uint64_t iOverlap=0) const;
+  virtual bool ApplyFunction(uint64_t iLODLevel,
+                             const BrickFunction& brickFunc,
+                             uint64_t iOverlap,
+                             unsigned int iThreadCount = 0,
+                             bool bOrdered = true) const;
 
   virtual const std::vector<std::pair<std::string, std::string>> GetMetadata() const;
 
@@ -173,6 +183,16 @@ public:
   virtual bool Crop( const PLANE<float>& plane, const std::string& strTempDir, 
                      bool bKeepOldData, bool bUseMedianFilter, bool bClampToEdge);
 
+  /// replaces bricks of the finest level of a timestep in place and brings
+  /// the coarser LoDs, the min/max data and the histograms up to date, see
+  /// TOCBlock::UpdateBricks, and recomputes the checksum of the file. Only
+  /// works for octree based files
+  bool UpdateBricks(size_t timestep,
+                    const std::vector<UINT64VECTOR4>& vBrickCoords,
+                    const std::vector<std::shared_ptr<uint8_t>>& vBrickData,
+                    bool bUseMedianFilter, bool bClampToEdge,
+                    COMPRESSION_TYPE ct=CT_ZLIB);
+
   bool AppendMesh(std::shared_ptr<const Mesh> m);
   bool RemoveMesh(size_t iMeshIndex);
   bool GeometryTransformToFile(size_t iMeshIndex, const FLOATMATRIX4& m);
@@ -197,6 +217,14 @@ public:
   BrickKey TOCVectorToKey(const UINTVECTOR4& hash, size_t timestep) const;
 
   bool IsTOCBlock() const {return m_bToCBlock;}
+  /// octree (ToC) reads lock the file themselves, raster blocks do not
+  virtual bool ConcurrentBrickReads() const {return m_bToCBlock;}
+  /// @returns the ToC block of the given timestep or NULL if this dataset
+  /// is not stored as an octree
+  const TOCBlock* GetTOCBlock(size_t timestep) const {
+    if(!m_bToCBlock || timestep >= m_timesteps.size()) return NULL;
+    return static_cast<const TOCTimestep*>(m_timesteps[timestep])->GetDB();
+  }
 
   /// this function computes the texture coordinates for a given brick
   /// this may be non trivial with power of two padding, overlap handling
@@ -222,6 +250,15 @@ private:
   bool VerifyRasterDataBlock(const RasterDataBlock*) const;
   bool VerifyTOCBlock(const TOCBlock* tb) const;
 
+  /// writes a cropped copy of an octree dataset to strTargetFilename without
+  /// flattening it, see TOCBlock::CropBricked
+  bool CropBricked(const PLANE<float>& plane,
+                   const std::string& strTargetFilename,
+                   const std::string& strTempDir,
+                   bool bUseMedianFilter, bool bClampToEdge) const;
+  bool ReplaceCroppedFile(const std::string& strTempFilename,
+                          bool bKeepOldData);
+
   template <class T> bool GetBrickTemplate(const BrickKey& k,
                             std::vector<T>& vData) const
   {